@@ -0,0 +1,206 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "adapt.h"
+#include "utils.h"
+
+int adapt_parse(const char *spec, struct adapt_t *adapt) {
+    assert(spec != NULL);
+    assert(adapt != NULL);
+
+    unsigned int min_length = 0, max_length = 0, step = ADAPT_DEFAULT_STEP;
+
+    int ret = sscanf(spec, "%u:%u:%u", &min_length, &max_length, &step);
+    if(ret < 2) {
+        printf("Wrong adaptive length '%s': expected min:max[:step]\n", spec);
+        return -1;
+    }
+
+    if(min_length < PACKET_HEADER_SIZE || max_length > ADAPT_MAX_LENGTH ||
+       min_length > max_length || step == 0) {
+        printf("Wrong adaptive length '%s': need %i <= min <= max <= %i, step > 0\n", spec,
+               (int)PACKET_HEADER_SIZE, (int)ADAPT_MAX_LENGTH);
+        return -1;
+    }
+
+    memset(adapt, 0x00, sizeof(struct adapt_t));
+
+    adapt->min_length = min_length;
+    adapt->max_length = max_length;
+    adapt->step       = step;
+
+    return 0;
+}
+
+void adapt_start(struct adapt_t *adapt, uint32_t length) {
+    assert(adapt != NULL);
+
+    if(length < adapt->min_length)
+        length = adapt->min_length;
+    if(length > adapt->max_length)
+        length = adapt->max_length;
+
+    adapt->length = length;
+    adapt->history_stride = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &adapt->start_ts);
+}
+
+static void adapt_add_history(struct adapt_t *adapt, struct adapt_point_t point) {
+    if(adapt->feedbacks % adapt->history_stride != 0) {
+        return;
+    }
+
+    /* Full: keep every second point, record half as often */
+    if(adapt->history_num == ADAPT_HISTORY_MAX) {
+        for(uint32_t i = 0; i < ADAPT_HISTORY_MAX / 2; i++) {
+            adapt->history[i] = adapt->history[i * 2];
+        }
+        adapt->history_num = ADAPT_HISTORY_MAX / 2;
+        adapt->history_stride *= 2;
+    }
+
+    adapt->history[adapt->history_num++] = point;
+}
+
+uint32_t adapt_feedback(struct adapt_t *adapt, const struct adapt_feedback_t *feedback) {
+    assert(adapt != NULL);
+    assert(feedback != NULL);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint32_t bad = feedback->crc_errors + feedback->lost;
+    uint32_t total = feedback->packets + feedback->lost;
+
+    struct adapt_point_t point;
+    point.t_ms      = timespec_to_ms(timespec_diff(adapt->start_ts, now));
+    point.length    = adapt->length;
+    point.error_ppm = total ? (uint64_t)bad * 1000000 / total : 0;
+    point.goodput   = feedback->interval_ms ? feedback->good_bytes * 1000.0 / feedback->interval_ms : 0.0;
+
+    adapt_add_history(adapt, point);
+
+    adapt->settle[adapt->feedbacks % ADAPT_SETTLE_NUM] = point;
+    if(point.goodput > adapt->best.goodput)
+        adapt->best = point;
+
+    adapt->feedbacks++;
+    adapt->good_bytes += feedback->good_bytes;
+    adapt->packets += feedback->packets;
+    adapt->errors += bad;
+
+    if(bad != 0 || (feedback->flags & ADAPT_FLAG_RESYNC)) {
+        adapt->length = adapt->length * ADAPT_DECREASE_PERCENT / 100;
+        if(adapt->length < adapt->min_length)
+            adapt->length = adapt->min_length;
+
+        adapt->decreases++;
+        if(feedback->flags & ADAPT_FLAG_RESYNC)
+            adapt->resyncs++;
+    } else if(feedback->packets != 0 && adapt->length < adapt->max_length) {
+        adapt->length += adapt->step;
+        if(adapt->length > adapt->max_length)
+            adapt->length = adapt->max_length;
+
+        adapt->increases++;
+    }
+
+    return adapt->length;
+}
+
+void adapt_print_stats(struct adapt_t *adapt) {
+    assert(adapt != NULL);
+
+    printf("Adaptive packet length:\n");
+    printf("\tRange:            %u..%u bytes, step %u, decrease to %i%%\n", adapt->min_length,
+           adapt->max_length, adapt->step, ADAPT_DECREASE_PERCENT);
+    printf("\tFeedbacks:        %" PRIu64 " (%" PRIu64 " up, %" PRIu64 " down, %" PRIu64 " resync)\n",
+           adapt->feedbacks, adapt->increases, adapt->decreases, adapt->resyncs);
+    if(adapt->bad_feedbacks > 0) {
+        printf("\tBad feedbacks:    %" PRIu64 " dropped\n", adapt->bad_feedbacks);
+    }
+    printf("\tPackets:          %" PRIu64 " received, %" PRIu64 " bad or lost\n", adapt->packets, adapt->errors);
+
+    if(adapt->feedbacks == 0) {
+        return;
+    }
+
+    printf("\tTrajectory:       %10s %8s %12s %12s\n", "t, ms", "length", "errors, ppm", "goodput, B/s");
+    for(uint32_t i = 0; i < adapt->history_num; i++) {
+        struct adapt_point_t *point = &adapt->history[i];
+        printf("\t                  %10" PRIu64 " %8u %12u %12.0f\n", point->t_ms, point->length,
+               point->error_ppm, point->goodput);
+    }
+
+    /* Operating point: mean of last feedbacks */
+    uint32_t num = adapt->feedbacks < ADAPT_SETTLE_NUM ? adapt->feedbacks : ADAPT_SETTLE_NUM;
+    uint32_t min_length = UINT32_MAX, max_length = 0;
+    double length = 0.0, goodput = 0.0;
+
+    for(uint32_t i = 0; i < num; i++) {
+        struct adapt_point_t *point = &adapt->settle[i];
+
+        length += point->length;
+        goodput += point->goodput;
+
+        if(point->length < min_length)
+            min_length = point->length;
+        if(point->length > max_length)
+            max_length = point->length;
+    }
+
+    printf("\tOperating point:  length %.0f (%u..%u), goodput %.0f B/s over last %u intervals\n",
+           length / num, min_length, max_length, goodput / num, num);
+    printf("\tBest interval:    length %u, goodput %.0f B/s, errors %u ppm\n",
+           adapt->best.length, adapt->best.goodput, adapt->best.error_ppm);
+}
+
+struct packet_t adapt_feedback_packet(const struct adapt_feedback_t *feedback, uint32_t number) {
+    struct packet_t packet;
+
+    assert(feedback != NULL);
+
+    packet.number    = number;
+    packet.channel   = ADAPT_FEEDBACK_CHANNEL;
+    packet.crc_type  = packet_get_checksum();
+    packet.data_size = ADAPT_FEEDBACK_SIZE;
+    packet.data      = (uint8_t*)malloc(packet.data_size);
+
+    if(packet.data == NULL) {
+        printf("adapt_feedback_packet: malloc() failed\n");
+        exit(1);
+    }
+
+    packet_put_le64(packet.data, feedback->good_bytes);
+    packet_put_le32(packet.data + 8, feedback->interval_ms);
+    packet_put_le32(packet.data + 12, feedback->packets);
+    packet_put_le32(packet.data + 16, feedback->crc_errors);
+    packet_put_le32(packet.data + 20, feedback->lost);
+    packet_put_le32(packet.data + 24, feedback->flags);
+    packet.crc32 = packet_checksum(&packet);
+
+    return packet;
+}
+
+int adapt_feedback_from_packet(const struct packet_t *packet, struct adapt_feedback_t *feedback) {
+    assert(packet != NULL);
+    assert(feedback != NULL);
+
+    if(packet->channel != ADAPT_FEEDBACK_CHANNEL ||
+       packet->data_size != ADAPT_FEEDBACK_SIZE ||
+       packet->crc32 != packet_checksum(packet)) {
+        return -1;
+    }
+
+    feedback->good_bytes  = packet_get_le64(packet->data);
+    feedback->interval_ms = packet_get_le32(packet->data + 8);
+    feedback->packets     = packet_get_le32(packet->data + 12);
+    feedback->crc_errors  = packet_get_le32(packet->data + 16);
+    feedback->lost        = packet_get_le32(packet->data + 20);
+    feedback->flags       = packet_get_le32(packet->data + 24);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef _ADAPT_H_
+#define _ADAPT_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "packet.h"
+
+/* Feedback packets travel back to sender on reserved channel */
+#define ADAPT_FEEDBACK_CHANNEL 0xffff
+
+#define ADAPT_FEEDBACK_MS    100 /* receiver report interval */
+#define ADAPT_RESYNC_IDLE_MS 50  /* idle line that marks packet boundary */
+
+#define ADAPT_DEFAULT_STEP     16
+#define ADAPT_DECREASE_PERCENT 50
+
+#define ADAPT_MAX_LENGTH  (PACKET_HEADER_SIZE + 64 * 1024)
+#define ADAPT_HISTORY_MAX 64  /* trajectory points in report */
+#define ADAPT_SETTLE_NUM  16  /* last feedbacks averaged for operating point */
+
+#define ADAPT_FLAG_RESYNC 0x01 /* receiver lost framing and waits for idle line */
+
+/*
+ * Receiver report, data of feedback packet: ADAPT_FEEDBACK_SIZE bytes,
+ * fields in this order, little-endian like the packet header
+ */
+#define ADAPT_FEEDBACK_SIZE 28
+
+struct adapt_feedback_t {
+    uint64_t good_bytes;  /* data bytes of packets with good checksum */
+    uint32_t interval_ms;
+    uint32_t packets;
+    uint32_t crc_errors;
+    uint32_t lost;
+    uint32_t flags;       /* ADAPT_FLAG_* */
+};
+
+struct adapt_point_t {
+    uint64_t t_ms;
+    uint32_t length;
+    uint32_t error_ppm;   /* bad or lost packets per million */
+    double   goodput;     /* data bytes/s */
+};
+
+/*
+ * Packet length controller
+ *
+ * AIMD on packet length: every error free feedback interval grows
+ * length by step bytes, an interval with checksum errors, lost
+ * packets or lost framing shrinks it to ADAPT_DECREASE_PERCENT.
+ * Length oscillates below the size where errors start to cost more
+ * than the header overhead saves.
+ */
+struct adapt_t {
+    uint32_t min_length;
+    uint32_t max_length;
+    uint32_t step;
+    uint32_t length;       /* current packet length */
+
+    struct timespec start_ts;
+
+    /* statistics */
+    uint64_t feedbacks;
+    uint64_t increases;
+    uint64_t decreases;
+    uint64_t resyncs;
+    uint64_t bad_feedbacks; /* damaged on the way back, dropped */
+    uint64_t good_bytes;
+    uint64_t packets;
+    uint64_t errors;
+
+    /* trajectory, every history_stride-th feedback */
+    struct adapt_point_t history[ADAPT_HISTORY_MAX];
+    uint32_t history_num;
+    uint32_t history_stride;
+
+    /* last feedbacks for operating point */
+    struct adapt_point_t settle[ADAPT_SETTLE_NUM];
+    struct adapt_point_t best;
+};
+
+/* Parse "min:max[:step]" */
+int  adapt_parse(const char *spec, struct adapt_t *adapt);
+void adapt_start(struct adapt_t *adapt, uint32_t length);
+
+/* Apply receiver feedback, returns new packet length */
+uint32_t adapt_feedback(struct adapt_t *adapt, const struct adapt_feedback_t *feedback);
+
+void adapt_print_stats(struct adapt_t *adapt);
+
+/* Feedback packet serialization */
+struct packet_t adapt_feedback_packet(const struct adapt_feedback_t *feedback, uint32_t number);
+int adapt_feedback_from_packet(const struct packet_t *packet, struct adapt_feedback_t *feedback);
+
+#endif /* _ADAPT_H_ */
@@ -0,0 +1,235 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "async_log.h"
+#include "spsc_ring.h"
+
+#define N_ERR "ASYNC_LOG ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define ALOG_IDLE_NSEC 1000000
+
+struct alog_record_t {
+    const char *fmt;
+    uint64_t args[ALOG_ARGS_MAX];
+};
+
+struct alog_ring_t {
+    struct spsc_ring_t ring;
+    int owned;         /* a live thread writes to it */
+    uint64_t written;
+    uint64_t dropped;
+};
+
+struct alog_config_t alog_config = {
+    .level = ALOG_DEFAULT_LEVEL,
+    .every = 1,
+};
+
+static struct alog_ring_t alog_rings[ALOG_THREADS_MAX];
+static uint32_t  alog_rings_num;
+static uint64_t  alog_no_ring; /* records dropped: too many threads */
+static int       alog_running;
+static int       alog_stopping;
+static pthread_t alog_thread;
+static pthread_key_t alog_ring_key; /* thread exit gives the ring back */
+static int       alog_key_created;
+
+static __thread struct alog_ring_t *alog_thread_ring;
+
+static void alog_print(const struct alog_record_t *record) {
+    printf(record->fmt, record->args[0], record->args[1], record->args[2], record->args[3]);
+}
+
+/* Print all queued records, returns number of records printed */
+static uint64_t alog_drain(void) {
+    uint32_t rings_num = __atomic_load_n(&alog_rings_num, __ATOMIC_ACQUIRE);
+    uint64_t printed = 0;
+
+    for(uint32_t i = 0; i < rings_num; i++) {
+        struct spsc_ring_t *ring = &alog_rings[i].ring;
+        const struct alog_record_t *record;
+
+        while((record = (const struct alog_record_t*)spsc_ring_read_slot(ring, NULL)) != NULL) {
+            alog_print(record);
+            spsc_ring_release(ring);
+            printed++;
+        }
+    }
+
+    return printed;
+}
+
+static void* alog_thread_func(void *arg) {
+    struct timespec idle = { 0, ALOG_IDLE_NSEC };
+
+    (void)arg;
+
+    while(!__atomic_load_n(&alog_stopping, __ATOMIC_ACQUIRE)) {
+        if(alog_drain() == 0) {
+            fflush(stdout);
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    alog_drain();
+    fflush(stdout);
+
+    return NULL;
+}
+
+/* Records still queued are printed by the logger thread, the next owner only appends */
+static void alog_release_ring(void *arg) {
+    struct alog_ring_t *ring = (struct alog_ring_t*)arg;
+
+    __atomic_store_n(&ring->owned, 0, __ATOMIC_RELEASE);
+}
+
+static struct alog_ring_t* alog_get_ring(void) {
+    if(alog_thread_ring != NULL) {
+        return alog_thread_ring;
+    }
+
+    for(uint32_t i = 0; i < ALOG_THREADS_MAX; i++) {
+        int owned = 0;
+
+        if(!__atomic_compare_exchange_n(&alog_rings[i].owned, &owned, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        /* Logger drains rings below alog_rings_num */
+        uint32_t rings_num = __atomic_load_n(&alog_rings_num, __ATOMIC_ACQUIRE);
+        while(rings_num < i + 1 &&
+              !__atomic_compare_exchange_n(&alog_rings_num, &rings_num, i + 1, 0,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            ;
+
+        alog_thread_ring = &alog_rings[i];
+        (void)pthread_setspecific(alog_ring_key, alog_thread_ring);
+
+        return alog_thread_ring;
+    }
+
+    return NULL;
+}
+
+int alog_start(void) {
+    if(alog_running) {
+        return 0;
+    }
+
+    for(int i = 0; i < ALOG_THREADS_MAX; i++) {
+        if(spsc_ring_init(&alog_rings[i].ring, ALOG_RING_SLOTS, sizeof(struct alog_record_t)) != 0) {
+            return -1;
+        }
+    }
+
+    if(!alog_key_created) {
+        if(pthread_key_create(&alog_ring_key, alog_release_ring) != 0) {
+            errprintf("pthread_key_create() failed\n");
+            return -1;
+        }
+        alog_key_created = 1;
+    }
+
+    /* Logger thread inherits blocked SIGINT */
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+
+    int ret = pthread_create(&alog_thread, NULL, alog_thread_func, NULL);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if(ret != 0) {
+        errprintf("pthread_create() failed\n");
+        return -1;
+    }
+
+    __atomic_store_n(&alog_running, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void alog_stop(void) {
+    if(!alog_running) {
+        return;
+    }
+
+    __atomic_store_n(&alog_stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(alog_thread, NULL);
+
+    __atomic_store_n(&alog_running, 0, __ATOMIC_RELEASE);
+
+    uint64_t written = 0, dropped = alog_no_ring;
+
+    for(int i = 0; i < ALOG_THREADS_MAX; i++) {
+        written += alog_rings[i].written;
+        dropped += alog_rings[i].dropped;
+        spsc_ring_free(&alog_rings[i].ring);
+    }
+
+    printf("Async log: %" PRIu64 " records, %" PRIu64 " dropped\n", written, dropped);
+}
+
+void alog_flush(void) {
+    struct timespec wait = { 0, ALOG_IDLE_NSEC };
+
+    if(!__atomic_load_n(&alog_running, __ATOMIC_ACQUIRE)) {
+        fflush(stdout);
+        return;
+    }
+
+    uint32_t rings_num = __atomic_load_n(&alog_rings_num, __ATOMIC_ACQUIRE);
+
+    for(uint32_t i = 0; i < rings_num; i++) {
+        while(spsc_ring_count(&alog_rings[i].ring) != 0) {
+            nanosleep(&wait, NULL);
+        }
+    }
+
+    /* Slots are released after printing */
+    fflush(stdout);
+}
+
+void alog_write(uint8_t level, const char *fmt, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3) {
+    if(level > alog_config.level) {
+        return;
+    }
+
+    struct alog_record_t record = { fmt, { a0, a1, a2, a3 } };
+
+    if(!__atomic_load_n(&alog_running, __ATOMIC_ACQUIRE)) {
+        alog_print(&record);
+        return;
+    }
+
+    struct alog_ring_t *ring = alog_get_ring();
+    if(ring == NULL) {
+        if(__atomic_fetch_add(&alog_no_ring, 1, __ATOMIC_RELAXED) == 0) {
+            errprintf("more than %i threads logging at once, records of the others are dropped\n",
+                      ALOG_THREADS_MAX);
+        }
+        return;
+    }
+
+    uint8_t *slot = spsc_ring_write_slot(&ring->ring);
+    if(slot == NULL) {
+        ring->dropped++;
+        return;
+    }
+
+    memcpy(slot, &record, sizeof(record));
+    spsc_ring_commit(&ring->ring, sizeof(record));
+
+    ring->written++;
+}
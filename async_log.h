@@ -0,0 +1,67 @@
+#ifndef _ASYNC_LOG_H_
+#define _ASYNC_LOG_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define ALOG_ERROR 0
+#define ALOG_WARN  1
+#define ALOG_INFO  2
+#define ALOG_DEBUG 3
+
+#define ALOG_DEFAULT_LEVEL ALOG_INFO
+
+#define ALOG_ARGS_MAX    4
+#define ALOG_THREADS_MAX 8
+#define ALOG_RING_SLOTS  4096
+
+/*
+ * Low overhead logging for send/receive loops
+ *
+ * A record is a format string pointer plus up to ALOG_ARGS_MAX integer
+ * arguments, written into a lock-free ring of the calling thread.
+ * Background thread formats records with printf() and flushes stdout.
+ * Records are dropped (and counted) when a ring is full, so logging
+ * never blocks the caller. A ring goes back to the pool when its thread
+ * exits; records of threads beyond ALOG_THREADS_MAX alive at once are
+ * dropped, reported once when it first happens.
+ *
+ * Format must be a string literal and use 64-bit conversions only
+ * ("%" PRIu64, "%" PRIx64 ...), all arguments are passed as uint64_t.
+ *
+ * Without alog_start() records are printed synchronously.
+ */
+struct alog_config_t {
+    uint8_t  level; /* records above level are discarded */
+    uint32_t every; /* alog_every(): log every Nth record of a call site */
+};
+
+extern struct alog_config_t alog_config;
+
+int  alog_start(void);
+void alog_stop(void);
+
+/* Wait until all queued records are printed */
+void alog_flush(void);
+
+void alog_write(uint8_t level, const char *fmt, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3);
+
+#define ALOG_ARG_(a) ((uint64_t)(a))
+
+#define alog4(level, fmt, a0, a1, a2, a3) \
+        alog_write(level, fmt, ALOG_ARG_(a0), ALOG_ARG_(a1), ALOG_ARG_(a2), ALOG_ARG_(a3))
+#define alog3(level, fmt, a0, a1, a2) alog4(level, fmt, a0, a1, a2, 0)
+#define alog2(level, fmt, a0, a1)     alog4(level, fmt, a0, a1, 0, 0)
+#define alog1(level, fmt, a0)         alog4(level, fmt, a0, 0, 0, 0)
+#define alog0(level, fmt)             alog4(level, fmt, 0, 0, 0, 0)
+
+/* Rate limited record: only every alog_config.every-th record of the call site */
+#define alog_every(level, fmt, a0, a1, a2, a3) \
+        do { \
+            static uint32_t alog_site_counter_; \
+            uint32_t n_ = __atomic_fetch_add(&alog_site_counter_, 1, __ATOMIC_RELAXED); \
+            if(alog_config.every <= 1 || n_ % alog_config.every == 0) \
+                alog4(level, fmt, a0, a1, a2, a3); \
+        } while(0)
+
+#endif /* _ASYNC_LOG_H_ */
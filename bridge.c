@@ -0,0 +1,426 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#include "bridge.h"
+#include "uart.h"
+#include "async_log.h"
+#include "utils.h"
+
+#define N_ERR "BRIDGE ERROR: "
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define BRIDGE_RING_MASK ((uint64_t)BRIDGE_RING_SIZE - 1)
+#define BRIDGE_MARKS_MASK (BRIDGE_MARKS - 1)
+
+#define BRIDGE_TAG_RX 0 /* epoll data: (port << 1) | tag */
+#define BRIDGE_TAG_TX 1
+
+static int bridge_set_nonblock(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        strerr("fcntl(O_NONBLOCK) failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void bridge_dir_init(struct bridge_dir_t *dir, const char *name,
+                            struct uart_t *from, struct uart_t *to) {
+    /* Ring itself needs no clearing */
+    dir->name = name;
+    dir->from = from;
+    dir->to = to;
+    dir->head = dir->tail = 0;
+
+    memset(&dir->framer, 0x00, sizeof(dir->framer));
+    dir->marks_head = dir->marks_tail = 0;
+
+    dir->reads = dir->writes = 0;
+    dir->max_used = dir->used_sum = dir->ring_full = 0;
+    dir->packets = dir->resyncs = dir->marks_dropped = 0;
+    dir->report_bytes = 0;
+    histogram_init(&dir->latency);
+}
+
+int bridge_init(struct bridge_t *bridge, struct uart_t *a, struct uart_t *b) {
+    assert(bridge != NULL);
+    assert(a != NULL);
+    assert(b != NULL);
+
+    struct uart_t *ports[2] = { a, b };
+
+    for(int i = 0; i < 2; i++) {
+        if(ports[i]->sim != NULL || ports[i]->uring != NULL || ports[i]->fd < 0) {
+            errprintf("%s: bridge needs a port with read()/write() on a descriptor, not sim or io_uring\n",
+                      ports[i]->dev);
+            return -1;
+        }
+
+        if(bridge_set_nonblock(ports[i]->fd) != 0)
+            return -1;
+        if(ports[i]->fd_tx != ports[i]->fd && bridge_set_nonblock(ports[i]->fd_tx) != 0)
+            return -1;
+    }
+
+    bridge_dir_init(&bridge->dir[0], "a->b", a, b);
+    bridge_dir_init(&bridge->dir[1], "b->a", b, a);
+
+    clock_gettime(CLOCK_MONOTONIC, &bridge->start_ts);
+    bridge->report_ts = bridge->start_ts;
+
+    return 0;
+}
+
+/*
+ * Follow packet boundaries in freshly read bytes
+ *
+ * Nothing is known about the stream at start or after a header with a
+ * size no packet can have: the framer then waits for a line idle for
+ * BRIDGE_IDLE_MS and takes the next byte as start of a header, the
+ * same gap the receiver of uart_test uses to find packets again.
+ */
+static void bridge_frame(struct bridge_dir_t *dir, const uint8_t *data, size_t size,
+                         uint64_t offset, struct timespec now) {
+    struct bridge_framer_t *framer = &dir->framer;
+
+    if(!framer->synced && timespec_to_ms(timespec_diff(framer->last_ts, now)) >= BRIDGE_IDLE_MS) {
+        framer->synced = 1;
+        framer->header_have = 0;
+        framer->data_left = 0;
+    }
+    framer->last_ts = now;
+
+    size_t i = 0;
+    while(framer->synced && i < size) {
+        if(framer->data_left > 0) {
+            size_t take = (size - i < framer->data_left) ? size - i : framer->data_left;
+            framer->data_left -= take;
+            i += take;
+        } else {
+            size_t take = PACKET_FRAME_PREFIX - framer->header_have;
+            if(take > size - i)
+                take = size - i;
+            memcpy(framer->header + framer->header_have, data + i, take);
+            framer->header_have += take;
+            i += take;
+
+            if(framer->header_have < PACKET_FRAME_PREFIX)
+                break;
+
+            /* Either header format: frame size is in its first bytes */
+            size_t frame_size = packet_frame_size(framer->header);
+
+            framer->header_have = 0;
+            framer->data_left = frame_size - PACKET_FRAME_PREFIX;
+
+            if(frame_size == 0 || framer->data_left > BRIDGE_MAX_DATA) {
+                framer->synced = 0;
+                dir->resyncs++;
+                break;
+            }
+        }
+
+        if(framer->data_left == 0) {
+            /* Whole packet is in the ring: stamp its last byte */
+            dir->packets++;
+
+            if(dir->marks_head - dir->marks_tail < BRIDGE_MARKS) {
+                struct bridge_mark_t *mark = &dir->marks[dir->marks_head & BRIDGE_MARKS_MASK];
+                mark->offset = offset + i;
+                mark->ts = now;
+                dir->marks_head++;
+            } else {
+                dir->marks_dropped++;
+            }
+        }
+    }
+}
+
+/* Returns bytes read, 0 - nothing now, -1 - port closed or failed */
+static ssize_t bridge_read(struct bridge_dir_t *dir) {
+    uint64_t used = dir->head - dir->tail;
+
+    if(used == BRIDGE_RING_SIZE) {
+        dir->ring_full++;
+        return 0;
+    }
+
+    /* Free space may wrap: fill up to two pieces with one readv() */
+    uint64_t start = dir->head & BRIDGE_RING_MASK;
+    uint64_t free_size = BRIDGE_RING_SIZE - used;
+    struct iovec iov[2];
+    int iovcnt = 1;
+
+    iov[0].iov_base = dir->ring + start;
+    iov[0].iov_len = (start + free_size <= BRIDGE_RING_SIZE) ? free_size : BRIDGE_RING_SIZE - start;
+    if(iov[0].iov_len < free_size) {
+        iov[1].iov_base = dir->ring;
+        iov[1].iov_len = free_size - iov[0].iov_len;
+        iovcnt = 2;
+    }
+
+    ssize_t ret = readv(dir->from->fd, iov, iovcnt);
+    dir->from->syscalls++;
+
+    if(ret < 0) {
+        if(errno == EAGAIN || errno == EINTR)
+            return 0;
+        strerr("%s: read() failed", dir->from->dev);
+        return -1;
+    }
+
+    if(ret == 0) {
+        dir->from->peer_closed = 1;
+        return -1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    size_t first = (size_t)ret < iov[0].iov_len ? (size_t)ret : iov[0].iov_len;
+    bridge_frame(dir, dir->ring + start, first, dir->head, now);
+    if((size_t)ret > first)
+        bridge_frame(dir, dir->ring, ret - first, dir->head + first, now);
+
+    dir->head += ret;
+    dir->reads++;
+
+    used = dir->head - dir->tail;
+    dir->used_sum += used;
+    if(used > dir->max_used)
+        dir->max_used = used;
+
+    return ret;
+}
+
+/* Returns bytes written, 0 - output full, -1 - port closed or failed */
+static ssize_t bridge_write(struct bridge_dir_t *dir) {
+    uint64_t used = dir->head - dir->tail;
+
+    if(used == 0)
+        return 0;
+
+    uint64_t start = dir->tail & BRIDGE_RING_MASK;
+    struct iovec iov[2];
+    int iovcnt = 1;
+
+    iov[0].iov_base = dir->ring + start;
+    iov[0].iov_len = (start + used <= BRIDGE_RING_SIZE) ? used : BRIDGE_RING_SIZE - start;
+    if(iov[0].iov_len < used) {
+        iov[1].iov_base = dir->ring;
+        iov[1].iov_len = used - iov[0].iov_len;
+        iovcnt = 2;
+    }
+
+    ssize_t ret = writev(dir->to->fd_tx, iov, iovcnt);
+    dir->to->syscalls++;
+
+    if(ret < 0) {
+        if(errno == EAGAIN || errno == EINTR)
+            return 0;
+        if(errno == EPIPE || errno == ECONNRESET) {
+            dir->to->peer_closed = 1;
+            return -1;
+        }
+        strerr("%s: write() failed", dir->to->dev);
+        return -1;
+    }
+
+    dir->tail += ret;
+    dir->writes++;
+
+    if(dir->marks_tail != dir->marks_head) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        while(dir->marks_tail != dir->marks_head) {
+            struct bridge_mark_t *mark = &dir->marks[dir->marks_tail & BRIDGE_MARKS_MASK];
+            if(mark->offset > dir->tail)
+                break;
+            histogram_add(&dir->latency, timespec_to_ns(timespec_diff(mark->ts, now)));
+            dir->marks_tail++;
+        }
+    }
+
+    return ret;
+}
+
+static void bridge_report(struct bridge_t *bridge, struct timespec now) {
+    uint64_t elapsed_ms = timespec_to_ms(timespec_diff(bridge->report_ts, now));
+
+    if(elapsed_ms < BRIDGE_REPORT_MS)
+        return;
+    bridge->report_ts = now;
+
+    for(int i = 0; i < 2; i++) {
+        struct bridge_dir_t *dir = &bridge->dir[i];
+        uint64_t rate = (dir->tail - dir->report_bytes) * 1000 / elapsed_ms;
+
+        dir->report_bytes = dir->tail;
+
+        alog4(ALOG_INFO, "Bridge: %" PRIu64 " B/s, ring %" PRIu64 " bytes, latency p50 %" PRIu64
+              " us, max %" PRIu64 " us\n", rate, dir->head - dir->tail,
+              histogram_percentile(&dir->latency, 50.0) / 1000, dir->latency.max / 1000);
+    }
+}
+
+struct bridge_fd_t {
+    int fd;
+    uint32_t events;  /* registered */
+};
+
+static int bridge_update_fd(int epoll_fd, struct bridge_fd_t *entry, uint32_t events, uint64_t data) {
+    if(entry->events == events)
+        return 0;
+
+    struct epoll_event ev;
+    int op = (entry->events == 0) ? EPOLL_CTL_ADD : (events == 0) ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+
+    memset(&ev, 0x00, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = data;
+
+    if(epoll_ctl(epoll_fd, op, entry->fd, &ev) != 0) {
+        strerr("epoll_ctl() failed");
+        return -1;
+    }
+
+    entry->events = events;
+    return 0;
+}
+
+void bridge_run(struct bridge_t *bridge, volatile uint8_t *running) {
+    assert(bridge != NULL);
+    assert(running != NULL);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0) {
+        strerr("epoll_create1() failed");
+        exit(1);
+    }
+
+    /*
+     * Per port: entry 0 reads (fd), entry 1 writes (fd_tx). For a single
+     * descriptor both use entry 0 with combined events, epoll does not
+     * take one descriptor twice.
+     */
+    struct bridge_fd_t fds[2][2];
+    for(int p = 0; p < 2; p++) {
+        struct uart_t *port = bridge->dir[p].from;
+        fds[p][0].fd = port->fd;
+        fds[p][0].events = 0;
+        fds[p][1].fd = port->fd_tx;
+        fds[p][1].events = 0;
+    }
+
+    int closed = 0;
+
+    while(*running && !closed) {
+        /* Read port p into dir[p] while there is room, write dir[!p] out through p while there is data */
+        for(int p = 0; p < 2 && !closed; p++) {
+            uint32_t rx = (bridge->dir[p].head - bridge->dir[p].tail < BRIDGE_RING_SIZE) ? EPOLLIN : 0;
+            uint32_t tx = (bridge->dir[!p].head != bridge->dir[!p].tail) ? EPOLLOUT : 0;
+
+            if(fds[p][0].fd == fds[p][1].fd) {
+                closed = bridge_update_fd(epoll_fd, &fds[p][0], rx | tx, (p << 1) | BRIDGE_TAG_RX);
+            } else {
+                closed = bridge_update_fd(epoll_fd, &fds[p][0], rx, (p << 1) | BRIDGE_TAG_RX) ||
+                         bridge_update_fd(epoll_fd, &fds[p][1], tx, (p << 1) | BRIDGE_TAG_TX);
+            }
+        }
+
+        struct epoll_event events[4];
+        int n = epoll_wait(epoll_fd, events, 4, BRIDGE_REPORT_MS);
+
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            strerr("epoll_wait() failed");
+            exit(1);
+        }
+
+        for(int i = 0; i < n && !closed; i++) {
+            int p = events[i].data.u64 >> 1;
+            uint32_t ev = events[i].events;
+
+            if((ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (events[i].data.u64 & 1) == BRIDGE_TAG_RX &&
+               (fds[p][0].events & EPOLLIN)) {
+                if(bridge_read(&bridge->dir[p]) < 0)
+                    closed = 1;
+            }
+
+            if((ev & (EPOLLOUT | EPOLLERR)) && !closed && bridge->dir[!p].head != bridge->dir[!p].tail) {
+                if(bridge_write(&bridge->dir[!p]) < 0)
+                    closed = 1;
+            }
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        bridge_report(bridge, now);
+    }
+
+    /* Input ended: pass on what is still in the rings */
+    for(int p = 0; p < 2; p++) {
+        struct bridge_dir_t *dir = &bridge->dir[p];
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        while(*running && dir->head != dir->tail && !dir->to->peer_closed) {
+            ssize_t ret = bridge_write(dir);
+            if(ret < 0)
+                break;
+            if(ret == 0) {
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if(timespec_to_ms(timespec_diff(start, now)) > UART_TIMEOUT_MSEC)
+                    break;
+                struct pollfd pfd = { .fd = dir->to->fd_tx, .events = POLLOUT };
+                (void)poll(&pfd, 1, 10);
+            }
+        }
+    }
+
+    close(epoll_fd);
+}
+
+void bridge_print_stats(struct bridge_t *bridge) {
+    assert(bridge != NULL);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = timespec_to_ns(timespec_diff(bridge->start_ts, now)) / 1e9;
+
+    for(int i = 0; i < 2; i++) {
+        struct bridge_dir_t *dir = &bridge->dir[i];
+
+        printf("Bridge %s (%s -> %s):\n", dir->name, dir->from->dev, dir->to->dev);
+        printf("\tBytes:            %" PRIu64 " read, %" PRIu64 " written\n", dir->head, dir->tail);
+        printf("\tThroughput:       %.0f B/s\n", seconds > 0 ? dir->tail / seconds : 0.0);
+        printf("\tSyscalls:         %" PRIu64 " reads, %" PRIu64 " writes\n", dir->reads, dir->writes);
+        printf("\tRing:             max %" PRIu64 ", mean %.0f of %u bytes, %" PRIu64 " times full\n",
+               dir->max_used, dir->reads ? (double)dir->used_sum / dir->reads : 0.0,
+               BRIDGE_RING_SIZE, dir->ring_full);
+        printf("\tPackets:          %" PRIu64 " recognized, %" PRIu64 " resyncs, %" PRIu64 " not stamped\n",
+               dir->packets, dir->resyncs, dir->marks_dropped);
+        histogram_print(&dir->latency, "Latency:", "us", 1000.0);
+    }
+}
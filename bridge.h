@@ -0,0 +1,86 @@
+#ifndef _BRIDGE_H_
+#define _BRIDGE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "histogram.h"
+#include "packet.h"
+
+struct uart_t;
+
+#define BRIDGE_RING_SIZE   (64 * 1024) /* bytes per direction, power of 2 */
+#define BRIDGE_MARKS       1024        /* packets in flight with latency stamp */
+#define BRIDGE_MAX_DATA    (64 * 1024) /* larger packet size in header: framing lost */
+#define BRIDGE_IDLE_MS     50          /* idle line before a packet header is expected again */
+#define BRIDGE_REPORT_MS   1000
+
+/* Packet end seen on input, waiting to leave on output */
+struct bridge_mark_t {
+    uint64_t offset;          /* stream offset after last byte */
+    struct timespec ts;       /* read of last byte */
+};
+
+/* Finds uart_test packet boundaries in a byte stream */
+struct bridge_framer_t {
+    uint8_t  header[PACKET_FRAME_PREFIX];
+    size_t   header_have;
+    uint64_t data_left;       /* bytes of current packet after its frame prefix still to come */
+    uint8_t  synced;          /* 0 - waiting for idle line */
+    struct timespec last_ts;  /* previous read */
+};
+
+/* One direction: bytes read from one port are written to the other */
+struct bridge_dir_t {
+    const char *name;
+    struct uart_t *from;
+    struct uart_t *to;
+
+    uint8_t  ring[BRIDGE_RING_SIZE];
+    uint64_t head;            /* bytes read, stream offset */
+    uint64_t tail;            /* bytes written */
+
+    struct bridge_framer_t framer;
+    struct bridge_mark_t marks[BRIDGE_MARKS];
+    uint32_t marks_head;
+    uint32_t marks_tail;
+
+    /* statistics */
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t max_used;        /* ring occupancy high water */
+    uint64_t used_sum;        /* occupancy after every read, for mean */
+    uint64_t ring_full;       /* reads postponed by full ring */
+    uint64_t packets;
+    uint64_t resyncs;
+    uint64_t marks_dropped;
+    struct histogram_t latency;  /* last byte in to last byte out, ns */
+
+    uint64_t report_bytes;    /* tail at previous report */
+};
+
+/*
+ * Relay between two ports
+ *
+ * Both ports are non-blocking in one epoll loop. Every direction has a
+ * ring buffer: read() fills the free part of the ring in place and
+ * write() drains the used part in place, so bytes are copied once in
+ * and once out. The bridge does not need to know the traffic, but it
+ * follows uart_test packet headers to stamp the last byte of a packet
+ * when it is read and when it is written to the other port, giving
+ * the latency the bridge adds.
+ */
+struct bridge_t {
+    struct bridge_dir_t dir[2]; /* a -> b, b -> a */
+    struct timespec start_ts;
+    struct timespec report_ts;
+};
+
+/* Ports must use read()/write() on file descriptors: not sim, not io_uring */
+int  bridge_init(struct bridge_t *bridge, struct uart_t *a, struct uart_t *b);
+/* Forward until *running is 0 or a port closes */
+void bridge_run(struct bridge_t *bridge, volatile uint8_t *running);
+void bridge_print_stats(struct bridge_t *bridge);
+
+#endif /* _BRIDGE_H_ */
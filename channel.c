@@ -0,0 +1,255 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "channel.h"
+#include "utils.h"
+
+static int timespec_before(struct timespec a, struct timespec b) {
+    return (a.tv_sec < b.tv_sec) || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+static struct timespec timespec_add_ms(struct timespec ts, uint32_t ms) {
+    ts.tv_sec  += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000L;
+
+    if(ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+void channel_init(struct channel_t *channel, uint16_t id) {
+    assert(channel != NULL);
+
+    memset(channel, 0x00, sizeof(struct channel_t));
+
+    channel->id = id;
+    channel->next_number = 1;
+    channel->lat_min_ns = UINT64_MAX;
+}
+
+int channel_parse(const char *spec, struct channel_t *channel) {
+    assert(spec != NULL);
+    assert(channel != NULL);
+
+    unsigned int id = 0, priority = 0, length = 0, period_ms = 0, packets_num = 0;
+
+    int ret = sscanf(spec, "%u:%u:%u:%u:%u", &id, &priority, &length, &period_ms, &packets_num);
+    if(ret < 3) {
+        printf("Wrong channel '%s': expected id:priority:length[:period_ms[:packets_num]]\n", spec);
+        return -1;
+    }
+
+    if(id > UINT16_MAX || priority > UINT8_MAX) {
+        printf("Wrong channel '%s': id or priority out of range\n", spec);
+        return -1;
+    }
+
+    if(length < PACKET_HEADER_SIZE || length - PACKET_HEADER_SIZE > CHANNEL_MAX_DATA_SIZE) {
+        printf("Wrong channel '%s': length must be %i..%i bytes\n", spec,
+               (int)PACKET_HEADER_SIZE, (int)(PACKET_HEADER_SIZE + CHANNEL_MAX_DATA_SIZE));
+        return -1;
+    }
+
+    channel_init(channel, id);
+
+    channel->priority      = priority;
+    channel->packet_length = length;
+    channel->period_ms     = period_ms;
+    channel->packets_num   = packets_num;
+
+    return 0;
+}
+
+void channel_start(struct channel_t *channels, int num, struct timespec now) {
+    for(int i = 0; i < num; i++) {
+        channels[i].next_ts = now;
+    }
+}
+
+struct channel_t* channel_find(struct channel_t *channels, int *num, uint16_t id) {
+    assert(channels != NULL);
+    assert(num != NULL);
+
+    for(int i = 0; i < *num; i++) {
+        if(channels[i].id == id)
+            return &channels[i];
+    }
+
+    if(*num == CHANNELS_MAX) {
+        return NULL;
+    }
+
+    channel_init(&channels[*num], id);
+
+    return &channels[(*num)++];
+}
+
+uint32_t channel_bulk_length(const struct channel_t *channels, int num) {
+    uint32_t bulk = 0;
+    uint32_t any = 0;
+
+    for(int i = 0; i < num; i++) {
+        if(channels[i].period_ms == 0 && channels[i].packet_length > bulk)
+            bulk = channels[i].packet_length;
+        if(channels[i].packet_length > any)
+            any = channels[i].packet_length;
+    }
+
+    return (bulk != 0) ? bulk : any;
+}
+
+/* Place of channel i in the round robin of its priority: turns start after the one served last */
+static int channel_turn(const struct channel_t *channels, int num, int i) {
+    for(int j = 0; j < num; j++) {
+        if(channels[j].served_last && channels[j].priority == channels[i].priority)
+            return (i - j - 1 + num) % num;
+    }
+
+    return i;
+}
+
+struct channel_t* channel_schedule(struct channel_t *channels, int num,
+                                   struct timespec now, struct timespec *wait, int *done) {
+    struct channel_t *best = NULL;
+    int best_turn = 0;
+    int waiting = 0;
+
+    assert(channels != NULL);
+    assert(wait != NULL);
+    assert(done != NULL);
+
+    for(int i = 0; i < num; i++) {
+        struct channel_t *channel = &channels[i];
+
+        if(channel->packets_num != 0 && channel->packets >= channel->packets_num) {
+            continue;
+        }
+
+        if(timespec_before(now, channel->next_ts)) {
+            /* Periodic channel: not ready yet */
+            if(!waiting || timespec_before(channel->next_ts, *wait))
+                *wait = channel->next_ts;
+            waiting = 1;
+            continue;
+        }
+
+        if(best == NULL || channel->priority < best->priority) {
+            best = channel;
+            best_turn = channel_turn(channels, num, i);
+        } else if(channel->priority == best->priority) {
+            int turn = channel_turn(channels, num, i);
+
+            if(turn < best_turn) {
+                best = channel;
+                best_turn = turn;
+            }
+        }
+    }
+
+    if(best != NULL) {
+        for(int i = 0; i < num; i++) {
+            if(channels[i].priority == best->priority)
+                channels[i].served_last = 0;
+        }
+        best->served_last = 1;
+    }
+
+    *done = (best == NULL && !waiting);
+
+    return best;
+}
+
+struct packet_t channel_create_packet(struct channel_t *channel, struct timespec ready_ts) {
+    struct packet_t packet;
+
+    assert(channel != NULL);
+    assert(channel->packet_length >= PACKET_HEADER_SIZE);
+
+    packet.number    = channel->next_number++;
+    packet.channel   = channel->id;
+    packet.crc_type  = packet_get_checksum();
+    packet.data_size = channel->packet_length - PACKET_HEADER_SIZE;
+    packet.data      = generate_data(packet.data_size);
+
+    if(packet.data_size >= sizeof(uint64_t)) {
+        uint64_t stamp = timespec_to_ns(ready_ts);
+        memcpy(packet.data, &stamp, sizeof(stamp));
+    }
+
+    packet.crc32 = packet_checksum(&packet);
+
+    /* Next packet of periodic channel */
+    if(channel->period_ms != 0) {
+        channel->next_ts = timespec_add_ms(channel->next_ts, channel->period_ms);
+    }
+
+    return packet;
+}
+
+uint64_t channel_packet_stamp(const struct packet_t *packet) {
+    uint64_t stamp = 0;
+
+    assert(packet != NULL);
+
+    if(packet->data_size >= sizeof(uint64_t)) {
+        memcpy(&stamp, packet->data, sizeof(stamp));
+    }
+
+    return stamp;
+}
+
+void channel_add_packet(struct channel_t *channel, size_t bytes, struct timespec now) {
+    assert(channel != NULL);
+
+    if(channel->packets == 0) {
+        channel->first_ts = now;
+    }
+    channel->last_ts = now;
+
+    channel->packets++;
+    channel->bytes += bytes;
+}
+
+void channel_add_latency(struct channel_t *channel, uint64_t latency_ns) {
+    assert(channel != NULL);
+
+    channel->lat_num++;
+    channel->lat_sum_ns += latency_ns;
+
+    if(latency_ns < channel->lat_min_ns)
+        channel->lat_min_ns = latency_ns;
+    if(latency_ns > channel->lat_max_ns)
+        channel->lat_max_ns = latency_ns;
+}
+
+void channel_print_stats(struct channel_t *channels, int num, const char *latency_name) {
+    printf("Channels:\n");
+    printf("\t%4s %4s %8s %10s %12s %10s %8s %8s %10s %10s %10s\n",
+           "id", "prio", "length", "packets", "bytes", "B/s", "lost", "crc_err",
+           "lat_min_us", "lat_avg_us", "lat_max_us");
+
+    for(int i = 0; i < num; i++) {
+        struct channel_t *channel = &channels[i];
+
+        struct timespec elapsed = timespec_diff(channel->first_ts, channel->last_ts);
+        double seconds = elapsed.tv_sec + elapsed.tv_nsec / 1.0e9;
+
+        uint64_t lat_min = channel->lat_num ? channel->lat_min_ns / 1000 : 0;
+        uint64_t lat_avg = channel->lat_num ? channel->lat_sum_ns / channel->lat_num / 1000 : 0;
+        uint64_t lat_max = channel->lat_max_ns / 1000;
+
+        printf("\t%4u %4u %8u %10" PRIu64 " %12" PRIu64 " %10.0f %8" PRIu64 " %8" PRIu64
+               " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+               channel->id, channel->priority, channel->packet_length,
+               channel->packets, channel->bytes,
+               seconds > 0 ? channel->bytes / seconds : 0.0,
+               channel->lost, channel->crc_errors, lat_min, lat_avg, lat_max);
+    }
+
+    printf("\tLatency: %s\n", latency_name);
+}
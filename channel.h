@@ -0,0 +1,87 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "packet.h"
+
+#define CHANNELS_MAX 8
+
+/* Max data size accepted by receiver in channel mode */
+#define CHANNEL_MAX_DATA_SIZE (64 * 1024)
+
+/*
+ * Logical channel multiplexed over one UART
+ *
+ * Every channel is a generator stream with own packet numbering,
+ * packet length and priority. Bulk channels (period 0) always have
+ * a packet ready, periodic channels get a new packet every period_ms.
+ * The scheduler sends the highest priority ready packet at every
+ * frame boundary, channels of the same priority take turns.
+ *
+ * First 8 bytes of data hold CLOCK_MONOTONIC time the packet became
+ * ready, so receiver on the same host measures one-way latency.
+ */
+struct channel_t {
+    uint16_t id;
+    uint8_t  priority;      /* 0 - highest */
+    uint32_t packet_length;
+    uint32_t period_ms;     /* 0 - bulk, always ready */
+    uint32_t packets_num;   /* 0 - unlimited */
+
+    /* sender state */
+    uint32_t next_number;
+    struct timespec next_ts;
+    uint8_t  served_last;   /* of its priority, round robin goes on after it */
+
+    /* receiver state */
+    uint32_t prev_number;
+
+    /* statistics */
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t lost;
+    uint64_t crc_errors;
+
+    uint64_t lat_num;
+    uint64_t lat_sum_ns;
+    uint64_t lat_min_ns;
+    uint64_t lat_max_ns;
+
+    struct timespec first_ts;
+    struct timespec last_ts;
+};
+
+/* Parse "id:priority:length[:period_ms[:packets_num]]" */
+int channel_parse(const char *spec, struct channel_t *channel);
+
+void channel_init(struct channel_t *channel, uint16_t id);
+void channel_start(struct channel_t *channels, int num, struct timespec now);
+
+/* Find channel by id, add it if not found and there is space */
+struct channel_t* channel_find(struct channel_t *channels, int *num, uint16_t id);
+
+/*
+ * Pick highest priority channel with a packet ready at 'now',
+ * returns NULL when nothing is ready and sets 'wait' to earliest ready time
+ * or when all channels are done (wait untouched)
+ */
+struct channel_t* channel_schedule(struct channel_t *channels, int num,
+                                   struct timespec now, struct timespec *wait, int *done);
+
+/* Longest packet of bulk channels, of all channels when none is bulk */
+uint32_t channel_bulk_length(const struct channel_t *channels, int num);
+
+struct packet_t channel_create_packet(struct channel_t *channel, struct timespec ready_ts);
+
+/* Ready time stamped into packet data by sender, 0 if packet is too short */
+uint64_t channel_packet_stamp(const struct packet_t *packet);
+
+void channel_add_packet(struct channel_t *channel, size_t bytes, struct timespec now);
+void channel_add_latency(struct channel_t *channel, uint64_t latency_ns);
+
+void channel_print_stats(struct channel_t *channels, int num, const char *latency_name);
+
+#endif /* _CHANNEL_H_ */
@@ -0,0 +1,265 @@
+#include <string.h>
+
+#include "checksum.h"
+
+#if defined(__SSE4_2__) || ((defined(__x86_64__) || defined(__i386__)) && !defined(CHECKSUM_CRC32C_HW_BUILTIN))
+#include <nmmintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define CRC32C_POLY      0x82f63b78 /* reflected */
+#define CRC16_CCITT_POLY 0x1021
+
+static uint32_t crc32c_tab[8][256];
+static uint16_t crc16_tab[256];
+static int      crc32c_use_hw;
+
+static const char* checksum_names[CHECKSUM_NUM] = {
+    [CHECKSUM_CRC32]       = "crc32",
+    [CHECKSUM_CRC32C]      = "crc32c",
+    [CHECKSUM_CRC16_CCITT] = "crc16",
+    [CHECKSUM_FLETCHER32]  = "fletcher32",
+    [CHECKSUM_ADLER32]     = "adler32",
+};
+
+/* Generate tables and detect CPU features before main() */
+__attribute__((constructor))
+static void checksum_init(void) {
+    for(uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+
+        crc32c_tab[0][i] = crc;
+    }
+
+    for(uint32_t i = 0; i < 256; i++) {
+        for(int slice = 1; slice < 8; slice++) {
+            uint32_t prev = crc32c_tab[slice - 1][i];
+            crc32c_tab[slice][i] = (prev >> 8) ^ crc32c_tab[0][prev & 0xff];
+        }
+    }
+
+    for(uint32_t i = 0; i < 256; i++) {
+        uint16_t crc = i << 8;
+
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ CRC16_CCITT_POLY : crc << 1;
+
+        crc16_tab[i] = crc;
+    }
+
+#if defined(CHECKSUM_CRC32C_HW_BUILTIN)
+    crc32c_use_hw = 1;
+#elif defined(CHECKSUM_CRC32C_HW)
+    __builtin_cpu_init();
+    crc32c_use_hw = __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+uint32_t crc32c_table(uint32_t crc, const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t*)buf;
+
+    crc = ~crc;
+
+    /* Single bytes up to 8 byte alignment */
+    while(size > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_tab[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        size--;
+    }
+
+    while(size >= 8) {
+        uint32_t lo, hi;
+
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+
+        crc = crc32c_tab[7][lo & 0xff] ^ crc32c_tab[6][(lo >> 8) & 0xff] ^
+              crc32c_tab[5][(lo >> 16) & 0xff] ^ crc32c_tab[4][lo >> 24] ^
+              crc32c_tab[3][hi & 0xff] ^ crc32c_tab[2][(hi >> 8) & 0xff] ^
+              crc32c_tab[1][(hi >> 16) & 0xff] ^ crc32c_tab[0][hi >> 24];
+
+        p += 8;
+        size -= 8;
+    }
+
+    while(size--) {
+        crc = crc32c_tab[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+#if defined(CHECKSUM_CRC32C_HW)
+
+#if defined(__ARM_FEATURE_CRC32)
+
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t*)buf;
+
+    crc = ~crc;
+
+    while(size >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+        p += 8;
+        size -= 8;
+    }
+
+    while(size--) {
+        crc = __crc32cb(crc, *p++);
+    }
+
+    return ~crc;
+}
+
+#else /* x86 SSE4.2 */
+
+#if !defined(__SSE4_2__)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t*)buf;
+
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+
+    while(size >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+        p += 8;
+        size -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+#endif
+
+    while(size >= 4) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = _mm_crc32_u32(crc, v);
+        p += 4;
+        size -= 4;
+    }
+
+    while(size--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return ~crc;
+}
+
+#endif /* __ARM_FEATURE_CRC32 */
+#endif /* CHECKSUM_CRC32C_HW */
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t size) {
+#if defined(CHECKSUM_CRC32C_HW_BUILTIN)
+    return crc32c_hw(crc, buf, size);
+#elif defined(CHECKSUM_CRC32C_HW)
+    if(crc32c_use_hw)
+        return crc32c_hw(crc, buf, size);
+    return crc32c_table(crc, buf, size);
+#else
+    return crc32c_table(crc, buf, size);
+#endif
+}
+
+uint16_t crc16_ccitt(uint16_t crc, const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t*)buf;
+
+    while(size--) {
+        crc = (crc << 8) ^ crc16_tab[((crc >> 8) ^ *p++) & 0xff];
+    }
+
+    return crc;
+}
+
+uint32_t fletcher32(const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t*)buf;
+    uint32_t sum1 = 0xffff, sum2 = 0xffff;
+
+    /* Little endian 16-bit words, odd tail byte padded with zero */
+    size_t words = size / 2;
+
+    while(words > 0) {
+        /* 359 words is the max before sums may overflow 32 bits */
+        size_t block = words > 359 ? 359 : words;
+        words -= block;
+
+        while(block--) {
+            sum1 += (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+            sum2 += sum1;
+            p += 2;
+        }
+
+        sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+        sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    }
+
+    if(size & 1) {
+        sum1 += *p;
+        sum2 += sum1;
+        sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+        sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+    }
+
+    sum1 = (sum1 & 0xffff) + (sum1 >> 16);
+    sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+
+    return (sum2 << 16) | sum1;
+}
+
+uint32_t adler32(uint32_t adler, const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t*)buf;
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+
+    while(size > 0) {
+        /* 5552 bytes is the max before b may overflow 32 bits */
+        size_t block = size > 5552 ? 5552 : size;
+        size -= block;
+
+        while(block--) {
+            a += *p++;
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+int checksum_crc32c_hw(void) {
+    return crc32c_use_hw;
+}
+
+const char* checksum_name(uint8_t type) {
+    if(type >= CHECKSUM_NUM)
+        return "unknown";
+
+    return checksum_names[type];
+}
+
+int checksum_from_name(const char *name) {
+    for(int i = 0; i < CHECKSUM_NUM; i++) {
+        if(strcmp(name, checksum_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
@@ -0,0 +1,72 @@
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Checksum algorithm IDs, carried in packet header */
+#define CHECKSUM_CRC32       0 /* crc32.c, default */
+#define CHECKSUM_CRC32C      1 /* Castagnoli */
+#define CHECKSUM_CRC16_CCITT 2 /* CRC-16/CCITT-FALSE */
+#define CHECKSUM_FLETCHER32  3
+#define CHECKSUM_ADLER32     4
+
+#define CHECKSUM_NUM         5
+
+#define CHECKSUM_DEFAULT     CHECKSUM_CRC32
+
+extern uint32_t crc32(uint32_t crc, const void *buf, size_t size);
+
+/* Slicing-by-8 table kernel */
+uint32_t crc32c_table(uint32_t crc, const void *buf, size_t size);
+
+/*
+ * CRC-32C hardware kernel: SSE4.2 crc32 or ARMv8 CRC32 instructions
+ * If build flags enable them (-msse4.2, -march=armv8-a+crc) crc32c() is the
+ * hardware kernel, otherwise it checks once at startup if x86 CPU supports SSE4.2
+ */
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+#define CHECKSUM_CRC32C_HW_BUILTIN
+#endif
+
+#if defined(CHECKSUM_CRC32C_HW_BUILTIN) || defined(__x86_64__) || defined(__i386__)
+#define CHECKSUM_CRC32C_HW
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t size);
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t size);
+
+uint16_t crc16_ccitt(uint16_t crc, const void *buf, size_t size);
+uint32_t fletcher32(const void *buf, size_t size);
+uint32_t adler32(uint32_t adler, const void *buf, size_t size);
+
+/* 1 if crc32c() uses hardware kernel */
+int checksum_crc32c_hw(void);
+
+const char* checksum_name(uint8_t type);
+/* Returns checksum ID or -1 for unknown name */
+int checksum_from_name(const char *name);
+
+/*
+ * Checksum of whole buffer
+ * Only direct calls: the switch folds away when type is a constant
+ * and is a predictable branch in per-packet loops otherwise
+ */
+static inline uint32_t checksum(uint8_t type, const void *buf, size_t size) {
+    switch(type) {
+        case CHECKSUM_CRC32:
+            return crc32(0x00, buf, size);
+        case CHECKSUM_CRC32C:
+            return crc32c(0x00, buf, size);
+        case CHECKSUM_CRC16_CCITT:
+            return crc16_ccitt(0xffff, buf, size);
+        case CHECKSUM_FLETCHER32:
+            return fletcher32(buf, size);
+        case CHECKSUM_ADLER32:
+            return adler32(1, buf, size);
+        default:
+            return 0;
+    }
+}
+
+#endif /* _CHECKSUM_H_ */
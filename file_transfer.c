@@ -0,0 +1,362 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "file_transfer.h"
+#include "checksum.h"
+#include "async_log.h"
+#include "utils.h"
+
+#define N_ERR "FILE_TRANSFER ERROR: "
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+static uint64_t file_transfer_elapsed_ms(struct file_transfer_t *transfer) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_ms(timespec_diff(transfer->start_ts, now));
+}
+
+static void file_transfer_reset(struct file_transfer_t *transfer) {
+    memset(transfer, 0x00, sizeof(struct file_transfer_t));
+
+    transfer->fd = -1;
+    transfer->next_report_ms = FILE_TRANSFER_REPORT_MS;
+    clock_gettime(CLOCK_MONOTONIC, &transfer->start_ts);
+}
+
+int file_transfer_open_input(struct file_transfer_t *transfer, const char *path, uint32_t slice) {
+    struct stat st;
+
+    assert(transfer != NULL);
+    assert(path != NULL);
+    assert(slice > 0);
+
+    file_transfer_reset(transfer);
+
+    transfer->fd = open(path, O_RDONLY);
+    if(transfer->fd < 0) {
+        strerr("open(%s) failed", path);
+        return -1;
+    }
+
+    if(fstat(transfer->fd, &st) != 0) {
+        strerr("fstat(%s) failed", path);
+        goto error;
+    }
+
+    transfer->size = st.st_size;
+    transfer->slice = slice;
+    transfer->slices = (transfer->size + slice - 1) / slice;
+
+    if(transfer->slices > UINT32_MAX) {
+        errprintf("%s: %" PRIu64 " slices do not fit packet number, use longer packets\n", path,
+                  transfer->slices);
+        goto error;
+    }
+
+    if(transfer->size > 0) {
+        transfer->map = (uint8_t*)mmap(NULL, transfer->size, PROT_READ, MAP_SHARED, transfer->fd, 0);
+        if(transfer->map == MAP_FAILED) {
+            transfer->map = NULL;
+            strerr("mmap(%s) failed", path);
+            goto error;
+        }
+
+        /* Read ahead: pages are touched once, in order */
+        (void)madvise(transfer->map, transfer->size, MADV_SEQUENTIAL);
+    }
+
+    return 0;
+
+error:
+    file_transfer_close(transfer);
+    return -1;
+}
+
+int file_transfer_next(struct file_transfer_t *transfer, struct packet_t *packet) {
+    assert(transfer != NULL);
+    assert(packet != NULL);
+
+    if(transfer->next >= transfer->slices) {
+        return 0;
+    }
+
+    uint64_t offset = transfer->next * transfer->slice;
+    uint64_t length = transfer->size - offset;
+    if(length > transfer->slice)
+        length = transfer->slice;
+
+    packet->number    = transfer->next;
+    packet->channel   = 0;
+    packet->crc_type  = packet_get_checksum();
+    packet->data      = transfer->map + offset;
+    packet->data_size = length;
+    packet->crc32     = packet_checksum(packet);
+
+    /* Slices go out in order: running crc is crc of the file */
+    transfer->crc32 = crc32(transfer->crc32, packet->data, length);
+
+    transfer->next++;
+    transfer->packets++;
+    transfer->file_bytes += length;
+    transfer->line_bytes += PACKET_HEADER_SIZE + length;
+
+    return 1;
+}
+
+void file_transfer_init_output(struct file_transfer_t *transfer) {
+    assert(transfer != NULL);
+
+    file_transfer_reset(transfer);
+}
+
+int file_transfer_start_output(struct file_transfer_t *transfer, const char *path,
+                               const struct file_transfer_record_t *start) {
+    assert(transfer != NULL);
+    assert(path != NULL);
+    assert(start != NULL);
+
+    if(start->slice == 0) {
+        errprintf("START record with zero slice length\n");
+        return -1;
+    }
+
+    transfer->size = start->size;
+    transfer->slice = start->slice;
+    transfer->slices = (transfer->size + transfer->slice - 1) / transfer->slice;
+
+    transfer->written = (uint8_t*)calloc(transfer->slices / 8 + 1, 1);
+    if(transfer->written == NULL) {
+        printf("file_transfer_start_output: calloc() failed\n");
+        exit(1);
+    }
+
+    transfer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(transfer->fd < 0) {
+        strerr("open(%s) failed", path);
+        return -1;
+    }
+
+    /* Missing slices read as zeros, file has its final size from the start */
+    if(ftruncate(transfer->fd, transfer->size) != 0) {
+        strerr("ftruncate(%s) failed", path);
+        return -1;
+    }
+
+    transfer->started = 1;
+    clock_gettime(CLOCK_MONOTONIC, &transfer->start_ts);
+
+    return 0;
+}
+
+static uint64_t file_transfer_slice_length(const struct file_transfer_t *transfer, uint64_t index) {
+    uint64_t offset = index * transfer->slice;
+
+    return (transfer->size - offset < transfer->slice) ? transfer->size - offset : transfer->slice;
+}
+
+size_t file_transfer_packet_size(const struct file_transfer_t *transfer, const uint8_t *header) {
+    assert(transfer != NULL);
+    assert(header != NULL);
+
+    struct data_t data = { (uint8_t*)header, PACKET_HEADER_SIZE };
+    struct packet_t packet = packet_view(data);
+    size_t data_size = packet_data_size(header);
+
+    if(packet.channel == FILE_TRANSFER_CHANNEL && data_size == FILE_TRANSFER_RECORD_SIZE) {
+        return PACKET_HEADER_SIZE + data_size;
+    }
+
+    if(!transfer->started || packet.channel != 0 || packet.number >= transfer->slices ||
+       data_size != file_transfer_slice_length(transfer, packet.number)) {
+        return 0;
+    }
+
+    return PACKET_HEADER_SIZE + data_size;
+}
+
+int file_transfer_write(struct file_transfer_t *transfer, const struct packet_t *packet) {
+    assert(transfer != NULL);
+    assert(packet != NULL);
+    assert(transfer->started);
+
+    transfer->packets++;
+    transfer->line_bytes += PACKET_HEADER_SIZE + packet->data_size;
+
+    /* Header is not covered by checksum: offset and size must match the slice */
+    uint64_t index = packet->number;
+    uint64_t offset = index * transfer->slice;
+
+    if(index >= transfer->slices || packet->channel != 0 ||
+       packet->data_size != file_transfer_slice_length(transfer, index) ||
+       packet->crc32 != packet_checksum(packet)) {
+        transfer->bad_packets++;
+        return -1;
+    }
+
+    if(transfer->written[index / 8] & (1 << (index % 8))) {
+        transfer->duplicates++;
+        return 0;
+    }
+
+    size_t done = 0;
+    while(done < packet->data_size) {
+        ssize_t ret = pwrite(transfer->fd, packet->data + done, packet->data_size - done, offset + done);
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            strerr("pwrite() failed");
+            exit(1);
+        }
+        done += ret;
+    }
+
+    transfer->written[index / 8] |= (1 << (index % 8));
+    transfer->file_bytes += packet->data_size;
+
+    return 0;
+}
+
+int file_transfer_verify(struct file_transfer_t *transfer) {
+    assert(transfer != NULL);
+
+    if(!transfer->started || !transfer->ended || transfer->file_bytes != transfer->size) {
+        return -1;
+    }
+
+    uint32_t crc = 0;
+
+    if(transfer->size > 0) {
+        uint8_t *map = (uint8_t*)mmap(NULL, transfer->size, PROT_READ, MAP_SHARED, transfer->fd, 0);
+        if(map == MAP_FAILED) {
+            strerr("mmap() of output failed");
+            return -1;
+        }
+
+        (void)madvise(map, transfer->size, MADV_SEQUENTIAL);
+        crc = crc32(0, map, transfer->size);
+        munmap(map, transfer->size);
+    }
+
+    return (crc == transfer->crc32) ? 0 : -1;
+}
+
+void file_transfer_close(struct file_transfer_t *transfer) {
+    assert(transfer != NULL);
+
+    if(transfer->map != NULL) {
+        munmap(transfer->map, transfer->size);
+        transfer->map = NULL;
+    }
+
+    if(transfer->fd >= 0) {
+        close(transfer->fd);
+        transfer->fd = -1;
+    }
+
+    free(transfer->written);
+    transfer->written = NULL;
+}
+
+struct file_transfer_record_t file_transfer_record(struct file_transfer_t *transfer, uint32_t type) {
+    struct file_transfer_record_t record;
+
+    assert(transfer != NULL);
+
+    memset(&record, 0x00, sizeof(record));
+    record.type = type;
+    record.slice = transfer->slice;
+    record.size = transfer->size;
+    record.crc32 = transfer->crc32;
+
+    transfer->line_bytes += PACKET_HEADER_SIZE + sizeof(record);
+
+    return record;
+}
+
+struct packet_t file_transfer_record_packet(const struct file_transfer_record_t *record, uint8_t *data) {
+    struct packet_t packet;
+
+    assert(record != NULL);
+    assert(data != NULL);
+
+    packet_put_le32(data, record->type);
+    packet_put_le32(data + 4, record->slice);
+    packet_put_le64(data + 8, record->size);
+    packet_put_le32(data + 16, record->crc32);
+    packet_put_le32(data + 20, record->reserved);
+
+    packet.number    = record->type;
+    packet.channel   = FILE_TRANSFER_CHANNEL;
+    packet.crc_type  = packet_get_checksum();
+    packet.data      = data;
+    packet.data_size = FILE_TRANSFER_RECORD_SIZE;
+    packet.crc32     = packet_checksum(&packet);
+
+    return packet;
+}
+
+int file_transfer_record_from_packet(const struct packet_t *packet, struct file_transfer_record_t *record) {
+    assert(packet != NULL);
+    assert(record != NULL);
+
+    if(packet->channel != FILE_TRANSFER_CHANNEL ||
+       packet->data_size != FILE_TRANSFER_RECORD_SIZE ||
+       packet->crc32 != packet_checksum(packet)) {
+        return -1;
+    }
+
+    record->type     = packet_get_le32(packet->data);
+    record->slice    = packet_get_le32(packet->data + 4);
+    record->size     = packet_get_le64(packet->data + 8);
+    record->crc32    = packet_get_le32(packet->data + 16);
+    record->reserved = packet_get_le32(packet->data + 20);
+
+    return 0;
+}
+
+void file_transfer_progress(struct file_transfer_t *transfer) {
+    assert(transfer != NULL);
+
+    uint64_t elapsed_ms = file_transfer_elapsed_ms(transfer);
+    if(elapsed_ms < transfer->next_report_ms) {
+        return;
+    }
+    transfer->next_report_ms = elapsed_ms + FILE_TRANSFER_REPORT_MS;
+
+    uint64_t goodput = transfer->file_bytes * 1000 / elapsed_ms;
+    uint64_t left = transfer->size > transfer->file_bytes ? transfer->size - transfer->file_bytes : 0;
+
+    alog4(ALOG_INFO, "File: %" PRIu64 " of %" PRIu64 " bytes, %" PRIu64 " B/s, ETA %" PRIu64 " s\n",
+          transfer->file_bytes, transfer->size, goodput, goodput ? left / goodput : 0);
+}
+
+void file_transfer_print_stats(struct file_transfer_t *transfer, const char *title) {
+    assert(transfer != NULL);
+    assert(title != NULL);
+
+    uint64_t elapsed_ms = file_transfer_elapsed_ms(transfer);
+    double seconds = elapsed_ms / 1000.0;
+
+    printf("%s:\n", title);
+    printf("\tFile size:        %" PRIu64 " bytes, %" PRIu64 " slices of %u\n", transfer->size,
+           transfer->slices, transfer->slice);
+    printf("\tFile bytes:       %" PRIu64 "\n", transfer->file_bytes);
+    printf("\tPackets:          %" PRIu64 "\n", transfer->packets);
+    printf("\tElapsed:          %.3f s\n", seconds);
+    printf("\tGoodput:          %.0f B/s\n", seconds > 0 ? transfer->file_bytes / seconds : 0.0);
+    printf("\tLine efficiency:  %.1f %% (file bytes of packet bytes on the line)\n",
+           transfer->line_bytes ? 100.0 * transfer->file_bytes / transfer->line_bytes : 0.0);
+}
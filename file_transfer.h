@@ -0,0 +1,95 @@
+#ifndef _FILE_TRANSFER_H_
+#define _FILE_TRANSFER_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "packet.h"
+
+/* START and END records travel on reserved channel, file slices on channel 0 */
+#define FILE_TRANSFER_CHANNEL 0xfffd
+
+#define FILE_TRANSFER_START 1 /* size and slice length, before first slice */
+#define FILE_TRANSFER_END   2 /* crc32 of whole file, after last slice */
+
+#define FILE_TRANSFER_RECORD_REPEAT 3    /* records are sent this many times, receiver takes first */
+#define FILE_TRANSFER_REPORT_MS     1000 /* progress line interval */
+
+/*
+ * Data of record packet: FILE_TRANSFER_RECORD_SIZE bytes, fields in
+ * this order, little-endian like the packet header
+ */
+#define FILE_TRANSFER_RECORD_SIZE 24
+
+struct file_transfer_record_t {
+    uint32_t type;
+    uint32_t slice;  /* file bytes per data packet */
+    uint64_t size;   /* file size */
+    uint32_t crc32;  /* END: crc32() of file */
+    uint32_t reserved;
+};
+
+/*
+ * File transfer over the packet link
+ *
+ * The sender maps the input file and builds packets straight from the
+ * mapping, slice i of the file is packet number i, so the receiver
+ * knows the offset of every slice without extra header fields. The
+ * receiver pwrite()s good slices into the output file, a bitmap keeps
+ * duplicates and missing slices apart, and the crc32 of the written
+ * file is checked against the END record of the sender.
+ */
+struct file_transfer_t {
+    int      fd;
+    uint8_t *map;          /* sender: input file mapping */
+    uint64_t size;
+    uint32_t slice;
+    uint64_t slices;
+
+    uint64_t next;         /* sender: next slice to send */
+    uint32_t crc32;        /* sender: crc32 of sent slices, receiver: crc32 from END */
+    uint8_t *written;      /* receiver: bitmap of written slices */
+    uint8_t  started;      /* receiver: START record seen */
+    uint8_t  ended;        /* receiver: END record seen */
+
+    /* statistics */
+    uint64_t file_bytes;   /* sent or written */
+    uint64_t line_bytes;   /* all packets on the line, headers and records included */
+    uint64_t packets;
+    uint64_t bad_packets;  /* receiver: checksum error, wrong size or offset */
+    uint64_t duplicates;
+
+    struct timespec start_ts;
+    uint64_t next_report_ms;
+};
+
+/* Sender: map input file, slice is file bytes per packet */
+int file_transfer_open_input(struct file_transfer_t *transfer, const char *path, uint32_t slice);
+/* Next slice as packet pointing into the mapping, returns 0 when all slices are sent */
+int file_transfer_next(struct file_transfer_t *transfer, struct packet_t *packet);
+
+/* Receiver: output is created when START record comes */
+void file_transfer_init_output(struct file_transfer_t *transfer);
+int  file_transfer_start_output(struct file_transfer_t *transfer, const char *path,
+                                const struct file_transfer_record_t *start);
+/* Bytes of packet starting with header, 0 - no packet of this transfer starts here */
+size_t file_transfer_packet_size(const struct file_transfer_t *transfer, const uint8_t *header);
+/* Write data packet at its slice offset, returns 0 or -1 for a bad packet */
+int  file_transfer_write(struct file_transfer_t *transfer, const struct packet_t *packet);
+/* Compare crc32 of output file with END record, returns 0 if equal */
+int  file_transfer_verify(struct file_transfer_t *transfer);
+
+void file_transfer_close(struct file_transfer_t *transfer);
+
+/* Record packets */
+struct file_transfer_record_t file_transfer_record(struct file_transfer_t *transfer, uint32_t type);
+/* Packet of record encoded into data of FILE_TRANSFER_RECORD_SIZE bytes, owned by the caller */
+struct packet_t file_transfer_record_packet(const struct file_transfer_record_t *record, uint8_t *data);
+int file_transfer_record_from_packet(const struct packet_t *packet, struct file_transfer_record_t *record);
+
+/* Progress line every FILE_TRANSFER_REPORT_MS: done bytes, goodput, ETA */
+void file_transfer_progress(struct file_transfer_t *transfer);
+void file_transfer_print_stats(struct file_transfer_t *transfer, const char *title);
+
+#endif /* _FILE_TRANSFER_H_ */
@@ -0,0 +1,107 @@
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "histogram.h"
+
+static inline unsigned int histogram_index(uint64_t value) {
+    if(value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+
+    unsigned int msb = 63 - __builtin_clzll(value);
+    unsigned int sub = (value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/* Largest value of bucket */
+static uint64_t histogram_bucket_limit(unsigned int index) {
+    if(index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    unsigned int msb = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+    uint64_t low = ((uint64_t)1 << msb) | (sub << (msb - HISTOGRAM_SUB_BITS));
+
+    return low + ((uint64_t)1 << (msb - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void histogram_init(struct histogram_t *histogram) {
+    assert(histogram != NULL);
+
+    memset(histogram, 0x00, sizeof(struct histogram_t));
+    histogram->min = UINT64_MAX;
+}
+
+void histogram_add(struct histogram_t *histogram, uint64_t value) {
+    histogram->buckets[histogram_index(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+
+    if(value < histogram->min)
+        histogram->min = value;
+    if(value > histogram->max)
+        histogram->max = value;
+}
+
+void histogram_merge(struct histogram_t *dst, const struct histogram_t *src) {
+    assert(dst != NULL);
+    assert(src != NULL);
+
+    for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+
+    if(src->min < dst->min)
+        dst->min = src->min;
+    if(src->max > dst->max)
+        dst->max = src->max;
+}
+
+uint64_t histogram_percentile(const struct histogram_t *histogram, double percentile) {
+    assert(histogram != NULL);
+
+    if(histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(histogram->count * percentile / 100.0 + 0.5);
+    if(rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+
+    for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if(seen >= rank) {
+            uint64_t limit = histogram_bucket_limit(i);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+double histogram_mean(const struct histogram_t *histogram) {
+    assert(histogram != NULL);
+
+    return histogram->count ? (double)histogram->sum / histogram->count : 0.0;
+}
+
+void histogram_print(const struct histogram_t *histogram, const char *name,
+                     const char *unit, double divider) {
+    assert(histogram != NULL);
+
+    printf("\t%-18s %10" PRIu64 "  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f %s\n",
+           name, histogram->count,
+           histogram_percentile(histogram, 50.0) / divider,
+           histogram_percentile(histogram, 90.0) / divider,
+           histogram_percentile(histogram, 99.0) / divider,
+           histogram_percentile(histogram, 99.9) / divider,
+           histogram->max / divider, unit);
+}
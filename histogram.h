@@ -0,0 +1,39 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+ * Log-linear histogram of 64-bit values
+ *
+ * Every power of two range is split into HISTOGRAM_SUB_BUCKETS buckets,
+ * so percentiles are within 1/HISTOGRAM_SUB_BUCKETS of the real value
+ * and adding a value is a few instructions with fixed memory.
+ */
+#define HISTOGRAM_SUB_BITS    3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS     ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram_t {
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+void histogram_init(struct histogram_t *histogram);
+void histogram_add(struct histogram_t *histogram, uint64_t value);
+/* Merge src into dst */
+void histogram_merge(struct histogram_t *dst, const struct histogram_t *src);
+
+/* Upper bound of bucket holding percentile (0.0 - 100.0), 0 if empty */
+uint64_t histogram_percentile(const struct histogram_t *histogram, double percentile);
+double   histogram_mean(const struct histogram_t *histogram);
+
+/* One line: count, p50, p90, p99, p99.9 and max scaled by divider */
+void histogram_print(const struct histogram_t *histogram, const char *name,
+                     const char *unit, double divider);
+
+#endif /* _HISTOGRAM_H_ */
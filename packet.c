@@ -2,39 +2,361 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h> /* rand() */
+#include <stdint.h>
 #include <time.h>
 
 #include "packet.h"
+#include "checksum.h"
+#include "async_log.h"
 
-struct packet_t create_packet(size_t packet_length) {
-    struct packet_t packet;
+static uint8_t packet_checksum_type = CHECKSUM_DEFAULT;
+static uint8_t packet_pattern = PACKET_PATTERN_RANDOM;
+static uint8_t packet_format = PACKET_FORMAT_STANDARD;
+
+static const char* packet_format_names[PACKET_FORMAT_NUM] = {
+    [PACKET_FORMAT_STANDARD] = "standard",
+    [PACKET_FORMAT_COMPACT]  = "compact",
+};
+
+#define PACKET_TAG(format) ((uint8_t)(PACKET_VERSION << 4 | (format)))
+
+#define PACKET_VARINT_MAX 5 /* bytes of a 32-bit value */
+#define PACKET_VARINT_STOPS 0x8080808080ULL /* continuation bits of PACKET_VARINT_MAX bytes */
+
+static const char* packet_pattern_names[PACKET_PATTERN_NUM] = {
+    [PACKET_PATTERN_RANDOM]  = "random",
+    [PACKET_PATTERN_ZEROS]   = "zeros",
+    [PACKET_PATTERN_ONES]    = "ones",
+    [PACKET_PATTERN_ALT]     = "alt",
+    [PACKET_PATTERN_COUNTER] = "counter",
+};
+
+void packet_set_pattern(uint8_t pattern) {
+    assert(pattern < PACKET_PATTERN_NUM);
+
+    packet_pattern = pattern;
+}
+
+const char* packet_pattern_name(uint8_t pattern) {
+    return (pattern < PACKET_PATTERN_NUM) ? packet_pattern_names[pattern] : "unknown";
+}
+
+int packet_pattern_from_name(const char *name) {
+    assert(name != NULL);
+
+    for(int i = 0; i < PACKET_PATTERN_NUM; i++) {
+        if(strcmp(name, packet_pattern_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+void packet_set_format(uint8_t format) {
+    assert(format < PACKET_FORMAT_NUM);
+
+    packet_format = format;
+}
+
+uint8_t packet_get_format(void) {
+    return packet_format;
+}
+
+const char* packet_format_name(uint8_t format) {
+    return (format < PACKET_FORMAT_NUM) ? packet_format_names[format] : "unknown";
+}
+
+int packet_format_from_name(const char *name) {
+    assert(name != NULL);
+
+    for(int i = 0; i < PACKET_FORMAT_NUM; i++) {
+        if(strcmp(name, packet_format_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+void packet_set_checksum(uint8_t type) {
+    assert(type < CHECKSUM_NUM);
+
+    packet_checksum_type = type;
+}
+
+uint8_t packet_get_checksum(void) {
+    return packet_checksum_type;
+}
+
+uint32_t packet_checksum(const struct packet_t *packet) {
+    assert(packet != NULL);
+
+    return checksum(packet->crc_type, packet->data, packet->data_size);
+}
+
+static inline uint64_t packet_load_le64(const uint8_t *p) {
+    uint64_t word;
+
+    memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
 
-    static unsigned int packet_number = 1;
-    static unsigned int header_size = sizeof(packet.number) + sizeof(packet.data_size) + sizeof(packet.crc32);
+static inline void packet_store_le64(uint8_t *p, uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    memcpy(p, &word, sizeof(word));
+}
+
+static inline size_t packet_varint_size(uint32_t value) {
+    /* Value 0 takes one byte as well */
+    return 1 + (31 - __builtin_clz(value | 1)) / 7;
+}
+
+/*
+ * Varints are spread and gathered in one 64-bit word: shifts and masks
+ * move 7-bit groups between bytes, the size sets continuation bits on
+ * encode and the first clear one ends the value on decode, so neither
+ * loops per byte. Encoding stores 8 bytes at p and decoding loads 8:
+ * the header code leaves room for that.
+ */
+static inline uint64_t packet_varint_word(uint32_t value, size_t size) {
+    uint64_t v = value;
+
+    uint64_t word = (v & 0x7f) | ((v << 1) & 0x7f00) | ((v << 2) & 0x7f0000) |
+                    ((v << 3) & 0x7f000000) | ((v << 4) & 0x7f00000000ULL);
+
+    return word | (PACKET_VARINT_STOPS & ((1ULL << (8 * (size - 1))) - 1));
+}
+
+static inline size_t packet_put_varint(uint8_t *p, uint32_t value) {
+    size_t size = packet_varint_size(value);
+
+    packet_store_le64(p, packet_varint_word(value, size));
+
+    return size;
+}
+
+/* Returns bytes of varint, 0 - longer than PACKET_VARINT_MAX or above 32 bits */
+static inline size_t packet_get_varint(const uint8_t *p, uint32_t *value) {
+    uint64_t word = packet_load_le64(p);
+    uint64_t stops = ~word & PACKET_VARINT_STOPS;
+
+    if(stops == 0)
+        return 0;
+
+    size_t size = __builtin_ctzll(stops) / 8 + 1;
+    word &= ~0ULL >> (64 - 8 * size);
+
+    uint64_t v = (word & 0x7f) | ((word >> 1) & 0x3f80) | ((word >> 2) & 0x1fc000) |
+                 ((word >> 3) & 0xfe00000) | ((word >> 4) & 0x7f0000000ULL);
+    *value = (uint32_t)v;
 
-    assert(header_size == PACKET_HEADER_SIZE);
+    return (v >> 32) ? 0 : size;
+}
+
+/* Compact header bytes but the frame size varint */
+static inline size_t packet_compact_fields_size(uint32_t number, uint16_t channel) {
+    return 1 + packet_varint_size(number) + 1 + packet_varint_size(channel) + sizeof(uint32_t);
+}
+
+static inline size_t packet_compact_header_size(const struct packet_t *packet) {
+    /* Frame size counts its own varint: one more byte when that crosses a 7-bit boundary */
+    size_t fields = packet_compact_fields_size(packet->number, packet->channel);
+    size_t rest = fields + packet->data_size;
+
+    return fields + packet_varint_size(rest + packet_varint_size(rest + 1));
+}
+
+size_t packet_header_size(const struct packet_t *packet, uint8_t format) {
+    assert(packet != NULL);
+
+    return (format == PACKET_FORMAT_STANDARD) ? PACKET_HEADER_SIZE : packet_compact_header_size(packet);
+}
+
+size_t packet_encode_header(const struct packet_t *packet, uint8_t format, uint8_t *out) {
+    assert(packet != NULL);
+    assert(out != NULL);
+    assert(format < PACKET_FORMAT_NUM);
+
+    out[0] = PACKET_TAG(format);
+
+    if(format == PACKET_FORMAT_STANDARD) {
+        out[1] = packet->crc_type;
+        packet_put_le16(out + 2, packet->channel);
+        packet_put_le32(out + 4, (uint32_t)packet->data_size);
+        packet_put_le32(out + 8, packet->number);
+        packet_put_le32(out + 12, packet->crc32);
+
+        return PACKET_HEADER_SIZE;
+    }
+
+    size_t header_size = packet_compact_header_size(packet);
+    size_t size = 1;
+
+    /* Stores run past each field into the next one, the last varint is at most 3 bytes */
+    size += packet_put_varint(out + size, (uint32_t)(header_size + packet->data_size));
+    size += packet_put_varint(out + size, packet->number);
+    out[size++] = packet->crc_type;
+
+    size_t channel_size = packet_varint_size(packet->channel);
+    uint32_t channel_word = (uint32_t)packet_varint_word(packet->channel, channel_size);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    channel_word = __builtin_bswap32(channel_word);
+#endif
+    memcpy(out + size, &channel_word, sizeof(channel_word));
+    size += channel_size;
+
+    packet_put_le32(out + size, packet->crc32);
+    size += sizeof(uint32_t);
+
+    assert(size == header_size);
+
+    return size;
+}
+
+size_t packet_decode_header(const uint8_t *buf, size_t size, struct packet_t *packet) {
+    uint8_t copy[PACKET_HEADER_MAX + sizeof(uint64_t)];
+    const uint8_t *header = buf;
+    uint32_t frame_size = 0, number = 0, channel = 0; /* stay 0 when a varint is not valid */
+
+    assert(buf != NULL);
+    assert(packet != NULL);
+
+    /* Short buffer: zeros after the copy end any varint, a cut header fails the size check */
+    if(size < sizeof(copy)) {
+        memset(copy, 0x00, sizeof(copy));
+        memcpy(copy, buf, (size < PACKET_HEADER_MAX) ? size : PACKET_HEADER_MAX);
+        header = copy;
+    }
+
+    if(header[0] == PACKET_TAG(PACKET_FORMAT_STANDARD)) {
+        packet->crc_type = header[1];
+        packet->channel = packet_get_le16(header + 2);
+        packet->data_size = packet_get_le32(header + 4);
+        packet->number = packet_get_le32(header + 8);
+        packet->crc32 = packet_get_le32(header + 12);
+
+        return (size >= PACKET_HEADER_SIZE) ? PACKET_HEADER_SIZE : 0;
+    }
+
+    if(header[0] != PACKET_TAG(PACKET_FORMAT_COMPACT))
+        return 0;
+
+    size_t frame_bytes = packet_get_varint(header + 1, &frame_size);
+    size_t number_bytes = packet_get_varint(header + 1 + frame_bytes, &number);
+    size_t offset = 1 + frame_bytes + number_bytes;
+
+    packet->crc_type = header[offset++];
+
+    size_t channel_bytes = packet_get_varint(header + offset, &channel);
+    offset += channel_bytes;
+
+    packet->crc32 = packet_get_le32(header + offset);
+    offset += sizeof(uint32_t);
+
+    packet->number = number;
+    packet->channel = (uint16_t)channel;
+    packet->data_size = frame_size - offset;
+
+    int valid = (frame_bytes != 0) & (number_bytes != 0) & (channel_bytes != 0) &
+                (channel <= UINT16_MAX) & (offset <= size) & (frame_size >= offset);
+
+    return valid ? offset : 0;
+}
+
+/* Fields of a header that is not valid: checksum of unknown type is 0, crc32 never matches it */
+static void packet_set_invalid(struct packet_t *packet) {
+    packet->number = 0;
+    packet->channel = 0;
+    packet->crc_type = PACKET_CRC_TYPE_INVALID;
+    packet->crc32 = 0xffffffff;
+}
+
+static uint32_t packet_number = 1;
+
+size_t packet_frame_header_size(uint32_t number, uint16_t channel, uint8_t format, size_t frame_size) {
+    struct packet_t packet = { .number = number, .channel = channel };
+    size_t header_size = PACKET_HEADER_SIZE;
+
+    if(format == PACKET_FORMAT_COMPACT)
+        header_size = packet_compact_fields_size(number, channel) + packet_varint_size((uint32_t)frame_size);
+
+    if(frame_size < header_size || frame_size - header_size > PACKET_DATA_SIZE_MAX)
+        return 0;
+
+    packet.data_size = frame_size - header_size;
+
+    /* Data size the header gives must fill the frame */
+    return (packet_header_size(&packet, format) == header_size) ? header_size : 0;
+}
+
+int packet_length_valid(size_t packet_length) {
+    /* Longest header of channel 0 fits */
+    return packet_length >= PACKET_HEADER_SIZE &&
+           packet_frame_header_size(1, 0, packet_format, packet_length) != 0;
+}
+
+struct packet_t packet_fill(uint8_t *data, size_t packet_length) {
+    struct packet_t packet;
 
     packet.number = packet_number++;
+    packet.channel = 0;
+    packet.crc_type = packet_checksum_type;
+
+    size_t header_size = packet_frame_header_size(packet.number, packet.channel, packet_format, packet_length);
+
+    assert(header_size != 0);
+    assert(data != NULL || packet_length == header_size);
 
-    assert((ssize_t)(packet_length - header_size) >= 0);
     packet.data_size = packet_length - header_size;
 
-    packet.data = generate_data(packet.data_size);
-    packet.crc32  = crc32(0x00, packet.data, packet.data_size);
+    packet.data = data;
+    fill_data(packet.data, packet.data_size);
+    packet.crc32  = packet_checksum(&packet);
 
     return packet;
 }
 
-unsigned char* generate_data(size_t length) {
-    unsigned char* buffer = (unsigned char*)malloc(length);
+struct packet_t create_packet(size_t packet_length) {
+    assert(packet_length >= PACKET_HEADER_SIZE);
 
-    if (buffer == NULL) {
-        printf("generate_data: malloc() failed\n");
+    /* Compact header leaves more of packet_length to data */
+    uint8_t *data = (uint8_t*)malloc(packet_length);
+    if (data == NULL) {
+        printf("create_packet: malloc() failed\n");
         exit(1);
     }
 
+    return packet_fill(data, packet_length);
+}
+
+void fill_data(uint8_t *buffer, size_t length) {
     static int srandomized = 0;
 
+    switch(packet_pattern) {
+        case PACKET_PATTERN_ZEROS:
+            memset(buffer, 0x00, length);
+            return;
+        case PACKET_PATTERN_ONES:
+            memset(buffer, 0xff, length);
+            return;
+        case PACKET_PATTERN_ALT:
+            for(size_t i = 0; i < length; ++i) {
+                buffer[i] = (i & 1) ? 0xaa : 0x55;
+            }
+            return;
+        case PACKET_PATTERN_COUNTER:
+            for(size_t i = 0; i < length; ++i) {
+                buffer[i] = (uint8_t)i;
+            }
+            return;
+        default:
+            break;
+    }
+
     if(!srandomized) {
         srand(time(NULL));
         srandomized = 1;
@@ -43,6 +365,17 @@ unsigned char* generate_data(size_t length) {
     for(int i  = 0; i < length; ++i) {
         buffer[i] = (unsigned char)rand();
     }
+}
+
+unsigned char* generate_data(size_t length) {
+    unsigned char* buffer = (unsigned char*)malloc(length);
+
+    if (buffer == NULL) {
+        printf("generate_data: malloc() failed\n");
+        exit(1);
+    }
+
+    fill_data(buffer, length);
 
     return buffer;
 }
@@ -50,69 +383,106 @@ unsigned char* generate_data(size_t length) {
 struct data_t packet_to_data(struct packet_t packet) {
     struct data_t data;
 
-    int header_size = sizeof(packet.number) + sizeof(packet.data_size) + sizeof(packet.crc32);
+    size_t size = packet_header_size(&packet, packet_format) + packet.data_size;
 
-    assert(header_size == PACKET_HEADER_SIZE);
-
-    data.ptr = (unsigned char*)malloc(header_size + packet.data_size);
+    data.ptr = (unsigned char*)malloc(size);
     if (data.ptr == NULL) {
         printf("packet_to_data: malloc() failed\n");
         exit(1);
     }
 
-    unsigned int offset = 0;
+    data.size = packet_to_buffer(packet, data.ptr, size);
 
-    /* Copy header */
-    memcpy((void*)(data.ptr + offset), (void*)&packet.number, sizeof(packet.number));
-    offset += sizeof(packet.number);
+    return data;
+}
 
-    memcpy((void*)(data.ptr + offset), (void*)&packet.data_size, sizeof(packet.data_size));
-    offset += sizeof(packet.data_size);
+size_t packet_to_buffer(struct packet_t packet, uint8_t *buffer, size_t size) {
+    assert(buffer != NULL);
 
-    memcpy((void*)(data.ptr + offset), (void*)&packet.crc32, sizeof(packet.crc32));
-    offset += sizeof(packet.crc32);
+    size_t header_size = packet_header_size(&packet, packet_format);
 
-    /* Copy data */
-    memcpy((void*)(data.ptr + offset), (void*)packet.data, packet.data_size);
+    if(header_size + packet.data_size > size) {
+        return 0;
+    }
 
-    data.size = packet.data_size + header_size;
+    if(size >= PACKET_HEADER_MAX) {
+        (void)packet_encode_header(&packet, packet_format, buffer);
+    } else {
+        uint8_t header[PACKET_HEADER_MAX];
 
-    return data;
+        (void)packet_encode_header(&packet, packet_format, header);
+        memcpy(buffer, header, header_size);
+    }
+
+    /* Copy data */
+    memcpy((void*)(buffer + header_size), (void*)packet.data, packet.data_size);
+
+    return header_size + packet.data_size;
 }
 
 struct packet_t packet_from_data(struct data_t data) {
-    struct packet_t packet;
-    int header_size = sizeof(packet.number) + sizeof(packet.data_size) + sizeof(packet.crc32);
+    struct packet_t packet = packet_view(data);
 
-    assert(header_size == PACKET_HEADER_SIZE);
-
-    unsigned char* buffer = (unsigned char*)malloc(data.size - header_size);
+    unsigned char* buffer = (unsigned char*)malloc(packet.data_size + 1);
     if (buffer == NULL) {
         printf("packet_from_data: malloc() failed\n");
         exit(1);
     }
 
-    unsigned int offset = 0;
+    memcpy((void*)buffer, (void*)packet.data, packet.data_size);
+    packet.data = buffer;
 
-    memcpy((void*)&packet.number, (void*)(data.ptr + offset), sizeof(packet.number));
-    offset += sizeof(packet.number);
+    return packet;
+}
 
-    memcpy((void*)&packet.data_size, (void*)(data.ptr + offset), sizeof(packet.data_size));
-    offset += sizeof(packet.data_size);
+struct packet_t packet_view(struct data_t data) {
+    struct packet_t packet;
 
-    memcpy((void*)&packet.crc32, (void*)(data.ptr + offset), sizeof(packet.crc32));
-    offset += sizeof(packet.crc32);
+    size_t header_size = packet_decode_header(data.ptr, data.size, &packet);
 
-    memcpy((void*)buffer, (void*)(data.ptr + offset), data.size - header_size);
+    if(header_size == 0) {
+        packet_set_invalid(&packet);
+    }
 
-    packet.data = buffer;
+    /* Data is the rest of the buffer, whatever the header says */
+    packet.data = data.ptr + header_size;
     packet.data_size = data.size - header_size;
 
     return packet;
 }
 
+size_t packet_data_size(const uint8_t *header) {
+    assert(header != NULL);
+
+    if(header[0] != PACKET_TAG(PACKET_FORMAT_STANDARD))
+        return SIZE_MAX;
+
+    return packet_get_le32(header + 4);
+}
+
+size_t packet_frame_size(const uint8_t *header) {
+    uint8_t prefix[PACKET_FRAME_PREFIX + sizeof(uint64_t)] = { 0 };
+    uint32_t frame_size = 0;
+
+    assert(header != NULL);
+
+    memcpy(prefix, header, PACKET_FRAME_PREFIX);
+
+    if(prefix[0] == PACKET_TAG(PACKET_FORMAT_STANDARD)) {
+        uint32_t data_size = packet_get_le32(prefix + 4);
+        return (data_size <= PACKET_DATA_SIZE_MAX) ? PACKET_HEADER_SIZE + data_size : 0;
+    }
+
+    if(prefix[0] != PACKET_TAG(PACKET_FORMAT_COMPACT) || packet_get_varint(prefix + 1, &frame_size) == 0)
+        return 0;
+
+    return (frame_size >= PACKET_COMPACT_HEADER_MIN &&
+            frame_size <= PACKET_COMPACT_HEADER_MAX + PACKET_DATA_SIZE_MAX) ? frame_size : 0;
+}
+
 void show_packet_info(struct packet_t *packet) {
-    printf("Packet: [Number: %.8i   Data size: %lu   CRC32: 0x%.8x]\n", packet->number, packet->data_size, packet->crc32);
+    alog_every(ALOG_INFO, "Packet: [Number: %.8" PRIu64 "   Channel: %" PRIu64 "   Data size: %" PRIu64 "   Checksum: 0x%.8" PRIx64 "]\n",
+               packet->number, packet->channel, packet->data_size, packet->crc32);
 }
 
 void show_packet_data(struct packet_t *packet) {
@@ -3,11 +3,99 @@
 
 #include <inttypes.h>
 
-#define PACKET_HEADER_SIZE 12 /* num + len + crc32 */
+#include <stddef.h>
+
+/*
+ * Wire header, version 1, all fields little-endian on every host
+ *
+ * Standard, PACKET_HEADER_SIZE bytes:
+ *   0  u8   tag: version << 4 | PACKET_FORMAT_STANDARD
+ *   1  u8   crc_type
+ *   2  u16  channel
+ *   4  u32  data size
+ *   8  u32  number
+ *  12  u32  crc32
+ *
+ * Compact, PACKET_COMPACT_HEADER_MIN..PACKET_COMPACT_HEADER_MAX bytes:
+ *      u8      tag: version << 4 | PACKET_FORMAT_COMPACT
+ *      varint  frame size, header included, 1-4 bytes
+ *      varint  number, 1-5 bytes
+ *      u8      crc_type
+ *      varint  channel, 1-3 bytes
+ *      u32     crc32
+ *
+ * Varints are LEB128: 7 bits per byte, low group first, high bit set
+ * on all bytes but the last. A packet of less than 128 bytes numbered
+ * below 128 on channel 0 has a 9 byte compact header, 10 bytes up to
+ * 16 Kbyte and number 16383. The first PACKET_FRAME_PREFIX bytes of
+ * either format give the frame size, which is what framers need.
+ * A tag of another version or format makes the header invalid.
+ */
+#define PACKET_VERSION 1
+
+#define PACKET_FORMAT_STANDARD 0
+#define PACKET_FORMAT_COMPACT  1
+#define PACKET_FORMAT_NUM      2
+
+#define PACKET_HEADER_SIZE         16
+#define PACKET_COMPACT_HEADER_MIN  9
+#define PACKET_COMPACT_HEADER_MAX  18
+#define PACKET_HEADER_MAX          18 /* longest header of any format */
+#define PACKET_FRAME_PREFIX        8  /* header bytes enough for packet_frame_size() */
+
+/* crc_type of a header not valid: unknown tag or cut short, checksum never matches */
+#define PACKET_CRC_TYPE_INVALID 0xff
+
+/* First byte of a header of this version in any format */
+static inline int packet_tag_valid(uint8_t tag) {
+    return (tag >> 4) == PACKET_VERSION && (tag & 0x0f) < PACKET_FORMAT_NUM;
+}
+
+/* Fixed fields byte by byte: same wire bytes on every host, one load or store on little-endian ones */
+static inline void packet_put_le16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void packet_put_le32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static inline void packet_put_le64(uint8_t *p, uint64_t value) {
+    packet_put_le32(p, (uint32_t)value);
+    packet_put_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+static inline uint16_t packet_get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t packet_get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t packet_get_le64(const uint8_t *p) {
+    return (uint64_t)packet_get_le32(p) | (uint64_t)packet_get_le32(p + 4) << 32;
+}
+
+/* Data of new packets */
+#define PACKET_DATA_SIZE_MAX (16 * 1024 * 1024) /* larger size in a header is garbage */
+
+#define PACKET_PATTERN_RANDOM  0
+#define PACKET_PATTERN_ZEROS   1 /* 0x00 */
+#define PACKET_PATTERN_ONES    2 /* 0xff */
+#define PACKET_PATTERN_ALT     3 /* 0x55 0xaa, most transitions per bit */
+#define PACKET_PATTERN_COUNTER 4 /* byte index */
+#define PACKET_PATTERN_NUM     5
 
 struct packet_t {
     uint32_t number;
     uint32_t crc32;
+    uint16_t channel;
+    uint8_t  crc_type; /* CHECKSUM_* algorithm of crc32 field */
     uint8_t* data;
     size_t   data_size;
 };
@@ -17,17 +105,70 @@ struct data_t {
     size_t   size;
 };
 
+/*
+ * Packet of packet_length bytes can be made in the current format:
+ * compact frame size varint gets a byte longer at 128, 16384 and
+ * 2097152 bytes, so frames of just these sizes do not exist
+ */
+int     packet_length_valid(size_t packet_length);
+/* Next packet of packet_length bytes on the wire in the current format */
 struct  packet_t create_packet(size_t packet_length);
+/* Next packet with random data in caller buffer of packet_length bytes, header takes its part */
+struct  packet_t packet_fill(uint8_t *data, size_t packet_length);
 
 struct  data_t   packet_to_data(struct packet_t packet);
+/* Serialize into caller buffer, returns bytes used or 0 if buffer is too small */
+size_t           packet_to_buffer(struct packet_t packet, uint8_t *buffer, size_t size);
 struct  packet_t packet_from_data(struct data_t);
+/* Decode without copy: packet data points into data buffer */
+struct  packet_t packet_view(struct data_t data);
+
+/*
+ * Header bytes of a frame of frame_size bytes for packet number on
+ * channel in format, 0 - no such frame: too short or too long, or
+ * a compact frame size varint cannot give it
+ */
+size_t packet_frame_header_size(uint32_t number, uint16_t channel, uint8_t format, size_t frame_size);
+/* Header bytes of packet in format */
+size_t packet_header_size(const struct packet_t *packet, uint8_t format);
+/* Serialize header of packet in format into out of PACKET_HEADER_MAX bytes, returns bytes used, rest is scratch */
+size_t packet_encode_header(const struct packet_t *packet, uint8_t format, uint8_t *out);
+/*
+ * Parse header from first size bytes of buf, returns header bytes or
+ * 0 - not a valid header. Fields and data_size from the header go to
+ * packet, data is not touched.
+ */
+size_t packet_decode_header(const uint8_t *buf, size_t size, struct packet_t *packet);
+
+/* Get data size from standard header of PACKET_HEADER_SIZE bytes, SIZE_MAX - not a standard header */
+size_t packet_data_size(const uint8_t *header);
+/* Bytes of packet from first PACKET_FRAME_PREFIX bytes of any format, 0 - not a valid header */
+size_t packet_frame_size(const uint8_t *header);
 
 uint8_t*  generate_data(size_t length);
+void      fill_data(uint8_t *buffer, size_t length);
 void      show_data_struct(struct data_t *data);
 
+/* Data pattern for new packets, PACKET_PATTERN_RANDOM if not set */
+void        packet_set_pattern(uint8_t pattern);
+const char* packet_pattern_name(uint8_t pattern);
+/* Returns PACKET_PATTERN_* or -1 */
+int         packet_pattern_from_name(const char *name);
+
+/* Header format of new packets, PACKET_FORMAT_STANDARD if not set */
+void        packet_set_format(uint8_t format);
+uint8_t     packet_get_format(void);
+const char* packet_format_name(uint8_t format);
+/* Returns PACKET_FORMAT_* or -1 */
+int         packet_format_from_name(const char *name);
+
+/* Checksum algorithm for new packets, CHECKSUM_DEFAULT if not set */
+void     packet_set_checksum(uint8_t type);
+uint8_t  packet_get_checksum(void);
+/* Checksum of packet data with packet crc_type algorithm */
+uint32_t packet_checksum(const struct packet_t *packet);
+
 void show_packet_info(struct packet_t *packet);
 void show_packet_data(struct packet_t *packet);
 
-extern uint32_t crc32(uint32_t crc, const void *buf, size_t size);
-
 #endif /* _PACKET_H */
@@ -0,0 +1,313 @@
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "packet_stream.h"
+#include "checksum.h"
+
+#define N_ERR "PACKET_STREAM ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+int packet_decoder_init(struct packet_decoder_t *decoder, uint8_t *buf, size_t buf_size, size_t fixed_size,
+                        packet_decoder_cb_t on_packet, void *ctx) {
+    assert(decoder != NULL);
+    assert(buf != NULL);
+    assert(on_packet != NULL);
+
+    if(buf_size < PACKET_FRAME_PREFIX || fixed_size > buf_size ||
+       (fixed_size != 0 && fixed_size < PACKET_FRAME_PREFIX)) {
+        errprintf("buffer of %lu bytes for frames of %lu bytes\n", buf_size, fixed_size);
+        return -1;
+    }
+
+    memset(decoder, 0x00, sizeof(struct packet_decoder_t));
+
+    decoder->buf = buf;
+    decoder->buf_size = buf_size;
+    decoder->fixed_size = fixed_size;
+    decoder->on_packet = on_packet;
+    decoder->ctx = ctx;
+    decoder->hunting = 1;
+
+    return 0;
+}
+
+static inline int packet_decoder_frame_valid(const struct packet_decoder_t *decoder, size_t frame) {
+    return frame != 0 && frame <= decoder->buf_size &&
+           (decoder->fixed_size == 0 || frame == decoder->fixed_size);
+}
+
+/* Drop count bytes from buf start */
+static void packet_decoder_consume(struct packet_decoder_t *decoder, size_t count) {
+    decoder->have -= count;
+    if(decoder->have > 0)
+        memmove(decoder->buf, decoder->buf + count, decoder->have);
+
+    decoder->offset += count;
+    decoder->frame = 0;
+}
+
+/* Drop bytes up to the first one from 'from' on a frame may start from */
+static void packet_decoder_skip(struct packet_decoder_t *decoder, size_t from) {
+    size_t i;
+
+    for(i = from; i < decoder->have; i++) {
+        if(!packet_tag_valid(decoder->buf[i]))
+            continue;
+
+        /* Too few bytes to tell yet */
+        if(decoder->have - i < PACKET_FRAME_PREFIX)
+            break;
+
+        if(packet_decoder_frame_valid(decoder, packet_frame_size(decoder->buf + i)))
+            break;
+    }
+
+    decoder->skipped += i;
+    packet_decoder_consume(decoder, i);
+}
+
+static void packet_decoder_lose(struct packet_decoder_t *decoder) {
+    decoder->hunting = 1;
+    decoder->misses = 0;
+    decoder->resyncs++;
+}
+
+/* Frame at buf start is complete, returns 0 - it was not a frame */
+static int packet_decoder_complete(struct packet_decoder_t *decoder) {
+    struct packet_decoder_event_t event;
+    struct data_t data = { decoder->buf, decoder->frame };
+
+    event.packet = packet_view(data);
+    event.frame = decoder->buf;
+    event.size = decoder->frame;
+    event.offset = decoder->offset;
+    event.crc = 0;
+
+    /* Unknown type gives checksum 0: a misaligned header with zero bytes for crc32 would pass */
+    if(event.packet.crc_type < CHECKSUM_NUM)
+        event.crc = packet_checksum(&event.packet);
+    event.crc_ok = (event.packet.crc_type < CHECKSUM_NUM && event.packet.crc32 == event.crc);
+
+    if(decoder->hunting) {
+        if(!event.crc_ok) {
+            packet_decoder_skip(decoder, 1);
+            return 0;
+        }
+        decoder->hunting = 0;
+    }
+
+    decoder->frames++;
+    if(event.crc_ok) {
+        decoder->misses = 0;
+    } else {
+        decoder->crc_errors++;
+        decoder->misses++;
+    }
+
+    decoder->on_packet(decoder->ctx, &event);
+
+    packet_decoder_consume(decoder, event.size);
+
+    if(decoder->misses >= PACKET_DECODER_MISSES_MAX)
+        packet_decoder_lose(decoder);
+
+    return 1;
+}
+
+/* Pass on every frame complete in buf, returns frames passed on */
+static size_t packet_decoder_process(struct packet_decoder_t *decoder) {
+    size_t frames = 0;
+
+    while(decoder->have >= PACKET_FRAME_PREFIX) {
+        if(decoder->frame == 0) {
+            size_t frame = packet_frame_size(decoder->buf);
+
+            if(packet_decoder_frame_valid(decoder, frame)) {
+                decoder->frame = frame;
+            } else if(!decoder->hunting && decoder->fixed_size != 0) {
+                /* Damaged header of a frame in line: it still ends where the next one starts */
+                decoder->frame = decoder->fixed_size;
+            } else {
+                if(!decoder->hunting)
+                    packet_decoder_lose(decoder);
+                packet_decoder_skip(decoder, 1);
+                continue;
+            }
+        }
+
+        if(decoder->have < decoder->frame)
+            break;
+
+        frames += packet_decoder_complete(decoder);
+    }
+
+    return frames;
+}
+
+uint8_t* packet_decoder_space(struct packet_decoder_t *decoder, size_t *size) {
+    assert(decoder != NULL);
+    assert(size != NULL);
+
+    size_t target = PACKET_FRAME_PREFIX;
+
+    if(decoder->frame != 0)
+        target = decoder->frame;
+    else if(decoder->fixed_size != 0)
+        target = decoder->fixed_size;
+
+    /* Bytes left over by process() are less than that */
+    assert(target > decoder->have);
+
+    *size = target - decoder->have;
+
+    return decoder->buf + decoder->have;
+}
+
+size_t packet_decoder_commit(struct packet_decoder_t *decoder, size_t count) {
+    assert(decoder != NULL);
+    assert(decoder->have + count <= decoder->buf_size);
+
+    decoder->have += count;
+    decoder->bytes += count;
+
+    return packet_decoder_process(decoder);
+}
+
+size_t packet_decoder_feed(struct packet_decoder_t *decoder, const uint8_t *in, size_t count) {
+    size_t frames = 0;
+
+    assert(decoder != NULL);
+    assert(in != NULL || count == 0);
+
+    while(count > 0) {
+        size_t size;
+        uint8_t *space = packet_decoder_space(decoder, &size);
+
+        if(size > count)
+            size = count;
+
+        memcpy(space, in, size);
+        in += size;
+        count -= size;
+
+        frames += packet_decoder_commit(decoder, size);
+    }
+
+    return frames;
+}
+
+void packet_decoder_restart(struct packet_decoder_t *decoder) {
+    assert(decoder != NULL);
+
+    decoder->have = 0;
+    decoder->frame = 0;
+    decoder->offset = 0;
+    decoder->hunting = 1;
+    decoder->misses = 0;
+}
+
+void packet_decoder_print_stats(const struct packet_decoder_t *decoder) {
+    assert(decoder != NULL);
+
+    printf("Decoder:\n");
+    printf("\tFrames:           %" PRIu64 " from %" PRIu64 " bytes, %" PRIu64 " bad\n",
+           decoder->frames, decoder->bytes, decoder->crc_errors);
+    printf("\tResyncs:          %" PRIu64 ", %" PRIu64 " bytes skipped\n", decoder->resyncs, decoder->skipped);
+}
+
+void packet_encoder_init(struct packet_encoder_t *encoder, uint8_t format, uint8_t crc_type, uint16_t channel) {
+    assert(encoder != NULL);
+    assert(format < PACKET_FORMAT_NUM);
+    assert(crc_type < CHECKSUM_NUM);
+
+    memset(encoder, 0x00, sizeof(struct packet_encoder_t));
+
+    encoder->number = 1;
+    encoder->channel = channel;
+    encoder->format = format;
+    encoder->crc_type = crc_type;
+}
+
+/* Header goes in front of data already in place: encoding writes scratch past the header */
+static size_t packet_encoder_put_header(const struct packet_encoder_t *encoder, const struct packet_t *packet,
+                                        uint8_t *out) {
+    uint8_t header[PACKET_HEADER_MAX];
+    size_t header_size = packet_encode_header(packet, encoder->format, header);
+
+    memcpy(out, header, header_size);
+
+    return header_size;
+}
+
+size_t packet_encoder_encode(struct packet_encoder_t *encoder, const uint8_t *data, size_t size,
+                             uint8_t *out, size_t out_size) {
+    struct packet_t packet;
+
+    assert(encoder != NULL);
+    assert(data != NULL || size == 0);
+    assert(out != NULL);
+
+    if(size > PACKET_DATA_SIZE_MAX)
+        return 0;
+
+    packet.number = encoder->number;
+    packet.channel = encoder->channel;
+    packet.crc_type = encoder->crc_type;
+    packet.data = (uint8_t*)data;
+    packet.data_size = size;
+    packet.crc32 = packet_checksum(&packet);
+
+    size_t header_size = packet_header_size(&packet, encoder->format);
+    if(header_size + size > out_size)
+        return 0;
+
+    memmove(out + header_size, data, size);
+    (void)packet_encoder_put_header(encoder, &packet, out);
+
+    encoder->number++;
+    encoder->frames++;
+    encoder->bytes += header_size + size;
+
+    return header_size + size;
+}
+
+uint8_t* packet_encoder_begin(struct packet_encoder_t *encoder, uint8_t *out, size_t frame_size,
+                              struct packet_t *packet) {
+    assert(encoder != NULL);
+    assert(out != NULL);
+    assert(packet != NULL);
+
+    size_t header_size = packet_frame_header_size(encoder->number, encoder->channel, encoder->format, frame_size);
+    if(header_size == 0)
+        return NULL;
+
+    packet->number = encoder->number;
+    packet->channel = encoder->channel;
+    packet->crc_type = encoder->crc_type;
+    packet->crc32 = 0;
+    packet->data = out + header_size;
+    packet->data_size = frame_size - header_size;
+
+    return packet->data;
+}
+
+size_t packet_encoder_finish(struct packet_encoder_t *encoder, uint8_t *out, struct packet_t *packet) {
+    assert(encoder != NULL);
+    assert(out != NULL);
+    assert(packet != NULL);
+    assert(packet->number == encoder->number);
+
+    packet->crc32 = packet_checksum(packet);
+
+    size_t header_size = packet_encoder_put_header(encoder, packet, out);
+    assert(out + header_size == packet->data);
+
+    encoder->number++;
+    encoder->frames++;
+    encoder->bytes += header_size + packet->data_size;
+
+    return header_size + packet->data_size;
+}
@@ -0,0 +1,126 @@
+#ifndef _PACKET_STREAM_H_
+#define _PACKET_STREAM_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "packet.h"
+
+#define PACKET_DECODER_MISSES_MAX 3 /* bad frames in a row: frame ends are lost, hunt */
+
+/* One frame out of the byte stream */
+struct packet_decoder_event_t {
+    struct packet_t packet;   /* fields of the header, data points into decoder buffer */
+    const uint8_t *frame;
+    size_t   size;            /* frame bytes, header included */
+    uint64_t offset;          /* stream offset of the frame start */
+    uint32_t crc;             /* checksum of data received */
+    uint8_t  crc_ok;          /* header valid and crc32 matches */
+};
+
+/* Called for every frame, event and the data it points to are valid until it returns */
+typedef void (*packet_decoder_cb_t)(void *ctx, const struct packet_decoder_event_t *event);
+
+/*
+ * Incremental packet decoder
+ *
+ * Takes the byte stream in chunks of any size, as they come from a
+ * read() or a receive callback of another event loop, and calls back
+ * once per frame. It never blocks and never allocates: frames are
+ * collected in a buffer of the caller, which is the longest frame
+ * taken. Frames of either header format are cut by the size from
+ * their first PACKET_FRAME_PREFIX bytes.
+ *
+ * A stream starts hunting: a frame is taken only when its checksum
+ * matches, trying every byte a header may start from. Once aligned,
+ * every frame is passed on, bad ones with crc_ok clear. A header not
+ * valid, or PACKET_DECODER_MISSES_MAX bad frames in a row, mean frame
+ * ends are lost and the decoder hunts again. With fixed_size set all
+ * frames are of that size: a damaged header does not lose alignment,
+ * the frame is passed on as bad, as a reader of fixed frames would.
+ */
+struct packet_decoder_t {
+    uint8_t *buf;
+    size_t   buf_size;
+    size_t   have;            /* bytes in buf */
+    size_t   frame;           /* size of frame at buf start, 0 - not known yet */
+    size_t   fixed_size;      /* 0 - frame sizes from headers */
+    uint64_t offset;          /* stream offset of buf start */
+    uint8_t  hunting;         /* frame ends not known */
+    unsigned misses;          /* bad frames in a row */
+
+    packet_decoder_cb_t on_packet;
+    void    *ctx;
+
+    /* statistics */
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t crc_errors;      /* frames passed on with crc_ok clear */
+    uint64_t resyncs;         /* alignment lost */
+    uint64_t skipped;         /* bytes not in any frame */
+};
+
+/*
+ * Decode into buf of buf_size bytes, owned by the caller; fixed_size
+ * 0 or frame size of every packet, at most buf_size. Returns 0 or -1
+ * if buf cannot hold a frame prefix or fixed_size.
+ */
+int packet_decoder_init(struct packet_decoder_t *decoder, uint8_t *buf, size_t buf_size, size_t fixed_size,
+                        packet_decoder_cb_t on_packet, void *ctx);
+
+/* Take count bytes of the stream, returns frames passed on */
+size_t packet_decoder_feed(struct packet_decoder_t *decoder, const uint8_t *in, size_t count);
+
+/*
+ * Zero copy feed: read straight into the decoder buffer. Returns where
+ * the next bytes go, *size - bytes that complete the frame in progress,
+ * never 0. packet_decoder_commit() takes up to that many of them.
+ */
+uint8_t* packet_decoder_space(struct packet_decoder_t *decoder, size_t *size);
+size_t   packet_decoder_commit(struct packet_decoder_t *decoder, size_t count);
+
+/* Stream broke off, e.g. device reopened: partial frame is dropped, offsets start from 0, hunt */
+void packet_decoder_restart(struct packet_decoder_t *decoder);
+
+/* Bytes of a frame in progress */
+static inline size_t packet_decoder_pending(const struct packet_decoder_t *decoder) {
+    return decoder->have;
+}
+
+void packet_decoder_print_stats(const struct packet_decoder_t *decoder);
+
+/*
+ * Packet encoder
+ *
+ * Counterpart of the decoder: numbers packets and writes whole frames
+ * into buffers of the caller, in one step from data or in two around
+ * data the caller generates in place.
+ */
+struct packet_encoder_t {
+    uint32_t number;          /* of next packet */
+    uint16_t channel;
+    uint8_t  format;          /* PACKET_FORMAT_* */
+    uint8_t  crc_type;        /* CHECKSUM_* */
+
+    /* statistics */
+    uint64_t frames;
+    uint64_t bytes;
+};
+
+void packet_encoder_init(struct packet_encoder_t *encoder, uint8_t format, uint8_t crc_type, uint16_t channel);
+
+/* Frame of size bytes of data into out, returns frame bytes or 0 - out_size too small */
+size_t packet_encoder_encode(struct packet_encoder_t *encoder, const uint8_t *data, size_t size,
+                             uint8_t *out, size_t out_size);
+
+/*
+ * Start next frame of exactly frame_size bytes in out: packet gets its
+ * fields, returns the data area of packet->data_size bytes in out for
+ * the caller to fill, NULL - no such frame, see packet_frame_header_size()
+ */
+uint8_t* packet_encoder_begin(struct packet_encoder_t *encoder, uint8_t *out, size_t frame_size,
+                              struct packet_t *packet);
+/* Checksum data and write the header of the frame begun in out, returns frame bytes */
+size_t   packet_encoder_finish(struct packet_encoder_t *encoder, uint8_t *out, struct packet_t *packet);
+
+#endif /* _PACKET_STREAM_H_ */
@@ -0,0 +1,116 @@
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "queue_monitor.h"
+#include "async_log.h"
+#include "utils.h"
+
+void queue_monitor_init(struct queue_monitor_t *monitor, struct uart_t *uart,
+                        uint8_t direction, uint32_t target) {
+    assert(monitor != NULL);
+    assert(uart != NULL);
+
+    memset(monitor, 0x00, sizeof(struct queue_monitor_t));
+
+    monitor->uart = uart;
+    monitor->direction = direction;
+    monitor->target = target;
+    monitor->char_ns = uart_char_time_ns(uart);
+    monitor->interval_ms = QUEUE_MONITOR_INTERVAL_MS;
+
+    histogram_init(&monitor->depth);
+
+    clock_gettime(CLOCK_MONOTONIC, &monitor->start_ts);
+    monitor->interval_ts = monitor->start_ts;
+}
+
+static void queue_monitor_interval(struct queue_monitor_t *monitor) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if(timespec_to_ms(timespec_diff(monitor->interval_ts, now)) < monitor->interval_ms) {
+        return;
+    }
+
+    const char *fmt = (monitor->direction == QUEUE_MONITOR_TX) ?
+        "TX queue: t=%" PRIu64 " ms avg %" PRIu64 " max %" PRIu64 " bytes (%" PRIu64 " samples)\n" :
+        "RX queue: t=%" PRIu64 " ms avg %" PRIu64 " max %" PRIu64 " bytes (%" PRIu64 " samples)\n";
+
+    alog4(ALOG_INFO, fmt, timespec_to_ms(timespec_diff(monitor->start_ts, now)),
+          monitor->interval_sum / monitor->interval_samples,
+          monitor->interval_max, monitor->interval_samples);
+
+    monitor->interval_ts = now;
+    monitor->interval_sum = 0;
+    monitor->interval_samples = 0;
+    monitor->interval_max = 0;
+}
+
+int queue_monitor_sample(struct queue_monitor_t *monitor) {
+    /* Device does not report queue depth, do not retry */
+    if(monitor->failed) {
+        return -1;
+    }
+
+    int bytes = (monitor->direction == QUEUE_MONITOR_TX) ?
+                uart_get_outq(monitor->uart) : uart_get_inq(monitor->uart);
+
+    if(bytes < 0) {
+        monitor->failed = 1;
+        return -1;
+    }
+
+    histogram_add(&monitor->depth, bytes);
+
+    monitor->interval_sum += bytes;
+    monitor->interval_samples++;
+    if((uint32_t)bytes > monitor->interval_max)
+        monitor->interval_max = bytes;
+
+    queue_monitor_interval(monitor);
+
+    return bytes;
+}
+
+void queue_monitor_wait(struct queue_monitor_t *monitor) {
+    assert(monitor->direction == QUEUE_MONITOR_TX);
+
+    /* Writes queued in io_uring are not in kernel TX queue yet; waiting for the wire would leave nothing to pace */
+    (void)uart_submit(monitor->uart);
+
+    while(1) {
+        int bytes = queue_monitor_sample(monitor);
+        if(bytes < 0 || monitor->target == 0 || (uint32_t)bytes <= monitor->target) {
+            return;
+        }
+
+        /* Sleep while excess bytes go out on the wire */
+        uint64_t wait_ns = (bytes - monitor->target) * monitor->char_ns;
+        if(wait_ns < QUEUE_MONITOR_MIN_WAIT_NS)
+            wait_ns = QUEUE_MONITOR_MIN_WAIT_NS;
+
+        struct timespec wait = { wait_ns / 1000000000ULL, wait_ns % 1000000000ULL };
+        nanosleep(&wait, NULL);
+
+        monitor->waits++;
+        monitor->wait_ns += wait_ns;
+    }
+}
+
+void queue_monitor_print_stats(struct queue_monitor_t *monitor) {
+    assert(monitor != NULL);
+
+    printf("%s queue depth:\n", (monitor->direction == QUEUE_MONITOR_TX ? "TX" : "RX"));
+    if(monitor->direction == QUEUE_MONITOR_TX) {
+        printf("\tTarget:           %u bytes (%.1f ms)\n", monitor->target,
+               monitor->target * monitor->char_ns / 1.0e6);
+        printf("\tPacing waits:     %" PRIu64 " (%.3f ms)\n", monitor->waits, monitor->wait_ns / 1.0e6);
+    }
+    histogram_print(&monitor->depth, "Depth:", "bytes", 1.0);
+    printf("\tMean depth:       %.1f bytes (%.1f ms queueing delay)\n", histogram_mean(&monitor->depth),
+           histogram_mean(&monitor->depth) * monitor->char_ns / 1.0e6);
+    if(monitor->failed) {
+        printf("\tSampling failed, depth is not available\n");
+    }
+}
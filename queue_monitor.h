@@ -0,0 +1,62 @@
+#ifndef _QUEUE_MONITOR_H_
+#define _QUEUE_MONITOR_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "uart.h"
+#include "histogram.h"
+
+#define QUEUE_MONITOR_TX 0 /* kernel output queue, TIOCOUTQ */
+#define QUEUE_MONITOR_RX 1 /* kernel input queue, TIOCINQ */
+
+#define QUEUE_MONITOR_INTERVAL_MS 1000
+
+/* Shortest pacing sleep, shorter waits are not worth a timer */
+#define QUEUE_MONITOR_MIN_WAIT_NS 50000
+
+/*
+ * Kernel queue depth monitor and TX pacing
+ *
+ * Samples bytes waiting in the kernel queue of the UART. On the send
+ * side queue_monitor_wait() holds the next write until the output
+ * queue drained down to target bytes, so the line stays busy while
+ * the queueing delay of a new packet is bounded by target characters.
+ * Depth histogram covers the whole run, every interval_ms a line
+ * with interval average and maximum is logged.
+ */
+struct queue_monitor_t {
+    struct uart_t *uart;
+    uint8_t  direction;  /* QUEUE_MONITOR_TX, QUEUE_MONITOR_RX */
+    uint32_t target;     /* TX only: max queued bytes before write, 0 - monitor only */
+    uint64_t char_ns;
+
+    struct histogram_t depth;
+
+    /* current interval */
+    struct timespec start_ts;
+    struct timespec interval_ts;
+    uint32_t interval_ms;
+    uint64_t interval_sum;
+    uint64_t interval_samples;
+    uint32_t interval_max;
+
+    /* statistics */
+    uint64_t waits;
+    uint64_t wait_ns;
+    uint8_t  failed;  /* device does not report queue depth */
+};
+
+void queue_monitor_init(struct queue_monitor_t *monitor, struct uart_t *uart,
+                        uint8_t direction, uint32_t target);
+
+/* Sample queue depth, returns bytes queued or -1 */
+int queue_monitor_sample(struct queue_monitor_t *monitor);
+
+/* TX: sleep until output queue holds no more than target bytes */
+void queue_monitor_wait(struct queue_monitor_t *monitor);
+
+void queue_monitor_print_stats(struct queue_monitor_t *monitor);
+
+#endif /* _QUEUE_MONITOR_H_ */
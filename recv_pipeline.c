@@ -0,0 +1,162 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <signal.h>
+#include <time.h>
+
+#include "recv_pipeline.h"
+#include "utils.h"
+
+#define N_ERR "RECV_PIPELINE ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define IO_WAIT_NSEC     20000
+#define WORKER_WAIT_NSEC 20000
+
+static void* recv_pipeline_io(void *arg) {
+    struct recv_pipeline_t *pipeline = (struct recv_pipeline_t*)arg;
+    struct timespec wait = { 0, IO_WAIT_NSEC };
+    int stalled = 0;
+
+    while(!__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE)) {
+        struct recv_chunk_t *chunk = (struct recv_chunk_t*)spsc_ring_write_slot(&pipeline->ring);
+        if(chunk == NULL) {
+            if(!stalled)
+                pipeline->io_stalls++;
+            stalled = 1;
+            nanosleep(&wait, NULL);
+            continue;
+        }
+        stalled = 0;
+
+        int ret = uart_poll(pipeline->uart, RECV_PIPELINE_POLL_MSEC);
+        if(ret < 0) {
+            break;
+        }
+        if(ret == 0) {
+            continue;
+        }
+
+        ssize_t bytes = uart_read_some(pipeline->uart, chunk->data, pipeline->chunk_size);
+        if(bytes < 0) {
+            break;
+        }
+        if(bytes == 0) {
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &chunk->ts);
+        chunk->size = bytes;
+
+        spsc_ring_commit(&pipeline->ring, sizeof(struct recv_chunk_t) + bytes);
+
+        pipeline->chunks++;
+        pipeline->bytes += bytes;
+    }
+
+    __atomic_store_n(&pipeline->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+int recv_pipeline_start(struct recv_pipeline_t *pipeline, struct uart_t *uart,
+                        uint32_t slots, size_t chunk_size) {
+    assert(pipeline != NULL);
+    assert(uart != NULL);
+    assert(chunk_size > 0);
+
+    memset(pipeline, 0x00, sizeof(struct recv_pipeline_t));
+
+    pipeline->uart = uart;
+    pipeline->chunk_size = chunk_size;
+
+    /* Keep chunk headers aligned */
+    size_t slot_size = (sizeof(struct recv_chunk_t) + chunk_size + 7) & ~(size_t)7;
+
+    if(spsc_ring_init(&pipeline->ring, slots, slot_size) != 0) {
+        return -1;
+    }
+
+    /* I/O thread inherits blocked SIGINT */
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+
+    int ret = pthread_create(&pipeline->thread, NULL, recv_pipeline_io, pipeline);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if(ret != 0) {
+        errprintf("pthread_create() failed\n");
+        spsc_ring_free(&pipeline->ring);
+        return -1;
+    }
+
+    return 0;
+}
+
+void recv_pipeline_stop(struct recv_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    __atomic_store_n(&pipeline->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(pipeline->thread, NULL);
+
+    spsc_ring_free(&pipeline->ring);
+}
+
+const struct recv_chunk_t* recv_pipeline_next(struct recv_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    const struct recv_chunk_t *chunk =
+        (const struct recv_chunk_t*)spsc_ring_read_slot(&pipeline->ring, NULL);
+
+    if(chunk != NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+        uint64_t delay = timespec_to_ns(timespec_diff(chunk->ts, now));
+        if(delay > pipeline->max_delay_ns)
+            pipeline->max_delay_ns = delay;
+    }
+
+    return chunk;
+}
+
+void recv_pipeline_release(struct recv_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    spsc_ring_release(&pipeline->ring);
+}
+
+void recv_pipeline_wait(struct recv_pipeline_t *pipeline) {
+    struct timespec wait = { 0, WORKER_WAIT_NSEC };
+
+    assert(pipeline != NULL);
+
+    pipeline->worker_idle++;
+    nanosleep(&wait, NULL);
+}
+
+int recv_pipeline_done(struct recv_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    return __atomic_load_n(&pipeline->done, __ATOMIC_ACQUIRE) &&
+           spsc_ring_count(&pipeline->ring) == 0;
+}
+
+void recv_pipeline_print_stats(struct recv_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    printf("Receive pipeline:\n");
+    printf("\tRing slots:       %u x %lu bytes\n", pipeline->ring.slots, pipeline->chunk_size);
+    printf("\tChunks read:      %" PRIu64 " (avg %.1f bytes)\n", pipeline->chunks,
+           pipeline->chunks ? (double)pipeline->bytes / pipeline->chunks : 0.0);
+    printf("\tRing high water:  %u\n", pipeline->ring.high_water);
+    printf("\tI/O stalls:       %" PRIu64 " (ring full)\n", pipeline->io_stalls);
+    printf("\tWorker idle:      %" PRIu64 "\n", pipeline->worker_idle);
+    printf("\tMax ring delay:   %" PRIu64 " us\n", pipeline->max_delay_ns / 1000);
+}
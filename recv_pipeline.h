@@ -0,0 +1,63 @@
+#ifndef _RECV_PIPELINE_H_
+#define _RECV_PIPELINE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "spsc_ring.h"
+#include "uart.h"
+
+/* Poll timeout of I/O thread to notice stop request */
+#define RECV_PIPELINE_POLL_MSEC 100
+
+/* Chunk of data read by one read() call */
+struct recv_chunk_t {
+    struct timespec ts; /* CLOCK_MONOTONIC_RAW after read() returned */
+    size_t size;
+    uint8_t data[];
+};
+
+/*
+ * Receive pipeline
+ *
+ * Dedicated I/O thread only drains the fd into a lock-free ring of chunks
+ * and timestamps each chunk, the caller (worker) decodes and verifies.
+ * SIGINT is blocked in I/O thread, so it is delivered to the worker.
+ */
+struct recv_pipeline_t {
+    struct spsc_ring_t ring;
+    pthread_t thread;
+    struct uart_t *uart;
+
+    size_t chunk_size;
+
+    int stop;  /* set by worker */
+    int done;  /* set by I/O thread on error */
+
+    /* I/O thread statistics */
+    uint64_t chunks;
+    uint64_t bytes;
+    uint64_t io_stalls;   /* ring full: decode stage fell behind */
+
+    /* worker statistics */
+    uint64_t worker_idle; /* ring empty */
+    uint64_t max_delay_ns; /* max time chunk waited in ring */
+};
+
+int recv_pipeline_start(struct recv_pipeline_t *pipeline, struct uart_t *uart,
+                        uint32_t slots, size_t chunk_size);
+void recv_pipeline_stop(struct recv_pipeline_t *pipeline);
+
+/* Oldest chunk or NULL if ring is empty (non-blocking) */
+const struct recv_chunk_t* recv_pipeline_next(struct recv_pipeline_t *pipeline);
+void recv_pipeline_release(struct recv_pipeline_t *pipeline);
+
+/* Short sleep while ring is empty */
+void recv_pipeline_wait(struct recv_pipeline_t *pipeline);
+int  recv_pipeline_done(struct recv_pipeline_t *pipeline);
+
+void recv_pipeline_print_stats(struct recv_pipeline_t *pipeline);
+
+#endif /* _RECV_PIPELINE_H_ */
@@ -0,0 +1,99 @@
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "rx_timing.h"
+#include "utils.h"
+
+void rx_timing_init(struct rx_timing_t *timing, uint64_t char_ns, uint32_t stall_chars) {
+    assert(timing != NULL);
+
+    memset(timing, 0x00, sizeof(struct rx_timing_t));
+
+    histogram_init(&timing->inter_arrival);
+    histogram_init(&timing->byte_gap);
+
+    timing->char_ns = char_ns;
+    timing->stall_chars = stall_chars;
+}
+
+/* Keep RX_TIMING_WORST_NUM largest gaps sorted from worst */
+static void rx_timing_add_worst(struct rx_timing_t *timing, uint64_t gap_ns, uint32_t number, uint8_t kind) {
+    struct rx_timing_gap_t *worst = timing->worst[kind];
+    int i = RX_TIMING_WORST_NUM - 1;
+
+    if(gap_ns <= worst[i].gap_ns) {
+        return;
+    }
+
+    for(; i > 0 && worst[i - 1].gap_ns < gap_ns; i--) {
+        worst[i] = worst[i - 1];
+    }
+
+    worst[i].gap_ns = gap_ns;
+    worst[i].number = number;
+}
+
+static void rx_timing_print_worst(struct rx_timing_t *timing, uint8_t kind, const char *name) {
+    struct rx_timing_gap_t *worst = timing->worst[kind];
+
+    if(worst[0].gap_ns == 0) {
+        return;
+    }
+
+    printf("\t%s\n", name);
+    for(int i = 0; i < RX_TIMING_WORST_NUM && worst[i].gap_ns != 0; i++) {
+        printf("\t\t#%.8u %12.1f us\n", worst[i].number, worst[i].gap_ns / 1000.0);
+    }
+}
+
+void rx_timing_chunk(struct rx_timing_t *timing, struct timespec ts, size_t bytes, int in_packet) {
+    if(in_packet && timing->chunks != 0) {
+        uint64_t gap = timespec_to_ns(timespec_diff(timing->prev_chunk_ts, ts));
+
+        histogram_add(&timing->byte_gap, gap);
+
+        if(gap > timing->packet_gap_ns)
+            timing->packet_gap_ns = gap;
+
+        /* Chunk needs bytes * char_ns on the wire, anything above is idle line */
+        uint64_t expected = (bytes + timing->stall_chars) * timing->char_ns;
+        if(gap > expected) {
+            timing->stalls++;
+            timing->stall_ns += gap - bytes * timing->char_ns;
+        }
+    }
+
+    timing->prev_chunk_ts = ts;
+    timing->chunks++;
+}
+
+void rx_timing_packet(struct rx_timing_t *timing, struct timespec ts, uint32_t number) {
+    if(timing->packets++ != 0) {
+        uint64_t gap = timespec_to_ns(timespec_diff(timing->prev_packet_ts, ts));
+
+        histogram_add(&timing->inter_arrival, gap);
+        rx_timing_add_worst(timing, gap, number, RX_TIMING_GAP_INTER);
+    }
+
+    if(timing->packet_gap_ns != 0) {
+        rx_timing_add_worst(timing, timing->packet_gap_ns, number, RX_TIMING_GAP_INTRA);
+        timing->packet_gap_ns = 0;
+    }
+
+    timing->prev_packet_ts = ts;
+}
+
+void rx_timing_print_stats(struct rx_timing_t *timing) {
+    assert(timing != NULL);
+
+    printf("Receive timing:\n");
+    printf("\tChar time:        %.1f us\n", timing->char_ns / 1000.0);
+    histogram_print(&timing->inter_arrival, "Inter-arrival:", "us", 1000.0);
+    histogram_print(&timing->byte_gap, "Byte gaps:", "us", 1000.0);
+    printf("\tSender stalls:    %" PRIu64 " (gap > %u chars above wire time), %.3f ms idle\n",
+           timing->stalls, timing->stall_chars, timing->stall_ns / 1.0e6);
+
+    rx_timing_print_worst(timing, RX_TIMING_GAP_INTRA, "Worst gaps inside packet:");
+    rx_timing_print_worst(timing, RX_TIMING_GAP_INTER, "Worst inter-arrival:");
+}
@@ -0,0 +1,65 @@
+#ifndef _RX_TIMING_H_
+#define _RX_TIMING_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "histogram.h"
+
+#define RX_TIMING_CLOCK CLOCK_MONOTONIC_RAW
+
+#define RX_TIMING_WORST_NUM          8
+#define RX_TIMING_DEFAULT_STALL_CHARS 16
+
+#define RX_TIMING_GAP_INTER 0 /* between completed packets */
+#define RX_TIMING_GAP_INTRA 1 /* between chunks of one packet */
+
+struct rx_timing_gap_t {
+    uint64_t gap_ns;
+    uint32_t number;  /* packet number */
+};
+
+/*
+ * Receive side timing
+ *
+ * Every read chunk and every completed packet is stamped with
+ * RX_TIMING_CLOCK. Gaps between chunks of one packet mean the sender
+ * paused mid-packet (FIFO underrun, USB polling), they are reported
+ * as stalls when they exceed the time the chunk needed on the wire
+ * by more than stall_chars character times.
+ */
+struct rx_timing_t {
+    uint64_t char_ns;     /* one character on the wire at configured speed */
+    uint32_t stall_chars;
+
+    struct histogram_t inter_arrival; /* completed packet to completed packet */
+    struct histogram_t byte_gap;      /* chunk to chunk inside a packet */
+
+    struct timespec prev_chunk_ts;
+    struct timespec prev_packet_ts;
+    uint64_t chunks;
+    uint64_t packets;
+    uint64_t packet_gap_ns;           /* worst intra gap of current packet */
+
+    uint64_t stalls;
+    uint64_t stall_ns;
+
+    /* worst gaps by RX_TIMING_GAP_* kind */
+    struct rx_timing_gap_t worst[2][RX_TIMING_WORST_NUM];
+};
+
+void rx_timing_init(struct rx_timing_t *timing, uint64_t char_ns, uint32_t stall_chars);
+
+static inline void rx_timing_now(struct timespec *ts) {
+    clock_gettime(RX_TIMING_CLOCK, ts);
+}
+
+/* Chunk of bytes read at ts, in_packet - chunk continues a started packet */
+void rx_timing_chunk(struct rx_timing_t *timing, struct timespec ts, size_t bytes, int in_packet);
+/* Packet completed by chunk read at ts */
+void rx_timing_packet(struct rx_timing_t *timing, struct timespec ts, uint32_t number);
+
+void rx_timing_print_stats(struct rx_timing_t *timing);
+
+#endif /* _RX_TIMING_H_ */
@@ -0,0 +1,257 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "scenario.h"
+#include "uart.h"
+#include "uart_options.h"
+
+#define N_ERR "SCENARIO ERROR: "
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+static int scenario_parse_uint(const char *value, uint32_t *result) {
+    char *end = NULL;
+
+    errno = 0;
+    unsigned long number = strtoul(value, &end, 0);
+    if(errno != 0 || end == value || *end != '\0' || number > UINT32_MAX) {
+        return -1;
+    }
+
+    *result = number;
+    return 0;
+}
+
+static int scenario_parse_item(char *item, struct scenario_step_t *step) {
+    char *value = strchr(item, '=');
+    if(value == NULL || value[1] == '\0') {
+        return -1;
+    }
+    *value++ = '\0';
+
+    if(strcmp(item, "speed") == 0) {
+        return scenario_parse_uint(value, &step->speed);
+    } else if(strcmp(item, "framing") == 0) {
+        return uart_parse_framing(value, &step->bits, &step->parity, &step->stop_bits);
+    } else if(strcmp(item, "length") == 0) {
+        if(scenario_parse_uint(value, &step->packet_length) != 0 || step->packet_length < PACKET_HEADER_SIZE)
+            return -1;
+        return 0;
+    } else if(strcmp(item, "count") == 0) {
+        return scenario_parse_uint(value, &step->packets_num);
+    } else if(strcmp(item, "duration") == 0) {
+        return scenario_parse_uint(value, &step->duration_ms);
+    } else if(strcmp(item, "delay") == 0) {
+        return scenario_parse_uint(value, &step->delay_ms);
+    } else if(strcmp(item, "pattern") == 0) {
+        int pattern = packet_pattern_from_name(value);
+        if(pattern < 0)
+            return -1;
+        step->pattern = pattern;
+        return 0;
+    } else if(strcmp(item, "direction") == 0) {
+        if(strcmp(value, "forward") == 0) {
+            step->direction = SCENARIO_FORWARD;
+        } else if(strcmp(value, "reverse") == 0) {
+            step->direction = SCENARIO_REVERSE;
+        } else {
+            return -1;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+int scenario_load(const char *path, const struct scenario_step_t *defaults, struct scenario_t *scenario) {
+    assert(path != NULL);
+    assert(defaults != NULL);
+    assert(scenario != NULL);
+
+    memset(scenario, 0x00, sizeof(struct scenario_t));
+
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        strerr("fopen(%s) failed", path);
+        return -1;
+    }
+
+    struct scenario_step_t step = *defaults;
+    uint32_t capacity = 0;
+    uint32_t line_number = 0;
+    char line[512];
+
+    while(fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if(comment != NULL)
+            *comment = '\0';
+
+        char *save = NULL;
+        char *item = strtok_r(line, " \t\r\n", &save);
+        if(item == NULL)
+            continue;
+
+        for(; item != NULL; item = strtok_r(NULL, " \t\r\n", &save)) {
+            char copy[strlen(item) + 1];
+            strcpy(copy, item);
+
+            if(scenario_parse_item(item, &step) != 0) {
+                printf("%s:%u: wrong step parameter '%s'\n", path, line_number, copy);
+                goto error;
+            }
+        }
+
+        if(step.packets_num == 0 && step.duration_ms == 0) {
+            printf("%s:%u: step needs count or duration\n", path, line_number);
+            goto error;
+        }
+
+        if(scenario->steps_num == SCENARIO_MAX_STEPS) {
+            printf("%s:%u: too many steps, max is %i\n", path, line_number, SCENARIO_MAX_STEPS);
+            goto error;
+        }
+
+        if(scenario->steps_num == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+
+            struct scenario_step_t *steps = realloc(scenario->steps, capacity * sizeof(struct scenario_step_t));
+            if(steps == NULL) {
+                printf("scenario_load: realloc() failed\n");
+                goto error;
+            }
+            scenario->steps = steps;
+        }
+
+        step.line = line_number;
+        scenario->steps[scenario->steps_num++] = step;
+    }
+
+    fclose(file);
+
+    if(scenario->steps_num == 0) {
+        printf("%s: no steps\n", path);
+        scenario_free(scenario);
+        return -1;
+    }
+
+    return 0;
+
+error:
+    fclose(file);
+    scenario_free(scenario);
+    return -1;
+}
+
+void scenario_free(struct scenario_t *scenario) {
+    assert(scenario != NULL);
+
+    free(scenario->steps);
+    scenario->steps = NULL;
+    scenario->steps_num = 0;
+}
+
+int scenario_line_changed(const struct scenario_step_t *a, const struct scenario_step_t *b) {
+    assert(a != NULL);
+    assert(b != NULL);
+
+    return a->speed != b->speed || a->bits != b->bits || a->parity != b->parity ||
+           a->stop_bits != b->stop_bits;
+}
+
+int scenario_step_passed(const struct scenario_result_t *result) {
+    assert(result != NULL);
+
+    return result->completed && result->sent == result->received &&
+           result->crc_errors == 0 && result->framing == 0;
+}
+
+void scenario_print_result(struct scenario_t *scenario, uint32_t index, uint8_t sending,
+                           const struct scenario_result_t *result) {
+    assert(scenario != NULL);
+    assert(index < scenario->steps_num);
+    assert(result != NULL);
+
+    const struct scenario_step_t *step = &scenario->steps[index];
+    static const char parity[] = { 'N', 'O', 'E' };
+
+    printf("Step %u/%u (line %u): %u %u%c%u, %u B x %u%s, %s, %s: ", index + 1, scenario->steps_num,
+           step->line, step->speed, step->bits, parity[step->parity % 3], step->stop_bits,
+           step->packet_length, step->packets_num, (step->duration_ms ? " or duration" : ""),
+           packet_pattern_name(step->pattern), (sending ? "send" : "receive"));
+
+    if(!result->completed) {
+        printf("no answer from peer FAIL\n");
+        return;
+    }
+
+    double seconds = result->elapsed_ns / 1e9;
+
+    printf("%" PRIu64 " sent, %" PRIu64 " received, %" PRIu64 " crc errors, %" PRIu64 " framing, "
+           "%.3f s, %.0f B/s %s\n", result->sent, result->received, result->crc_errors, result->framing,
+           seconds, (seconds > 0 ? result->bytes / seconds : 0.0),
+           (scenario_step_passed(result) ? "PASS" : "FAIL"));
+}
+
+void scenario_print_summary(struct scenario_t *scenario) {
+    assert(scenario != NULL);
+
+    printf("Scenario completed:\n");
+    printf("\tSteps:            %u (%u passed, %u failed)\n", scenario->steps_num, scenario->passed,
+           scenario->failed);
+    printf("\tReconfigurations: %u\n", scenario->reconfigs);
+    printf("\tData time:        %.3f s\n", scenario->data_ns / 1e9);
+    printf("\tControl time:     %.3f s (handshakes, reconfiguration)\n", scenario->control_ns / 1e9);
+}
+
+struct packet_t scenario_control_packet(const struct scenario_control_t *control, uint32_t number) {
+    struct packet_t packet;
+
+    assert(control != NULL);
+
+    packet.number    = number;
+    packet.channel   = SCENARIO_CONTROL_CHANNEL;
+    packet.crc_type  = packet_get_checksum();
+    packet.data_size = SCENARIO_CONTROL_SIZE;
+    packet.data      = (uint8_t*)malloc(packet.data_size);
+
+    if(packet.data == NULL) {
+        printf("scenario_control_packet: malloc() failed\n");
+        exit(1);
+    }
+
+    packet_put_le32(packet.data, control->type);
+    packet_put_le32(packet.data + 4, control->step);
+    packet_put_le64(packet.data + 8, control->packets);
+    packet_put_le64(packet.data + 16, control->crc_errors);
+    packet_put_le64(packet.data + 24, control->framing);
+    packet_put_le64(packet.data + 32, control->bytes);
+    packet.crc32 = packet_checksum(&packet);
+
+    return packet;
+}
+
+int scenario_control_from_packet(const struct packet_t *packet, struct scenario_control_t *control) {
+    assert(packet != NULL);
+    assert(control != NULL);
+
+    if(packet->channel != SCENARIO_CONTROL_CHANNEL ||
+       packet->data_size != SCENARIO_CONTROL_SIZE ||
+       packet->crc32 != packet_checksum(packet)) {
+        return -1;
+    }
+
+    control->type       = packet_get_le32(packet->data);
+    control->step       = packet_get_le32(packet->data + 4);
+    control->packets    = packet_get_le64(packet->data + 8);
+    control->crc_errors = packet_get_le64(packet->data + 16);
+    control->framing    = packet_get_le64(packet->data + 24);
+    control->bytes      = packet_get_le64(packet->data + 32);
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef _SCENARIO_H_
+#define _SCENARIO_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "packet.h"
+
+/* Step control packets travel on reserved channel */
+#define SCENARIO_CONTROL_CHANNEL 0xfffe
+
+#define SCENARIO_MAX_STEPS 4096
+
+#define SCENARIO_FORWARD 0 /* side started without -R sends */
+#define SCENARIO_REVERSE 1 /* side started with -R sends */
+
+/* Control messages */
+#define SCENARIO_READY  1 /* sender: step configured, waiting to start */
+#define SCENARIO_ACK    2 /* receiver: step configured, start */
+#define SCENARIO_DONE   3 /* sender: all packets sent */
+#define SCENARIO_RESULT 4 /* receiver: step counters */
+
+#define SCENARIO_RETRY_MS 200 /* control message resend interval */
+#define SCENARIO_RETRIES  25  /* peer silent this many intervals: step failed */
+#define SCENARIO_IDLE_MS  50  /* idle line after garbage */
+
+/* Parameters not given on a line are kept from previous step */
+struct scenario_step_t {
+    uint32_t line;
+    uint32_t speed;
+    uint8_t  bits;
+    uint8_t  parity;
+    uint8_t  stop_bits;
+    uint32_t packet_length;
+    uint32_t packets_num;  /* 0 - send for duration_ms */
+    uint32_t duration_ms;  /* 0 - send packets_num */
+    uint32_t delay_ms;     /* between packets */
+    uint8_t  pattern;      /* PACKET_PATTERN_* */
+    uint8_t  direction;    /* SCENARIO_FORWARD, SCENARIO_REVERSE */
+};
+
+/*
+ * Data of control packet: SCENARIO_CONTROL_SIZE bytes, fields in this
+ * order, little-endian like the packet header
+ */
+#define SCENARIO_CONTROL_SIZE 40
+
+struct scenario_control_t {
+    uint32_t type;       /* SCENARIO_READY ... SCENARIO_RESULT */
+    uint32_t step;
+    uint64_t packets;    /* DONE: sent, RESULT: received */
+    uint64_t crc_errors; /* RESULT */
+    uint64_t framing;    /* RESULT: garbage skipped */
+    uint64_t bytes;      /* RESULT: data bytes of good packets */
+};
+
+struct scenario_result_t {
+    uint8_t  completed;  /* peer answered, counters are valid */
+    uint64_t sent;
+    uint64_t received;
+    uint64_t crc_errors;
+    uint64_t framing;
+    uint64_t bytes;
+    uint64_t elapsed_ns; /* data phase */
+};
+
+/*
+ * Scenario: list of test steps run in one process on one open port
+ *
+ * Text file, one step per line of key=value pairs, '#' starts a comment:
+ *   speed=115200 framing=8N1 length=64 count=100 pattern=counter direction=forward
+ *   speed=230400 length=256 duration=2000 direction=reverse delay=1
+ * Keys: speed, framing (bits, parity N/O/E, stop bits), length, count,
+ * duration (ms), delay (ms), pattern (see packet.h), direction.
+ * The first step starts from command line options.
+ *
+ * Both ends load the same file. Every step starts with READY/ACK from
+ * sender to receiver at the step settings and ends with DONE/RESULT,
+ * so counters of the step are known on both sides before the line is
+ * reconfigured for the next one.
+ */
+struct scenario_t {
+    struct scenario_step_t *steps;
+    uint32_t steps_num;
+
+    /* statistics */
+    uint32_t passed;
+    uint32_t failed;
+    uint32_t reconfigs;
+    uint64_t control_ns;  /* handshakes and reconfiguration */
+    uint64_t data_ns;
+};
+
+/* Load steps, defaults are applied to first step */
+int  scenario_load(const char *path, const struct scenario_step_t *defaults, struct scenario_t *scenario);
+void scenario_free(struct scenario_t *scenario);
+
+/* Step settings that need a line reconfiguration */
+int scenario_line_changed(const struct scenario_step_t *a, const struct scenario_step_t *b);
+
+int  scenario_step_passed(const struct scenario_result_t *result);
+void scenario_print_result(struct scenario_t *scenario, uint32_t index, uint8_t sending,
+                           const struct scenario_result_t *result);
+void scenario_print_summary(struct scenario_t *scenario);
+
+/* Control packet serialization */
+struct packet_t scenario_control_packet(const struct scenario_control_t *control, uint32_t number);
+int scenario_control_from_packet(const struct packet_t *packet, struct scenario_control_t *control);
+
+#endif /* _SCENARIO_H_ */
@@ -0,0 +1,150 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sched.h>
+#include <time.h>
+
+#include "send_pipeline.h"
+#include "packet.h"
+
+#define N_ERR "SEND_PIPELINE ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+/* Producer sleep while ring is full: writer is blocked in write() anyway */
+#define PRODUCER_WAIT_NSEC 50000
+
+static void* send_pipeline_producer(void *arg) {
+    struct send_pipeline_t *pipeline = (struct send_pipeline_t*)arg;
+    struct timespec wait = { 0, PRODUCER_WAIT_NSEC };
+
+    /* packets_num 0 - until stopped */
+    for(uint32_t i = 0; pipeline->packets_num == 0 || i < pipeline->packets_num; i++) {
+        uint8_t *slot;
+
+        while((slot = spsc_ring_write_slot(&pipeline->ring)) == NULL) {
+            if(__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE) || !*pipeline->running)
+                goto exit;
+
+            pipeline->producer_waits++;
+            nanosleep(&wait, NULL);
+        }
+
+        if(__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE))
+            break;
+
+        struct packet_t packet;
+        uint8_t *body = packet_encoder_begin(&pipeline->encoder, slot, pipeline->packet_length, &packet);
+
+        assert(body != NULL);
+        fill_data(body, packet.data_size);
+
+        size_t size = packet_encoder_finish(&pipeline->encoder, slot, &packet);
+        assert(size == pipeline->packet_length);
+
+        show_packet_info(&packet);
+
+        spsc_ring_commit(&pipeline->ring, size);
+    }
+
+exit:
+    __atomic_store_n(&pipeline->done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+int send_pipeline_start(struct send_pipeline_t *pipeline, uint32_t packet_length,
+                        uint32_t packets_num, uint32_t depth, uint8_t pregenerate, volatile uint8_t *running) {
+    assert(pipeline != NULL);
+    assert(running != NULL);
+    assert(!pregenerate || packets_num > 0);
+
+    memset(pipeline, 0x00, sizeof(struct send_pipeline_t));
+
+    pipeline->packet_length = packet_length;
+    pipeline->packets_num = packets_num;
+    pipeline->pregenerate = pregenerate;
+    pipeline->running = running;
+
+    packet_encoder_init(&pipeline->encoder, packet_get_format(), packet_get_checksum(), 0);
+
+    if(pregenerate) {
+        depth = packets_num;
+    }
+
+    if(depth == 0) {
+        depth = 1;
+    }
+
+    if(spsc_ring_init(&pipeline->ring, depth, packet_length) != 0) {
+        return -1;
+    }
+
+    if(pthread_create(&pipeline->thread, NULL, send_pipeline_producer, pipeline) != 0) {
+        errprintf("pthread_create() failed\n");
+        spsc_ring_free(&pipeline->ring);
+        return -1;
+    }
+
+    if(pregenerate) {
+        pthread_join(pipeline->thread, NULL);
+        printf("Pregenerated %u packets: %lu bytes\n", packets_num, (size_t)packets_num * packet_length);
+    }
+
+    return 0;
+}
+
+void send_pipeline_stop(struct send_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    __atomic_store_n(&pipeline->stop, 1, __ATOMIC_RELEASE);
+
+    if(!pipeline->pregenerate) {
+        pthread_join(pipeline->thread, NULL);
+    }
+
+    spsc_ring_free(&pipeline->ring);
+}
+
+const uint8_t* send_pipeline_next(struct send_pipeline_t *pipeline, size_t *size) {
+    assert(pipeline != NULL);
+
+    const uint8_t *slot = spsc_ring_read_slot(&pipeline->ring, size);
+    if(slot != NULL) {
+        return slot;
+    }
+
+    /* Line goes idle: generation does not keep up */
+    pipeline->writer_stalls++;
+
+    while(slot == NULL) {
+        if(__atomic_load_n(&pipeline->done, __ATOMIC_ACQUIRE)) {
+            /* Last packets may be committed just before done flag */
+            return spsc_ring_read_slot(&pipeline->ring, size);
+        }
+
+        sched_yield();
+        slot = spsc_ring_read_slot(&pipeline->ring, size);
+    }
+
+    return slot;
+}
+
+void send_pipeline_release(struct send_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    spsc_ring_release(&pipeline->ring);
+}
+
+void send_pipeline_print_stats(struct send_pipeline_t *pipeline) {
+    assert(pipeline != NULL);
+
+    printf("Send pipeline:\n");
+    printf("\tLookahead:        %u packets%s\n", pipeline->ring.slots,
+           pipeline->pregenerate ? " (pregenerated)" : "");
+    printf("\tRing high water:  %u\n", pipeline->ring.high_water);
+    printf("\tWriter stalls:    %" PRIu64 "\n", pipeline->writer_stalls);
+    printf("\tProducer waits:   %" PRIu64 "\n", pipeline->producer_waits);
+}
@@ -0,0 +1,47 @@
+#ifndef _SEND_PIPELINE_H_
+#define _SEND_PIPELINE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "spsc_ring.h"
+#include "packet_stream.h"
+
+/*
+ * Producer/consumer send pipeline
+ *
+ * Producer thread generates, CRCs and serializes packets ahead of the writer
+ * into a lock-free ring of 'depth' slots, the writer only issues writes.
+ * With 'pregenerate' set the whole run is prepared before the first write.
+ */
+struct send_pipeline_t {
+    struct spsc_ring_t ring;
+    pthread_t thread;
+    struct packet_encoder_t encoder; /* producer only */
+
+    uint32_t packet_length;
+    uint32_t packets_num;   /* 0 - until stopped */
+    uint8_t  pregenerate;
+
+    int stop; /* set by writer */
+    volatile uint8_t *running; /* cleared on stop request, producer gives up waiting */
+    int done; /* set by producer */
+
+    /* statistics */
+    uint64_t writer_stalls;   /* writer found ring empty */
+    uint64_t producer_waits;  /* producer found ring full */
+};
+
+/* pregenerate needs packets_num above 0: the whole run must fit the ring */
+int send_pipeline_start(struct send_pipeline_t *pipeline, uint32_t packet_length,
+                        uint32_t packets_num, uint32_t depth, uint8_t pregenerate, volatile uint8_t *running);
+void send_pipeline_stop(struct send_pipeline_t *pipeline);
+
+/* Next serialized packet, waits for producer - NULL when all packets are consumed */
+const uint8_t* send_pipeline_next(struct send_pipeline_t *pipeline, size_t *size);
+void send_pipeline_release(struct send_pipeline_t *pipeline);
+
+void send_pipeline_print_stats(struct send_pipeline_t *pipeline);
+
+#endif /* _SEND_PIPELINE_H_ */
@@ -0,0 +1,320 @@
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "seq_tracker.h"
+#include "utils.h"
+
+#define SEQ_TRACKER_MASK (SEQ_TRACKER_WINDOW - 1)
+
+void seq_tracker_init(struct seq_tracker_t *tracker) {
+    assert(tracker != NULL);
+
+    memset(tracker, 0x00, sizeof(struct seq_tracker_t));
+}
+
+static inline uint32_t seq_tracker_number(const struct seq_tracker_t *tracker, uint64_t idx) {
+    return tracker->first_number + (uint32_t)(idx - tracker->first_idx);
+}
+
+static double seq_tracker_seconds(const struct seq_tracker_t *tracker, struct timespec ts) {
+    return timespec_to_ns(timespec_diff(tracker->start_ts, ts)) / 1.0e9;
+}
+
+static void seq_tracker_start(struct seq_tracker_t *tracker, uint32_t number, struct timespec ts) {
+    /* Past every index of a previous run, none of them is in the window */
+    uint64_t idx = tracker->highest_idx + SEQ_TRACKER_WINDOW;
+
+    if(tracker->received == 0)
+        tracker->start_ts = ts;
+
+    memset(tracker->window, 0x00, sizeof(tracker->window));
+    tracker->window_missing = 0;
+
+    tracker->first_idx = idx;
+    tracker->first_number = number;
+    tracker->highest_idx = idx;
+    tracker->corrupt_held = 0;
+    tracker->corrupt_dup = 0;
+
+    tracker->window[(idx & SEQ_TRACKER_MASK) / 64] |= 1ULL << (idx % 64);
+    tracker->ts[idx & SEQ_TRACKER_MASK] = ts;
+
+    tracker->received++;
+    tracker->started = 1;
+}
+
+static void seq_tracker_close_gap(struct seq_tracker_t *tracker, struct timespec after_ts) {
+    struct seq_tracker_gap_t gap;
+
+    gap.first = tracker->gap_first;
+    gap.count = tracker->gap_count;
+    gap.before_ts = tracker->last_ts;
+    gap.after_ts = after_ts;
+
+    if(gap.count > tracker->longest.count)
+        tracker->longest = gap;
+
+    tracker->last[tracker->gaps % SEQ_TRACKER_GAPS] = gap;
+    tracker->gaps++;
+    tracker->gap_count = 0;
+}
+
+/* Missing numbers leaving the window or never entering it */
+static void seq_tracker_lose(struct seq_tracker_t *tracker, uint64_t idx, uint64_t count) {
+    if(tracker->gap_count == 0)
+        tracker->gap_first = seq_tracker_number(tracker, idx);
+
+    tracker->gap_count += count;
+    tracker->lost += count;
+}
+
+static void seq_tracker_evict(struct seq_tracker_t *tracker, uint64_t idx) {
+    uint64_t slot = idx & SEQ_TRACKER_MASK;
+    uint64_t *word = &tracker->window[slot / 64];
+    uint64_t bit = 1ULL << (slot % 64);
+
+    if(idx < tracker->first_idx)
+        return;
+
+    if(*word & bit) {
+        *word &= ~bit;
+
+        if(tracker->gap_count != 0)
+            seq_tracker_close_gap(tracker, tracker->ts[slot]);
+        tracker->last_ts = tracker->ts[slot];
+    } else {
+        seq_tracker_lose(tracker, idx, 1);
+        tracker->window_missing--;
+    }
+}
+
+/* Packet of untrusted number for the slot after the ones held, returns 0 - held, -1 - run is full */
+static int seq_tracker_hold(struct seq_tracker_t *tracker, struct timespec ts, int dup) {
+    if(tracker->corrupt_held >= SEQ_TRACKER_SUSPECT_STEP)
+        return -1;
+
+    if(dup)
+        tracker->corrupt_dup |= 1U << tracker->corrupt_held;
+    tracker->corrupt_ts[tracker->corrupt_held++] = ts;
+
+    return 0;
+}
+
+/* First fill held packets took their slots, the others had other numbers */
+static void seq_tracker_settle(struct seq_tracker_t *tracker, uint64_t fill) {
+    for(uint32_t i = fill; i < tracker->corrupt_held; i++) {
+        if(tracker->corrupt_dup & (1U << i))
+            tracker->duplicates++;
+        else
+            tracker->ignored++;
+    }
+
+    tracker->corrupted += fill;
+    tracker->corrupt_held = 0;
+    tracker->corrupt_dup = 0;
+}
+
+/* New highest index idx: window slides over indexes up to idx - SEQ_TRACKER_WINDOW */
+static void seq_tracker_advance(struct seq_tracker_t *tracker, uint64_t idx, struct timespec ts) {
+    uint64_t step = idx - tracker->highest_idx;
+    uint64_t evict = (step < SEQ_TRACKER_WINDOW) ? step : SEQ_TRACKER_WINDOW;
+    uint64_t from = tracker->highest_idx - SEQ_TRACKER_WINDOW + 1;
+
+    for(uint64_t i = 0; i < evict; i++)
+        seq_tracker_evict(tracker, from + i);
+
+    /* Numbers passed over in one step, they never are in the window */
+    if(step > SEQ_TRACKER_WINDOW)
+        seq_tracker_lose(tracker, tracker->highest_idx + 1, step - SEQ_TRACKER_WINDOW);
+
+    tracker->window_missing += (step < SEQ_TRACKER_WINDOW) ? step - 1 : SEQ_TRACKER_WINDOW - 1;
+
+    /* Held packets fill the first slots passed over, the rest had other numbers */
+    uint64_t fill = (tracker->corrupt_held < step) ? tracker->corrupt_held : step - 1;
+
+    if(step > SEQ_TRACKER_WINDOW)
+        fill = 0;
+
+    for(uint64_t i = 0; i < fill; i++) {
+        uint64_t slot = (tracker->highest_idx + 1 + i) & SEQ_TRACKER_MASK;
+
+        tracker->window[slot / 64] |= 1ULL << (slot % 64);
+        tracker->ts[slot] = tracker->corrupt_ts[i];
+    }
+    tracker->window_missing -= fill;
+    seq_tracker_settle(tracker, fill);
+
+    tracker->window[(idx & SEQ_TRACKER_MASK) / 64] |= 1ULL << (idx % 64);
+    tracker->ts[idx & SEQ_TRACKER_MASK] = ts;
+    tracker->highest_idx = idx;
+    tracker->received++;
+}
+
+static void seq_tracker_take_suspect(struct seq_tracker_t *tracker) {
+    int32_t delta = (int32_t)(tracker->suspect_number - seq_tracker_highest(tracker));
+
+    seq_tracker_advance(tracker, tracker->highest_idx + delta, tracker->suspect_ts);
+}
+
+int seq_tracker_add(struct seq_tracker_t *tracker, uint32_t number, struct timespec ts, int intact) {
+    assert(tracker != NULL);
+
+    if(!tracker->started) {
+        if(!intact) {
+            tracker->ignored++;
+            return SEQ_TRACKER_IGNORED;
+        }
+
+        seq_tracker_start(tracker, number, ts);
+        return SEQ_TRACKER_NEXT;
+    }
+
+    /* Number not trusted, header may be garbage: the packet only took the next slot */
+    if(!intact) {
+        if(seq_tracker_hold(tracker, ts, 0) == 0)
+            return SEQ_TRACKER_HELD;
+
+        tracker->ignored++;
+        return SEQ_TRACKER_IGNORED;
+    }
+
+    if(tracker->suspect) {
+        int32_t step = (int32_t)(number - tracker->suspect_number);
+        int32_t ahead = (int32_t)(number - seq_tracker_highest(tracker));
+
+        if(step == 0) {
+            tracker->duplicates++;
+            return SEQ_TRACKER_DUPLICATE;
+        }
+
+        if(step >= -SEQ_TRACKER_SUSPECT_STEP) {
+            /* Next to it or beyond it: the jump was real */
+            tracker->suspect = 0;
+            seq_tracker_take_suspect(tracker);
+        } else if(ahead > 0) {
+            /* Sequence goes on from before the jump, or far between both: trust the newer one */
+            tracker->suspect = 0;
+            if(seq_tracker_hold(tracker, tracker->suspect_ts, 0) != 0)
+                tracker->ignored++;
+        }
+        /* Late or duplicate packet tells nothing yet */
+    }
+
+    int32_t delta = (int32_t)(number - seq_tracker_highest(tracker));
+
+    if(delta > SEQ_TRACKER_SUSPECT_STEP) {
+        tracker->suspect = 1;
+        tracker->suspect_number = number;
+        tracker->suspect_ts = ts;
+        return SEQ_TRACKER_JUMP;
+    }
+
+    if(delta > 0) {
+        uint64_t missing = seq_tracker_missing(tracker);
+
+        seq_tracker_advance(tracker, tracker->highest_idx + delta, ts);
+        return (seq_tracker_missing(tracker) == missing) ? SEQ_TRACKER_NEXT : SEQ_TRACKER_GAP;
+    }
+
+    uint64_t behind = (uint64_t)(-(int64_t)delta);
+    uint64_t idx = tracker->highest_idx - behind;
+    uint64_t *word = &tracker->window[(idx & SEQ_TRACKER_MASK) / 64];
+    uint64_t bit = 1ULL << (idx % 64);
+    int seen = (behind >= SEQ_TRACKER_WINDOW || idx < tracker->first_idx || (*word & bit));
+
+    /* First number again, not one the window waits for */
+    if(seen && number == 1 && delta < 0) {
+        seq_tracker_finish(tracker);
+        seq_tracker_start(tracker, number, ts);
+        tracker->restarts++;
+        return SEQ_TRACKER_RESTART;
+    }
+
+    if(behind >= SEQ_TRACKER_WINDOW || idx < tracker->first_idx) {
+        tracker->stale++;
+        return SEQ_TRACKER_STALE;
+    }
+
+    /* Repeated number may be a garbled one of the next slot: the next packet tells */
+    if(*word & bit) {
+        if(seq_tracker_hold(tracker, ts, 1) == 0)
+            return SEQ_TRACKER_HELD;
+
+        tracker->duplicates++;
+        return SEQ_TRACKER_DUPLICATE;
+    }
+
+    *word |= bit;
+    tracker->ts[idx & SEQ_TRACKER_MASK] = ts;
+    tracker->window_missing--;
+    tracker->reordered++;
+    tracker->received++;
+
+    return SEQ_TRACKER_LATE;
+}
+
+void seq_tracker_finish(struct seq_tracker_t *tracker) {
+    assert(tracker != NULL);
+
+    if(!tracker->started)
+        return;
+
+    /* Nothing came after it to tell it was garbage */
+    if(tracker->suspect) {
+        tracker->suspect = 0;
+        seq_tracker_take_suspect(tracker);
+    }
+
+    /* Highest index is received: it closes the last gap */
+    uint64_t from = tracker->highest_idx - SEQ_TRACKER_WINDOW + 1;
+
+    for(uint64_t i = 0; i < SEQ_TRACKER_WINDOW; i++)
+        seq_tracker_evict(tracker, from + i);
+
+    assert(tracker->window_missing == 0);
+
+    /* Nothing intact after them: their slots are not known to exist */
+    seq_tracker_settle(tracker, 0);
+
+    tracker->started = 0;
+}
+
+static void seq_tracker_print_gap(struct seq_tracker_t *tracker, const struct seq_tracker_gap_t *gap) {
+    uint64_t before_ns = timespec_to_ns(gap->before_ts);
+    uint64_t after_ns = timespec_to_ns(gap->after_ts);
+
+    /* Packet after the gap may have arrived first when reordered */
+    printf("#%.8u ... #%.8u %10" PRIu64 " packets at %.3f s, %.3f ms without packets\n",
+           gap->first, gap->first + (uint32_t)(gap->count - 1), gap->count,
+           seq_tracker_seconds(tracker, gap->before_ts),
+           (after_ns > before_ns) ? (after_ns - before_ns) / 1.0e6 : 0.0);
+}
+
+void seq_tracker_print_stats(struct seq_tracker_t *tracker) {
+    assert(tracker != NULL);
+
+    printf("Sequence:\n");
+    printf("\tReceived:         %" PRIu64 " numbers, %" PRIu64 " reordered, %" PRIu64 " duplicates, "
+           "%" PRIu64 " too late, %" PRIu64 " corrupted ignored\n",
+           tracker->received, tracker->reordered, tracker->duplicates, tracker->stale, tracker->ignored);
+    if(tracker->corrupted > 0) {
+        printf("\tCorrupted:        %" PRIu64 " numbers received corrupt in sequence\n", tracker->corrupted);
+    }
+    printf("\tMissing:          %" PRIu64 " in %" PRIu64 " gaps, %" PRIu64 " sender restarts\n",
+           seq_tracker_missing(tracker), tracker->gaps, tracker->restarts);
+
+    if(tracker->longest.count == 0)
+        return;
+
+    printf("\tLongest outage:   ");
+    seq_tracker_print_gap(tracker, &tracker->longest);
+
+    uint64_t last = (tracker->gaps < SEQ_TRACKER_GAPS) ? tracker->gaps : SEQ_TRACKER_GAPS;
+
+    printf("\tLast gaps:\n");
+    for(uint64_t i = tracker->gaps - last; i < tracker->gaps; i++) {
+        printf("\t\t");
+        seq_tracker_print_gap(tracker, &tracker->last[i % SEQ_TRACKER_GAPS]);
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef _SEQ_TRACKER_H_
+#define _SEQ_TRACKER_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#define SEQ_TRACKER_WINDOW 1024 /* numbers below highest that may still arrive, power of 2 */
+#define SEQ_TRACKER_GAPS   8    /* last gaps kept for report */
+#define SEQ_TRACKER_SUSPECT_STEP 16 /* larger steps ahead wait for the next packet to confirm them */
+
+/* seq_tracker_add() results */
+#define SEQ_TRACKER_NEXT      0 /* highest number + 1 */
+#define SEQ_TRACKER_GAP       1 /* ahead of highest number + 1: numbers between are missing */
+#define SEQ_TRACKER_LATE      2 /* missing number arrived out of order */
+#define SEQ_TRACKER_DUPLICATE 3
+#define SEQ_TRACKER_STALE     4 /* below window: duplicate or late, not known */
+#define SEQ_TRACKER_RESTART   5 /* number 1 after higher ones: sender started again */
+#define SEQ_TRACKER_IGNORED   6 /* corrupted packet, number not trusted */
+#define SEQ_TRACKER_JUMP      7 /* far ahead: a gap if the next packet follows it */
+#define SEQ_TRACKER_HELD      8 /* number not trusted or not fitting: held for the next slot, see below */
+
+struct seq_tracker_gap_t {
+    uint32_t first;             /* first missing number */
+    uint64_t count;             /* missing numbers */
+    struct timespec before_ts;  /* arrival of last packet before gap */
+    struct timespec after_ts;   /* arrival of first packet after gap */
+};
+
+/*
+ * Packet sequence accounting
+ *
+ * Numbers are extended to 64 bits by serial arithmetic, so wraparound
+ * of 32-bit packet numbers is a step like any other. A bitmap holds
+ * the last SEQ_TRACKER_WINDOW numbers up to the highest one: a clear
+ * bit is a number still missing, which becomes lost only when the
+ * window slides over it. Numbers leaving the window are folded into
+ * gap ranges, so memory does not grow with run length and every gap
+ * is known exactly, with arrival times of the packets around it.
+ *
+ * The checksum does not cover the packet header: one flipped bit of a
+ * number would open a gap of thousands. A step of more than
+ * SEQ_TRACKER_SUSPECT_STEP is held until the next packet follows it,
+ * otherwise the number was garbage.
+ *
+ * Only intact packets move the sequence. A corrupted one, whatever
+ * number it carries, is held for the next slot: when the next intact
+ * packet steps over that slot, the packet was received corrupt rather
+ * than lost, otherwise it is ignored. Corrupted packets never count as
+ * late, duplicate or missing numbers. An intact packet whose number
+ * turns out garbage (a jump the sequence does not follow) or repeats
+ * an older one is held the same way: it took the next slot if the next packet steps
+ * over it, otherwise it was garbage or a real duplicate.
+ */
+struct seq_tracker_t {
+    uint8_t  started;
+    uint64_t first_idx;         /* index of first number of the run */
+    uint32_t first_number;
+    uint64_t highest_idx;
+
+    uint64_t window[SEQ_TRACKER_WINDOW / 64];  /* bit per index, set - received */
+    struct timespec ts[SEQ_TRACKER_WINDOW];    /* arrival of received indexes */
+    uint64_t window_missing;    /* clear bits from first_idx up to highest_idx */
+
+    struct timespec start_ts;
+    struct timespec last_ts;    /* last received index that left the window */
+
+    /* step far ahead waiting for next packet */
+    uint8_t  suspect;
+    uint32_t suspect_number;
+    struct timespec suspect_ts;
+
+    /* packets held for the slots after highest, run of them */
+    uint32_t corrupt_held;
+    uint32_t corrupt_dup;       /* bit per held packet: duplicate number if it takes no slot */
+    struct timespec corrupt_ts[SEQ_TRACKER_SUSPECT_STEP];
+
+    /* gap of indexes leaving the window, closed by next received one */
+    uint32_t gap_first;
+    uint64_t gap_count;
+
+    /* statistics */
+    uint64_t received;          /* distinct numbers */
+    uint64_t lost;              /* missing numbers that left the window */
+    uint64_t reordered;
+    uint64_t duplicates;
+    uint64_t stale;
+    uint64_t restarts;
+    uint64_t ignored;
+    uint64_t corrupted;         /* numbers received corrupt or with garbled number, in their slots */
+
+    uint64_t gaps;
+    struct seq_tracker_gap_t longest;
+    struct seq_tracker_gap_t last[SEQ_TRACKER_GAPS];
+};
+
+void seq_tracker_init(struct seq_tracker_t *tracker);
+
+/*
+ * Packet number received at ts, returns SEQ_TRACKER_*
+ *
+ * intact - packet passed its checksum. A corrupted packet only counts
+ * as received corrupt in the next slot, when the next intact packet
+ * steps over it: a garbage number would open a false gap, fill a real
+ * one or look late or duplicate.
+ */
+int seq_tracker_add(struct seq_tracker_t *tracker, uint32_t number, struct timespec ts, int intact);
+
+/* Highest number seen */
+static inline uint32_t seq_tracker_highest(const struct seq_tracker_t *tracker) {
+    return tracker->first_number + (uint32_t)(tracker->highest_idx - tracker->first_idx);
+}
+
+/* Numbers missing so far: lost ones and the ones the window still waits for */
+static inline uint64_t seq_tracker_missing(const struct seq_tracker_t *tracker) {
+    return tracker->lost + tracker->window_missing;
+}
+
+/* No more packets: numbers still missing are lost */
+void seq_tracker_finish(struct seq_tracker_t *tracker);
+
+void seq_tracker_print_stats(struct seq_tracker_t *tracker);
+
+#endif /* _SEQ_TRACKER_H_ */
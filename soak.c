@@ -0,0 +1,205 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+#include "soak.h"
+#include "async_log.h"
+#include "utils.h"
+
+#define N_ERR "SOAK ERROR: "
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+static void soak_counters_add(struct soak_counters_t *dst, const struct soak_counters_t *src) {
+    dst->packets += src->packets;
+    dst->bytes += src->bytes;
+    dst->errors += src->errors;
+    dst->lost += src->lost;
+}
+
+/* Sum of ring slots */
+static struct soak_counters_t soak_ring_sum(const struct soak_counters_t *ring) {
+    struct soak_counters_t sum;
+    memset(&sum, 0x00, sizeof(sum));
+
+    for(int i = 0; i < SOAK_SLOTS; i++) {
+        soak_counters_add(&sum, &ring[i]);
+    }
+
+    return sum;
+}
+
+static uint64_t soak_error_ppm(const struct soak_counters_t *counters) {
+    uint64_t total = counters->packets + counters->lost;
+    return total ? (counters->errors + counters->lost) * 1000000 / total : 0;
+}
+
+void soak_init(struct soak_t *soak, uint32_t duration_s, uint32_t max_error_ppm,
+               const char *checkpoint_path) {
+    assert(soak != NULL);
+
+    memset(soak, 0x00, sizeof(struct soak_t));
+
+    soak->duration_s = duration_s;
+    soak->max_error_ppm = max_error_ppm;
+    soak->checkpoint_path = checkpoint_path;
+
+    soak->next_status_s = SOAK_STATUS_SEC;
+    soak->next_checkpoint_s = SOAK_CHECKPOINT_SEC;
+
+    clock_gettime(CLOCK_MONOTONIC, &soak->start_ts);
+}
+
+/* Close current second, counters are zero for seconds without packets */
+static void soak_roll_second(struct soak_t *soak) {
+    soak->seconds[soak->now_s % SOAK_SLOTS] = soak->current;
+    soak_counters_add(&soak->minute, &soak->current);
+    soak_counters_add(&soak->total, &soak->current);
+    memset(&soak->current, 0x00, sizeof(soak->current));
+
+    soak->now_s++;
+
+    if(soak->now_s % SOAK_SLOTS == 0) {
+        soak->minutes[(soak->now_s / SOAK_SLOTS - 1) % SOAK_SLOTS] = soak->minute;
+        memset(&soak->minute, 0x00, sizeof(soak->minute));
+    }
+}
+
+static void soak_status(struct soak_t *soak) {
+    struct soak_counters_t minute = soak_ring_sum(soak->seconds);
+
+    /* Soak runs log warnings only by default, status line must stay visible */
+    alog4(ALOG_WARN, "Soak: %" PRIu64 " s, last min %" PRIu64 " B/s, %" PRIu64 " errors ppm, total %" PRIu64 " packets\n",
+          soak->now_s, minute.bytes / SOAK_SLOTS, soak_error_ppm(&minute), soak->total.packets);
+}
+
+int soak_tick(struct soak_t *soak) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t elapsed_s = timespec_diff(soak->start_ts, now).tv_sec;
+    if(elapsed_s == soak->now_s) {
+        return soak->stop_reason;
+    }
+
+    while(soak->now_s < elapsed_s) {
+        soak_roll_second(soak);
+    }
+
+    if(soak->now_s >= soak->next_status_s) {
+        soak_status(soak);
+        soak->next_status_s = soak->now_s + SOAK_STATUS_SEC;
+    }
+
+    if(soak->checkpoint_path != NULL && soak->now_s >= soak->next_checkpoint_s) {
+        (void)soak_checkpoint(soak, "checkpoint");
+        soak->next_checkpoint_s = soak->now_s + SOAK_CHECKPOINT_SEC;
+    }
+
+    if(soak->duration_s != 0 && soak->now_s >= soak->duration_s) {
+        soak->stop_reason = SOAK_STOP_TIME;
+    }
+
+    if(soak->max_error_ppm != 0) {
+        struct soak_counters_t minute = soak_ring_sum(soak->seconds);
+
+        if(minute.packets >= SOAK_MIN_RATE_PACKETS && soak_error_ppm(&minute) > soak->max_error_ppm) {
+            soak->stop_reason = SOAK_STOP_ERRORS;
+        }
+    }
+
+    return soak->stop_reason;
+}
+
+static void soak_print_window(FILE *file, const char *name, const struct soak_counters_t *counters,
+                              uint64_t seconds) {
+    if(seconds == 0) {
+        fprintf(file, "\t%-10s n/a\n", name);
+        return;
+    }
+
+    fprintf(file, "\t%-10s %12.1f packets/s %14.1f B/s %10" PRIu64 " errors %10" PRIu64 " lost %8" PRIu64 " ppm\n",
+            name, (double)counters->packets / seconds, (double)counters->bytes / seconds,
+            counters->errors, counters->lost, soak_error_ppm(counters));
+}
+
+void soak_report(struct soak_t *soak, FILE *file, const char *title) {
+    assert(soak != NULL);
+    assert(file != NULL);
+
+    /* Totals include current second */
+    struct soak_counters_t total = soak->total;
+    soak_counters_add(&total, &soak->current);
+
+    struct soak_counters_t minute = soak_ring_sum(soak->seconds);
+    struct soak_counters_t hour = soak_ring_sum(soak->minutes);
+
+    uint64_t minutes = soak->now_s / SOAK_SLOTS;
+
+    const char *reason = (soak->stop_reason == SOAK_STOP_TIME) ? "duration elapsed" :
+                         (soak->stop_reason == SOAK_STOP_ERRORS) ? "error rate above threshold" :
+                         (soak->stop_reason == SOAK_STOP_USER) ? "stopped" : "running";
+
+    struct rusage usage;
+    memset(&usage, 0x00, sizeof(usage));
+    (void)getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(file, "Soak %s: %" PRIu64 ":%.2" PRIu64 ":%.2" PRIu64 " elapsed, %s\n", title,
+            soak->now_s / 3600, soak->now_s / 60 % 60, soak->now_s % 60, reason);
+    fprintf(file, "\tTotal:     %" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64 " errors, %" PRIu64 " lost, %" PRIu64 " ppm\n",
+            total.packets, total.bytes, total.errors, total.lost, soak_error_ppm(&total));
+
+    soak_print_window(file, "Last 1 s:", &soak->seconds[(soak->now_s + SOAK_SLOTS - 1) % SOAK_SLOTS],
+                      soak->now_s ? 1 : 0);
+    soak_print_window(file, "Last 1 min:", &minute, soak->now_s < SOAK_SLOTS ? soak->now_s : SOAK_SLOTS);
+    soak_print_window(file, "Last 1 h:", &hour,
+                      (minutes < SOAK_SLOTS ? minutes : SOAK_SLOTS) * SOAK_SLOTS);
+    soak_print_window(file, "Average:", &total, soak->now_s);
+
+    fprintf(file, "\tMax RSS:   %ld KiB\n", usage.ru_maxrss);
+
+    fflush(file);
+}
+
+int soak_checkpoint(struct soak_t *soak, const char *title) {
+    assert(soak != NULL);
+
+    if(soak->checkpoint_path == NULL) {
+        return 0;
+    }
+
+    char path[strlen(soak->checkpoint_path) + 5];
+    snprintf(path, sizeof(path), "%s.tmp", soak->checkpoint_path);
+
+    FILE *file = fopen(path, "w");
+    if(file == NULL) {
+        strerr("fopen(%s) failed", path);
+        return -1;
+    }
+
+    soak_report(soak, file, title);
+    fclose(file);
+
+    if(rename(path, soak->checkpoint_path) != 0) {
+        strerr("rename(%s) failed", soak->checkpoint_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+void soak_finish(struct soak_t *soak) {
+    assert(soak != NULL);
+
+    (void)soak_tick(soak);
+
+    if(soak->stop_reason == SOAK_RUNNING)
+        soak->stop_reason = SOAK_STOP_USER;
+
+    soak_report(soak, stdout, "final report");
+    (void)soak_checkpoint(soak, "final report");
+}
@@ -0,0 +1,76 @@
+#ifndef _SOAK_H_
+#define _SOAK_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#define SOAK_SLOTS            60   /* seconds in minute ring, minutes in hour ring */
+#define SOAK_STATUS_SEC       60   /* console status line */
+#define SOAK_CHECKPOINT_SEC   60   /* checkpoint file rewrite */
+#define SOAK_MIN_RATE_PACKETS 100  /* packets in 1 min window before error rate stop applies */
+
+#define SOAK_RUNNING     0
+#define SOAK_STOP_TIME   1  /* duration elapsed */
+#define SOAK_STOP_ERRORS 2  /* error rate above threshold */
+#define SOAK_STOP_USER   3  /* interrupted or transfer finished */
+
+struct soak_counters_t {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t errors;  /* checksum errors */
+    uint64_t lost;
+};
+
+/*
+ * Long run statistics with fixed memory
+ *
+ * Counters of the current second are rolled into a ring of the last
+ * SOAK_SLOTS seconds and every full minute into a ring of the last
+ * SOAK_SLOTS minutes, giving 1 s, 1 min and 1 h windows next to the
+ * run totals. soak_tick() must be called at least once a second,
+ * it rewrites the checkpoint file and decides when the run stops.
+ */
+struct soak_t {
+    uint32_t duration_s;       /* 0 - until interrupted */
+    uint32_t max_error_ppm;    /* 0 - never stop on errors */
+    const char *checkpoint_path;
+
+    struct timespec start_ts;
+    uint64_t now_s;            /* seconds since start of current slot */
+
+    struct soak_counters_t current;              /* current second */
+    struct soak_counters_t seconds[SOAK_SLOTS];  /* completed seconds */
+    struct soak_counters_t minute;               /* current minute */
+    struct soak_counters_t minutes[SOAK_SLOTS];  /* completed minutes */
+    struct soak_counters_t total;
+
+    uint64_t next_status_s;
+    uint64_t next_checkpoint_s;
+    int      stop_reason;
+};
+
+void soak_init(struct soak_t *soak, uint32_t duration_s, uint32_t max_error_ppm,
+               const char *checkpoint_path);
+
+static inline void soak_add(struct soak_t *soak, uint64_t bytes, uint64_t errors, uint64_t lost) {
+    soak->current.packets++;
+    soak->current.bytes += bytes;
+    soak->current.errors += errors;
+    soak->current.lost += lost;
+}
+
+/* Roll windows, returns SOAK_RUNNING or SOAK_STOP_* */
+int soak_tick(struct soak_t *soak);
+
+/* Full report: totals, windows and stop reason */
+void soak_report(struct soak_t *soak, FILE *file, const char *title);
+
+/* Write report to checkpoint file (replaced atomically) */
+int soak_checkpoint(struct soak_t *soak, const char *title);
+
+/* Final report to stdout and checkpoint file */
+void soak_finish(struct soak_t *soak);
+
+#endif /* _SOAK_H_ */
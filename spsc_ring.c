@@ -0,0 +1,104 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "spsc_ring.h"
+
+int spsc_ring_init(struct spsc_ring_t *ring, uint32_t slots, size_t slot_size) {
+    assert(ring != NULL);
+    assert(slots > 0);
+    assert(slot_size > 0);
+
+    memset(ring, 0x00, sizeof(struct spsc_ring_t));
+
+    /* No power of two above it to round up to */
+    if(slots > SPSC_RING_SLOTS_MAX) {
+        printf("spsc_ring_init: %u slots of %lu bytes is too many\n", slots, slot_size);
+        return -1;
+    }
+
+    uint32_t size = 1;
+    while(size < slots) {
+        size <<= 1;
+    }
+
+    if((size_t)size > SIZE_MAX / slot_size) {
+        printf("spsc_ring_init: %u slots of %lu bytes is too many\n", slots, slot_size);
+        return -1;
+    }
+
+    ring->slots = size;
+    ring->mask = size - 1;
+    ring->slot_size = slot_size;
+
+    ring->buf  = (uint8_t*)malloc((size_t)size * slot_size);
+    ring->used = (size_t*)malloc(size * sizeof(size_t));
+
+    if(ring->buf == NULL || ring->used == NULL) {
+        printf("spsc_ring_init: malloc() failed\n");
+        free(ring->buf);
+        free(ring->used);
+        return -1;
+    }
+
+    return 0;
+}
+
+void spsc_ring_free(struct spsc_ring_t *ring) {
+    assert(ring != NULL);
+
+    free(ring->buf);
+    free(ring->used);
+
+    ring->buf = NULL;
+    ring->used = NULL;
+}
+
+uint8_t* spsc_ring_write_slot(struct spsc_ring_t *ring) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if(ring->tail - head == ring->slots) {
+        return NULL;
+    }
+
+    return ring->buf + (size_t)(ring->tail & ring->mask) * ring->slot_size;
+}
+
+void spsc_ring_commit(struct spsc_ring_t *ring, size_t size) {
+    assert(size <= ring->slot_size);
+
+    ring->used[ring->tail & ring->mask] = size;
+
+    uint32_t count = ring->tail + 1 - __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if(count > ring->high_water) {
+        ring->high_water = count;
+    }
+
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+uint8_t* spsc_ring_read_slot(struct spsc_ring_t *ring, size_t *size) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if(tail == ring->head) {
+        return NULL;
+    }
+
+    uint32_t index = ring->head & ring->mask;
+
+    if(size != NULL) {
+        *size = ring->used[index];
+    }
+
+    return ring->buf + (size_t)index * ring->slot_size;
+}
+
+void spsc_ring_release(struct spsc_ring_t *ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t spsc_ring_count(struct spsc_ring_t *ring) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
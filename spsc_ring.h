@@ -0,0 +1,50 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define SPSC_CACHE_LINE 64
+#define SPSC_RING_SLOTS_MAX (1U << 31) /* largest power of two of uint32_t */
+
+/*
+ * Lock-free single producer / single consumer ring of fixed size slots
+ *
+ * Producer: spsc_ring_write_slot() -> fill slot -> spsc_ring_commit()
+ * Consumer: spsc_ring_read_slot()  -> use slot  -> spsc_ring_release()
+ *
+ * Head and tail are free running counters on separate cache lines,
+ * slots number is rounded up to power of 2
+ */
+struct spsc_ring_t {
+    /* consumer side */
+    uint32_t head __attribute__((aligned(SPSC_CACHE_LINE)));
+
+    /* producer side */
+    uint32_t tail __attribute__((aligned(SPSC_CACHE_LINE)));
+    uint32_t high_water; /* max slots used, updated by producer */
+
+    /* read only after init */
+    uint32_t slots __attribute__((aligned(SPSC_CACHE_LINE)));
+    uint32_t mask;
+    size_t   slot_size;
+    uint8_t *buf;
+    size_t  *used; /* bytes committed per slot */
+};
+
+/* slots are rounded up to a power of two, returns -1 above SPSC_RING_SLOTS_MAX */
+int  spsc_ring_init(struct spsc_ring_t *ring, uint32_t slots, size_t slot_size);
+void spsc_ring_free(struct spsc_ring_t *ring);
+
+/* Producer: next free slot or NULL if ring is full */
+uint8_t* spsc_ring_write_slot(struct spsc_ring_t *ring);
+void     spsc_ring_commit(struct spsc_ring_t *ring, size_t size);
+
+/* Consumer: oldest committed slot or NULL if ring is empty */
+uint8_t* spsc_ring_read_slot(struct spsc_ring_t *ring, size_t *size);
+void     spsc_ring_release(struct spsc_ring_t *ring);
+
+/* Slots in use, approximate when called concurrently */
+uint32_t spsc_ring_count(struct spsc_ring_t *ring);
+
+#endif /* _SPSC_RING_H_ */
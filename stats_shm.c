@@ -0,0 +1,266 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/serial.h>
+
+#include "stats_shm.h"
+#include "uart.h"
+#include "utils.h"
+
+#define N_ERR "STATS_SHM ERROR: "
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define STATS_SHM_READ_TRIES 1000
+
+/* shm_open() names start with '/' */
+static int stats_shm_set_name(struct stats_shm_t *shm, const char *name) {
+    int length = snprintf(shm->name, sizeof(shm->name), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+    if(length >= sizeof(shm->name) || strchr(shm->name + 1, '/') != NULL) {
+        errprintf("Wrong segment name '%s'\n", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+struct stats_shm_t* stats_shm_create(const char *name) {
+    assert(name != NULL);
+
+    struct stats_shm_t *shm = (struct stats_shm_t*)calloc(1, sizeof(struct stats_shm_t));
+    if(shm == NULL) {
+        printf("stats_shm_create: calloc() failed\n");
+        exit(1);
+    }
+
+    if(stats_shm_set_name(shm, name) != 0) {
+        free(shm);
+        return NULL;
+    }
+
+    int fd = shm_open(shm->name, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) {
+        strerr("shm_open(%s) failed", shm->name);
+        free(shm);
+        return NULL;
+    }
+
+    if(ftruncate(fd, sizeof(struct stats_shm_layout_t)) != 0) {
+        strerr("ftruncate(%s) failed", shm->name);
+        close(fd);
+        free(shm);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(struct stats_shm_layout_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED) {
+        strerr("mmap(%s) failed", shm->name);
+        free(shm);
+        return NULL;
+    }
+
+    shm->layout = (struct stats_shm_layout_t*)map;
+
+    /* Segment left by a killed run is reused: readers see magic last */
+    __atomic_store_n(&shm->layout->magic, 0, __ATOMIC_RELEASE);
+    memset((uint8_t*)shm->layout + sizeof(uint32_t), 0x00, sizeof(struct stats_shm_layout_t) - sizeof(uint32_t));
+
+    shm->layout->version = STATS_SHM_VERSION;
+    shm->layout->size = sizeof(struct stats_shm_layout_t);
+    shm->layout->pid = getpid();
+    __atomic_store_n(&shm->layout->magic, STATS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return shm;
+}
+
+void stats_shm_destroy(struct stats_shm_t *shm) {
+    if(shm == NULL)
+        return;
+
+    munmap(shm->layout, sizeof(struct stats_shm_layout_t));
+    (void)shm_unlink(shm->name);
+    free(shm);
+}
+
+void stats_shm_writer_init(struct stats_shm_writer_t *writer, struct stats_shm_t *shm,
+                           struct uart_t *uart, uint32_t role) {
+    assert(writer != NULL);
+
+    memset(writer, 0x00, sizeof(struct stats_shm_writer_t));
+    writer->uart = uart;
+    clock_gettime(CLOCK_MONOTONIC, &writer->prev_ts);
+
+    if(shm == NULL) {
+        return;
+    }
+
+    uint32_t index = __atomic_fetch_add(&shm->layout->ports_num, 1, __ATOMIC_ACQ_REL);
+    if(index >= STATS_SHM_PORTS_MAX) {
+        errprintf("More than %i ports in %s, port not exported\n", STATS_SHM_PORTS_MAX, shm->name);
+        __atomic_fetch_sub(&shm->layout->ports_num, 1, __ATOMIC_ACQ_REL);
+        return;
+    }
+
+    writer->port = &shm->layout->ports[index];
+    writer->port->role = role;
+    if(uart != NULL) {
+        snprintf(writer->port->device, sizeof(writer->port->device), "%s", uart->dev);
+    }
+}
+
+void stats_shm_publish(struct stats_shm_writer_t *writer, const struct stats_shm_counters_t *counters,
+                       const struct histogram_t *latency, int force) {
+    struct stats_shm_values_t values;
+    struct timespec now;
+
+    assert(writer != NULL);
+    assert(counters != NULL);
+
+    if(writer->port == NULL) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t elapsed_ns = timespec_to_ns(timespec_diff(writer->prev_ts, now));
+
+    if(!force && elapsed_ns < STATS_SHM_PERIOD_MS * 1000000ULL) {
+        return;
+    }
+
+    /* Snapshot is prepared outside of the write section */
+    memset(&values, 0x00, sizeof(values));
+    values.time_ns = timespec_to_ns(now);
+    values.total = *counters;
+
+    if(elapsed_ns > 0) {
+        values.packets_rate = (counters->packets - writer->prev.packets) * 1000000000ULL / elapsed_ns;
+        values.bytes_rate = (counters->bytes - writer->prev.bytes) * 1000000000ULL / elapsed_ns;
+    }
+
+    if(latency != NULL) {
+        values.latency_p50_ns = histogram_percentile(latency, 50.0);
+        values.latency_p99_ns = histogram_percentile(latency, 99.0);
+        values.latency_max_ns = latency->max;
+    }
+
+    if(writer->uart != NULL && !writer->no_icount) {
+        const struct serial_icounter_struct *icount = uart_get_icounter(writer->uart);
+
+        if(icount != NULL) {
+            values.icount_rx = icount->rx;
+            values.icount_tx = icount->tx;
+            values.icount_frame = icount->frame;
+            values.icount_overrun = icount->overrun;
+            values.icount_parity = icount->parity;
+            values.icount_brk = icount->brk;
+            values.icount_buf_overrun = icount->buf_overrun;
+        } else {
+            writer->no_icount = 1;
+        }
+    }
+
+    /* Seqlock write: odd seq, values, even seq */
+    struct stats_shm_port_t *port = writer->port;
+    uint32_t seq = port->seq;
+
+    __atomic_store_n(&port->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(&port->values, &values, sizeof(values));
+
+    __atomic_store_n(&port->seq, seq + 2, __ATOMIC_RELEASE);
+
+    writer->prev_ts = now;
+    writer->prev = *counters;
+}
+
+struct stats_shm_t* stats_shm_open(const char *name) {
+    assert(name != NULL);
+
+    struct stats_shm_t *shm = (struct stats_shm_t*)calloc(1, sizeof(struct stats_shm_t));
+    if(shm == NULL) {
+        printf("stats_shm_open: calloc() failed\n");
+        exit(1);
+    }
+
+    if(stats_shm_set_name(shm, name) != 0) {
+        free(shm);
+        return NULL;
+    }
+
+    int fd = shm_open(shm->name, O_RDONLY, 0);
+    if(fd < 0) {
+        strerr("shm_open(%s) failed", shm->name);
+        free(shm);
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < sizeof(struct stats_shm_layout_t)) {
+        errprintf("%s: segment is smaller than layout version %i\n", shm->name, STATS_SHM_VERSION);
+        close(fd);
+        free(shm);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(struct stats_shm_layout_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED) {
+        strerr("mmap(%s) failed", shm->name);
+        free(shm);
+        return NULL;
+    }
+
+    shm->layout = (struct stats_shm_layout_t*)map;
+
+    if(__atomic_load_n(&shm->layout->magic, __ATOMIC_ACQUIRE) != STATS_SHM_MAGIC ||
+       shm->layout->version != STATS_SHM_VERSION || shm->layout->size < sizeof(struct stats_shm_layout_t)) {
+        errprintf("%s: unknown layout (magic 0x%.8x, version %u)\n", shm->name, shm->layout->magic,
+                  shm->layout->version);
+        stats_shm_close(shm);
+        return NULL;
+    }
+
+    return shm;
+}
+
+void stats_shm_close(struct stats_shm_t *shm) {
+    if(shm == NULL)
+        return;
+
+    munmap(shm->layout, sizeof(struct stats_shm_layout_t));
+    free(shm);
+}
+
+int stats_shm_read(const struct stats_shm_port_t *port, struct stats_shm_values_t *values) {
+    assert(port != NULL);
+    assert(values != NULL);
+
+    for(int i = 0; i < STATS_SHM_READ_TRIES; i++) {
+        uint32_t seq = __atomic_load_n(&port->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1)
+            continue;
+
+        memcpy(values, (const void*)&port->values, sizeof(struct stats_shm_values_t));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&port->seq, __ATOMIC_RELAXED) == seq)
+            return 0;
+    }
+
+    return -1;
+}
@@ -0,0 +1,113 @@
+#ifndef _STATS_SHM_H_
+#define _STATS_SHM_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "histogram.h"
+
+struct uart_t;
+
+#define STATS_SHM_MAGIC     0x54534155 /* "UAST" */
+#define STATS_SHM_VERSION   1
+#define STATS_SHM_PORTS_MAX 8
+#define STATS_SHM_PERIOD_MS 100        /* I/O loops publish at most this often */
+
+#define STATS_SHM_ROLE_SEND 1
+#define STATS_SHM_ROLE_RECV 2
+
+#define STATS_SHM_CACHE_LINE 64
+
+struct stats_shm_counters_t {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t crc_errors;
+    uint64_t lost;
+};
+
+/* Snapshot of one port */
+struct stats_shm_values_t {
+    uint64_t time_ns;         /* CLOCK_MONOTONIC of snapshot */
+    struct stats_shm_counters_t total;
+    uint64_t packets_rate;    /* per second, since previous snapshot */
+    uint64_t bytes_rate;
+    uint64_t latency_p50_ns;  /* receiver: packet inter-arrival, 0 - not measured */
+    uint64_t latency_p99_ns;
+    uint64_t latency_max_ns;
+    uint64_t icount_rx;       /* TIOCGICOUNT, zero if port has none */
+    uint64_t icount_tx;
+    uint64_t icount_frame;
+    uint64_t icount_overrun;
+    uint64_t icount_parity;
+    uint64_t icount_brk;
+    uint64_t icount_buf_overrun;
+};
+
+struct stats_shm_port_t {
+    uint32_t seq;             /* seqlock: odd while values are written */
+    uint32_t role;            /* STATS_SHM_ROLE_* */
+    char     device[64];
+    struct stats_shm_values_t values;
+} __attribute__((aligned(STATS_SHM_CACHE_LINE)));
+
+/*
+ * Shared memory layout, version STATS_SHM_VERSION
+ *
+ * New fields are only appended, readers check magic, version and size
+ * before use. Every port has one writer (the thread running its I/O
+ * loop) and its own seqlock: readers copy values and retry when seq
+ * was odd or changed meanwhile, the writer never waits for readers.
+ */
+struct stats_shm_layout_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;            /* sizeof(struct stats_shm_layout_t) of writer */
+    uint32_t ports_num;       /* ports in use */
+    int32_t  pid;             /* writer process */
+    uint32_t reserved;
+    struct stats_shm_port_t ports[STATS_SHM_PORTS_MAX];
+};
+
+struct stats_shm_t {
+    char name[64];
+    struct stats_shm_layout_t *layout;
+};
+
+/* Writer side of one port, I/O loops keep it on stack */
+struct stats_shm_writer_t {
+    struct stats_shm_port_t *port; /* NULL - export disabled */
+    struct uart_t *uart;
+    struct timespec prev_ts;
+    struct stats_shm_counters_t prev;
+    uint8_t  no_icount;            /* TIOCGICOUNT failed once, not asked again */
+};
+
+/* Create or reset segment "/<name>" of shm_open(), returns NULL on error */
+struct stats_shm_t* stats_shm_create(const char *name);
+/* Unmap and unlink */
+void stats_shm_destroy(struct stats_shm_t *shm);
+
+/* shm NULL - disabled writer, update is a no-op */
+void stats_shm_writer_init(struct stats_shm_writer_t *writer, struct stats_shm_t *shm,
+                           struct uart_t *uart, uint32_t role);
+
+/* Publish every STATS_SHM_PERIOD_MS, latency may be NULL */
+void stats_shm_publish(struct stats_shm_writer_t *writer, const struct stats_shm_counters_t *counters,
+                       const struct histogram_t *latency, int force);
+
+static inline void stats_shm_update(struct stats_shm_writer_t *writer, const struct stats_shm_counters_t *counters,
+                                    const struct histogram_t *latency) {
+    if(writer->port != NULL) {
+        stats_shm_publish(writer, counters, latency, 0);
+    }
+}
+
+/* Reader: map existing segment read-only, returns NULL on error or layout mismatch */
+struct stats_shm_t* stats_shm_open(const char *name);
+void stats_shm_close(struct stats_shm_t *shm);
+
+/* Consistent copy of port values, returns 0 or -1 if writer kept updating */
+int stats_shm_read(const struct stats_shm_port_t *port, struct stats_shm_values_t *values);
+
+#endif /* _STATS_SHM_H_ */
@@ -0,0 +1,338 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#include "traffic.h"
+#include "utils.h"
+
+#define N_ERR "TRAFFIC ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define TRAFFIC_LINE_MAX 256
+
+/* splitmix64 */
+static uint64_t traffic_rand(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static int traffic_type_from_name(const char *name) {
+    for(uint8_t type = TRAFFIC_POISSON; type <= TRAFFIC_TRACE; type++) {
+        if(strcmp(name, traffic_type_name(type)) == 0)
+            return type;
+    }
+
+    return -1;
+}
+
+const char* traffic_type_name(uint8_t type) {
+    switch(type) {
+        case TRAFFIC_POISSON: return "poisson";
+        case TRAFFIC_ONOFF:   return "onoff";
+        case TRAFFIC_TRACE:   return "trace";
+        default:              return "none";
+    }
+}
+
+int traffic_parse(const char *spec, struct traffic_config_t *config) {
+    assert(spec != NULL);
+    assert(config != NULL);
+
+    char copy[strlen(spec) + 1];
+    strcpy(copy, spec);
+
+    free(config->file);
+    memset(config, 0x00, sizeof(struct traffic_config_t));
+    config->scale = 1.0;
+
+    char *save = NULL;
+    char *item = strtok_r(copy, ",", &save);
+    int type = (item != NULL) ? traffic_type_from_name(item) : -1;
+
+    if(type < 0) {
+        printf("Wrong traffic profile '%s': expected poisson, onoff or trace\n", spec);
+        return -1;
+    }
+    config->type = type;
+
+    while((item = strtok_r(NULL, ",", &save)) != NULL) {
+        char *value = strchr(item, '=');
+        char *end = NULL;
+
+        if(value == NULL || value[1] == '\0') {
+            printf("Wrong traffic option '%s': expected key=value\n", item);
+            return -1;
+        }
+        *value++ = '\0';
+
+        if(strcmp(item, "rate") == 0) {
+            config->rate = strtod(value, &end);
+        } else if(strcmp(item, "period_ms") == 0) {
+            config->period_ms = strtoul(value, &end, 0);
+        } else if(strcmp(item, "duty") == 0) {
+            config->duty = strtod(value, &end);
+        } else if(strcmp(item, "scale") == 0) {
+            config->scale = strtod(value, &end);
+        } else if(strcmp(item, "seed") == 0) {
+            config->seed = strtoull(value, &end, 0);
+        } else if(strcmp(item, "file") == 0) {
+            /* Kept for the whole run */
+            free(config->file);
+            config->file = strdup(value);
+            end = value + strlen(value);
+        } else {
+            printf("Unknown traffic option '%s'\n", item);
+            return -1;
+        }
+
+        if(end == NULL || *end != '\0') {
+            printf("Wrong value of traffic option %s: '%s'\n", item, value);
+            return -1;
+        }
+    }
+
+    switch(config->type) {
+        case TRAFFIC_POISSON:
+            if(config->rate <= 0.0) {
+                printf("Wrong traffic profile '%s': poisson needs rate above 0\n", spec);
+                return -1;
+            }
+            break;
+        case TRAFFIC_ONOFF:
+            if(config->rate < 0.0 || config->period_ms == 0 || config->duty <= 0.0 || config->duty > 1.0) {
+                printf("Wrong traffic profile '%s': onoff needs period_ms and duty within 0..1\n", spec);
+                return -1;
+            }
+            break;
+        case TRAFFIC_TRACE:
+            if(config->file == NULL || config->scale <= 0.0) {
+                printf("Wrong traffic profile '%s': trace needs file and scale above 0\n", spec);
+                return -1;
+            }
+            break;
+    }
+
+    return 0;
+}
+
+static int traffic_load_trace(struct traffic_t *traffic, const char *path) {
+    char line[TRAFFIC_LINE_MAX];
+    size_t size = 0;
+    unsigned lineno = 0;
+
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        errprintf("fopen() of '%s' failed\n", path);
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), file) != NULL) {
+        char *end = NULL;
+
+        lineno++;
+
+        char *p = line + strspn(line, " \t");
+        if(*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+
+        double gap_us = strtod(p, &end);
+        if(end == p || gap_us < 0.0 || *(end + strspn(end, " \t\r\n")) != '\0') {
+            errprintf("%s:%u: expected gap in microseconds\n", path, lineno);
+            fclose(file);
+            return -1;
+        }
+
+        if(traffic->gaps_num == size) {
+            size = (size == 0) ? 1024 : size * 2;
+
+            uint64_t *gaps = (uint64_t*)realloc(traffic->gaps_ns, size * sizeof(uint64_t));
+            if(gaps == NULL) {
+                errprintf("realloc() failed\n");
+                fclose(file);
+                return -1;
+            }
+            traffic->gaps_ns = gaps;
+        }
+
+        traffic->gaps_ns[traffic->gaps_num++] = (uint64_t)(gap_us * traffic->config.scale * 1000.0);
+    }
+
+    fclose(file);
+
+    if(traffic->gaps_num == 0) {
+        errprintf("no gaps in trace '%s'\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int traffic_init(struct traffic_t *traffic, const struct traffic_config_t *config) {
+    assert(traffic != NULL);
+    assert(config != NULL);
+
+    memset(traffic, 0x00, sizeof(struct traffic_t));
+
+    traffic->config = *config;
+    traffic->rng = config->seed;
+    histogram_init(&traffic->lag);
+
+    if(config->type == TRAFFIC_TRACE && traffic_load_trace(traffic, config->file) != 0) {
+        traffic_free(traffic);
+        return -1;
+    }
+
+    return 0;
+}
+
+void traffic_free(struct traffic_t *traffic) {
+    assert(traffic != NULL);
+
+    free(traffic->gaps_ns);
+    traffic->gaps_ns = NULL;
+    traffic->gaps_num = 0;
+}
+
+/* Exponential gap of mean 1 / rate: inverse of its distribution at uniform (0, 1] */
+static uint64_t traffic_poisson_gap(struct traffic_t *traffic) {
+    double u = ((traffic_rand(&traffic->rng) >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+    return (uint64_t)(-log(u) / traffic->config.rate * 1.0e9);
+}
+
+/* Due time moved out of the off part of its period */
+static uint64_t traffic_onoff_due(const struct traffic_t *traffic, uint64_t due_ns) {
+    uint64_t period_ns = traffic->config.period_ms * 1000000ULL;
+    uint64_t on_ns = (uint64_t)(period_ns * traffic->config.duty);
+
+    if(due_ns % period_ns < on_ns)
+        return due_ns;
+
+    return (due_ns / period_ns + 1) * period_ns;
+}
+
+static uint64_t traffic_next_due(struct traffic_t *traffic, uint64_t sent_ns) {
+    uint64_t due_ns = traffic->due_ns;
+
+    switch(traffic->config.type) {
+        case TRAFFIC_POISSON:
+            return due_ns + traffic_poisson_gap(traffic);
+        case TRAFFIC_ONOFF:
+            /* Back to back while on: next one is due when the last one is written */
+            if(traffic->config.rate == 0.0)
+                return traffic_onoff_due(traffic, (sent_ns > due_ns) ? sent_ns : due_ns);
+            return traffic_onoff_due(traffic, due_ns + (uint64_t)(1.0e9 / traffic->config.rate));
+        case TRAFFIC_TRACE:
+            due_ns += traffic->gaps_ns[traffic->gap_next++];
+            if(traffic->gap_next == traffic->gaps_num) {
+                traffic->gap_next = 0;
+                traffic->loops++;
+            }
+            return due_ns;
+        default:
+            return sent_ns;
+    }
+}
+
+struct timespec traffic_due(struct traffic_t *traffic) {
+    assert(traffic != NULL);
+
+    /* First packet is due at once */
+    if(!traffic->started) {
+        clock_gettime(CLOCK_MONOTONIC, &traffic->start_ts);
+        traffic->due_ns = 0;
+        traffic->started = 1;
+    }
+
+    uint64_t due_ns = timespec_to_ns(traffic->start_ts) + traffic->due_ns;
+    struct timespec due;
+
+    due.tv_sec = due_ns / 1000000000ULL;
+    due.tv_nsec = due_ns % 1000000000ULL;
+
+    return due;
+}
+
+void traffic_sent(struct traffic_t *traffic, size_t bytes, struct timespec start_ts, struct timespec end_ts) {
+    assert(traffic != NULL);
+    assert(traffic->started);
+
+    uint64_t start_ns = timespec_to_ns(timespec_diff(traffic->start_ts, start_ts));
+    uint64_t lag_ns = (start_ns > traffic->due_ns) ? start_ns - traffic->due_ns : 0;
+
+    histogram_add(&traffic->lag, lag_ns);
+    if(lag_ns > TRAFFIC_LATE_NSEC)
+        traffic->late++;
+
+    if(traffic->packets == 0)
+        traffic->first_sent_ns = start_ns;
+
+    traffic->packets++;
+    traffic->bytes += bytes;
+    traffic->last_due_ns = traffic->due_ns;
+    traffic->last_start_ns = start_ns;
+    traffic->due_ns = traffic_next_due(traffic, timespec_to_ns(timespec_diff(traffic->start_ts, end_ts)));
+}
+
+void traffic_print_config(const struct traffic_config_t *config) {
+    assert(config != NULL);
+
+    switch(config->type) {
+        case TRAFFIC_POISSON:
+            printf("poisson, %.1f packets/s mean, seed %" PRIu64 "\n", config->rate, config->seed);
+            break;
+        case TRAFFIC_ONOFF:
+            if(config->rate == 0.0)
+                printf("onoff, back to back ");
+            else
+                printf("onoff, %.1f packets/s ", config->rate);
+            printf("for %.0f%% of %u ms", config->duty * 100.0, config->period_ms);
+            if(config->rate != 0.0)
+                printf(", %.1f packets/s mean", config->rate * config->duty);
+            printf("\n");
+            break;
+        case TRAFFIC_TRACE:
+            printf("trace '%s', gaps x %g\n", config->file, config->scale);
+            break;
+        default:
+            printf("none\n");
+            break;
+    }
+}
+
+void traffic_print_stats(struct traffic_t *traffic) {
+    assert(traffic != NULL);
+
+    if(traffic->packets == 0)
+        return;
+
+    /* From first to last packet: gaps of the schedule against gaps of the writes */
+    uint64_t intervals = traffic->packets - 1;
+    double bytes_per_packet = (double)traffic->bytes / traffic->packets;
+    double offered_s = traffic->last_due_ns / 1.0e9;
+    double achieved_s = (traffic->last_start_ns - traffic->first_sent_ns) / 1.0e9;
+
+    printf("Traffic:\n");
+    printf("\tProfile:          ");
+    traffic_print_config(&traffic->config);
+    if(traffic->config.type == TRAFFIC_TRACE) {
+        printf("\tTrace:            %lu gaps, %" PRIu64 " replays done\n", traffic->gaps_num, traffic->loops);
+    }
+    if(offered_s > 0.0) {
+        printf("\tOffered:          %.1f packets/s, %.0f B/s over %.3f s\n",
+               intervals / offered_s, intervals * bytes_per_packet / offered_s, offered_s);
+    }
+    if(achieved_s > 0.0) {
+        printf("\tAchieved:         %.1f packets/s, %.0f B/s over %.3f s\n",
+               intervals / achieved_s, intervals * bytes_per_packet / achieved_s, achieved_s);
+    }
+    printf("\tLate:             %" PRIu64 " packets over %.1f ms behind schedule\n",
+           traffic->late, TRAFFIC_LATE_NSEC / 1.0e6);
+    histogram_print(&traffic->lag, "Send lag:", "us", 1000.0);
+}
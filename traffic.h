@@ -0,0 +1,83 @@
+#ifndef _TRAFFIC_H_
+#define _TRAFFIC_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "histogram.h"
+
+#define TRAFFIC_NONE    0 /* back to back, or a fixed delay */
+#define TRAFFIC_POISSON 1 /* exponential gaps of mean 1 / rate */
+#define TRAFFIC_ONOFF   2 /* rate while on for duty of every period, silent for the rest */
+#define TRAFFIC_TRACE   3 /* gaps of a recorded trace, replayed in a loop */
+
+#define TRAFFIC_LATE_NSEC 1000000 /* send started later than this after its due time is late */
+
+struct traffic_config_t {
+    uint8_t  type;            /* TRAFFIC_* */
+    double   rate;            /* packets/s: poisson mean, onoff while on, 0 - back to back */
+    uint32_t period_ms;       /* onoff cycle */
+    double   duty;            /* onoff: on part of period, 0..1 */
+    char    *file;            /* trace: one gap in microseconds per line, # comments */
+    double   scale;           /* trace: gaps multiplied by */
+    uint64_t seed;
+};
+
+/*
+ * Sender traffic profile
+ *
+ * Due times of packets follow the profile from the start of the run,
+ * whatever the sender manages: an open-loop load like real traffic.
+ * A packet due while the sender is still busy with earlier ones goes
+ * out at once, the lag behind its due time is recorded. The offered
+ * rate is that of the schedule, the achieved one that of the writes:
+ * the difference and the lags show where the link, the driver or the
+ * kernel buffers cannot keep up with bursts.
+ */
+struct traffic_t {
+    struct traffic_config_t config;
+    uint64_t rng;
+
+    uint64_t *gaps_ns;        /* trace */
+    size_t   gaps_num;
+    size_t   gap_next;
+    uint64_t loops;           /* trace replays completed */
+
+    struct timespec start_ts;
+    uint64_t due_ns;          /* of next packet, from start */
+    uint8_t  started;
+
+    /* statistics */
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t first_sent_ns;   /* write start of first packet, from start */
+    uint64_t last_start_ns;   /* write start of last packet */
+    uint64_t last_due_ns;
+    uint64_t late;
+    struct histogram_t lag;   /* write start behind due time, ns */
+};
+
+/*
+ * Parse "poisson,rate=<packets/s>", "onoff,rate=<packets/s>,period_ms=<ms>,duty=<0..1>"
+ * or "trace,file=<path>[,scale=<x>]", any of them with ",seed=<n>"
+ */
+int traffic_parse(const char *spec, struct traffic_config_t *config);
+
+/* Loads trace file, returns 0 or -1 */
+int  traffic_init(struct traffic_t *traffic, const struct traffic_config_t *config);
+void traffic_free(struct traffic_t *traffic);
+
+/* Due time of next packet, the first call starts the schedule */
+struct timespec traffic_due(struct traffic_t *traffic);
+
+/* Next packet, due at traffic_due(), written from start_ts to end_ts */
+void traffic_sent(struct traffic_t *traffic, size_t bytes, struct timespec start_ts, struct timespec end_ts);
+
+const char* traffic_type_name(uint8_t type);
+void traffic_print_config(const struct traffic_config_t *config);
+
+/* Offered against achieved rate and lags */
+void traffic_print_stats(struct traffic_t *traffic);
+
+#endif /* _TRAFFIC_H_ */
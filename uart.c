@@ -6,6 +6,7 @@
 #include <poll.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 
 #ifdef __powerpc__
 /*
@@ -37,6 +38,13 @@
 #include "uart.h"
 
 #include "uart_options.h"
+#include "uart_uring.h"
+#include "uart_sim.h"
+#include "uart_pack.h"
+#include "uart_mark.h"
+#include "uart_transport.h"
+#include "uart_profile.h"
+#include "async_log.h"
 
 #define N_ "UART: "
 #define N_ERR "UART ERROR: "
@@ -73,12 +81,23 @@ struct uart_t* uart_init(char* dev, struct uart_options_t options) {
     uart->timeout_msec = options.timeout_msec;
     uart->bytes_limit = options.bytes_limit;
 
+    (void)uart_set_backend(uart, options.io_backend);
+
     ret = uart_set_interface_attribs(uart, uart->speed, uart->bits, uart->parity, uart->stop_bits);
     if (ret != 0) {
         errprintf("uart_set_interface_attribs() failed\n");
         return NULL;
     }
 
+    if(options.error_marks && uart_set_error_marks(uart) != 0) {
+        errprintf("uart_set_error_marks() failed\n");
+        return NULL;
+    }
+
+    if(uart->sim != NULL) {
+        uart_sim_configure(uart, &options.sim);
+    }
+
     return uart;
 }
 
@@ -90,21 +109,56 @@ struct uart_t* uart_open(const char* serial_device) {
 
     dprintf("Opening %s \n", serial_device);
 
-    int fd = open(serial_device, O_RDWR | O_NOCTTY | O_SYNC);
-    if (fd < 0) {
-        strerr("open() %s error", serial_device);
+    instance->transport = uart_transport_from_device(serial_device);
+
+    if(instance->transport == UART_TRANSPORT_SIM) {
+        if(uart_sim_open(instance, serial_device) == NULL) {
+            free(instance);
+            return NULL;
+        }
+
+        instance->fd = -1;
+        instance->fd_tx = -1;
+        instance->backend = UART_BACKEND_SIM;
+    } else if(instance->transport != UART_TRANSPORT_TTY) {
+        if(uart_transport_open(instance, serial_device) != 0) {
+            free(instance);
+            return NULL;
+        }
+    } else {
+        int fd = open(serial_device, O_RDWR | O_NOCTTY | O_SYNC);
+        if (fd < 0) {
+            strerr("open() %s error", serial_device);
 
+            free(instance);
+            return NULL;
+        }
+
+        assert(fd > 0);
+
+        instance->fd = fd;
+        instance->fd_tx = fd;
+    }
+
+    instance->pack = uart_pack_create();
+    if(instance->pack == NULL) {
+        if(instance->sim != NULL) {
+            uart_sim_close(instance);
+        } else {
+            (void)close(instance->fd);
+        }
         free(instance);
         return NULL;
     }
 
-    assert(fd > 0);
-
-    instance->fd = fd;
     strncpy(instance->dev, serial_device, sizeof(instance->dev));
     instance->timeout_msec = UART_TIMEOUT_MSEC;
     instance->bytes_limit  = UART_BYTES_LIMIT;
 
+#ifdef UART_PROFILE
+    instance->profile = uart_profile_create();
+#endif
+
     dprintf("Device %s opened successfully \n", serial_device);
 
     return instance;
@@ -115,7 +169,40 @@ int uart_close(struct uart_t *instance) {
 
     dprintf("Closing device %s with fd %i \n", instance->dev, instance->fd);
 
-    int ret = close(instance->fd);
+#ifdef UART_PROFILE
+    uart_profile_print(instance->profile, instance->dev);
+    uart_profile_free(instance->profile);
+#endif
+
+    uart_pack_print_stats(instance->pack, instance->dev, uart_char_time_ns(instance));
+    uart_pack_free(instance->pack);
+    instance->pack = NULL;
+
+    if(instance->mark != NULL) {
+        uart_mark_print_stats(instance->mark, instance->dev);
+        uart_mark_free(instance->mark);
+        instance->mark = NULL;
+    }
+
+    free(instance->gather);
+    instance->gather = NULL;
+
+    if(instance->uring != NULL) {
+        uart_uring_free(instance);
+    }
+
+    if(instance->sim != NULL) {
+        uart_sim_close(instance);
+        free(instance);
+        return 0;
+    }
+
+    if(instance->fd_tx >= 0 && instance->fd_tx != instance->fd) {
+        (void)close(instance->fd_tx);
+    }
+
+    /* Lost device that did not come back has no fd, see uart_reopen() */
+    int ret = (instance->fd >= 0) ? close(instance->fd) : 0;
     if (ret < 0) {
         strerr("close() error");
         return -1;
@@ -127,9 +214,64 @@ int uart_close(struct uart_t *instance) {
     return 0;
 }
 
+int uart_reopen(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->transport == UART_TRANSPORT_TTY);
+
+    int backend = instance->backend;
+
+    if(instance->uring != NULL) {
+        uart_uring_free(instance);
+    }
+
+    if(instance->fd >= 0) {
+        (void)close(instance->fd);
+        instance->fd = -1;
+        instance->fd_tx = -1;
+    }
+
+    int fd = open(instance->dev, O_RDWR | O_NOCTTY | O_SYNC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    instance->fd = fd;
+    instance->fd_tx = fd;
+    instance->device_lost = 0;
+
+    /* Stream offsets of error markers start again, as packing does */
+    if(instance->mark != NULL) {
+        instance->mark->state = UART_MARK_STATE_DATA;
+        instance->mark->offset = 0;
+    }
+
+    /* Configures packing again, both directions start from scratch */
+    if(uart_set_interface_attribs(instance, instance->speed, instance->bits, instance->parity, instance->stop_bits) != 0) {
+        return -1;
+    }
+
+    (void)uart_set_backend(instance, backend);
+
+    dprintf("Device %s reopened\n", instance->dev);
+
+    return 0;
+}
+
 int uart_set_interface_attribs (struct uart_t *instance, unsigned int speed, int bits, int parity, int stop_bits) {
         assert(instance != NULL);
 
+        /* Links other than tty take frame format for character time only */
+        if (instance->transport != UART_TRANSPORT_TTY) {
+            instance->speed = speed;
+            instance->bits = bits;
+            instance->parity = parity;
+            instance->stop_bits = stop_bits;
+
+            if(bits >= UART_BITS_5 && bits <= UART_BITS_8)
+                uart_pack_configure(instance->pack, bits);
+            return 0;
+        }
+
 #ifdef __powerpc__
 #define IOCTL_GETS TCGETS
 #define IOCTL_SETS TCSETS
@@ -216,6 +358,14 @@ int uart_set_interface_attribs (struct uart_t *instance, unsigned int speed, int
         tty.c_cc[VTIME] = 0;            // no timeout
 
         tty.c_iflag &= ~(IXON | IXOFF | IXANY); // enable xon/xoff ctrl
+        tty.c_iflag &= ~(ICRNL | INLCR | IGNCR | ISTRIP); // no CR/NL translation
+                                                          // of binary data
+
+        /* Parity and framing errors and breaks in band as \377 \0 <c>, see uart_mark.h */
+        if (instance->mark != NULL) {
+            tty.c_iflag &= ~(IGNPAR | BRKINT);
+            tty.c_iflag |= (INPCK | PARMRK);
+        }
         tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls, enable reading
         tty.c_cflag &= ~CRTSCTS;
 
@@ -250,6 +400,8 @@ int uart_set_interface_attribs (struct uart_t *instance, unsigned int speed, int
         instance->parity = parity;
         instance->stop_bits = stop_bits;
 
+        uart_pack_configure(instance->pack, bits);
+
         /* Set exclusive mode for tty */
         if (ioctl(instance->fd, TIOCEXCL) != 0)
         {
@@ -260,43 +412,164 @@ int uart_set_interface_attribs (struct uart_t *instance, unsigned int speed, int
         return 0;
 }
 
-/*
- * return codes:
- * -1 - error
- * 0  - timeout
- * 1  - data avaiable
- */
-int uart_poll(struct uart_t *instance, int timeout_msec) {
+int uart_set_error_marks(struct uart_t *instance) {
     assert(instance != NULL);
 
+    if(instance->mark != NULL)
+        return 0;
+
+    instance->mark = uart_mark_create();
+    if(instance->mark == NULL)
+        return -1;
+
+    if(instance->transport != UART_TRANSPORT_TTY)
+        return 0;
+
+    return uart_set_interface_attribs(instance, instance->speed, instance->bits, instance->parity, instance->stop_bits);
+}
+
+int uart_set_backend(struct uart_t *instance, int backend) {
+    assert(instance != NULL);
+
+    /* Simulated link has no file descriptor to hand to other backends */
+    if(instance->sim != NULL) {
+        return instance->backend;
+    }
+
+    /* io_uring writes to the read fd, pipe ends differ */
+    if(backend == UART_BACKEND_URING && instance->fd_tx != instance->fd) {
+        errprintf("io_uring backend needs one fd for both directions - fallback to read()/write()\n");
+        backend = UART_BACKEND_SYSCALL;
+    }
+
+    if(backend == UART_BACKEND_URING && instance->uring == NULL) {
+        instance->uring = uart_uring_init(instance);
+        if(instance->uring == NULL) {
+            errprintf("io_uring backend is not available - fallback to read()/write()\n");
+            backend = UART_BACKEND_SYSCALL;
+        }
+    }
+
+    if(backend == UART_BACKEND_SYSCALL && instance->uring != NULL) {
+        uart_uring_free(instance);
+    }
+
+    instance->backend = backend;
+
+    return backend;
+}
+
+static int uart_poll_wait(struct uart_t *instance, int timeout_msec) {
+    if(instance->uring != NULL) {
+        return uart_uring_poll(instance, timeout_msec);
+    }
+
+    if(instance->sim != NULL) {
+        return uart_sim_poll(instance, timeout_msec);
+    }
+
     struct pollfd fds;
     memset(&fds, 0x00, sizeof(struct pollfd));
 
     fds.fd = instance->fd;
     fds.events = POLLIN;
 
+    UART_PROFILE_BEGIN(profile_ts);
     int ret = poll(&fds, 1, timeout_msec);
+    UART_PROFILE_END(instance, UART_PROFILE_POLL, profile_ts, ret, 0);
     if(ret == -1) {
         strerr("uart_poll() : poll() failed");
         return -1;
     }
 
     if(ret == 0) {
-        dprintf("uart_poll(): timeout \n");
+        alog0(ALOG_DEBUG, N_ "uart_poll(): timeout \n");
         return 0;
     }
 
     if(fds.revents != POLLIN) {
-        printf("uart_poll(): unexpected revents returned");
+        alog1(ALOG_WARN, N_ "uart_poll(): unexpected revents returned: 0x%" PRIx64 "\n", fds.revents);
     }
 
     return 1;
 }
 
+/*
+ * return codes:
+ * -1 - error
+ * 0  - timeout
+ * 1  - data avaiable
+ */
+int uart_poll(struct uart_t *instance, int timeout_msec) {
+    assert(instance != NULL);
+
+    int ret = uart_poll_wait(instance, timeout_msec);
+
+    /* Silent line ends a broken frame of packed characters */
+    if(ret == 0 && timeout_msec >= UART_PACK_IDLE_MSEC && uart_pack_enabled(instance->pack)) {
+        uart_pack_rx_idle(instance->pack);
+    }
+
+    return ret;
+}
+
+/*
+ * Simulated link read of count bytes: returns 0 when nothing arrived
+ * within one wait, partial data when the line stays silent for
+ * timeout_msec in the middle
+ */
+static ssize_t uart_read_sim(struct uart_t *instance, void *buf, size_t count) {
+    size_t bytes_read = 0;
+    int idle_msec = 0;
+
+    while(bytes_read != count) {
+        instance->syscalls++;
+
+        ssize_t bytes = uart_sim_read(instance, (uint8_t*)buf + bytes_read, count - bytes_read);
+        if(bytes == 0) {
+            if(bytes_read == 0)
+                return 0;
+
+            idle_msec += UART_SIM_WAIT_MSEC;
+            if(idle_msec >= instance->timeout_msec) {
+                errprintf("simulated link silent: only %lu of %lu bytes read\n", bytes_read, count);
+                return bytes_read;
+            }
+            continue;
+        }
+
+        bytes_read += bytes;
+        idle_msec = 0;
+    }
+
+    return bytes_read;
+}
+
+static ssize_t uart_read_decoded(struct uart_t *instance, void *buf, size_t count);
+
+/* Errors of a tty whose device is gone: USB adapter unplugged or reset, PTY master closed */
+static void uart_check_lost(struct uart_t *instance) {
+    if(instance->transport == UART_TRANSPORT_TTY && (errno == EIO || errno == ENODEV || errno == ENXIO)) {
+        instance->device_lost = 1;
+    }
+}
+
 ssize_t uart_read(struct uart_t *instance, void *buf, size_t count) {
     assert(instance != NULL);
     assert(buf != NULL);
 
+    if(uart_pack_enabled(instance->pack) || instance->mark != NULL) {
+        return uart_read_decoded(instance, buf, count);
+    }
+
+    if(instance->uring != NULL) {
+        return uart_uring_read(instance, buf, count);
+    }
+
+    if(instance->sim != NULL) {
+        return uart_read_sim(instance, buf, count);
+    }
+
     size_t bytes_read = 0;
     size_t bytes_total = count;
 
@@ -304,12 +577,27 @@ ssize_t uart_read(struct uart_t *instance, void *buf, size_t count) {
 
     while(bytes_read != bytes_total)
     {
+        instance->syscalls++;
+
+        UART_PROFILE_BEGIN(profile_ts);
         ssize_t bytes = read(instance->fd, buf, count);
+        UART_PROFILE_END(instance, UART_PROFILE_READ, profile_ts, bytes, count);
         if(bytes == -1) {
+            uart_check_lost(instance);
             strerr("uart_read() : read() error");
             return bytes_read;
         }
 
+        if(bytes == 0 && instance->transport != UART_TRANSPORT_TTY) {
+            instance->peer_closed = 1;
+            return bytes_read;
+        }
+
+        if(bytes == 0) {
+            instance->device_lost = 1;
+            return bytes_read;
+        }
+
         buf += bytes;
         bytes_read += bytes;
         count -= bytes;
@@ -327,6 +615,128 @@ ssize_t uart_read(struct uart_t *instance, void *buf, size_t count) {
     return bytes_read;
 }
 
+/* Single read of characters as they are on the line */
+static ssize_t uart_read_raw(struct uart_t *instance, void *buf, size_t count) {
+    if(instance->uring != NULL) {
+        return uart_uring_read_some(instance, buf, count);
+    }
+
+    if(instance->sim != NULL) {
+        instance->syscalls++;
+        return uart_sim_read(instance, buf, count);
+    }
+
+    instance->syscalls++;
+
+    UART_PROFILE_BEGIN(profile_ts);
+    ssize_t bytes = read(instance->fd, buf, count);
+    UART_PROFILE_END(instance, UART_PROFILE_READ, profile_ts, bytes, count);
+    if(bytes == -1) {
+        uart_check_lost(instance);
+        strerr("uart_read_some() : read() error");
+    }
+
+    if(bytes == 0 && instance->transport != UART_TRANSPORT_TTY) {
+        instance->peer_closed = 1;
+    }
+
+    /* Blocking tty read returns nothing only after hangup */
+    if(bytes == 0 && instance->transport == UART_TRANSPORT_TTY) {
+        instance->device_lost = 1;
+    }
+
+    return bytes;
+}
+
+/* Single read of characters, error markers removed: blocks until a character is left */
+static ssize_t uart_read_chars(struct uart_t *instance, void *buf, size_t count) {
+    if(instance->mark == NULL) {
+        return uart_read_raw(instance, buf, count);
+    }
+
+    while(1) {
+        ssize_t ret = uart_read_raw(instance, buf, count);
+        if(ret <= 0)
+            return ret;
+
+        size_t chars = uart_mark_decode(instance->mark, (uint8_t*)buf, ret, (uint8_t*)buf);
+        if(chars > 0)
+            return chars;
+    }
+}
+
+/* Read characters until they give at least one byte */
+static ssize_t uart_read_some_packed(struct uart_t *instance, void *buf, size_t count) {
+    struct uart_pack_t *pack = instance->pack;
+
+    if(count == 0)
+        return 0;
+
+    size_t pending = uart_pack_take_pending(pack, (uint8_t*)buf, count);
+    if(pending > 0)
+        return pending;
+
+    while(1) {
+        size_t chars = uart_pack_chars_for(pack, count);
+        uint8_t *wire = uart_pack_buffer(pack, chars);
+
+        if(instance->mark != NULL)
+            uart_mark_set_position(instance->mark, pack->rx.bytes, pack->bits);
+
+        ssize_t ret = uart_read_chars(instance, wire, chars);
+        if(ret <= 0) {
+            /* Simulated link returns nothing after UART_SIM_WAIT_MSEC of silence */
+            if(ret == 0 && instance->sim != NULL)
+                uart_pack_rx_idle(pack);
+            return ret;
+        }
+
+        size_t bytes = uart_pack_decode(pack, wire, ret, (uint8_t*)buf, count);
+        if(bytes > 0)
+            return bytes;
+    }
+}
+
+/* uart_read() of packed characters or marked errors, partial data when the line stays silent for timeout_msec */
+static ssize_t uart_read_decoded(struct uart_t *instance, void *buf, size_t count) {
+    size_t bytes_read = 0;
+    int idle_msec = 0;
+
+    while(bytes_read != count) {
+        ssize_t bytes = uart_read_some(instance, (uint8_t*)buf + bytes_read, count - bytes_read);
+        if(bytes < 0)
+            return bytes_read;
+
+        if(bytes == 0) {
+            if(instance->peer_closed || (bytes_read == 0 && instance->sim != NULL))
+                return bytes_read;
+
+            idle_msec += UART_SIM_WAIT_MSEC;
+            if(idle_msec >= instance->timeout_msec) {
+                errprintf("line silent: only %lu of %lu bytes read\n", bytes_read, count);
+                return bytes_read;
+            }
+            continue;
+        }
+
+        bytes_read += bytes;
+        idle_msec = 0;
+    }
+
+    return bytes_read;
+}
+
+ssize_t uart_read_some(struct uart_t *instance, void *buf, size_t count) {
+    assert(instance != NULL);
+    assert(buf != NULL);
+
+    if(uart_pack_enabled(instance->pack)) {
+        return uart_read_some_packed(instance, buf, count);
+    }
+
+    return uart_read_chars(instance, buf, count);
+}
+
 unsigned char uart_read_byte(struct uart_t *instance) {
     assert(instance != NULL);
 
@@ -334,8 +744,22 @@ unsigned char uart_read_byte(struct uart_t *instance) {
     int ret = 0;
     int counter = 0;
 
+    if(uart_pack_enabled(instance->pack) || instance->mark != NULL) {
+        return (uart_read_decoded(instance, &c, 1) == 1) ? c : 0x00;
+    }
+
     while(ret != 1) {
-        ret = read(instance->fd, (unsigned char*)&c, 1);
+        if(instance->uring != NULL) {
+            ret = (uart_uring_read(instance, &c, 1) == 1) ? 1 : -1;
+        } else if(instance->sim != NULL) {
+            instance->syscalls++;
+            ret = uart_sim_read(instance, &c, 1);
+        } else {
+            instance->syscalls++;
+            UART_PROFILE_BEGIN(profile_ts);
+            ret = read(instance->fd, (unsigned char*)&c, 1);
+            UART_PROFILE_END(instance, UART_PROFILE_READ, profile_ts, ret, 1);
+        }
         if(ret == -1) {
             strerr("uart_read_byte() : read() error");
         }
@@ -348,7 +772,7 @@ unsigned char uart_read_byte(struct uart_t *instance) {
 
         #ifdef UART_DEBUG_BYTES
         if(ret == 1) {
-            dprintf("c = 0x%02x \n", c);
+            alog1(ALOG_DEBUG, N_ "c = 0x%02" PRIx64 " \n", c);
         }
         #endif
     } /* while */
@@ -380,27 +804,345 @@ unsigned int uart_read_word(struct uart_t *instance) {
     return word;
 }
 
+/* Write characters as they go on the line */
+static int uart_write_chars(struct uart_t *instance, const void* buf, size_t count) {
+    if(instance->uring != NULL) {
+        return uart_uring_write(instance, buf, count);
+    }
+
+    if(instance->sim != NULL) {
+        instance->syscalls++;
+        return uart_sim_write(instance, buf, count);
+    }
+
+    instance->syscalls++;
+
+    UART_PROFILE_BEGIN(profile_ts);
+    int ret = write(instance->fd_tx, (const uint8_t*)buf, count);
+    UART_PROFILE_END(instance, UART_PROFILE_WRITE, profile_ts, ret, count);
+
+    if(ret == -1) {
+        strerr("write() error");
+        return -1;
+    }
+
+    return ret;
+}
+
+/* Characters do not map back to bytes: all of them are written, returns count */
+static int uart_write_encoded(struct uart_t *instance, const void* buf, size_t count) {
+    const uint8_t *wire = (const uint8_t*)buf;
+    size_t chars = count;
+    size_t done = 0;
+
+    if(uart_pack_enabled(instance->pack)) {
+        struct uart_pack_t *pack = instance->pack;
+        uint8_t *packed = uart_pack_buffer(pack, uart_pack_chars_max(pack, count));
+
+        chars = uart_pack_encode(pack, wire, count, packed);
+        wire = packed;
+    }
+
+    /* Peer decodes error markers: escape \377 as the kernel does */
+    if(instance->mark != NULL && instance->transport != UART_TRANSPORT_TTY && chars > 0) {
+        uint8_t *escaped = uart_mark_buffer(instance->mark, 2 * chars);
+        if(escaped == NULL)
+            return -1;
+
+        chars = uart_mark_escape(wire, chars, escaped);
+        wire = escaped;
+    }
+
+    while(done < chars) {
+        int ret = uart_write_chars(instance, wire + done, chars - done);
+        if(ret <= 0)
+            return -1;
+        done += ret;
+    }
+
+    return count;
+}
+
 int uart_write(struct uart_t *instance, const void* buf, size_t count) {
     assert(instance != NULL);
     assert(buf != NULL);
 
-    int ret = write(instance->fd, (const uint8_t*)buf, count);
+    if(uart_pack_enabled(instance->pack) ||
+       (instance->mark != NULL && instance->transport != UART_TRANSPORT_TTY)) {
+        return uart_write_encoded(instance, buf, count);
+    }
+
+    return uart_write_chars(instance, buf, count);
+}
+
+int uart_writev(struct uart_t *instance, const struct iovec *iov, int iovcnt) {
+    assert(instance != NULL);
+    assert(iov != NULL || iovcnt == 0);
+
+    size_t count = 0;
+    for(int i = 0; i < iovcnt; i++)
+        count += iov[i].iov_len;
+
+    /* Encoding needs the frame in one piece */
+    if(uart_pack_enabled(instance->pack) ||
+       (instance->mark != NULL && instance->transport != UART_TRANSPORT_TTY)) {
+        if(count > instance->gather_size) {
+            uint8_t *gather = (uint8_t*)realloc(instance->gather, count);
+            if(gather == NULL) {
+                errprintf("realloc() of %lu bytes failed\n", count);
+                return -1;
+            }
+
+            instance->gather = gather;
+            instance->gather_size = count;
+        }
+
+        size_t have = 0;
+        for(int i = 0; i < iovcnt; i++) {
+            memcpy(instance->gather + have, iov[i].iov_base, iov[i].iov_len);
+            have += iov[i].iov_len;
+        }
+
+        return uart_write_encoded(instance, instance->gather, count);
+    }
+
+    /* Both copy writes into their own queue anyway: a write per part */
+    if(instance->uring != NULL || instance->sim != NULL) {
+        size_t done = 0;
+
+        if(instance->sim != NULL)
+            instance->syscalls++;
+
+        for(int i = 0; i < iovcnt; i++) {
+            int ret = (instance->uring != NULL) ?
+                      uart_uring_write(instance, iov[i].iov_base, iov[i].iov_len) :
+                      uart_sim_write(instance, iov[i].iov_base, iov[i].iov_len);
+            if(ret < 0)
+                return -1;
+
+            done += ret;
+            if((size_t)ret != iov[i].iov_len)
+                break;
+        }
+
+        return done;
+    }
+
+    instance->syscalls++;
+
+    UART_PROFILE_BEGIN(profile_ts);
+    ssize_t ret = writev(instance->fd_tx, iov, iovcnt);
+    UART_PROFILE_END(instance, UART_PROFILE_WRITE, profile_ts, ret, count);
 
     if(ret == -1) {
-        strerr("write() error");
+        strerr("writev() error");
         return -1;
     }
 
     return ret;
 }
 
+int uart_flush(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    if(instance->uring != NULL) {
+        return uart_uring_drain(instance);
+    }
+
+    if(instance->sim != NULL) {
+        return uart_sim_drain(instance);
+    }
+
+    return 0;
+}
+
+int uart_submit(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    if(instance->uring != NULL) {
+        return uart_uring_flush(instance);
+    }
+
+    /* Simulated link takes writes into its queue at once */
+    return 0;
+}
+
+int uart_wait_read(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    if(instance->sim != NULL) {
+        return uart_sim_wait_read(instance);
+    }
+
+    int queued = uart_get_outq(instance);
+    int idle_msec = 0;
+
+    while(queued > 0) {
+        usleep(1000);
+
+        int now_queued = uart_get_outq(instance);
+        if(now_queued < queued) {
+            idle_msec = 0;
+        } else if(++idle_msec >= instance->timeout_msec) {
+            errprintf("uart_wait_read(): %i bytes not read by peer\n", now_queued);
+            return -1;
+        }
+
+        queued = now_queued;
+    }
+
+    return (queued < 0) ? -1 : 0;
+}
+
+int uart_shutdown(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    switch(instance->transport) {
+        case UART_TRANSPORT_PIPE:
+            if(instance->fd_tx >= 0 && close(instance->fd_tx) != 0) {
+                strerr("close() error");
+                return -1;
+            }
+            instance->fd_tx = -1;
+            break;
+        case UART_TRANSPORT_SOCKETPAIR:
+        case UART_TRANSPORT_UNIX:
+        case UART_TRANSPORT_TCP:
+            if(shutdown(instance->fd, SHUT_WR) != 0) {
+                strerr("shutdown() error");
+                return -1;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+int uart_get_outq(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    int bytes = 0;
+
+    if(instance->sim != NULL) {
+        return uart_sim_outq(instance);
+    }
+
+    /* Pipe has no output queue, bytes not read yet by peer are the closest */
+    if(instance->transport == UART_TRANSPORT_PIPE) {
+        UART_PROFILE_BEGIN(profile_ts);
+        int ret = ioctl(instance->fd_tx, FIONREAD, &bytes);
+        UART_PROFILE_END(instance, UART_PROFILE_IOCTL, profile_ts, ret, 0);
+        if(ret != 0) {
+            strerr("ioctl(FIONREAD) failed");
+            return -1;
+        }
+        return bytes;
+    }
+
+    UART_PROFILE_BEGIN(profile_ts);
+    int ret = ioctl(instance->fd, TIOCOUTQ, &bytes);
+    UART_PROFILE_END(instance, UART_PROFILE_IOCTL, profile_ts, ret, 0);
+    if(ret != 0) {
+        strerr("ioctl(TIOCOUTQ) failed");
+        return -1;
+    }
+
+    return bytes;
+}
+
+int uart_get_inq(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    int bytes = 0;
+
+    if(instance->sim != NULL) {
+        return uart_sim_inq(instance);
+    }
+
+    UART_PROFILE_BEGIN(profile_ts);
+    int ret = ioctl(instance->fd, TIOCINQ, &bytes);
+    UART_PROFILE_END(instance, UART_PROFILE_IOCTL, profile_ts, ret, 0);
+    if(ret != 0) {
+        strerr("ioctl(TIOCINQ) failed");
+        return -1;
+    }
+
+    return bytes;
+}
+
+uint64_t uart_char_time_ns(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    if(instance->speed <= 0) {
+        return 0;
+    }
+
+    /* start bit + data bits + parity bit + stop bits */
+    unsigned int frame_bits = 1 + instance->bits + (instance->parity != UART_PARITY_NONE ? 1 : 0) +
+                              instance->stop_bits;
+
+    return (uint64_t)frame_bits * 1000000000ULL / instance->speed;
+}
+
+uint64_t uart_byte_time_ns(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    uint64_t char_time_ns = uart_char_time_ns(instance);
+
+    if(uart_pack_enabled(instance->pack)) {
+        return char_time_ns * 8 / instance->bits;
+    }
+
+    return char_time_ns;
+}
+
+void uart_set_framing(struct uart_t *instance, size_t header_size, size_t (*frame_size)(const uint8_t *header)) {
+    assert(instance != NULL);
+
+    uart_pack_set_framing(instance->pack, header_size, frame_size);
+}
+
+void uart_set_frame_fixed(struct uart_t *instance, size_t frame_fixed) {
+    assert(instance != NULL);
+
+    uart_pack_set_frame_fixed(instance->pack, frame_fixed);
+}
+
+void uart_rx_lost(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    if(uart_pack_enabled(instance->pack)) {
+        uart_pack_rx_lost(instance->pack);
+    }
+}
+
 const struct serial_icounter_struct* uart_get_icounter(struct uart_t *instance) {
     assert(instance != NULL);
 
     static struct serial_icounter_struct icount;
     int ret = 0;
 
+    if(instance->sim != NULL) {
+        uint64_t rx = 0, tx = 0;
+        uart_sim_counters(instance, &rx, &tx);
+
+        memset(&icount, 0x00, sizeof(icount));
+        icount.rx = (int)rx;
+        icount.tx = (int)tx;
+
+        return &icount;
+    }
+
+    /* Serial line counters exist for tty only, not for a lost one */
+    if(instance->transport != UART_TRANSPORT_TTY || instance->fd < 0) {
+        return NULL;
+    }
+
+    UART_PROFILE_BEGIN(profile_ts);
     ret = ioctl(instance->fd, TIOCGICOUNT, &icount);
+    UART_PROFILE_END(instance, UART_PROFILE_IOCTL, profile_ts, ret, 0);
     if(ret != 0) {
         strerr("ioctl(TIOCGICOUNT) failed");
         return NULL;
@@ -421,5 +1163,9 @@ void uart_print_icounter(struct uart_t *instance) {
             icount->rx,  icount->tx, icount->frame, icount->overrun, icount->parity,
             icount->brk, icount->buf_overrun);
 
+    if(instance->sim != NULL) {
+        uart_sim_print_stats(instance);
+    }
+
     return;
 }
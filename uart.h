@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <stddef.h>
+#include <sys/uio.h>
 #include <linux/serial.h>
 
 #include "uart_options.h"
@@ -25,9 +26,24 @@
 #define UART_DEFAULT_STOP_BITS UART_STOP_BITS_1
 #define UART_DEFAULT_BITS      UART_BITS_8
 
+#define UART_BACKEND_SYSCALL 0 /* read()/write() */
+#define UART_BACKEND_URING   1 /* io_uring, see uart_uring.h */
+#define UART_BACKEND_SIM     2 /* in-process simulated link, see uart_sim.h */
+
+#define UART_DEFAULT_BACKEND UART_BACKEND_SYSCALL
+
+struct uart_uring_t;
+struct uart_sim_t;
+struct uart_pack_t;
+struct uart_mark_t;
+
 struct uart_t {
     int fd;
+    int fd_tx;     /* differs from fd for pipe transport only */
     char dev[64];
+    int transport; /* UART_TRANSPORT_*, see uart_transport.h */
+    uint8_t peer_closed; /* pipe or socket read() returned end of file */
+    uint8_t device_lost; /* tty read() failed with EIO/ENODEV or hung up: adapter gone */
 
     int speed;
     int parity;    /* 0 - none, 1 -odd, 2 - even */
@@ -36,6 +52,22 @@ struct uart_t {
 
     int timeout_msec;
     int bytes_limit;
+
+    int backend;
+    struct uart_uring_t *uring;
+    struct uart_sim_t *sim;    /* device "sim[:name]", fd is -1 */
+
+    struct uart_pack_t *pack;  /* 5-7 bit characters: byte stream packed into bits, see uart_pack.h */
+    struct uart_mark_t *mark;  /* parity/framing error markers removed from reads, NULL - off, see uart_mark.h */
+
+    uint8_t *gather;           /* parts of uart_writev() on links that encode writes */
+    size_t   gather_size;
+
+    uint64_t syscalls; /* I/O syscalls issued */
+
+#ifdef UART_PROFILE
+    struct uart_profile_t *profile; /* see uart_profile.h */
+#endif
 };
 
 #define UART_TIMEOUT_MSEC 300
@@ -46,16 +78,73 @@ struct uart_t* uart_init(char* dev, struct uart_options_t options);
 struct uart_t* uart_open(const char* serial_device);
 int uart_close(struct uart_t *instance);
 
+/*
+ * Close tty device after device_lost and open it again: speed, frame
+ * format, backend and error marking are applied again, packing and
+ * marker stream offsets restart. Returns 0 or -1 with the old fd
+ * closed and errno of open() kept, call again when the node is back.
+ */
+int uart_reopen(struct uart_t *instance);
+
 int uart_set_interface_attribs (struct uart_t *instance, unsigned int speed, int bits, int parity, int stop_bits);
 void uart_set_blocking (struct uart_t *instance, int should_block);
 
+/*
+ * Mark parity and framing errors in the receive stream (INPCK, PARMRK):
+ * reads drop the markers and queue error offsets in instance->mark.
+ * Other transports than tty decode markers written by the peer.
+ */
+int uart_set_error_marks(struct uart_t *instance);
+
+/* Select I/O backend, falls back to UART_BACKEND_SYSCALL - returns backend used */
+int uart_set_backend(struct uart_t *instance, int backend);
+
 int uart_poll(struct uart_t *instance, int timeout_msec);
 
 ssize_t  uart_read(struct uart_t *instance, void *buf, size_t count);
+/* Single read: returns bytes available (blocks until at least one) or -1 */
+ssize_t  uart_read_some(struct uart_t *instance, void *buf, size_t count);
 uint8_t  uart_read_byte(struct uart_t *instance);
 uint32_t uart_read_word(struct uart_t *instance);
 
 int uart_write(struct uart_t *instance, const void* buf, size_t count);
+/*
+ * Write iovcnt parts as one write, returns bytes written or -1. Parts
+ * go to the fd with one writev() and are not copied; links that pack
+ * or escape writes gather them first, a frame is encoded as a whole.
+ */
+int uart_writev(struct uart_t *instance, const struct iovec *iov, int iovcnt);
+
+/* Wait until queued writes are done (io_uring backend), no-op for syscalls */
+int uart_flush(struct uart_t *instance);
+/* Hand queued writes to the kernel without waiting for them (io_uring backend), no-op otherwise */
+int uart_submit(struct uart_t *instance);
+
+/*
+ * Wait until the output queue is empty: sent for tty, read by peer
+ * for pipe, socket and simulated links. Gives up when the queue does
+ * not shrink for timeout_msec.
+ */
+int uart_wait_read(struct uart_t *instance);
+
+/* No more writes: peer read returns 0 once queued data is read (pipe and socket transports) */
+int uart_shutdown(struct uart_t *instance);
+
+/* Bytes in kernel output/input queue (ioctl TIOCOUTQ/TIOCINQ) or -1 */
+int uart_get_outq(struct uart_t *instance);
+int uart_get_inq(struct uart_t *instance);
+
+/* Time of one character on the wire for configured speed and frame format */
+uint64_t uart_char_time_ns(struct uart_t *instance);
+/* Time of one byte on the wire: a character, or 8 / bits characters when packing */
+uint64_t uart_byte_time_ns(struct uart_t *instance);
+
+/* Frame size function for packing of 5-7 bit characters, see uart_pack.h */
+void uart_set_framing(struct uart_t *instance, size_t header_size, size_t (*frame_size)(const uint8_t *header));
+/* All frames are frame_fixed bytes, 0 - any size the header tells */
+void uart_set_frame_fixed(struct uart_t *instance, size_t frame_fixed);
+/* Frame last read failed its check: packing hunts for the next frame start, no-op otherwise */
+void uart_rx_lost(struct uart_t *instance);
 
 /* Get icounter values using ioctl(TIOCGICOUNT) */
 const struct serial_icounter_struct* uart_get_icounter(struct uart_t *instance);
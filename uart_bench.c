@@ -0,0 +1,593 @@
+/*
+ * PTY pair benchmark for UART I/O backends
+ *
+ * Opens a pseudo terminal pair, writes a stream of bytes to the master
+ * from one thread and reads it back from the slave in another thread,
+ * for every I/O backend. Reports throughput and syscalls per byte.
+ *
+ * With -k measures packet checksum algorithms on in-memory buffers instead.
+ * With -H checks packet header formats round trip on edge values and
+ * measures encode and decode per header.
+ * With -m checks decoding of in-band error markers on crafted streams,
+ * split across reads at every position.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <assert.h>
+#include <time.h>
+
+#include "uart.h"
+#include "utils.h"
+#include "checksum.h"
+#include "packet.h"
+#include "uart_mark.h"
+
+#define N_ERR "UART_BENCH ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define BENCH_DEFAULT_BYTES (8 * 1024 * 1024)
+#define BENCH_DEFAULT_CHUNK 64
+#define BENCH_HEADER_FRAME 64   /* packet of timed header encode and decode */
+#define BENCH_HEADER_RING  4096 /* frames encoded, then decoded, per pass */
+#define BENCH_HEADER_LENGTH_MAX 20000 /* packet lengths checked to make exactly, both sides of 16384 */
+#define BENCH_MARK_EVENTS 4     /* events of one crafted stream */
+
+struct bench_t {
+    struct uart_t *tx;
+    struct uart_t *rx;
+
+    size_t total;
+    size_t chunk;
+
+    size_t received;
+    size_t errors;
+};
+
+static void* bench_writer(void *arg) {
+    struct bench_t *bench = (struct bench_t*)arg;
+    uint8_t buf[bench->chunk];
+    size_t sent = 0;
+
+    while(sent < bench->total) {
+        size_t size = bench->total - sent;
+        if(size > bench->chunk)
+            size = bench->chunk;
+
+        for(size_t i = 0; i < size; i++) {
+            buf[i] = (uint8_t)(sent + i);
+        }
+
+        int ret = uart_write(bench->tx, buf, size);
+        if(ret <= 0) {
+            break;
+        }
+        sent += ret;
+    }
+
+    (void)uart_flush(bench->tx);
+
+    return NULL;
+}
+
+static void bench_reader(struct bench_t *bench) {
+    uint8_t buf[bench->chunk];
+
+    while(bench->received < bench->total) {
+        size_t size = bench->total - bench->received;
+        if(size > bench->chunk)
+            size = bench->chunk;
+
+        ssize_t ret = uart_read(bench->rx, buf, size);
+        if(ret <= 0) {
+            break;
+        }
+
+        for(ssize_t i = 0; i < ret; i++) {
+            if(buf[i] != (uint8_t)(bench->received + i))
+                bench->errors++;
+        }
+        bench->received += ret;
+    }
+}
+
+static int bench_run(int backend, size_t total, size_t chunk) {
+    struct bench_t bench;
+    memset(&bench, 0x00, sizeof(bench));
+
+    bench.total = total;
+    bench.chunk = chunk;
+
+    bench.tx = uart_open("/dev/ptmx");
+    if(bench.tx == NULL) {
+        return -1;
+    }
+
+    if(grantpt(bench.tx->fd) != 0 || unlockpt(bench.tx->fd) != 0) {
+        errprintf("grantpt()/unlockpt() failed\n");
+        uart_close(bench.tx);
+        return -1;
+    }
+
+    bench.rx = uart_open(ptsname(bench.tx->fd));
+    if(bench.rx == NULL) {
+        uart_close(bench.tx);
+        return -1;
+    }
+
+    /* Raw mode on slave side */
+    bench.rx->bits = UART_BITS_8;
+    bench.rx->parity = UART_PARITY_NONE;
+    bench.rx->stop_bits = UART_STOP_BITS_1;
+
+    if(uart_set_interface_attribs(bench.rx, UART_DEFAULT_SPEED, UART_BITS_8,
+                                  UART_PARITY_NONE, UART_STOP_BITS_1) != 0) {
+        uart_close(bench.rx);
+        uart_close(bench.tx);
+        return -1;
+    }
+
+    int used = uart_set_backend(bench.tx, backend);
+    (void)uart_set_backend(bench.rx, backend);
+
+    struct timespec start, stop;
+    pthread_t writer;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_create(&writer, NULL, bench_writer, &bench);
+    bench_reader(&bench);
+    pthread_join(writer, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    struct timespec elapsed = timespec_diff(start, stop);
+    double seconds = elapsed.tv_sec + elapsed.tv_nsec / 1.0e9;
+
+    printf("%-8s %10lu %8.3f %10.2f %10" PRIu64 " %10" PRIu64 " %9.4f %8lu\n",
+           (used == UART_BACKEND_URING ? "uring" : "syscall"),
+           bench.received, seconds, bench.received / seconds / (1024 * 1024),
+           bench.tx->syscalls, bench.rx->syscalls,
+           (double)(bench.tx->syscalls + bench.rx->syscalls) / bench.received,
+           bench.errors);
+
+    uart_close(bench.rx);
+    uart_close(bench.tx);
+
+    return 0;
+}
+
+typedef uint32_t (*bench_checksum_func_t)(const void *buf, size_t size);
+
+static uint32_t bench_crc32c_table(const void *buf, size_t size) {
+    return crc32c_table(0x00, buf, size);
+}
+
+#if defined(CHECKSUM_CRC32C_HW)
+static uint32_t bench_crc32c_hw(const void *buf, size_t size) {
+    return crc32c_hw(0x00, buf, size);
+}
+#endif
+
+static void bench_checksum_print(const char *name, size_t total, struct timespec start,
+                                 struct timespec stop, uint32_t result) {
+    struct timespec elapsed = timespec_diff(start, stop);
+    double seconds = elapsed.tv_sec + elapsed.tv_nsec / 1.0e9;
+
+    printf("%-14s %10lu %8.3f %10.2f 0x%.8x\n", name, total, seconds,
+           total / seconds / (1024 * 1024), result);
+}
+
+/* Checksum of every chunk of total bytes, dispatched the way packet code does */
+static void bench_checksum_run(uint8_t type, const uint8_t *buf, size_t total, size_t chunk) {
+    struct timespec start, stop;
+    uint32_t result = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(size_t done = 0; done + chunk <= total; done += chunk) {
+        result += checksum(type, buf, chunk);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    bench_checksum_print(checksum_name(type), total, start, stop, result);
+}
+
+/* Specific kernel, called directly regardless of CPU detection */
+static void bench_kernel_run(const char *name, bench_checksum_func_t func,
+                             const uint8_t *buf, size_t total, size_t chunk) {
+    struct timespec start, stop;
+    uint32_t result = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(size_t done = 0; done + chunk <= total; done += chunk) {
+        result += func(buf, chunk);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    bench_checksum_print(name, total, start, stop, result);
+}
+
+static void bench_checksums(size_t total, size_t chunk) {
+    uint8_t *buf = (uint8_t*)malloc(chunk);
+    if(buf == NULL) {
+        errprintf("malloc() failed\n");
+        exit(1);
+    }
+
+    for(size_t i = 0; i < chunk; i++) {
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    /* Whole chunks only */
+    total -= total % chunk;
+
+    printf("Checksums: %lu bytes in %lu byte chunks, crc32c uses %s kernel\n", total, chunk,
+           (checksum_crc32c_hw() ? "hardware" : "table"));
+    printf("%-14s %10s %8s %10s %10s\n", "algorithm", "bytes", "sec", "MiB/s", "result");
+
+    for(uint8_t type = 0; type < CHECKSUM_NUM; type++) {
+        bench_checksum_run(type, buf, total, chunk);
+    }
+
+    bench_kernel_run("crc32c_table", bench_crc32c_table, buf, total, chunk);
+#if defined(CHECKSUM_CRC32C_HW)
+    if(checksum_crc32c_hw()) {
+        bench_kernel_run("crc32c_hw", bench_crc32c_hw, buf, total, chunk);
+    }
+#endif
+
+    free(buf);
+}
+
+/* Header of packet in format decodes to the same fields, frame size and length; a cut one fails */
+static size_t bench_header_check(const struct packet_t *packet, uint8_t format) {
+    uint8_t buf[PACKET_HEADER_MAX];
+    struct packet_t decoded;
+
+    size_t size = packet_encode_header(packet, format, buf);
+    size_t frame_size = packet_frame_size(buf);
+
+    if(size != packet_header_size(packet, format) ||
+       packet_decode_header(buf, size, &decoded) != size ||
+       packet_decode_header(buf, size - 1, &decoded) != 0) {
+        errprintf("%s header of #%u size %lu: wrong length\n", packet_format_name(format),
+                  packet->number, packet->data_size);
+        return 1;
+    }
+
+    (void)packet_decode_header(buf, size, &decoded);
+
+    if(decoded.number != packet->number || decoded.channel != packet->channel ||
+       decoded.crc_type != packet->crc_type || decoded.crc32 != packet->crc32 ||
+       decoded.data_size != packet->data_size ||
+       frame_size != (packet->data_size <= PACKET_DATA_SIZE_MAX ? size + packet->data_size : 0)) {
+        errprintf("%s header of #%u size %lu: fields differ\n", packet_format_name(format),
+                  packet->number, packet->data_size);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void bench_headers(size_t total) {
+    static const uint32_t numbers[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152,
+                                        268435455, 268435456, UINT32_MAX };
+    static const uint16_t channels[] = { 0, 1, 127, 128, 16383, 16384, UINT16_MAX };
+    static const size_t sizes[] = { 0, 1, 100, 109, 110, 118, 119, 120, 16363, 16364, 16365,
+                                    2097140, 2097141, PACKET_DATA_SIZE_MAX };
+    size_t errors = 0;
+    size_t checked = 0;
+
+    for(uint8_t format = 0; format < PACKET_FORMAT_NUM; format++) {
+        for(size_t n = 0; n < sizeof(numbers) / sizeof(numbers[0]); n++) {
+            for(size_t c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+                for(size_t d = 0; d < sizeof(sizes) / sizeof(sizes[0]); d++) {
+                    struct packet_t packet = {
+                        .number = numbers[n], .channel = channels[c], .data_size = sizes[d],
+                        .crc_type = (uint8_t)(n % CHECKSUM_NUM), .crc32 = 0x80000001 ^ numbers[n],
+                    };
+
+                    errors += bench_header_check(&packet, format);
+                    checked++;
+                }
+            }
+        }
+    }
+
+    /* Frames the sender makes have exactly the asked length, numbers cross 16384 on the way */
+    uint8_t *data = (uint8_t*)malloc(BENCH_HEADER_LENGTH_MAX);
+    if(data == NULL) {
+        errprintf("malloc() failed\n");
+        exit(1);
+    }
+
+    packet_set_pattern(PACKET_PATTERN_ZEROS);
+
+    for(uint8_t format = 0; format < PACKET_FORMAT_NUM; format++) {
+        packet_set_format(format);
+
+        for(size_t length = PACKET_HEADER_SIZE; length <= BENCH_HEADER_LENGTH_MAX; length++) {
+            if(!packet_length_valid(length))
+                continue;
+
+            struct packet_t packet = packet_fill(data, length);
+
+            if(packet_header_size(&packet, format) + packet.data_size != length) {
+                errprintf("%s packet of %lu bytes cannot be made\n", packet_format_name(format), length);
+                errors++;
+            }
+            checked++;
+        }
+    }
+    packet_set_format(PACKET_FORMAT_STANDARD);
+    free(data);
+
+    printf("Packet headers: %lu round trips, %lu errors\n", checked, errors);
+    /* Frames of a ring that stays in cache, encode and decode timed in separate passes as sender and receiver run them */
+    uint8_t *ring = (uint8_t*)malloc(BENCH_HEADER_RING * BENCH_HEADER_FRAME);
+    if(ring == NULL) {
+        errprintf("malloc() failed\n");
+        exit(1);
+    }
+
+    total -= total % BENCH_HEADER_RING;
+
+    printf("%-10s %10s %10s %10s %8s\n", "format", "headers", "encode ns", "decode ns", "bytes");
+
+    for(uint8_t format = 0; format < PACKET_FORMAT_NUM; format++) {
+        struct packet_t packet = { .channel = 0, .data_size = BENCH_HEADER_FRAME - PACKET_HEADER_SIZE,
+                                   .crc_type = CHECKSUM_CRC32 };
+        struct packet_t decoded;
+        struct timespec start, stop;
+        uint64_t encode_ns = 0, decode_ns = 0;
+        uint64_t bytes = 0;
+        uint32_t sum = 0;
+
+        for(size_t done = 0; done < total; done += BENCH_HEADER_RING) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(size_t i = 0; i < BENCH_HEADER_RING; i++) {
+                packet.number = (uint32_t)(done + i);
+                packet.crc32 = packet.number * 2654435761u;
+                bytes += packet_encode_header(&packet, format, ring + i * BENCH_HEADER_FRAME);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            encode_ns += timespec_to_ns(timespec_diff(start, stop));
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(size_t i = 0; i < BENCH_HEADER_RING; i++) {
+                sum += packet_decode_header(ring + i * BENCH_HEADER_FRAME, BENCH_HEADER_FRAME, &decoded);
+                sum += decoded.number;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            decode_ns += timespec_to_ns(timespec_diff(start, stop));
+        }
+
+        printf("%-10s %10lu %10.2f %10.2f %8.2f%s\n", packet_format_name(format), total,
+               (double)encode_ns / total, (double)decode_ns / total, (double)bytes / total,
+               (sum == 0 ? " " : ""));
+    }
+
+    free(ring);
+
+    if(errors != 0)
+        exit(1);
+}
+
+struct bench_mark_case_t {
+    const char *in;           /* characters as the kernel passes them */
+    size_t in_size;
+    const char *out;          /* bytes decoded */
+    size_t out_size;
+    uint8_t state;            /* UART_MARK_STATE_* after the last character */
+    size_t events_num;
+    struct uart_mark_event_t events[BENCH_MARK_EVENTS];
+};
+
+#define BENCH_MARK_STR(s) s, sizeof(s) - 1
+
+static const struct bench_mark_case_t bench_mark_cases[] = {
+    { BENCH_MARK_STR("a\377\0xb"), BENCH_MARK_STR("axb"), UART_MARK_STATE_DATA,
+      1, { { 1, UART_MARK_ERROR, 'x' } } },
+    { BENCH_MARK_STR("\377\0\1\377\0\2"), BENCH_MARK_STR("\1\2"), UART_MARK_STATE_DATA,
+      2, { { 0, UART_MARK_ERROR, 1 }, { 1, UART_MARK_ERROR, 2 } } },
+    { BENCH_MARK_STR("\377\377"), BENCH_MARK_STR("\377"), UART_MARK_STATE_DATA, 0, { { 0 } } },
+    { BENCH_MARK_STR("ab\377\0\0c"), BENCH_MARK_STR("ab\0c"), UART_MARK_STATE_DATA,
+      1, { { 2, UART_MARK_BREAK, 0 } } },
+    /* Error on a \377 character is not doubled */
+    { BENCH_MARK_STR("\377\0\377\377\377"), BENCH_MARK_STR("\377\377"), UART_MARK_STATE_DATA,
+      1, { { 0, UART_MARK_ERROR, 0xff } } },
+    { BENCH_MARK_STR("x\377\377\377\0y\377\0\0\377\377z"), BENCH_MARK_STR("x\377y\0\377z"),
+      UART_MARK_STATE_DATA, 2, { { 2, UART_MARK_ERROR, 'y' }, { 3, UART_MARK_BREAK, 0 } } },
+    { BENCH_MARK_STR("a\377bc"), BENCH_MARK_STR("abc"), UART_MARK_STATE_DATA, 0, { { 0 } } },
+    /* Lone \377 at the end waits for the next read */
+    { BENCH_MARK_STR("ab\377"), BENCH_MARK_STR("ab"), UART_MARK_STATE_ESCAPE, 0, { { 0 } } },
+    { BENCH_MARK_STR("ab\377\0"), BENCH_MARK_STR("ab"), UART_MARK_STATE_MARKED, 0, { { 0 } } },
+};
+
+/* Decode characters of in as reads split at first and second, each in place as uart.c does */
+static size_t bench_mark_decode(struct uart_mark_t *mark, const uint8_t *in, size_t size,
+                                size_t first, size_t second, uint8_t *out) {
+    size_t bounds[] = { 0, first, second, size };
+    size_t have = 0;
+
+    for(size_t i = 0; i < 3; i++) {
+        size_t count = bounds[i + 1] - bounds[i];
+
+        /* Decoded bytes come out ahead of the characters still to decode */
+        memcpy(out + have, in + bounds[i], count);
+        have += uart_mark_decode(mark, out + have, count, out + have);
+    }
+
+    return have;
+}
+
+static size_t bench_mark_check(const struct bench_mark_case_t *test, size_t first, size_t second) {
+    uint8_t out[test->in_size + 1];
+
+    struct uart_mark_t *mark = uart_mark_create();
+    if(mark == NULL)
+        exit(1);
+
+    size_t have = bench_mark_decode(mark, (const uint8_t*)test->in, test->in_size, first, second, out);
+    size_t errors = 0;
+
+    if(have != test->out_size || memcmp(out, test->out, have) != 0 || mark->state != test->state) {
+        errprintf("marks case of %lu chars read at %lu, %lu: %lu bytes, state %u\n",
+                  test->in_size, first, second, have, mark->state);
+        errors++;
+    }
+
+    for(size_t i = 0; i < test->events_num; i++) {
+        const struct uart_mark_event_t *expect = &test->events[i];
+        struct uart_mark_event_t event;
+
+        /* Not taken before the packet that holds it is checked */
+        if(uart_mark_next(mark, expect->offset, &event) != 0 ||
+           uart_mark_next(mark, expect->offset + 1, &event) != 1 ||
+           event.offset != expect->offset || event.type != expect->type ||
+           event.value != expect->value) {
+            errprintf("marks case of %lu chars read at %lu, %lu: event %lu differs\n",
+                      test->in_size, first, second, i);
+            errors++;
+            break;
+        }
+    }
+
+    struct uart_mark_event_t event;
+    if(errors == 0 && uart_mark_next(mark, UINT64_MAX, &event) != 0) {
+        errprintf("marks case of %lu chars read at %lu, %lu: extra event at %" PRIu64 "\n",
+                  test->in_size, first, second, event.offset);
+        errors++;
+    }
+
+    uart_mark_free(mark);
+
+    return errors;
+}
+
+static void bench_marks(void) {
+    size_t errors = 0;
+    size_t checked = 0;
+
+    for(size_t c = 0; c < sizeof(bench_mark_cases) / sizeof(bench_mark_cases[0]); c++) {
+        const struct bench_mark_case_t *test = &bench_mark_cases[c];
+
+        for(size_t first = 0; first <= test->in_size; first++) {
+            for(size_t second = first; second <= test->in_size; second++) {
+                errors += bench_mark_check(test, first, second);
+                checked++;
+            }
+        }
+    }
+
+    /* Links other than tty escape \377 on write: markers sent as data come out as data */
+    static const uint8_t data[] = { 0xff, 0x00, 'x', 0xff, 0x00, 0x00, 0xff, 0xff, 'y', 0xff };
+    uint8_t escaped[2 * sizeof(data)];
+    uint8_t out[2 * sizeof(data)];
+
+    size_t chars = uart_mark_escape(data, sizeof(data), escaped);
+
+    for(size_t first = 0; first <= chars; first++) {
+        struct uart_mark_t *mark = uart_mark_create();
+        if(mark == NULL)
+            exit(1);
+
+        struct uart_mark_event_t event;
+        size_t have = bench_mark_decode(mark, escaped, chars, first, first, out);
+
+        if(have != sizeof(data) || memcmp(out, data, have) != 0 ||
+           mark->state != UART_MARK_STATE_DATA || uart_mark_next(mark, UINT64_MAX, &event) != 0) {
+            errprintf("escaped data of %lu chars read at %lu: decoded differs\n", chars, first);
+            errors++;
+        }
+        checked++;
+
+        uart_mark_free(mark);
+    }
+
+    printf("Error marks: %lu decodes, %lu errors\n", checked, errors);
+
+    if(errors != 0)
+        exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    size_t total = BENCH_DEFAULT_BYTES;
+    size_t chunk = BENCH_DEFAULT_CHUNK;
+    int checksums = 0;
+    int headers = 0;
+    int marks = 0;
+
+    while (1) {
+        static const struct option lopts[] = {
+            { "bytes", 1, 0, 'n' },
+            { "chunk", 1, 0, 'c' },
+            { "checksum", 0, 0, 'k' },
+            { "header", 0, 0, 'H' },
+            { "marks", 0, 0, 'm' },
+            { "help",  0, 0, 'h' },
+            { NULL,    0, 0, 0   },
+        };
+
+        int c = getopt_long(argc, argv, "n:c:kHmh", lopts, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'n':
+                total = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                chunk = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                checksums = 1;
+                break;
+            case 'H':
+                headers = 1;
+                break;
+            case 'm':
+                marks = 1;
+                break;
+            default:
+                printf("Usage: %s [-n bytes] [-c chunk] [-k] [-H] [-m]\n", argv[0]);
+                exit(1);
+        }
+    } /* while */
+
+    if(chunk == 0 || total == 0) {
+        errprintf("bytes and chunk must be > 0\n");
+        exit(1);
+    }
+
+    if(checksums) {
+        bench_checksums(total, chunk);
+        return 0;
+    }
+
+    /* Bytes are headers here */
+    if(headers) {
+        bench_headers(total);
+        return 0;
+    }
+
+    if(marks) {
+        bench_marks();
+        return 0;
+    }
+
+    printf("PTY pair: %lu bytes in %lu byte chunks\n", total, chunk);
+    printf("%-8s %10s %8s %10s %10s %10s %9s %8s\n",
+           "backend", "bytes", "sec", "MiB/s", "tx_calls", "rx_calls", "calls/B", "errors");
+
+    bench_run(UART_BACKEND_SYSCALL, total, chunk);
+    bench_run(UART_BACKEND_URING, total, chunk);
+
+    return 0;
+}
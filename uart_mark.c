@@ -0,0 +1,186 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "uart_mark.h"
+
+#define N_ERR "UART_MARK ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+#define UART_MARK_ESCAPE 0xff
+
+struct uart_mark_t* uart_mark_create(void) {
+    struct uart_mark_t *mark = (struct uart_mark_t*)calloc(1, sizeof(struct uart_mark_t));
+    if(mark == NULL) {
+        errprintf("calloc() failed\n");
+        return NULL;
+    }
+
+    mark->state = UART_MARK_STATE_DATA;
+    mark->bits = 8;
+
+    return mark;
+}
+
+void uart_mark_free(struct uart_mark_t *mark) {
+    if(mark == NULL)
+        return;
+
+    free(mark->buf);
+    free(mark);
+}
+
+static void uart_mark_event(struct uart_mark_t *mark, size_t pos, uint8_t type, uint8_t value) {
+    if(type == UART_MARK_BREAK)
+        mark->breaks++;
+    else
+        mark->errors++;
+
+    uint64_t head = __atomic_load_n(&mark->head, __ATOMIC_ACQUIRE);
+    if(mark->tail - head == UART_MARK_EVENTS) {
+        mark->dropped++;
+        return;
+    }
+
+    struct uart_mark_event_t *event = &mark->events[mark->tail & (UART_MARK_EVENTS - 1)];
+    event->offset = mark->offset + pos * mark->bits / 8;
+    event->type = type;
+    event->value = value;
+
+    __atomic_store_n(&mark->tail, mark->tail + 1, __ATOMIC_RELEASE);
+}
+
+size_t uart_mark_decode(struct uart_mark_t *mark, const uint8_t *in, size_t count, uint8_t *out) {
+    assert(mark != NULL);
+    assert(in != NULL || count == 0);
+    assert(out != NULL || count == 0);
+
+    const uint8_t *end = in + count;
+    size_t have = 0;
+
+    mark->chars += count;
+
+    while(in < end) {
+        uint8_t c;
+
+        switch(mark->state) {
+            case UART_MARK_STATE_DATA: {
+                const uint8_t *escape = memchr(in, UART_MARK_ESCAPE, end - in);
+                size_t run = (escape != NULL ? escape : end) - in;
+
+                if(out + have != in)
+                    memmove(out + have, in, run);
+                have += run;
+                in += run;
+
+                if(escape != NULL) {
+                    in++;
+                    mark->state = UART_MARK_STATE_ESCAPE;
+                }
+                break;
+            }
+            case UART_MARK_STATE_ESCAPE:
+                c = *in++;
+                if(c == UART_MARK_ESCAPE) {
+                    out[have++] = UART_MARK_ESCAPE;
+                    mark->escapes++;
+                    mark->state = UART_MARK_STATE_DATA;
+                } else if(c == 0x00) {
+                    mark->state = UART_MARK_STATE_MARKED;
+                } else {
+                    /* Not from the kernel: \377 may have come from an earlier read, keep c only */
+                    out[have++] = c;
+                    mark->stray++;
+                    mark->state = UART_MARK_STATE_DATA;
+                }
+                break;
+            case UART_MARK_STATE_MARKED:
+                c = *in++;
+                uart_mark_event(mark, have, (c == 0x00) ? UART_MARK_BREAK : UART_MARK_ERROR, c);
+                out[have++] = c;
+                mark->state = UART_MARK_STATE_DATA;
+                break;
+        }
+    }
+
+    mark->offset += have * mark->bits / 8;
+
+    return have;
+}
+
+uint8_t* uart_mark_buffer(struct uart_mark_t *mark, size_t size) {
+    assert(mark != NULL);
+
+    if(size > mark->buf_size) {
+        uint8_t *buf = (uint8_t*)realloc(mark->buf, size);
+        if(buf == NULL) {
+            errprintf("realloc() of %lu bytes failed\n", size);
+            return NULL;
+        }
+
+        mark->buf = buf;
+        mark->buf_size = size;
+    }
+
+    return mark->buf;
+}
+
+size_t uart_mark_escape(const uint8_t *in, size_t count, uint8_t *out) {
+    const uint8_t *end = in + count;
+    size_t have = 0;
+
+    while(in < end) {
+        const uint8_t *escape = memchr(in, UART_MARK_ESCAPE, end - in);
+        size_t run = (escape != NULL ? escape + 1 : end) - in;
+
+        memcpy(out + have, in, run);
+        have += run;
+        in += run;
+
+        if(escape != NULL)
+            out[have++] = UART_MARK_ESCAPE;
+    }
+
+    return have;
+}
+
+void uart_mark_set_position(struct uart_mark_t *mark, uint64_t offset, unsigned bits) {
+    assert(mark != NULL);
+    assert(bits >= 5 && bits <= 8);
+
+    mark->offset = offset;
+    mark->bits = bits;
+}
+
+int uart_mark_next(struct uart_mark_t *mark, uint64_t end, struct uart_mark_event_t *event) {
+    assert(mark != NULL);
+    assert(event != NULL);
+
+    uint64_t tail = __atomic_load_n(&mark->tail, __ATOMIC_ACQUIRE);
+    if(mark->head == tail)
+        return 0;
+
+    const struct uart_mark_event_t *next = &mark->events[mark->head & (UART_MARK_EVENTS - 1)];
+    if(next->offset >= end)
+        return 0;
+
+    *event = *next;
+    __atomic_store_n(&mark->head, mark->head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+void uart_mark_print_stats(const struct uart_mark_t *mark, const char *dev) {
+    assert(mark != NULL);
+    assert(dev != NULL);
+
+    if(mark->chars == 0)
+        return;
+
+    printf("UART '%s' error marks: %" PRIu64 " chars, %" PRIu64 " errors, %" PRIu64 " breaks, "
+           "%" PRIu64 " escaped 0xff, %" PRIu64 " stray 0xff, %" PRIu64 " events dropped\n",
+           dev, mark->chars, mark->errors, mark->breaks, mark->escapes, mark->stray, mark->dropped);
+}
@@ -0,0 +1,92 @@
+#ifndef _UART_MARK_H_
+#define _UART_MARK_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define UART_MARK_EVENTS 256 /* errors queued for the reader, power of 2 */
+
+#define UART_MARK_ERROR 0 /* \377 \0 <c>: parity or framing error on character c */
+#define UART_MARK_BREAK 1 /* \377 \0 \0: break, or an error on character 0x00 */
+
+/* Decoder state between reads: a marker may be split */
+#define UART_MARK_STATE_DATA   0
+#define UART_MARK_STATE_ESCAPE 1 /* \377 seen */
+#define UART_MARK_STATE_MARKED 2 /* \377 \0 seen */
+
+struct uart_mark_event_t {
+    uint64_t offset;          /* byte offset in the read stream */
+    uint8_t  type;            /* UART_MARK_* */
+    uint8_t  value;           /* character as received */
+};
+
+/*
+ * In-band receive error markers (termios INPCK | PARMRK)
+ *
+ * With PARMRK the kernel passes a character received with a parity
+ * or framing error as \377 \0 <c>, a break as \377 \0 \0, and doubles
+ * a good \377 to tell it from a marker. uart.c decodes every read in
+ * place: markers and escapes are removed, the marked character keeps
+ * its place in the stream so packets stay aligned, and an event with
+ * its stream offset is queued for the reader, which decides what to
+ * do with the bytes of that packet.
+ *
+ * Decoding is a memchr() for \377 and a memmove() of the run before
+ * it, and works on any byte stream: a pipe or a file with synthetic
+ * markers exercises it without a port that can make errors. Writes to
+ * links other than tty escape \377 like the kernel, so both ends of
+ * a socket or simulated link can use markers.
+ *
+ * Events are queued by the thread that reads and taken by the thread
+ * that checks packets: one producer, one consumer.
+ */
+struct uart_mark_t {
+    uint8_t  state;           /* UART_MARK_STATE_* */
+    uint64_t offset;          /* stream offset of next decoded character */
+    unsigned bits;            /* less than 8: characters of packed bytes, see uart_mark_set_position() */
+
+    struct uart_mark_event_t events[UART_MARK_EVENTS];
+    uint64_t head;            /* events taken, consumer */
+    uint64_t tail;            /* events queued, producer */
+
+    /* statistics */
+    uint64_t chars;           /* characters decoded, markers included */
+    uint64_t escapes;         /* \377 \377 */
+    uint64_t errors;
+    uint64_t breaks;
+    uint64_t stray;           /* \377 followed by other than \377 or \0 */
+    uint64_t dropped;         /* events lost on full queue */
+
+    uint8_t *buf;             /* escaped characters of one write */
+    size_t   buf_size;
+};
+
+struct uart_mark_t* uart_mark_create(void);
+void uart_mark_free(struct uart_mark_t *mark);
+
+/*
+ * Decode count characters, returns bytes put to out
+ *
+ * out may be in: no more bytes come out than characters go in.
+ */
+size_t uart_mark_decode(struct uart_mark_t *mark, const uint8_t *in, size_t count, uint8_t *out);
+
+/*
+ * Next decoded character is at byte offset of the stream. Characters
+ * of bits < 8 carry packed bytes: offsets after it advance by bits / 8
+ * per character, pads of frame ends make them approximate.
+ */
+void uart_mark_set_position(struct uart_mark_t *mark, uint64_t offset, unsigned bits);
+
+/* Buffer of at least size bytes, owned by mark */
+uint8_t* uart_mark_buffer(struct uart_mark_t *mark, size_t size);
+
+/* Double every \377 of count characters, returns characters put to out of 2 * count */
+size_t uart_mark_escape(const uint8_t *in, size_t count, uint8_t *out);
+
+/* Take oldest event of offset below end, returns 1 - event taken, 0 - none */
+int uart_mark_next(struct uart_mark_t *mark, uint64_t end, struct uart_mark_event_t *event);
+
+void uart_mark_print_stats(const struct uart_mark_t *mark, const char *dev);
+
+#endif /* _UART_MARK_H_ */
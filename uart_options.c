@@ -24,19 +24,76 @@ struct uart_options_t uart_default_options() {
     options.timeout_msec = UART_TIMEOUT_MSEC;
     options.bytes_limit = UART_BYTES_LIMIT;
 
+    options.io_backend = UART_DEFAULT_BACKEND;
+    options.error_marks = 0;
+
+    memset(&options.sim, 0x00, sizeof(options.sim));
+    options.sim.seed = 1;
+
     return options;
 }
 
 void uart_print_usage(const char *prog) {
-    printf("UART options: %s [-Dsbpth] \n", prog);
-    puts("  -D --device <device>       - set UART device to use  \n"
+    printf("UART options: %s [-DsbptIMeh] \n", prog);
+    puts("  -D --device <device>       - set UART device to use: tty path, pipe[:name], socketpair[:name], \n"
+         "                               unix:<path>, tcp:<host>:<port> or sim[:name] (simulated link) \n"
          "  -s --speed <baud rate>     - set UART baud rate (any)\n"
          "  -b --bits <bits>           - set UART bits (5, 6, 7, 8) \n"
          "  -p --parity <parity>       - set parity (0 - none, 1 - odd, 2 - even) \n"
          "  -t --stop_bits <stop bits> - set stop bits (1, 2)    \n"
+         "  -I --io_backend <backend>  - set I/O backend (syscall, uring) \n"
+         "  -M --sim <key=value,...>   - simulated link impairments of sent bytes: seed, ber, drop, dup, \n"
+         "                               burst, burst_len, latency_us, jitter_us, unlimited (no rate limit) \n"
+         "  -e --error_marks           - mark parity and framing errors in received data (PARMRK), \n"
+         "                               receiver reports them per packet and byte \n"
          "  -h --help                  - print help \n");
 }
 
+int uart_parse_framing(const char *value, uint8_t *bits, uint8_t *parity, uint8_t *stop_bits) {
+    if(strlen(value) != 3 || value[0] < '5' || value[0] > '8' || (value[2] != '1' && value[2] != '2')) {
+        return -1;
+    }
+
+    switch(value[1]) {
+        case 'N': case 'n':
+            *parity = UART_PARITY_NONE;
+            break;
+        case 'O': case 'o':
+            *parity = UART_PARITY_ODD;
+            break;
+        case 'E': case 'e':
+            *parity = UART_PARITY_EVEN;
+            break;
+        default:
+            return -1;
+    }
+
+    *bits = value[0] - '0';
+    *stop_bits = value[2] - '0';
+
+    return 0;
+}
+
+int uart_parse_line(const char *spec, struct uart_options_t *options) {
+    char *end = NULL;
+
+    unsigned long speed = strtoul(spec, &end, 0);
+    if(end == spec || speed == 0 || speed > UINT32_MAX) {
+        return -1;
+    }
+    options->speed = speed;
+
+    if(*end == '\0') {
+        return 0;
+    }
+
+    if(*end != ',') {
+        return -1;
+    }
+
+    return uart_parse_framing(end + 1, &options->bits, &options->parity, &options->stop_bits);
+}
+
 struct uart_options_t uart_parse_options(int argc, char** argv) {
     struct uart_options_t options = uart_default_options();
 
@@ -47,12 +104,15 @@ struct uart_options_t uart_parse_options(int argc, char** argv) {
             { "bits",        1, 0, 'b' },
             { "parity",      1, 0, 'p' },
             { "stop_bits",   1, 0, 't' },
+            { "io_backend",  1, 0, 'I' },
+            { "sim",         1, 0, 'M' },
+            { "error_marks", 0, 0, 'e' },
             { "help",        0, 0, 'h' },
             { NULL,          0, 0, 0   },
         };
         int c;
 
-        c = getopt_long(argc, argv, "D:s:b:p:t:h", lopts, NULL);
+        c = getopt_long(argc, argv, "D:s:b:p:t:I:M:eh", lopts, NULL);
         if (c == -1)
             break;
 
@@ -72,6 +132,26 @@ struct uart_options_t uart_parse_options(int argc, char** argv) {
             case 't':
                 options.stop_bits = atoi(optarg);
                 break;
+            case 'I':
+                if(strcmp(optarg, "uring") == 0) {
+                    options.io_backend = UART_BACKEND_URING;
+                } else if(strcmp(optarg, "syscall") == 0) {
+                    options.io_backend = UART_BACKEND_SYSCALL;
+                } else {
+                    printf("UART: wrong I/O backend selected: %s\n", optarg);
+                    uart_print_usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'M':
+                if(uart_sim_parse(optarg, &options.sim) != 0) {
+                    uart_print_usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'e':
+                options.error_marks = 1;
+                break;
             case 'h':
                 uart_print_usage(argv[0]);
                 break;
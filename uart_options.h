@@ -4,6 +4,8 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+#include "uart_sim.h"
+
 struct uart_options_t {
     char device[64];
 
@@ -14,6 +16,11 @@ struct uart_options_t {
 
     uint32_t timeout_msec;
     uint32_t bytes_limit;
+
+    uint8_t io_backend; /* UART_BACKEND_SYSCALL, UART_BACKEND_URING */
+    uint8_t error_marks; /* decode PARMRK error markers, see uart_mark.h */
+
+    struct uart_sim_config_t sim; /* impairments of simulated link device */
 };
 
 struct uart_options_t uart_default_options();
@@ -22,4 +29,9 @@ void uart_print_usage(const char *prog);
 
 struct uart_options_t uart_parse_options(int argc, char** argv);
 
+/* "8N1": data bits, parity N/O/E, stop bits, returns 0 or -1 */
+int uart_parse_framing(const char *value, uint8_t *bits, uint8_t *parity, uint8_t *stop_bits);
+/* "<speed>[,<framing>]", sets speed and framing of options, returns 0 or -1 */
+int uart_parse_line(const char *spec, struct uart_options_t *options);
+
 #endif /* _UART_OPTIONS_H_ */
@@ -0,0 +1,595 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "uart_pack.h"
+
+#if defined(UART_PACK_BMI2)
+#include <immintrin.h>
+#endif
+
+#define N_ERR "UART_PACK ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+static int uart_pack_use_bmi2 = -1;
+
+/* Little endian: first byte holds the first bits on the line */
+static inline uint64_t uart_pack_load(const uint8_t *p, size_t size) {
+    uint64_t v = 0;
+
+    memcpy(&v, p, size);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void uart_pack_store(uint8_t *p, uint64_t v, size_t size) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    memcpy(p, &v, size);
+}
+
+/*
+ * Group kernels: <bits> bytes <-> 8 characters
+ *
+ * Only the low 8 * bits bits of a loaded word are used, so a full
+ * 8 byte load is fine whenever 8 bytes are readable; stores of the
+ * unpack side may run over into the next group, which overwrites
+ * them, except for the last group.
+ */
+static void uart_pack_groups_word(const struct uart_pack_t *pack, const uint8_t *in, size_t groups,
+                                  size_t in_left, uint8_t *out) {
+    const unsigned bits = pack->bits;
+
+    for(size_t g = 0; g < groups; g++) {
+        uint64_t v = uart_pack_load(in, in_left >= 8 ? 8 : bits);
+        uint64_t chars = 0;
+
+        for(unsigned i = 0; i < UART_PACK_GROUP_CHARS; i++)
+            chars |= ((v >> (i * bits)) & pack->char_mask) << (i * 8);
+
+        uart_pack_store(out, chars, UART_PACK_GROUP_CHARS);
+
+        in += bits;
+        in_left -= bits;
+        out += UART_PACK_GROUP_CHARS;
+    }
+}
+
+static void uart_unpack_groups_word(const struct uart_pack_t *pack, const uint8_t *chars, size_t groups,
+                                    uint8_t *out) {
+    const unsigned bits = pack->bits;
+
+    for(size_t g = 0; g < groups; g++) {
+        uint64_t c = uart_pack_load(chars, UART_PACK_GROUP_CHARS);
+        uint64_t v = 0;
+
+        for(unsigned i = 0; i < UART_PACK_GROUP_CHARS; i++)
+            v |= ((c >> (i * 8)) & pack->char_mask) << (i * bits);
+
+        uart_pack_store(out, v, (g + 1 < groups) ? 8 : bits);
+
+        chars += UART_PACK_GROUP_CHARS;
+        out += bits;
+    }
+}
+
+#if defined(UART_PACK_BMI2)
+
+__attribute__((target("bmi2")))
+static void uart_pack_groups_bmi2(const struct uart_pack_t *pack, const uint8_t *in, size_t groups,
+                                  size_t in_left, uint8_t *out) {
+    const unsigned bits = pack->bits;
+
+    for(size_t g = 0; g < groups; g++) {
+        uint64_t v = uart_pack_load(in, in_left >= 8 ? 8 : bits);
+
+        uart_pack_store(out, _pdep_u64(v, pack->group_mask), UART_PACK_GROUP_CHARS);
+
+        in += bits;
+        in_left -= bits;
+        out += UART_PACK_GROUP_CHARS;
+    }
+}
+
+__attribute__((target("bmi2")))
+static void uart_unpack_groups_bmi2(const struct uart_pack_t *pack, const uint8_t *chars, size_t groups,
+                                    uint8_t *out) {
+    const unsigned bits = pack->bits;
+
+    for(size_t g = 0; g < groups; g++) {
+        uint64_t c = uart_pack_load(chars, UART_PACK_GROUP_CHARS);
+
+        uart_pack_store(out, _pext_u64(c, pack->group_mask), (g + 1 < groups) ? 8 : bits);
+
+        chars += UART_PACK_GROUP_CHARS;
+        out += bits;
+    }
+}
+
+#endif /* UART_PACK_BMI2 */
+
+static void uart_pack_groups(const struct uart_pack_t *pack, const uint8_t *in, size_t groups,
+                             size_t in_left, uint8_t *out) {
+#if defined(UART_PACK_BMI2)
+    if(uart_pack_use_bmi2) {
+        uart_pack_groups_bmi2(pack, in, groups, in_left, out);
+        return;
+    }
+#endif
+    uart_pack_groups_word(pack, in, groups, in_left, out);
+}
+
+static void uart_unpack_groups(const struct uart_pack_t *pack, const uint8_t *chars, size_t groups,
+                               uint8_t *out) {
+#if defined(UART_PACK_BMI2)
+    if(uart_pack_use_bmi2) {
+        uart_unpack_groups_bmi2(pack, chars, groups, out);
+        return;
+    }
+#endif
+    uart_unpack_groups_word(pack, chars, groups, out);
+}
+
+struct uart_pack_t* uart_pack_create(void) {
+    struct uart_pack_t *pack = (struct uart_pack_t*)calloc(1, sizeof(struct uart_pack_t));
+    if(pack == NULL) {
+        errprintf("calloc() failed\n");
+        return NULL;
+    }
+
+    if(uart_pack_use_bmi2 < 0) {
+#if defined(UART_PACK_BMI2)
+        __builtin_cpu_init();
+        uart_pack_use_bmi2 = __builtin_cpu_supports("bmi2") != 0;
+#else
+        uart_pack_use_bmi2 = 0;
+#endif
+    }
+
+    uart_pack_configure(pack, 8);
+
+    return pack;
+}
+
+void uart_pack_free(struct uart_pack_t *pack) {
+    if(pack == NULL)
+        return;
+
+    free(pack->buf);
+    free(pack);
+}
+
+static void uart_pack_framer_reset(struct uart_pack_framer_t *framer) {
+    framer->header_have = 0;
+    framer->body_left = 0;
+    framer->in_body = 0;
+    framer->synced = 1;
+}
+
+void uart_pack_configure(struct uart_pack_t *pack, unsigned bits) {
+    assert(pack != NULL);
+    assert(bits >= 5 && bits <= 8);
+
+    pack->bits = bits;
+    pack->char_mask = (1ULL << bits) - 1;
+    pack->group_mask = 0;
+    for(unsigned i = 0; i < UART_PACK_GROUP_CHARS; i++)
+        pack->group_mask |= pack->char_mask << (i * 8);
+
+    pack->hunt_chars = (pack->header_size * 8 + bits - 1) / bits;
+
+    memset(&pack->tx, 0x00, sizeof(pack->tx));
+    memset(&pack->rx, 0x00, sizeof(pack->rx));
+    uart_pack_framer_reset(&pack->tx.framer);
+    uart_pack_framer_reset(&pack->rx.framer);
+}
+
+void uart_pack_set_framing(struct uart_pack_t *pack, size_t header_size, uart_pack_frame_size_t frame_size) {
+    assert(pack != NULL);
+    assert(header_size > 0 && header_size <= UART_PACK_HEADER_MAX);
+
+    pack->header_size = header_size;
+    pack->frame_size = frame_size;
+    pack->hunt_chars = (header_size * 8 + pack->bits - 1) / pack->bits;
+
+    uart_pack_framer_reset(&pack->tx.framer);
+    uart_pack_framer_reset(&pack->rx.framer);
+}
+
+void uart_pack_set_frame_fixed(struct uart_pack_t *pack, size_t frame_fixed) {
+    assert(pack != NULL);
+    assert(frame_fixed == 0 || frame_fixed >= pack->header_size);
+
+    pack->frame_fixed = frame_fixed;
+}
+
+/* Frame size from a header is one a frame may have */
+static inline int uart_pack_frame_valid(const struct uart_pack_t *pack, size_t frame_size) {
+    return frame_size >= pack->header_size && (pack->frame_fixed == 0 || frame_size == pack->frame_fixed);
+}
+
+/* Bytes until the current frame ends, UINT64_MAX - end not known */
+static uint64_t uart_pack_frame_room(const struct uart_pack_t *pack, const struct uart_pack_framer_t *framer) {
+    if(pack->frame_size == NULL || !framer->synced)
+        return UINT64_MAX;
+
+    return framer->in_body ? framer->body_left : pack->header_size - framer->header_have;
+}
+
+/* Pass size bytes of at most frame room, returns 1 when they end the frame */
+static int uart_pack_frame_feed(const struct uart_pack_t *pack, struct uart_pack_dir_t *dir,
+                                const uint8_t *bytes, size_t size) {
+    struct uart_pack_framer_t *framer = &dir->framer;
+
+    if(pack->frame_size == NULL || !framer->synced)
+        return 0;
+
+    if(framer->in_body) {
+        framer->body_left -= size;
+        if(framer->body_left > 0)
+            return 0;
+        framer->in_body = 0;
+        return 1;
+    }
+
+    memcpy(framer->header + framer->header_have, bytes, size);
+    framer->header_have += size;
+    if(framer->header_have < pack->header_size)
+        return 0;
+
+    framer->header_have = 0;
+
+    size_t frame_size = pack->frame_size(framer->header);
+    if(!uart_pack_frame_valid(pack, frame_size)) {
+        framer->synced = 0;
+        dir->resyncs++;
+        return 0;
+    }
+
+    if(frame_size == pack->header_size)
+        return 1;
+
+    framer->body_left = frame_size - pack->header_size;
+    framer->in_body = 1;
+
+    return 0;
+}
+
+size_t uart_pack_chars_max(const struct uart_pack_t *pack, size_t count) {
+    assert(pack != NULL);
+
+    /* Every frame has at least one header, its last character may be a pad */
+    size_t frames = (pack->frame_size != NULL) ? count / pack->header_size + 1 : 1;
+
+    return (count * 8 + pack->tx.acc_bits) / pack->bits + frames + 1;
+}
+
+size_t uart_pack_chars_for(const struct uart_pack_t *pack, size_t count) {
+    assert(pack != NULL);
+    assert(count > 0);
+
+    /* Pending bits plus new characters must not give more than count bytes */
+    size_t chars = (count * 8 - pack->rx.acc_bits) / pack->bits;
+
+    return chars > 0 ? chars : 1;
+}
+
+uint8_t* uart_pack_buffer(struct uart_pack_t *pack, size_t chars) {
+    assert(pack != NULL);
+
+    if(chars > pack->buf_size) {
+        uint8_t *buf = (uint8_t*)realloc(pack->buf, chars);
+        if(buf == NULL) {
+            errprintf("realloc() of %lu bytes failed\n", chars);
+            exit(1);
+        }
+        pack->buf = buf;
+        pack->buf_size = chars;
+    }
+
+    return pack->buf;
+}
+
+/* Frame end on send side: pad the last character */
+static size_t uart_pack_tx_end(struct uart_pack_t *pack, uint8_t *out) {
+    struct uart_pack_dir_t *tx = &pack->tx;
+    size_t chars = 0;
+
+    if(tx->acc_bits > 0) {
+        out[0] = (uint8_t)(tx->acc & pack->char_mask);
+        tx->pad_bits += pack->bits - tx->acc_bits;
+        chars = 1;
+    }
+
+    tx->acc = 0;
+    tx->acc_bits = 0;
+    tx->frames++;
+
+    return chars;
+}
+
+static size_t uart_pack_tx_bits(struct uart_pack_t *pack, const uint8_t *in, size_t size, uint8_t *out) {
+    struct uart_pack_dir_t *tx = &pack->tx;
+    const unsigned bits = pack->bits;
+    size_t chars = 0;
+
+    if(tx->acc_bits == 0 && size >= bits) {
+        size_t groups = size / bits;
+
+        uart_pack_groups(pack, in, groups, size, out);
+        in += groups * bits;
+        size -= groups * bits;
+        chars = groups * UART_PACK_GROUP_CHARS;
+    }
+
+    while(size-- > 0) {
+        tx->acc |= (uint64_t)*in++ << tx->acc_bits;
+        tx->acc_bits += 8;
+
+        while(tx->acc_bits >= bits) {
+            out[chars++] = (uint8_t)(tx->acc & pack->char_mask);
+            tx->acc >>= bits;
+            tx->acc_bits -= bits;
+        }
+    }
+
+    return chars;
+}
+
+size_t uart_pack_encode(struct uart_pack_t *pack, const uint8_t *in, size_t count, uint8_t *out) {
+    assert(pack != NULL);
+    assert(uart_pack_enabled(pack));
+
+    struct uart_pack_dir_t *tx = &pack->tx;
+    size_t chars = 0;
+
+    tx->bytes += count;
+
+    while(count > 0) {
+        uint64_t room = uart_pack_frame_room(pack, &tx->framer);
+        size_t size = (count < room) ? count : room;
+
+        chars += uart_pack_tx_bits(pack, in, size, out + chars);
+
+        int end = uart_pack_frame_feed(pack, tx, in, size);
+        in += size;
+        count -= size;
+
+        if(end)
+            chars += uart_pack_tx_end(pack, out + chars);
+    }
+
+    /* Frame ends not known: this write is the frame */
+    if(pack->frame_size == NULL || !tx->framer.synced) {
+        chars += uart_pack_tx_end(pack, out + chars);
+        uart_pack_framer_reset(&tx->framer);
+    }
+
+    tx->chars += chars;
+
+    return chars;
+}
+
+/* Frame end on receive side: bits left are the pad of the last character */
+static void uart_pack_rx_end(struct uart_pack_t *pack) {
+    struct uart_pack_dir_t *rx = &pack->rx;
+
+    rx->pad_bits += rx->acc_bits;
+    rx->acc = 0;
+    rx->acc_bits = 0;
+    rx->frames++;
+}
+
+/* Bytes beyond out_size wait in pending for the next read */
+static inline void uart_pack_rx_byte(struct uart_pack_dir_t *rx, uint8_t byte, uint8_t *out,
+                                     size_t *bytes, size_t out_size) {
+    if(*bytes < out_size) {
+        out[(*bytes)++] = byte;
+    } else {
+        assert(rx->pending_have < UART_PACK_PENDING_MAX);
+        rx->pending[rx->pending_have++] = byte;
+    }
+    rx->bytes++;
+}
+
+static void uart_pack_rx_char(struct uart_pack_t *pack, uint8_t c, uint8_t *out, size_t *bytes, size_t out_size) {
+    struct uart_pack_dir_t *rx = &pack->rx;
+
+    rx->acc |= (uint64_t)(c & pack->char_mask) << rx->acc_bits;
+    rx->acc_bits += pack->bits;
+
+    if(rx->acc_bits < 8)
+        return;
+
+    uint8_t byte = (uint8_t)rx->acc;
+    rx->acc >>= 8;
+    rx->acc_bits -= 8;
+
+    uart_pack_rx_byte(rx, byte, out, bytes, out_size);
+
+    if(uart_pack_frame_feed(pack, rx, &byte, 1))
+        uart_pack_rx_end(pack);
+}
+
+/* Header decoded from characters starting a frame is a valid one */
+static int uart_pack_hunt_valid(const struct uart_pack_t *pack, const uint8_t *chars) {
+    uint8_t header[UART_PACK_HEADER_MAX];
+    uint64_t acc = 0;
+    unsigned acc_bits = 0;
+    size_t have = 0;
+
+    while(have < pack->header_size) {
+        acc |= (uint64_t)(*chars++ & pack->char_mask) << acc_bits;
+        acc_bits += pack->bits;
+
+        if(acc_bits >= 8) {
+            header[have++] = (uint8_t)acc;
+            acc >>= 8;
+            acc_bits -= 8;
+        }
+    }
+
+    return uart_pack_frame_valid(pack, pack->frame_size(header));
+}
+
+/*
+ * Look for a frame start after an invalid header
+ *
+ * Characters are held until a valid header decodes from the oldest
+ * one, then the held characters are decoded from there. A header
+ * a few characters early often looks valid too: its size field is
+ * the real size shifted up, so a start is only taken when the header
+ * one character later is not valid. Characters that start no frame
+ * are decoded as they are, the application sees garbage there.
+ */
+static void uart_pack_hunt(struct uart_pack_t *pack, uint8_t c, uint8_t *out, size_t *bytes, size_t out_size) {
+    struct uart_pack_dir_t *rx = &pack->rx;
+
+    rx->hunt[rx->hunt_have++] = c;
+    if(rx->hunt_have < pack->hunt_chars + 1)
+        return;
+
+    if(uart_pack_hunt_valid(pack, rx->hunt) && !uart_pack_hunt_valid(pack, rx->hunt + 1)) {
+        uint8_t held[UART_PACK_HUNT_MAX];
+        size_t held_num = rx->hunt_have;
+
+        memcpy(held, rx->hunt, held_num);
+        rx->hunt_have = 0;
+        rx->acc = 0;
+        rx->acc_bits = 0;
+        uart_pack_framer_reset(&rx->framer);
+
+        for(size_t i = 0; i < held_num; i++)
+            uart_pack_rx_char(pack, held[i], out, bytes, out_size);
+        return;
+    }
+
+    c = rx->hunt[0];
+    memmove(rx->hunt, rx->hunt + 1, --rx->hunt_have);
+    uart_pack_rx_char(pack, c, out, bytes, out_size);
+}
+
+size_t uart_pack_decode(struct uart_pack_t *pack, const uint8_t *chars, size_t count,
+                        uint8_t *out, size_t out_size) {
+    assert(pack != NULL);
+    assert(uart_pack_enabled(pack));
+
+    struct uart_pack_dir_t *rx = &pack->rx;
+    const unsigned bits = pack->bits;
+    size_t bytes = 0;
+
+    rx->chars += count;
+
+    while(count > 0) {
+        if(pack->frame_size != NULL && !rx->framer.synced) {
+            uart_pack_hunt(pack, *chars++, out, &bytes, out_size);
+            count--;
+            continue;
+        }
+
+        uint64_t room = uart_pack_frame_room(pack, &rx->framer);
+
+        if(rx->acc_bits == 0 && count >= UART_PACK_GROUP_CHARS && room >= bits && out_size - bytes >= bits) {
+            size_t groups = count / UART_PACK_GROUP_CHARS;
+            if(groups > room / bits)
+                groups = room / bits;
+            if(groups > (out_size - bytes) / bits)
+                groups = (out_size - bytes) / bits;
+
+            uart_unpack_groups(pack, chars, groups, out + bytes);
+
+            int end = uart_pack_frame_feed(pack, rx, out + bytes, groups * bits);
+            bytes += groups * bits;
+            rx->bytes += groups * bits;
+            chars += groups * UART_PACK_GROUP_CHARS;
+            count -= groups * UART_PACK_GROUP_CHARS;
+
+            if(end)
+                uart_pack_rx_end(pack);
+            continue;
+        }
+
+        uart_pack_rx_char(pack, *chars++, out, &bytes, out_size);
+        count--;
+    }
+
+    return bytes;
+}
+
+size_t uart_pack_take_pending(struct uart_pack_t *pack, uint8_t *out, size_t count) {
+    assert(pack != NULL);
+
+    struct uart_pack_dir_t *rx = &pack->rx;
+    size_t size = (count < rx->pending_have) ? count : rx->pending_have;
+
+    if(size > 0) {
+        memcpy(out, rx->pending, size);
+        memmove(rx->pending, rx->pending + size, rx->pending_have - size);
+        rx->pending_have -= size;
+    }
+
+    return size;
+}
+
+void uart_pack_rx_idle(struct uart_pack_t *pack) {
+    assert(pack != NULL);
+
+    struct uart_pack_dir_t *rx = &pack->rx;
+    struct uart_pack_framer_t *framer = &rx->framer;
+
+    if(framer->synced && framer->header_have == 0 && !framer->in_body && rx->acc_bits == 0)
+        return;
+
+    /* Held characters started no frame before the line went silent */
+    rx->hunt_have = 0;
+    rx->acc = 0;
+    rx->acc_bits = 0;
+    uart_pack_framer_reset(framer);
+}
+
+void uart_pack_rx_lost(struct uart_pack_t *pack) {
+    assert(pack != NULL);
+
+    struct uart_pack_dir_t *rx = &pack->rx;
+
+    if(pack->frame_size == NULL || !rx->framer.synced)
+        return;
+
+    rx->framer.synced = 0;
+    rx->resyncs++;
+}
+
+void uart_pack_print_stats(const struct uart_pack_t *pack, const char *dev, uint64_t char_time_ns) {
+    assert(pack != NULL);
+    assert(dev != NULL);
+
+    const struct uart_pack_dir_t *tx = &pack->tx;
+    const struct uart_pack_dir_t *rx = &pack->rx;
+
+    if(!uart_pack_enabled(pack) || (tx->chars == 0 && rx->chars == 0))
+        return;
+
+    printf("UART '%s' packing: %u-bit characters, %s kernels\n", dev, pack->bits,
+           uart_pack_use_bmi2 > 0 ? "bmi2" : "word");
+    if(tx->chars > 0) {
+        printf("\ttx: %" PRIu64 " bytes in %" PRIu64 " chars, %" PRIu64 " frames, %" PRIu64 " pad bits\n",
+               tx->bytes, tx->chars, tx->frames, tx->pad_bits);
+    }
+    if(rx->chars > 0) {
+        printf("\trx: %" PRIu64 " bytes in %" PRIu64 " chars, %" PRIu64 " frames, %" PRIu64 " pad bits, "
+               "%" PRIu64 " resyncs\n", rx->bytes, rx->chars, rx->frames, rx->pad_bits, rx->resyncs);
+    }
+
+    /* Payload per character on the line: bits / 8 bytes less pads */
+    const struct uart_pack_dir_t *dir = (tx->chars > 0) ? tx : rx;
+    double efficiency = dir->chars ? (double)dir->bytes * 8 / ((double)dir->chars * pack->bits) : 0.0;
+    double capacity = char_time_ns ? 1e9 / char_time_ns * pack->bits / 8 : 0.0;
+
+    printf("\tPayload: %.2f %% of character bits, line capacity %.0f B/s\n", 100.0 * efficiency, capacity);
+}
@@ -0,0 +1,129 @@
+#ifndef _UART_PACK_H_
+#define _UART_PACK_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define UART_PACK_HEADER_MAX  32 /* longest frame header the framer collects */
+#define UART_PACK_GROUP_CHARS 8  /* characters of one group, a group carries <bits> bytes */
+#define UART_PACK_IDLE_MSEC   20 /* poll timeouts at least this long restart the receive framer */
+#define UART_PACK_HUNT_MAX    64 /* characters of the longest header at 5 bits, plus one */
+#define UART_PACK_PENDING_MAX 64 /* decoded bytes beyond the read buffer */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UART_PACK_BMI2 /* pdep/pext kernels, selected at runtime */
+#endif
+
+/* Bytes of frame starting with header, 0 - header of no valid frame */
+typedef size_t (*uart_pack_frame_size_t)(const uint8_t *header);
+
+/* Finds frame ends in the byte stream of one direction */
+struct uart_pack_framer_t {
+    uint8_t  header[UART_PACK_HEADER_MAX];
+    size_t   header_have;
+    uint64_t body_left;       /* frame bytes after header still to come */
+    uint8_t  in_body;
+    uint8_t  synced;          /* 0 - invalid header seen, frame ends are unknown */
+};
+
+struct uart_pack_dir_t {
+    uint64_t acc;             /* bits not yet in a whole character (tx) or byte (rx) */
+    unsigned acc_bits;
+    struct uart_pack_framer_t framer;
+
+    uint8_t  hunt[UART_PACK_HUNT_MAX];       /* rx: characters held while looking for a frame start */
+    size_t   hunt_have;
+    uint8_t  pending[UART_PACK_PENDING_MAX]; /* rx: bytes for the next read */
+    size_t   pending_have;
+
+    /* statistics */
+    uint64_t bytes;
+    uint64_t chars;
+    uint64_t pad_bits;
+    uint64_t frames;
+    uint64_t resyncs;         /* invalid headers, bad frames reported */
+};
+
+/*
+ * Bit packing for 5, 6 and 7 bit characters
+ *
+ * A character of N bits cannot carry a byte, so the byte stream is
+ * treated as a bit stream (least significant bit first, as the UART
+ * shifts them out) and cut into N-bit characters: 8 characters carry
+ * N bytes. uart.c packs every write and unpacks every read, callers
+ * keep working with bytes.
+ *
+ * Bytes of a frame rarely fill the last character, so the packer pads
+ * it and the unpacker has to know where frames end to drop the pad.
+ * The application tells both with a frame size function, uart_test
+ * uses its packet header. Every frame starts on a new character: a
+ * lost character damages its own frame, and mostly the next one whose
+ * header decodes as garbage: the receiver then hunts for a character
+ * a valid header starts from, or takes the first character after an
+ * idle line. Headers carry no checksum of their own: when all frames
+ * are of one size, a header telling another one is damaged too, and
+ * the application reports frames that failed its own check so that
+ * the receiver hunts again rather than keep cutting the stream at
+ * sizes from a header nobody verified.
+ * Without a frame size function every write is a frame,
+ * which reads back correctly only when writes carry whole groups.
+ *
+ * Whole groups go through word kernels: BMI2 pdep/pext turn 8 bytes
+ * of characters into N bytes and back with one instruction, other
+ * CPUs shift within a 64-bit word.
+ */
+struct uart_pack_t {
+    unsigned bits;            /* character size, 8 - packing off */
+    uint64_t char_mask;       /* one character */
+    uint64_t group_mask;      /* N low bits of every byte of a group */
+
+    size_t   header_size;
+    uart_pack_frame_size_t frame_size;
+    size_t   frame_fixed;     /* 0 - frames of any size the header tells */
+    size_t   hunt_chars;      /* characters of one header */
+
+    struct uart_pack_dir_t tx;
+    struct uart_pack_dir_t rx;
+
+    uint8_t *buf;             /* characters of one write or read */
+    size_t   buf_size;
+};
+
+struct uart_pack_t* uart_pack_create(void);
+void uart_pack_free(struct uart_pack_t *pack);
+
+/* Set character size, resets both directions */
+void uart_pack_configure(struct uart_pack_t *pack, unsigned bits);
+/* Frame size function, NULL - every write is a frame; header_size <= UART_PACK_HEADER_MAX */
+void uart_pack_set_framing(struct uart_pack_t *pack, size_t header_size, uart_pack_frame_size_t frame_size);
+/* All frames are frame_fixed bytes, 0 - any size */
+void uart_pack_set_frame_fixed(struct uart_pack_t *pack, size_t frame_fixed);
+
+static inline int uart_pack_enabled(const struct uart_pack_t *pack) {
+    return pack != NULL && pack->bits < 8;
+}
+
+/* Characters needed to write count bytes, at most */
+size_t uart_pack_chars_max(const struct uart_pack_t *pack, size_t count);
+/* Characters to read for at most count bytes out of uart_pack_decode() */
+size_t uart_pack_chars_for(const struct uart_pack_t *pack, size_t count);
+
+/* Buffer of at least chars characters, owned by pack */
+uint8_t* uart_pack_buffer(struct uart_pack_t *pack, size_t chars);
+
+/* Returns characters put to out */
+size_t uart_pack_encode(struct uart_pack_t *pack, const uint8_t *in, size_t count, uint8_t *out);
+/* Returns bytes put to out, more than out_size wait for uart_pack_take_pending() */
+size_t uart_pack_decode(struct uart_pack_t *pack, const uint8_t *chars, size_t count,
+                        uint8_t *out, size_t out_size);
+size_t uart_pack_take_pending(struct uart_pack_t *pack, uint8_t *out, size_t count);
+
+/* Line was idle: a broken frame ends here, next character starts a frame */
+void uart_pack_rx_idle(struct uart_pack_t *pack);
+/* Frame just received failed the application check: its header is not trusted, hunt for the next one */
+void uart_pack_rx_lost(struct uart_pack_t *pack);
+
+/* Character and pad overhead, payload capacity from character time */
+void uart_pack_print_stats(const struct uart_pack_t *pack, const char *dev, uint64_t char_time_ns);
+
+#endif /* _UART_PACK_H_ */
@@ -0,0 +1,126 @@
+#ifdef UART_PROFILE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "uart_profile.h"
+
+static const char* uart_profile_names[UART_PROFILE_CALLS] = {
+    [UART_PROFILE_READ]  = "read()",
+    [UART_PROFILE_WRITE] = "write()",
+    [UART_PROFILE_POLL]  = "poll()",
+    [UART_PROFILE_IOCTL] = "ioctl()",
+};
+
+struct uart_profile_t* uart_profile_create(void) {
+    struct uart_profile_t *profile = (struct uart_profile_t*)malloc(sizeof(struct uart_profile_t));
+    if(profile == NULL) {
+        printf("uart_profile_create: malloc() failed\n");
+        exit(1);
+    }
+
+    memset(profile, 0x00, sizeof(struct uart_profile_t));
+
+    for(int i = 0; i < UART_PROFILE_CALLS; i++) {
+        histogram_init(&profile->calls[i].duration_ns);
+        histogram_init(&profile->calls[i].bytes);
+    }
+
+    profile->start_ns = uart_profile_now();
+
+    return profile;
+}
+
+void uart_profile_free(struct uart_profile_t *profile) {
+    free(profile);
+}
+
+void uart_profile_add(struct uart_profile_t *profile, int type, uint64_t start_ns,
+                      long ret, size_t requested) {
+    uint64_t duration_ns = uart_profile_now() - start_ns;
+
+    assert(profile != NULL);
+    assert(type >= 0 && type < UART_PROFILE_CALLS);
+
+    struct uart_profile_call_t *call = &profile->calls[type];
+
+    call->calls++;
+    call->total_ns += duration_ns;
+    histogram_add(&call->duration_ns, duration_ns);
+
+    if(ret < 0) {
+        call->errors++;
+        return;
+    }
+
+    if(type == UART_PROFILE_POLL) {
+        if(ret == 0)
+            call->short_calls++;
+        return;
+    }
+
+    if(type == UART_PROFILE_IOCTL) {
+        return;
+    }
+
+    histogram_add(&call->bytes, ret);
+
+    if(ret == requested) {
+        call->full++;
+    } else {
+        call->short_calls++;
+        if(ret == 1)
+            call->single_byte++;
+    }
+}
+
+void uart_profile_print(struct uart_profile_t *profile, const char *device) {
+    assert(profile != NULL);
+    assert(device != NULL);
+
+    uint64_t wall_ns = uart_profile_now() - profile->start_ns;
+    uint64_t syscall_ns = 0;
+
+    printf("UART '%s' syscall profile:\n", device);
+
+    for(int i = 0; i < UART_PROFILE_CALLS; i++) {
+        struct uart_profile_call_t *call = &profile->calls[i];
+
+        syscall_ns += call->total_ns;
+
+        if(call->calls == 0)
+            continue;
+
+        printf("\t%-8s %10" PRIu64 " calls, %.3f s, %" PRIu64 " errors", uart_profile_names[i],
+               call->calls, call->total_ns / 1e9, call->errors);
+
+        if(i == UART_PROFILE_POLL) {
+            printf(", %" PRIu64 " timeouts\n", call->short_calls);
+        } else if(i == UART_PROFILE_IOCTL) {
+            printf("\n");
+        } else {
+            printf(", %" PRIu64 " full, %" PRIu64 " short (%" PRIu64 " of 1 byte)\n",
+                   call->full, call->short_calls, call->single_byte);
+        }
+
+        histogram_print(&call->duration_ns, "  duration:", "us", 1000.0);
+
+        if(i == UART_PROFILE_READ || i == UART_PROFILE_WRITE) {
+            histogram_print(&call->bytes, "  bytes/call:", "B", 1.0);
+        }
+    }
+
+    /* Blocked in syscalls while the clock ran: never more than wall time */
+    if(syscall_ns > wall_ns)
+        syscall_ns = wall_ns;
+
+    printf("\tWall time:  %.3f s\n", wall_ns / 1e9);
+    printf("\tSyscalls:   %.3f s (%.1f %%), blocking waits included\n", syscall_ns / 1e9,
+           wall_ns ? 100.0 * syscall_ns / wall_ns : 0.0);
+    printf("\tUser space: %.3f s (%.1f %%)\n", (wall_ns - syscall_ns) / 1e9,
+           wall_ns ? 100.0 * (wall_ns - syscall_ns) / wall_ns : 0.0);
+}
+
+#endif /* UART_PROFILE */
@@ -0,0 +1,78 @@
+#ifndef _UART_PROFILE_H_
+#define _UART_PROFILE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* Profiled call types */
+#define UART_PROFILE_READ  0
+#define UART_PROFILE_WRITE 1
+#define UART_PROFILE_POLL  2
+#define UART_PROFILE_IOCTL 3
+#define UART_PROFILE_CALLS 4
+
+struct uart_t;
+
+/*
+ * Syscall profiling of uart.c, build flag UART_PROFILE (make profile)
+ *
+ * Every read(), write(), poll() and ioctl() of the syscall backend is
+ * stamped with CLOCK_MONOTONIC before and after the call. Per device
+ * and call type the profile keeps histograms of call duration and of
+ * bytes moved, counts short reads and writes (fewer bytes than asked,
+ * for poll() a timeout) and prints the split of wall time between
+ * syscalls and everything else on uart_close().
+ *
+ * Without UART_PROFILE the macros are empty and struct uart_t has no
+ * profile pointer: the hot path is unchanged.
+ */
+#ifdef UART_PROFILE
+
+#include <time.h>
+
+#include "histogram.h"
+
+struct uart_profile_call_t {
+    uint64_t calls;
+    uint64_t errors;       /* returned -1 */
+    uint64_t short_calls;  /* fewer bytes than asked, poll() timeout */
+    uint64_t single_byte;  /* read/write of 1 byte while more was asked */
+    uint64_t full;         /* all bytes asked */
+    uint64_t total_ns;
+    struct histogram_t duration_ns;
+    struct histogram_t bytes;
+};
+
+struct uart_profile_t {
+    uint64_t start_ns;
+    struct uart_profile_call_t calls[UART_PROFILE_CALLS];
+};
+
+static inline uint64_t uart_profile_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct uart_profile_t* uart_profile_create(void);
+void uart_profile_free(struct uart_profile_t *profile);
+
+/* Call of type started at start_ns returned ret, requested - bytes asked (0 for poll/ioctl) */
+void uart_profile_add(struct uart_profile_t *profile, int type, uint64_t start_ns,
+                      long ret, size_t requested);
+
+void uart_profile_print(struct uart_profile_t *profile, const char *device);
+
+#define UART_PROFILE_BEGIN(ts) uint64_t ts = uart_profile_now()
+#define UART_PROFILE_END(instance, type, ts, ret, requested) \
+        uart_profile_add((instance)->profile, type, ts, ret, requested)
+
+#else
+
+#define UART_PROFILE_BEGIN(ts)
+#define UART_PROFILE_END(instance, type, ts, ret, requested)
+
+#endif /* UART_PROFILE */
+
+#endif /* _UART_PROFILE_H_ */
@@ -0,0 +1,604 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "uart.h"
+#include "uart_sim.h"
+
+#define N_ "UART_SIM: "
+#define N_ERR "UART_SIM ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+/* One direction of the link, written by one endpoint */
+struct sim_queue_t {
+    uint8_t  data[UART_SIM_QUEUE_SIZE];
+    uint64_t ts[UART_SIM_QUEUE_SIZE];  /* delivery time, ns */
+    uint64_t head;                     /* free running positions */
+    uint64_t tail;
+
+    uint64_t line_ns;  /* line is busy until */
+    uint64_t last_ns;  /* delivery time of last character */
+    uint64_t char_ns;  /* character time of last write */
+
+    struct uart_sim_config_t config;
+    uint64_t rng;
+    uint64_t error_threshold;  /* event when rand() < threshold */
+    uint64_t drop_threshold;
+    uint64_t dup_threshold;
+    uint64_t burst_threshold;
+    uint32_t burst_left;
+
+    struct uart_sim_stats_t stats;
+};
+
+struct sim_link_t {
+    char name[64];
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;  /* data written, consumed or endpoint closed */
+
+    struct sim_queue_t queue[2];
+    uint8_t opened[2];
+    uint8_t closed[2];
+
+    struct sim_link_t *next;
+};
+
+struct uart_sim_t {
+    struct sim_link_t *link;
+    int side;
+
+    uint64_t rx;
+    uint64_t tx;
+};
+
+static struct sim_link_t *sim_links = NULL;
+static pthread_mutex_t sim_links_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t sim_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* splitmix64 */
+static uint64_t sim_rand(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t sim_threshold(double probability) {
+    if(probability <= 0.0)
+        return 0;
+    if(probability >= 1.0)
+        return UINT64_MAX;
+
+    return (uint64_t)(probability * 18446744073709551616.0);
+}
+
+static int sim_event(uint64_t *rng, uint64_t threshold) {
+    return threshold != 0 && sim_rand(rng) < threshold;
+}
+
+/* Sleep on link condition until until_ns, at most UART_SIM_WAIT_MSEC */
+static void sim_wait(struct sim_link_t *link, uint64_t until_ns) {
+    uint64_t limit_ns = sim_now_ns() + UART_SIM_WAIT_MSEC * 1000000ULL;
+    if(until_ns == 0 || until_ns > limit_ns)
+        until_ns = limit_ns;
+
+    struct timespec ts;
+    ts.tv_sec  = until_ns / 1000000000ULL;
+    ts.tv_nsec = until_ns % 1000000000ULL;
+
+    (void)pthread_cond_timedwait(&link->cond, &link->lock, &ts);
+}
+
+int uart_sim_parse(const char *spec, struct uart_sim_config_t *config) {
+    assert(spec != NULL);
+    assert(config != NULL);
+
+    char copy[strlen(spec) + 1];
+    strcpy(copy, spec);
+
+    char *save = NULL;
+    for(char *item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        char *end = NULL;
+
+        if(strcmp(item, "unlimited") == 0) {
+            config->unlimited = 1;
+            continue;
+        }
+
+        if(value == NULL || value[1] == '\0') {
+            printf("Wrong simulated link option '%s': expected key=value\n", item);
+            return -1;
+        }
+        *value++ = '\0';
+
+        if(strcmp(item, "seed") == 0) {
+            config->seed = strtoull(value, &end, 0);
+        } else if(strcmp(item, "ber") == 0) {
+            config->ber = strtod(value, &end);
+        } else if(strcmp(item, "drop") == 0) {
+            config->drop = strtod(value, &end);
+        } else if(strcmp(item, "dup") == 0) {
+            config->dup = strtod(value, &end);
+        } else if(strcmp(item, "burst") == 0) {
+            config->burst = strtod(value, &end);
+        } else if(strcmp(item, "burst_len") == 0) {
+            config->burst_len = strtoul(value, &end, 0);
+        } else if(strcmp(item, "latency_us") == 0) {
+            config->latency_us = strtoul(value, &end, 0);
+        } else if(strcmp(item, "jitter_us") == 0) {
+            config->jitter_us = strtoul(value, &end, 0);
+        } else {
+            printf("Unknown simulated link option '%s'\n", item);
+            return -1;
+        }
+
+        if(end == NULL || *end != '\0') {
+            printf("Wrong value of simulated link option %s: '%s'\n", item, value);
+            return -1;
+        }
+    }
+
+    if(config->ber < 0.0 || config->ber > 1.0 || config->drop < 0.0 || config->drop > 1.0 ||
+       config->dup < 0.0 || config->dup > 1.0 || config->burst < 0.0 || config->burst > 1.0) {
+        printf("Wrong simulated link option '%s': probabilities must be within 0..1\n", spec);
+        return -1;
+    }
+
+    return 0;
+}
+
+struct uart_sim_t* uart_sim_open(struct uart_t *instance, const char *device) {
+    assert(instance != NULL);
+    assert(device != NULL);
+
+    struct uart_sim_t *sim = (struct uart_sim_t*)malloc(sizeof(struct uart_sim_t));
+    if(sim == NULL) {
+        errprintf("malloc() failed\n");
+        return NULL;
+    }
+    memset(sim, 0x00, sizeof(struct uart_sim_t));
+
+    pthread_mutex_lock(&sim_links_lock);
+
+    /* Second open of the same name gets the other end */
+    struct sim_link_t *link = sim_links;
+    while(link != NULL && (strcmp(link->name, device) != 0 || link->opened[1])) {
+        link = link->next;
+    }
+
+    if(link != NULL) {
+        sim->side = 1;
+    } else {
+        link = (struct sim_link_t*)malloc(sizeof(struct sim_link_t));
+        if(link == NULL) {
+            pthread_mutex_unlock(&sim_links_lock);
+            errprintf("malloc() failed\n");
+            free(sim);
+            return NULL;
+        }
+        memset(link, 0x00, sizeof(struct sim_link_t));
+
+        strncpy(link->name, device, sizeof(link->name) - 1);
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&link->cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_init(&link->lock, NULL);
+
+        link->next = sim_links;
+        sim_links = link;
+
+        sim->side = 0;
+    }
+
+    link->opened[sim->side] = 1;
+    sim->link = link;
+
+    pthread_mutex_unlock(&sim_links_lock);
+
+    instance->sim = sim;
+    uart_sim_configure(instance, NULL);
+
+    return sim;
+}
+
+void uart_sim_close(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+
+    pthread_mutex_lock(&sim_links_lock);
+
+    pthread_mutex_lock(&link->lock);
+    link->closed[sim->side] = 1;
+    pthread_cond_broadcast(&link->cond);
+    int unused = link->closed[!sim->side] || !link->opened[!sim->side];
+    pthread_mutex_unlock(&link->lock);
+
+    if(unused) {
+        struct sim_link_t **next = &sim_links;
+        while(*next != link) {
+            next = &(*next)->next;
+        }
+        *next = link->next;
+
+        pthread_cond_destroy(&link->cond);
+        pthread_mutex_destroy(&link->lock);
+        free(link);
+    }
+
+    pthread_mutex_unlock(&sim_links_lock);
+
+    free(sim);
+    instance->sim = NULL;
+}
+
+void uart_sim_configure(struct uart_t *instance, const struct uart_sim_config_t *config) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[sim->side];
+
+    pthread_mutex_lock(&link->lock);
+
+    if(config != NULL) {
+        queue->config = *config;
+    } else {
+        memset(&queue->config, 0x00, sizeof(queue->config));
+    }
+
+    if(queue->config.burst_len == 0)
+        queue->config.burst_len = 1;
+
+    /* Character error rate for BER, one flipped bit per corrupted character */
+    double good = 1.0;
+    for(int i = 0; i < instance->bits; i++) {
+        good *= 1.0 - queue->config.ber;
+    }
+
+    queue->error_threshold = sim_threshold(1.0 - good);
+    queue->drop_threshold  = sim_threshold(queue->config.drop);
+    queue->dup_threshold   = sim_threshold(queue->config.dup);
+    queue->burst_threshold = sim_threshold(queue->config.burst);
+    queue->burst_left = 0;
+
+    /* Directions of one link differ with the same seed */
+    queue->rng = queue->config.seed ^ (sim->side ? 0x5bd1e9955bd1e995ULL : 0);
+
+    pthread_mutex_unlock(&link->lock);
+}
+
+/* Apply impairments to character, returns copies to deliver: 0, 1 or 2 */
+static int sim_impair(struct sim_queue_t *queue, uint8_t *c, int bits) {
+    if(sim_event(&queue->rng, queue->drop_threshold)) {
+        queue->stats.dropped++;
+        return 0;
+    }
+
+    if(queue->burst_left == 0 && sim_event(&queue->rng, queue->burst_threshold)) {
+        queue->burst_left = queue->config.burst_len;
+        queue->stats.bursts++;
+    }
+
+    if(queue->burst_left != 0) {
+        *c = (uint8_t)sim_rand(&queue->rng);
+        queue->burst_left--;
+        queue->stats.burst_bytes++;
+    } else if(sim_event(&queue->rng, queue->error_threshold)) {
+        *c ^= 1 << (sim_rand(&queue->rng) % bits);
+        queue->stats.flipped++;
+    }
+
+    if(sim_event(&queue->rng, queue->dup_threshold)) {
+        queue->stats.duplicated++;
+        return 2;
+    }
+
+    return 1;
+}
+
+int uart_sim_write(struct uart_t *instance, const void *buf, size_t count) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+    assert(buf != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[sim->side];
+    const uint8_t *ptr = (const uint8_t*)buf;
+
+    uint8_t mask = (instance->bits < UART_BITS_8) ? (1 << instance->bits) - 1 : 0xff;
+
+    pthread_mutex_lock(&link->lock);
+
+    uint64_t char_ns = queue->config.unlimited ? 0 : uart_char_time_ns(instance);
+    uint64_t latency_ns = (uint64_t)queue->config.latency_us * 1000;
+    uint64_t tx_buffer_ns = UART_SIM_TX_BUFFER * char_ns;
+    uint64_t now = sim_now_ns();
+
+    queue->char_ns = char_ns;
+
+    for(size_t i = 0; i < count; i++) {
+        uint8_t c = ptr[i] & mask;
+        int copies = sim_impair(queue, &c, instance->bits);
+
+        if(copies == 0) {
+            /* Lost character still took its time on the line */
+            queue->line_ns = (queue->line_ns > now ? queue->line_ns : now) + char_ns;
+        }
+
+        for(int copy = 0; copy < copies; copy++) {
+            /* Writer blocks while queue or transmit buffer is full, like tty write() */
+            while(!link->closed[!sim->side]) {
+                int full = queue->tail - queue->head == UART_SIM_QUEUE_SIZE;
+
+                if(!full && (char_ns == 0 || queue->line_ns <= now + tx_buffer_ns))
+                    break;
+
+                pthread_cond_broadcast(&link->cond);
+                sim_wait(link, full ? 0 : queue->line_ns - tx_buffer_ns);
+                now = sim_now_ns();
+            }
+
+            /* Nobody listens on closed end: bytes go nowhere */
+            if(link->closed[!sim->side])
+                continue;
+
+            queue->line_ns = (queue->line_ns > now ? queue->line_ns : now) + char_ns;
+
+            uint64_t delivery_ns = queue->line_ns + latency_ns;
+            if(queue->config.jitter_us != 0)
+                delivery_ns += sim_rand(&queue->rng) % ((uint64_t)queue->config.jitter_us * 1000 + 1);
+
+            /* Jitter delays, never reorders */
+            if(delivery_ns < queue->last_ns)
+                delivery_ns = queue->last_ns;
+            queue->last_ns = delivery_ns;
+
+            uint64_t slot = queue->tail % UART_SIM_QUEUE_SIZE;
+            queue->data[slot] = c;
+            queue->ts[slot] = delivery_ns;
+            queue->tail++;
+
+            queue->stats.bytes++;
+        }
+    }
+
+    sim->tx += count;
+
+    pthread_cond_broadcast(&link->cond);
+    pthread_mutex_unlock(&link->lock);
+
+    return count;
+}
+
+ssize_t uart_sim_read(struct uart_t *instance, void *buf, size_t count) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+    assert(buf != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[!sim->side];
+    uint8_t *ptr = (uint8_t*)buf;
+
+    pthread_mutex_lock(&link->lock);
+
+    uint64_t deadline = sim_now_ns() + UART_SIM_WAIT_MSEC * 1000000ULL;
+
+    while(1) {
+        uint64_t now = sim_now_ns();
+        size_t bytes = 0;
+
+        while(bytes < count && queue->head != queue->tail &&
+              queue->ts[queue->head % UART_SIM_QUEUE_SIZE] <= now) {
+            ptr[bytes++] = queue->data[queue->head % UART_SIM_QUEUE_SIZE];
+            queue->head++;
+        }
+
+        if(bytes != 0) {
+            sim->rx += bytes;
+            pthread_cond_broadcast(&link->cond);
+            pthread_mutex_unlock(&link->lock);
+            return bytes;
+        }
+
+        /* End of data: peer closed and everything delivered */
+        if(link->closed[!sim->side] && queue->head == queue->tail) {
+            instance->peer_closed = 1;
+            break;
+        }
+
+        if(now >= deadline)
+            break;
+
+        uint64_t next = deadline;
+        if(queue->head != queue->tail && queue->ts[queue->head % UART_SIM_QUEUE_SIZE] < next)
+            next = queue->ts[queue->head % UART_SIM_QUEUE_SIZE];
+
+        sim_wait(link, next);
+    }
+
+    pthread_mutex_unlock(&link->lock);
+
+    return 0;
+}
+
+int uart_sim_poll(struct uart_t *instance, int timeout_msec) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[!sim->side];
+
+    if(timeout_msec < 0)
+        timeout_msec = UART_SIM_WAIT_MSEC;
+
+    pthread_mutex_lock(&link->lock);
+
+    uint64_t deadline = sim_now_ns() + (uint64_t)timeout_msec * 1000000ULL;
+    int ret = 0;
+
+    while(1) {
+        uint64_t now = sim_now_ns();
+
+        if(queue->head != queue->tail && queue->ts[queue->head % UART_SIM_QUEUE_SIZE] <= now) {
+            ret = 1;
+            break;
+        }
+
+        /* Hang up: read returns 0 */
+        if(link->closed[!sim->side] && queue->head == queue->tail) {
+            ret = 1;
+            break;
+        }
+
+        if(now >= deadline)
+            break;
+
+        uint64_t next = deadline;
+        if(queue->head != queue->tail && queue->ts[queue->head % UART_SIM_QUEUE_SIZE] < next)
+            next = queue->ts[queue->head % UART_SIM_QUEUE_SIZE];
+
+        sim_wait(link, next);
+    }
+
+    pthread_mutex_unlock(&link->lock);
+
+    return ret;
+}
+
+int uart_sim_drain(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[sim->side];
+
+    pthread_mutex_lock(&link->lock);
+
+    uint64_t now = sim_now_ns();
+    while(queue->line_ns > now && !link->closed[!sim->side]) {
+        sim_wait(link, queue->line_ns);
+        now = sim_now_ns();
+    }
+
+    pthread_mutex_unlock(&link->lock);
+
+    return 0;
+}
+
+int uart_sim_wait_read(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[sim->side];
+
+    pthread_mutex_lock(&link->lock);
+
+    while(queue->head != queue->tail && !link->closed[!sim->side]) {
+        sim_wait(link, 0);
+    }
+
+    pthread_mutex_unlock(&link->lock);
+
+    return 0;
+}
+
+int uart_sim_outq(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[sim->side];
+
+    pthread_mutex_lock(&link->lock);
+
+    uint64_t now = sim_now_ns();
+    int bytes = 0;
+
+    if(queue->char_ns != 0 && queue->line_ns > now)
+        bytes = (queue->line_ns - now + queue->char_ns - 1) / queue->char_ns;
+
+    pthread_mutex_unlock(&link->lock);
+
+    return bytes;
+}
+
+int uart_sim_inq(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[!sim->side];
+
+    pthread_mutex_lock(&link->lock);
+
+    uint64_t now = sim_now_ns();
+    int bytes = 0;
+
+    for(uint64_t pos = queue->head; pos != queue->tail; pos++) {
+        if(queue->ts[pos % UART_SIM_QUEUE_SIZE] > now)
+            break;
+        bytes++;
+    }
+
+    pthread_mutex_unlock(&link->lock);
+
+    return bytes;
+}
+
+void uart_sim_counters(struct uart_t *instance, uint64_t *rx, uint64_t *tx) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    *rx = instance->sim->rx;
+    *tx = instance->sim->tx;
+}
+
+void uart_sim_print_stats(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->sim != NULL);
+
+    struct uart_sim_t *sim = instance->sim;
+    struct sim_link_t *link = sim->link;
+    struct sim_queue_t *queue = &link->queue[sim->side];
+
+    pthread_mutex_lock(&link->lock);
+    struct uart_sim_config_t config = queue->config;
+    struct uart_sim_stats_t stats = queue->stats;
+    pthread_mutex_unlock(&link->lock);
+
+    printf("Simulated link '%s' end %i TX: %s, seed %" PRIu64 ", ber %g, drop %g, dup %g, burst %g x %u, "
+           "latency %u us, jitter %u us\n", link->name, sim->side,
+           (config.unlimited ? "unlimited rate" : "line rate"), config.seed, config.ber, config.drop,
+           config.dup, config.burst, config.burst_len, config.latency_us, config.jitter_us);
+    printf("chars: %" PRIu64 " flipped: %" PRIu64 " dropped: %" PRIu64 " duplicated: %" PRIu64
+           " bursts: %" PRIu64 " (%" PRIu64 " chars)\n", stats.bytes, stats.flipped, stats.dropped,
+           stats.duplicated, stats.bursts, stats.burst_bytes);
+}
@@ -0,0 +1,83 @@
+#ifndef _UART_SIM_H_
+#define _UART_SIM_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct uart_t;
+struct uart_sim_t;
+
+/* Device names of simulated link: "sim" or "sim:<name>", see uart_transport.h */
+#define UART_SIM_DEVICE "sim"
+
+#define UART_SIM_QUEUE_SIZE (64 * 1024) /* bytes in flight per direction */
+#define UART_SIM_TX_BUFFER  4096        /* untransmitted bytes before write() blocks */
+#define UART_SIM_WAIT_MSEC  100         /* longest blocking wait, callers re-check stop flags */
+
+/* Impairments applied to bytes written by one endpoint */
+struct uart_sim_config_t {
+    uint64_t seed;
+    double   ber;         /* bit error rate, one flipped bit per corrupted character */
+    double   drop;        /* probability a character is lost */
+    double   dup;         /* probability a character is received twice */
+    double   burst;       /* probability a burst of garbage starts at a character */
+    uint32_t burst_len;   /* characters replaced by one burst */
+    uint32_t latency_us;  /* line delay */
+    uint32_t jitter_us;   /* extra random delay, order is kept */
+    uint8_t  unlimited;   /* no character rate: bytes move at memory speed */
+};
+
+/* Impairment counters of one direction */
+struct uart_sim_stats_t {
+    uint64_t bytes;       /* characters put on the line */
+    uint64_t flipped;
+    uint64_t dropped;
+    uint64_t duplicated;
+    uint64_t burst_bytes;
+    uint64_t bursts;
+};
+
+/*
+ * In-process simulated serial link
+ *
+ * Two uart_open() calls with the same "sim[:name]" device get the two
+ * endpoints of one link. Each direction is a queue of characters with
+ * a delivery time: the writer puts characters on the line one
+ * character time apart (uart_char_time_ns() of the writing endpoint),
+ * so the receiver sees the configured rate, latency and jitter.
+ * Impairments come from a per-direction RNG seeded from the config,
+ * the same byte stream gets the same errors in every run.
+ *
+ * Functions are called by uart.c, uart_init() configures the link from
+ * struct uart_options_t. Test drivers running both ends use
+ * uart_sim_wait_read() to know when the transfer is complete.
+ */
+/* Parse "key=value,..." impairment spec, see uart_print_usage() */
+int uart_sim_parse(const char *spec, struct uart_sim_config_t *config);
+
+struct uart_sim_t* uart_sim_open(struct uart_t *instance, const char *device);
+void uart_sim_close(struct uart_t *instance);
+
+void uart_sim_configure(struct uart_t *instance, const struct uart_sim_config_t *config);
+
+/* Blocks at most UART_SIM_WAIT_MSEC, 0 - no data or peer closed */
+ssize_t uart_sim_read(struct uart_t *instance, void *buf, size_t count);
+int uart_sim_write(struct uart_t *instance, const void *buf, size_t count);
+int uart_sim_poll(struct uart_t *instance, int timeout_msec);
+
+/* Wait until all written characters left the line (tcdrain()) */
+int uart_sim_drain(struct uart_t *instance);
+
+/* Wait until the peer read all written bytes or closed its end */
+int uart_sim_wait_read(struct uart_t *instance);
+
+/* Bytes not yet on the line / ready to read */
+int uart_sim_outq(struct uart_t *instance);
+int uart_sim_inq(struct uart_t *instance);
+
+/* Bytes read and written by endpoint */
+void uart_sim_counters(struct uart_t *instance, uint64_t *rx, uint64_t *tx);
+void uart_sim_print_stats(struct uart_t *instance);
+
+#endif /* _UART_SIM_H_ */
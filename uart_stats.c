@@ -0,0 +1,134 @@
+/*
+ * Live statistics reader for uart_test -Y segments
+ *
+ * Maps one or more shared memory segments published by running
+ * uart_test processes and prints a consistent snapshot of every port,
+ * once or every interval.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats_shm.h"
+#include "utils.h"
+
+#define N_ERR "UART_STATS ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+static const char* stats_role_name(uint32_t role) {
+    return (role == STATS_SHM_ROLE_SEND) ? "send" : (role == STATS_SHM_ROLE_RECV) ? "recv" : "-";
+}
+
+static void stats_print_segment(struct stats_shm_t *shm) {
+    struct stats_shm_layout_t *layout = shm->layout;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint32_t ports_num = __atomic_load_n(&layout->ports_num, __ATOMIC_ACQUIRE);
+    if(ports_num > STATS_SHM_PORTS_MAX)
+        ports_num = STATS_SHM_PORTS_MAX;
+
+    int alive = (kill(layout->pid, 0) == 0 || errno == EPERM);
+
+    for(uint32_t i = 0; i < ports_num; i++) {
+        struct stats_shm_port_t *port = &layout->ports[i];
+        struct stats_shm_values_t values;
+
+        if(stats_shm_read(port, &values) != 0) {
+            printf("%s[%u] %s: snapshot busy\n", shm->name, i, port->device);
+            continue;
+        }
+
+        uint64_t now_ns = timespec_to_ns(now);
+        uint64_t age_ms = (values.time_ns && now_ns > values.time_ns) ? (now_ns - values.time_ns) / 1000000 : 0;
+
+        printf("%s[%u] %s %s: %" PRIu64 " packets %" PRIu64 "/s, %" PRIu64 " B %" PRIu64 " B/s, "
+               "%" PRIu64 " crc errors, %" PRIu64 " lost, latency p50/p99/max %.1f/%.1f/%.1f us, "
+               "icount rx %" PRIu64 " tx %" PRIu64 " ferr %" PRIu64 " overrun %" PRIu64 " perr %" PRIu64
+               " brk %" PRIu64 " buf_overrun %" PRIu64 ", age %" PRIu64 " ms%s\n",
+               shm->name, i, port->device, stats_role_name(port->role),
+               values.total.packets, values.packets_rate, values.total.bytes, values.bytes_rate,
+               values.total.crc_errors, values.total.lost,
+               values.latency_p50_ns / 1000.0, values.latency_p99_ns / 1000.0, values.latency_max_ns / 1000.0,
+               values.icount_rx, values.icount_tx, values.icount_frame, values.icount_overrun,
+               values.icount_parity, values.icount_brk, values.icount_buf_overrun, age_ms,
+               alive ? "" : " (writer exited)");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t interval_ms = 0;
+    uint32_t count = 0;
+
+    while (1) {
+        static const struct option lopts[] = {
+            { "interval", 1, 0, 'i' },
+            { "count",    1, 0, 'n' },
+            { "help",     0, 0, 'h' },
+            { NULL,       0, 0, 0   },
+        };
+
+        int c = getopt_long(argc, argv, "i:n:h", lopts, NULL);
+        if (c == -1)
+            break;
+
+        switch (c) {
+            case 'i':
+                interval_ms = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                printf("Usage: %s [-i interval_ms] [-n count] <segment> [<segment> ...]\n", argv[0]);
+                printf("  Segments are the names given to uart_test -Y, one per process.\n");
+                printf("  Without -i prints once, with -i until interrupted or -n snapshots.\n");
+                exit(1);
+        }
+    } /* while */
+
+    int segments_num = argc - optind;
+    if(segments_num <= 0) {
+        errprintf("no segment given\n");
+        exit(1);
+    }
+
+    struct stats_shm_t *segments[segments_num];
+
+    for(int i = 0; i < segments_num; i++) {
+        segments[i] = stats_shm_open(argv[optind + i]);
+        if(segments[i] == NULL) {
+            exit(1);
+        }
+    }
+
+    struct timespec sleep_time = timespec_from_ms(interval_ms);
+
+    for(uint32_t n = 0; count == 0 || n < count; n++) {
+        for(int i = 0; i < segments_num; i++) {
+            stats_print_segment(segments[i]);
+        }
+        fflush(stdout);
+
+        if(interval_ms == 0)
+            break;
+
+        nanosleep(&sleep_time, NULL);
+    }
+
+    for(int i = 0; i < segments_num; i++) {
+        stats_shm_close(segments[i]);
+    }
+
+    return 0;
+}
@@ -11,13 +11,34 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "config.h"
 
 #include "uart.h"
 #include "uart_options.h"
+#include "uart_transport.h"
+#include "uart_mark.h"
+#include "uart_watch.h"
 
 #include "packet.h"
+#include "packet_stream.h"
+#include "checksum.h"
+#include "write_batch.h"
+#include "channel.h"
+#include "send_pipeline.h"
+#include "recv_pipeline.h"
+#include "rx_timing.h"
+#include "seq_tracker.h"
+#include "queue_monitor.h"
+#include "adapt.h"
+#include "soak.h"
+#include "scenario.h"
+#include "file_transfer.h"
+#include "stats_shm.h"
+#include "traffic.h"
+#include "bridge.h"
+#include "async_log.h"
 
 #include "utils.h"
 
@@ -31,12 +52,47 @@ struct options_t {
     uint32_t packets_num;
     uint32_t send_delay_ms;
     uint32_t byte_delay_ms;
+    uint32_t batch_bytes;      /* 0 - one write() per packet */
+    uint32_t batch_timeout_ms;
+    uint32_t lookahead;        /* 0 - generate packets inline */
+    uint8_t  pregenerate;
+    uint32_t rx_queue;         /* 0 - read and decode in one loop */
+    uint32_t stall_chars;      /* receiver stall threshold, characters */
+    uint8_t  reconnect;        /* receiver: wait for a lost device and open it again */
+    uint32_t reconnect_s;      /* give up after, 0 - never */
+    int32_t  queue_target;     /* kernel TX queue target, -1 - disabled */
+    uint8_t  log_async;
+    uint8_t  checksum;         /* CHECKSUM_* for sent packets */
+    uint8_t  header_format;    /* PACKET_FORMAT_* for sent packets */
+    struct traffic_config_t traffic; /* sender load shape, TRAFFIC_NONE - back to back or -d */
     uint8_t  direction; /* 0 - receive, 1 - send */
     uint8_t  verbose;
+
+    struct channel_t channels[CHANNELS_MAX];
+    int channels_num; /* 0 - single stream mode */
+
+    struct adapt_t adapt;
+    uint8_t adaptive; /* packet length driven by receiver feedback */
+
+    uint8_t  soak;             /* long run: unlimited packets, rolling windows */
+    uint32_t soak_s;           /* 0 - until interrupted */
+    uint32_t max_error_ppm;    /* 0 - never stop on errors */
+    char    *checkpoint;
+
+    char    *scenario;         /* steps file, NULL - single test */
+
+    char    *file;             /* sender: file to transfer */
+    char    *output;           /* receiver: file written from transfer */
+
+    char    *stats_shm;        /* shared memory segment for live counters, NULL - none */
+
+    char    *bridge;           /* second device to relay to, NULL - no bridge */
+    char    *bridge_line;      /* "<speed>[,<framing>]" of second device, NULL - as first */
 };
 
 static struct options_t options;
 static uint8_t test_in_action = 1;
+static struct stats_shm_t *stats_shm = NULL;
 
 void register_signal_handler();
 void signal_handler(int signal);
@@ -66,14 +122,60 @@ void signal_handler(int signal);
 #endif /* D_DEBUG */
 
 void print_usage(const char *prog) {
-    printf("Packet options: %s [-lndRvh] \n", prog);
+    printf("Packet options: %s [-lndiwBTOCFPGKHRQJrSWXZfoYNUAELvh] \n", prog);
     puts(
-    "  -l --packet_length <length> - set packet length (min 12 bytes for header) \n"
+    "  -l --packet_length <length> - set packet length (min header size) \n"
     "  -n --packets_num <num>      - set packets number     \n"
     "  -d --delay <msec>           - set send delay in msec \n"
     "  -i --byte_delay <msec>      - set inter byte delay in msec \n"
+    "  -w --traffic <profile>      - send packets by traffic profile instead of back to back: \n"
+    "                                poisson,rate=<packets/s> - random arrivals at mean rate \n"
+    "                                onoff,rate=<packets/s>,period_ms=<ms>,duty=<0..1> - bursts at \n"
+    "                                rate (0 - back to back) for duty of every period \n"
+    "                                trace,file=<path>[,scale=<x>] - replay gaps in us, one per line \n"
+    "                                add ,seed=<n> for other random arrivals; reports offered and \n"
+    "                                achieved rate, single stream sender only \n"
+    "  -B --batch <bytes>          - coalesce packets into writes of up to <bytes> \n"
+    "  -T --batch_timeout <msec>   - flush coalesced packets older than <msec> \n"
+    "  -O --queue_target <bytes>   - keep kernel TX queue at most <bytes> deep before every write \n"
+    "                                (0 - only monitor), receiver monitors RX queue with any value, \n"
+    "                                channel sender on a tty or sim line keeps one bulk packet \n"
+    "                                without it \n"
+    "  -P --lookahead <packets>    - prepare packets in producer thread <packets> ahead \n"
+    "  -G --pregenerate            - prepare all packets before sending \n"
+    "  -K --checksum <type>        - packet checksum: crc32, crc32c, crc16, fletcher32, adler32 \n"
+    "                                (receiver verifies with type from packet header) \n"
+    "  -H --header <format>        - packet header: standard (16 bytes), compact (varint number and \n"
+    "                                size, 9-16 bytes), receiver reads both; single stream only \n"
+    "  -C --channel <id:prio:len[:period_ms[:num]]> \n"
+    "                              - add logical channel (repeat for more, prio 0 - highest, \n"
+    "                                period 0 - bulk), receiver also needs -C to enable channel mode \n"
+    "  -F --adapt <min:max[:step]> - adapt packet length to link errors from receiver feedback, \n"
+    "                                receiver also needs -F with the same max \n"
     "  -R --receive                - receive packets only   \n"
+    "  -Q --rx_queue <chunks>      - read in I/O thread, queue up to <chunks> for decoding \n"
+    "  -J --stall_chars <chars>    - report gaps inside a packet longer than <chars> \n"
+    "                                character times above wire time as sender stalls \n"
+    "  -r --reconnect <sec>        - receiver: when the device disappears wait up to <sec> for it to \n"
+    "                                come back (0 - forever), reopen it and resync to packets \n"
+    "  -S --soak <sec>             - soak run for <sec> (0 - until interrupted): unlimited packets, \n"
+    "                                fixed memory, 1 s / 1 min / 1 h window statistics \n"
+    "  -W --checkpoint <file>      - rewrite soak report to <file> every minute \n"
+    "  -X --max_error_ppm <ppm>    - stop soak run when errors in last minute exceed <ppm> \n"
+    "  -Z --scenario <file>        - run test steps from <file> on one open port, both sides load \n"
+    "                                the same file (see scenario.h), exit code 1 if a step failed \n"
+    "  -f --file <path>            - send file, mapped and cut into slices of packet length \n"
+    "  -o --output <path>          - receive file into <path>, exit code 1 if CRC32 of file differs \n"
+    "  -Y --stats_shm <name>       - publish live counters in shared memory segment <name>, \n"
+    "                                read them with uart_stats <name> \n"
+    "  -N --bridge <device>        - relay between the port and <device> in both directions, \n"
+    "                                measure throughput, buffering and forwarding latency \n"
+    "  -U --bridge_line <speed>[,<framing>] \n"
+    "                              - line of bridged <device>, e.g. 115200,7E1 (default as port) \n"
     "  -v --verbose                - enable verbose mode (show packets body) \n"
+    "  -A --log_async              - log packets from background thread (drop on overload) \n"
+    "  -L --log_level <level>      - set log level (0 - errors, 1 - warnings, 2 - info, 3 - debug) \n"
+    "  -E --log_every <N>          - log every Nth packet info and CRC OK line \n"
     "  -h --help                   - print help\n");
 }
 
@@ -84,14 +186,71 @@ void print_options(struct options_t *options) {
     printf("    UART bits:      %i \n", options->uart_options.bits);
     printf("    UART parity:    %i \n", options->uart_options.parity);
     printf("    UART stop bits: %i \n", options->uart_options.stop_bits);
+    printf("    UART transport: %s \n", uart_transport_name(uart_transport_from_device(options->uart_options.device)));
+    printf("    UART backend:   %s \n", (options->uart_options.io_backend == UART_BACKEND_URING ? "io_uring" : "syscall"));
 
     printf("Packet options:\n");
     printf("    Packet length:  %i \n", options->packet_length);
     printf("    Packets num:    %i \n", options->packets_num);
     printf("    Send delay, ms: %i \n", options->send_delay_ms);
     printf("    Byte delay, ms: %i \n", options->send_delay_ms);
+    printf("    Traffic:        ");
+    traffic_print_config(&options->traffic);
+    printf("    Batch, bytes:   %i \n", options->batch_bytes);
+    printf("    Batch tmo, ms:  %i \n", options->batch_timeout_ms);
+    printf("    Queue target:   %i \n", options->queue_target);
+    printf("    Lookahead:      %i%s \n", options->lookahead, (options->pregenerate ? " (pregenerate)" : ""));
+    printf("    RX queue:       %i \n", options->rx_queue);
+    printf("    Stall, chars:   %i \n", options->stall_chars);
+    printf("    Checksum:       %s%s \n", checksum_name(options->checksum),
+           (options->checksum == CHECKSUM_CRC32C && checksum_crc32c_hw() ? " (hw)" : ""));
+    printf("    Header:         %s, version %i \n", packet_format_name(options->header_format), PACKET_VERSION);
     printf("    Direction:      %s \n", (options->direction == DIRECTION_SEND ? "Send" : "Receive"));
     printf("    Verbose mode:   %s \n", (options->verbose == 1 ? "Enabled" : "Disabled"));
+    printf("    Log:            %s, level %i, every %i \n", (options->log_async ? "async" : "sync"),
+           alog_config.level, alog_config.every);
+
+    if(options->reconnect) {
+        printf("    Reconnect:      %s%u s \n", (options->reconnect_s ? "" : "forever, "), options->reconnect_s);
+    }
+
+    if(options->soak) {
+        printf("    Soak:           %u s, max errors %u ppm, checkpoint %s \n", options->soak_s,
+               options->max_error_ppm, (options->checkpoint ? options->checkpoint : "none"));
+    }
+
+    if(options->scenario) {
+        printf("    Scenario:       %s \n", options->scenario);
+    }
+
+    if(options->file) {
+        printf("    Send file:      %s \n", options->file);
+    }
+
+    if(options->output) {
+        printf("    Output file:    %s \n", options->output);
+    }
+
+    if(options->stats_shm) {
+        printf("    Stats segment:  %s \n", options->stats_shm);
+    }
+
+    if(options->bridge) {
+        printf("    Bridge to:      %s%s%s \n", options->bridge, (options->bridge_line ? ", " : ""),
+               (options->bridge_line ? options->bridge_line : ""));
+    }
+
+    if(options->adaptive) {
+        printf("    Adaptive len:   %u..%u, step %u \n", options->adapt.min_length,
+               options->adapt.max_length, options->adapt.step);
+    }
+
+    for(int i = 0; i < options->channels_num; i++) {
+        struct channel_t *channel = &options->channels[i];
+        printf("    Channel %u:      priority %u, length %u, period %u ms, packets %u \n",
+               channel->id, channel->priority, channel->packet_length,
+               channel->period_ms, channel->packets_num);
+    }
 }
 
 void print_help(char** argv, struct options_t *options) {
@@ -110,8 +269,36 @@ struct options_t parse_options(int argc, char** argv) {
     options.packets_num = 4;
     options.send_delay_ms = 0;
     options.byte_delay_ms = 0;
+    options.batch_bytes = 0;
+    options.batch_timeout_ms = 10;
+    options.queue_target = -1;
+    options.lookahead = 0;
+    options.pregenerate = 0;
+    options.rx_queue = 0;
+    options.stall_chars = RX_TIMING_DEFAULT_STALL_CHARS;
+    options.reconnect = 0;
+    options.reconnect_s = 0;
+    options.log_async = 0;
+    options.checksum = CHECKSUM_DEFAULT;
+    options.header_format = PACKET_FORMAT_STANDARD;
+    memset(&options.traffic, 0x00, sizeof(options.traffic));
+    options.traffic.type = TRAFFIC_NONE;
     options.direction = DIRECTION_SEND;
     options.verbose = 0;
+    options.channels_num = 0;
+    options.adaptive = 0;
+    options.soak = 0;
+    options.soak_s = 0;
+    options.max_error_ppm = 0;
+    options.checkpoint = NULL;
+    options.scenario = NULL;
+    options.file = NULL;
+    options.output = NULL;
+    options.stats_shm = NULL;
+    options.bridge = NULL;
+    options.bridge_line = NULL;
+
+    int log_level_set = 0;
 
     /* disable getopt_long error messages */
     opterr = 0;
@@ -135,13 +322,38 @@ struct options_t parse_options(int argc, char** argv) {
             { "packets_num",   1, 0, 'n' },
             { "delay",         1, 0, 'd' },
             { "byte_delay",    1, 0, 'b' },
+            { "batch",         1, 0, 'B' },
+            { "batch_timeout", 1, 0, 'T' },
+            { "channel",       1, 0, 'C' },
+            { "checksum",      1, 0, 'K' },
+            { "header",        1, 0, 'H' },
+            { "traffic",       1, 0, 'w' },
+            { "adapt",         1, 0, 'F' },
+            { "queue_target",  1, 0, 'O' },
+            { "lookahead",     1, 0, 'P' },
+            { "pregenerate",   0, 0, 'G' },
+            { "rx_queue",      1, 0, 'Q' },
+            { "stall_chars",   1, 0, 'J' },
+            { "reconnect",     1, 0, 'r' },
+            { "log_async",     0, 0, 'A' },
+            { "log_level",     1, 0, 'L' },
+            { "log_every",     1, 0, 'E' },
+            { "soak",          1, 0, 'S' },
+            { "checkpoint",    1, 0, 'W' },
+            { "scenario",      1, 0, 'Z' },
+            { "file",          1, 0, 'f' },
+            { "output",        1, 0, 'o' },
+            { "stats_shm",     1, 0, 'Y' },
+            { "bridge",        1, 0, 'N' },
+            { "bridge_line",   1, 0, 'U' },
+            { "max_error_ppm", 1, 0, 'X' },
             { "receive",       1, 0, 'R' },
             { "verbose",       1, 0, 'v' },
             { NULL,        0, 0, 0   },
         };
         int c;
 
-        c = getopt_long(argc, argv, "hl:n:d:i:Rv", lopts, NULL);
+        c = getopt_long(argc, argv, "hl:n:d:i:w:B:T:O:C:K:H:F:P:GQ:J:r:S:W:X:Z:f:o:Y:N:U:AL:E:Rv", lopts, NULL);
         if (c == -1)
             break;
 
@@ -149,7 +361,7 @@ struct options_t parse_options(int argc, char** argv) {
             case 'l':
                 options.packet_length = atoi(optarg);
                 if (options.packet_length < PACKET_HEADER_SIZE) {
-                    printf("Wrong packet length: min is %i bytes\n", PACKET_HEADER_SIZE);
+                    printf("Wrong packet length: min is %i bytes\n", (int)PACKET_HEADER_SIZE);
                     exit(1);
                 }
                 break;
@@ -162,6 +374,112 @@ struct options_t parse_options(int argc, char** argv) {
             case 'i':
                 options.byte_delay_ms = atoi(optarg);
                 break;
+            case 'w':
+                if(traffic_parse(optarg, &options.traffic) != 0) {
+                    exit(1);
+                }
+                break;
+            case 'B':
+                options.batch_bytes = atoi(optarg);
+                break;
+            case 'T':
+                options.batch_timeout_ms = atoi(optarg);
+                break;
+            case 'O':
+                options.queue_target = atoi(optarg);
+                if(options.queue_target < 0) {
+                    printf("Wrong queue target: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                options.lookahead = atoi(optarg);
+                break;
+            case 'G':
+                options.pregenerate = 1;
+                break;
+            case 'Q':
+                options.rx_queue = atoi(optarg);
+                break;
+            case 'J':
+                options.stall_chars = atoi(optarg);
+                break;
+            case 'r':
+                options.reconnect = 1;
+                options.reconnect_s = atoi(optarg);
+                break;
+            case 'A':
+                options.log_async = 1;
+                break;
+            case 'L':
+                alog_config.level = atoi(optarg);
+                log_level_set = 1;
+                break;
+            case 'S':
+                options.soak = 1;
+                options.soak_s = atoi(optarg);
+                break;
+            case 'W':
+                options.checkpoint = optarg;
+                break;
+            case 'Z':
+                options.scenario = optarg;
+                break;
+            case 'f':
+                options.file = optarg;
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            case 'Y':
+                options.stats_shm = optarg;
+                break;
+            case 'N':
+                options.bridge = optarg;
+                break;
+            case 'U':
+                options.bridge_line = optarg;
+                break;
+            case 'X':
+                options.max_error_ppm = atoi(optarg);
+                break;
+            case 'E':
+                alog_config.every = atoi(optarg);
+                break;
+            case 'K': {
+                int type = checksum_from_name(optarg);
+                if(type < 0) {
+                    printf("Wrong checksum type: %s\n", optarg);
+                    exit(1);
+                }
+                options.checksum = type;
+                break;
+            }
+            case 'H': {
+                int format = packet_format_from_name(optarg);
+                if(format < 0) {
+                    printf("Wrong header format: %s\n", optarg);
+                    exit(1);
+                }
+                options.header_format = format;
+                break;
+            }
+            case 'F':
+                if(adapt_parse(optarg, &options.adapt) != 0) {
+                    exit(1);
+                }
+                options.adaptive = 1;
+                break;
+            case 'C':
+                if(options.channels_num == CHANNELS_MAX) {
+                    printf("Too many channels: max is %i\n", CHANNELS_MAX);
+                    exit(1);
+                }
+                if(channel_parse(optarg, &options.channels[options.channels_num]) != 0) {
+                    exit(1);
+                }
+                options.channels_num++;
+                break;
             case 'R':
                 options.direction = DIRECTION_RECV;
                 break;
@@ -185,6 +503,74 @@ struct options_t parse_options(int argc, char** argv) {
         free(argv_uart[i]);
     }
 
+    if(options.scenario != NULL && (options.soak || options.adaptive || options.channels_num > 0)) {
+        printf("Scenario mode does not support -S, -F and -C\n");
+        exit(1);
+    }
+
+    if((options.file != NULL || options.output != NULL) &&
+       (options.soak || options.adaptive || options.channels_num > 0 || options.scenario != NULL)) {
+        printf("File transfer does not support -S, -F, -C and -Z\n");
+        exit(1);
+    }
+
+    if(options.header_format != PACKET_FORMAT_STANDARD &&
+       (options.adaptive || options.channels_num > 0 || options.scenario != NULL ||
+        options.file != NULL || options.output != NULL)) {
+        printf("Compact header is for single stream only, not with -F, -C, -Z, -f and -o\n");
+        exit(1);
+    }
+
+    if(options.reconnect &&
+       (options.direction != DIRECTION_RECV || options.rx_queue > 0 || options.adaptive ||
+        options.channels_num > 0 || options.scenario != NULL || options.output != NULL || options.bridge != NULL)) {
+        printf("Reconnect works for packet receiver (-R) only, not with -Q, -F, -C, -Z, -o and -N\n");
+        exit(1);
+    }
+
+    if(options.bridge != NULL &&
+       (options.soak || options.adaptive || options.channels_num > 0 || options.scenario != NULL ||
+        options.file != NULL || options.output != NULL || options.stats_shm != NULL)) {
+        printf("Bridge mode does not support -S, -F, -C, -Z, -f, -o and -Y\n");
+        exit(1);
+    }
+
+    if(options.traffic.type != TRAFFIC_NONE &&
+       (options.direction != DIRECTION_SEND || options.send_delay_ms > 0 || options.byte_delay_ms > 0 ||
+        options.adaptive || options.channels_num > 0 || options.scenario != NULL ||
+        options.file != NULL || options.bridge != NULL)) {
+        printf("Traffic profile is for single stream sender only, not with -R, -d, -i, -F, -C, -Z, -f and -N\n");
+        exit(1);
+    }
+
+    if(options.bridge_line != NULL && options.bridge == NULL) {
+        printf("Bridge line -U needs bridge device -N\n");
+        exit(1);
+    }
+
+    if(options.pregenerate && options.packets_num == 0) {
+        printf("Pregenerate -G needs a packet count, not -n 0\n");
+        exit(1);
+    }
+
+    if(options.file != NULL && options.packet_length <= PACKET_HEADER_SIZE) {
+        printf("File transfer needs packet length above header size %i\n", (int)PACKET_HEADER_SIZE);
+        exit(1);
+    }
+
+    if(options.soak) {
+        if(options.pregenerate || options.adaptive || options.channels_num > 0) {
+            printf("Soak mode does not support -G, -F and -C\n");
+            exit(1);
+        }
+
+        options.packets_num = 0; /* unlimited */
+
+        /* No line per packet unless asked for */
+        if(!log_level_set)
+            alog_config.level = ALOG_WARN;
+    }
+
     /* print help if no cmdline params set */
     if(argc < 2) {
         (void)print_help(argv, &options);
@@ -194,173 +580,1912 @@ struct options_t parse_options(int argc, char** argv) {
     return options;
 }
 
+/* Write one serialized packet using the selected write mode, returns bytes sent */
+static int send_data(struct uart_t *uart, struct options_t *options, struct write_batch_t *batch,
+                     const uint8_t *ptr, size_t size) {
+    int bytes = 0;
+
+    if(batch != NULL) {
+        if(write_batch_add(batch, (const void*)ptr, size) != 0) {
+            strerr("UART write failed\n");
+            exit(1);
+        }
+        bytes = size;
+    } else if(options->byte_delay_ms == 0) {
+        bytes = uart_write(uart, (const void*)ptr, size);
+        if (bytes == -1) {
+            /* Interrupted by stop request or reader gone on stop: keep final report */
+            if((errno == EINTR || errno == EPIPE) && test_in_action == 0)
+                return 0;
+            strerr("UART write failed\n");
+            exit(1);
+        }
+
+        if (bytes != size) {
+            alog2(ALOG_WARN, "Warning: Partial write: %" PRIu64 " of %" PRIu64 "\n", bytes, size);
+        }
+    } else { /* add inter byte delay */
+        struct timespec byte_time = timespec_from_ms(options->byte_delay_ms);
+
+        while(bytes < size)
+        {
+            int ret = uart_write(uart, (const void*)(ptr + bytes), 1);
+            if (ret == -1) {
+                strerr("UART write failed\n");
+                exit(1);
+            }
+
+            bytes++;
+            (void)uart_submit(uart);
+            nanosleep(&byte_time, NULL);
+        } /* while bytes < size */
+    } /* if options->byte_delay_ms */
+
+    return bytes;
+}
+
+/* Write header and data of one packet from where they are, data is not copied behind the header */
+static int send_data_parts(struct uart_t *uart, struct options_t *options, const uint8_t *header,
+                           size_t header_size, const uint8_t *data, size_t data_size) {
+    if(options->byte_delay_ms != 0) {
+        int bytes = send_data(uart, options, NULL, header, header_size);
+        return bytes + send_data(uart, options, NULL, data, data_size);
+    }
+
+    struct iovec iov[2] = {
+        { .iov_base = (void*)header, .iov_len = header_size },
+        { .iov_base = (void*)data,   .iov_len = data_size },
+    };
+    size_t size = header_size + data_size;
+
+    int bytes = uart_writev(uart, iov, 2);
+    if (bytes == -1) {
+        /* Interrupted by stop request or reader gone on stop: keep final report */
+        if((errno == EINTR || errno == EPIPE) && test_in_action == 0)
+            return 0;
+        strerr("UART write failed\n");
+        exit(1);
+    }
+
+    if (bytes != size) {
+        alog2(ALOG_WARN, "Warning: Partial write: %" PRIu64 " of %" PRIu64 "\n", bytes, size);
+    }
+
+    return bytes;
+}
+
+/* Header in its own buffer, data goes out of the packet as it is */
+static int send_packet_parts(struct uart_t *uart, struct options_t *options, const struct packet_t *packet) {
+    uint8_t header[PACKET_HEADER_MAX];
+    size_t header_size = packet_encode_header(packet, packet_get_format(), header);
+
+    return send_data_parts(uart, options, header, header_size, packet->data, packet->data_size);
+}
+
 void send_packets(struct uart_t *uart, struct options_t *options) {
-    unsigned int packets_send = 0;
+    uint64_t packets_send = 0;
     int bytes = 0;
 
+    struct stats_shm_counters_t counters;
+    struct stats_shm_writer_t shm_writer;
+
+    memset(&counters, 0x00, sizeof(counters));
+    stats_shm_writer_init(&shm_writer, stats_shm, uart, STATS_SHM_ROLE_SEND);
+
     assert(options != NULL);
     assert(uart != NULL);
-    assert(uart->fd > 0);
+    assert(uart->fd > 0 || uart->transport == UART_TRANSPORT_SIM);
 
     /* Convert delay from msec to struct timespec */
     struct timespec sleep_time = timespec_from_ms(options->send_delay_ms);
-    struct timespec byte_time  = timespec_from_ms(options->byte_delay_ms);
 
-    /* send data */
-    for(int i = 0; i < options->packets_num; ++i) {
-        struct packet_t packet = create_packet(options->packet_length);
-        struct data_t data = packet_to_data(packet);
+    /* Write coalescing is not compatible with inter byte delay */
+    struct write_batch_t batch;
+    int batching = (options->batch_bytes > 0 && options->byte_delay_ms == 0);
 
-        show_packet_info(&packet);
+    if(batching) {
+        if(write_batch_init(&batch, uart, options->batch_bytes, options->batch_timeout_ms) != 0) {
+            exit(1);
+        }
+    }
 
-        if(options->byte_delay_ms == 0) {
-            bytes = uart_write(uart, (const void*)data.ptr, data.size);
-            if (bytes == -1) {
-                strerr("UART write failed\n");
-                exit(1);
-            }
+    /* Pace writes by kernel TX queue depth */
+    struct queue_monitor_t queue;
+    int pacing = (options->queue_target >= 0);
+
+    if(pacing) {
+        queue_monitor_init(&queue, uart, QUEUE_MONITOR_TX, options->queue_target);
+    }
+
+    /* Prepare packets in producer thread */
+    struct send_pipeline_t pipeline;
+    int pipelined = (options->lookahead > 0 || options->pregenerate);
+
+    if(pipelined) {
+        if(send_pipeline_start(&pipeline, options->packet_length, options->packets_num,
+                               options->lookahead, options->pregenerate, &test_in_action) != 0) {
+            exit(1);
+        }
+    }
+
+    struct soak_t soak;
+    if(options->soak) {
+        soak_init(&soak, options->soak_s, 0, options->checkpoint);
+    }
+
+    /* Packets due by traffic profile */
+    struct traffic_t traffic;
+    int shaping = (options->traffic.type != TRAFFIC_NONE);
+    struct timespec write_ts, done_ts;
+
+    if(shaping && traffic_init(&traffic, &options->traffic) != 0) {
+        exit(1);
+    }
+
+    /* Packets built in place in the same buffer all the time */
+    struct packet_encoder_t encoder;
+    packet_encoder_init(&encoder, packet_get_format(), packet_get_checksum(), 0);
+
+    uint8_t *wire_buf = (uint8_t*)malloc(options->packet_length);
+    if(wire_buf == NULL) {
+        printf("send_packets: malloc() failed\n");
+        exit(1);
+    }
+
+    /* send data */
+    for(uint64_t i = 0; options->packets_num == 0 || i < options->packets_num; ++i) {
+        struct data_t data;
 
-            if (bytes != data.size) {
-                printf("Warning: Partial write: %d of %d\n", bytes, data.size);
+        if(pipelined) {
+            data.ptr = (uint8_t*)send_pipeline_next(&pipeline, &data.size);
+            if(data.ptr == NULL) {
+                break;
             }
-        } else { /* add inter byte delay */
-            while(bytes < data.size)
-            {
-                int ret = uart_write(uart, (const void*)data.ptr++, 1);
-                if (ret == -1) {
+        } else {
+            struct packet_t packet;
+            uint8_t *body = packet_encoder_begin(&encoder, wire_buf, options->packet_length, &packet);
+
+            assert(body != NULL);
+            fill_data(body, packet.data_size);
+
+            data.ptr = wire_buf;
+            data.size = packet_encoder_finish(&encoder, wire_buf, &packet);
+
+            show_packet_info(&packet);
+        }
+
+        if(pacing) {
+            queue_monitor_wait(&queue);
+        }
+
+        if(shaping) {
+            struct timespec due = traffic_due(&traffic);
+
+            clock_gettime(CLOCK_MONOTONIC, &write_ts);
+            if(timespec_to_ns(write_ts) < timespec_to_ns(due)) {
+                /* Packets coalesced or queued before go out while waiting */
+                if(batching && write_batch_flush(&batch) != 0) {
                     strerr("UART write failed\n");
                     exit(1);
                 }
+                (void)uart_flush(uart);
+
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+                clock_gettime(CLOCK_MONOTONIC, &write_ts);
+            }
+        }
 
-                bytes++;
-                nanosleep(&byte_time, NULL);
-            } /* while bytes < data.size */
-        } /* if options->byte_delay_ms */
+        bytes = send_data(uart, options, batching ? &batch : NULL, data.ptr, data.size);
+
+        if(shaping) {
+            clock_gettime(CLOCK_MONOTONIC, &done_ts);
+            traffic_sent(&traffic, bytes, write_ts, done_ts);
+        }
 
         if(options->verbose == 1) {
             printf("Packet dump: %i\n", bytes);
             show_data_struct(&data);
         }
 
+        if(pipelined) {
+            send_pipeline_release(&pipeline);
+        }
+
         packets_send++;
-        nanosleep(&sleep_time, NULL);
+
+        counters.packets = packets_send;
+        counters.bytes += bytes;
+        stats_shm_update(&shm_writer, &counters, NULL);
+
+        if(options->soak) {
+            soak_add(&soak, bytes, 0, 0);
+            if(soak_tick(&soak) != SOAK_RUNNING)
+                break;
+        }
+
+        /* Do not keep packets buffered while the line is idle */
+        if(batching && (options->send_delay_ms >= options->batch_timeout_ms || write_batch_expired(&batch))) {
+            if(write_batch_flush(&batch) != 0) {
+                strerr("UART write failed\n");
+                exit(1);
+            }
+        }
+
+        /* Queued writes (io_uring backend) must not wait while sleeping */
+        if(options->send_delay_ms > 0) {
+            (void)uart_flush(uart);
+            nanosleep(&sleep_time, NULL);
+        }
 
         if(test_in_action == 0) {
             break;
         }
     } /* for 0 to options->packets_num */
 
-    printf("Transfer done:\n\tPackets send: %i\n", packets_send);
-}
+    if(batching) {
+        if(write_batch_flush(&batch) != 0) {
+            strerr("UART write failed\n");
+        }
+    }
 
-void read_packets(struct uart_t *uart, struct options_t *options) {
-    unsigned int packets_received = 0;
-    unsigned int crc_errors       = 0;
-    unsigned int packets_lost     = 0;
-    unsigned int prev_packet_num  = 0;
-    unsigned int crc              = 0;
+    (void)uart_flush(uart);
 
-    struct packet_t packet;
-    struct data_t data;
+    stats_shm_publish(&shm_writer, &counters, NULL, 1);
 
-    assert(options != NULL);
-    assert(uart != NULL);
+    alog_flush();
 
-    data.ptr = (unsigned char*)malloc(options->packet_length);
-    data.size = options->packet_length;
+    printf("Transfer done:\n\tPackets send: %" PRIu64 "\n", packets_send);
+    printf("\tI/O syscalls: %" PRIu64 "\n", uart->syscalls);
 
-    if (data.ptr == NULL) {
-        printf("read_packets: malloc() failed\n");
-        exit(1);
+    if(options->soak) {
+        soak_finish(&soak);
     }
 
-    assert(uart->fd > 0);
+    if(shaping) {
+        traffic_print_stats(&traffic);
+        traffic_free(&traffic);
+    }
 
-    while(test_in_action != 0) {
-        int bytes = uart_read(uart, data.ptr, data.size);
-        if(bytes < 0) {
-            strerr("UART read() failed\n");
-            exit(1);
-        }
+    free(wire_buf);
 
-        if(bytes == 0) {
-            /* No data yet */
-            continue;
-        }
+    if(pacing) {
+        queue_monitor_print_stats(&queue);
+    }
 
-        if(bytes != options->packet_length) {
-            printf("Error: Bytes read: %i, packet size: %i\n", bytes, options->packet_length);
-            break;
-        }
-        data.size = bytes;
+    if(batching) {
+        write_batch_print_stats(&batch);
+        write_batch_free(&batch);
+    }
 
-        packet = packet_from_data(data);
-        show_packet_info(&packet);
-        packets_received++;
+    if(pipelined) {
+        send_pipeline_stop(&pipeline);
+        send_pipeline_print_stats(&pipeline);
+    }
+}
 
-        if(options->verbose == 1) {
-            printf("Packet dump: %i\n", bytes);
-            show_data_struct(&data);
-        }
+struct recv_stats_t {
+    uint64_t packets_received;
+    uint64_t crc_errors;
+    uint64_t packets_marked;   /* with parity/framing error markers, not checked */
+    uint8_t checksum_warned;
 
-        if(prev_packet_num != 0 /*ignore first transfer*/ && packet.number > 1)
-        if(packet.number - prev_packet_num != 1) {
-            printf("Warning! Packet lost [%.8i ... %.8i]\n", prev_packet_num, packet.number);
-            packets_lost++;
-        }
-        prev_packet_num = packet.number;
+    struct seq_tracker_t seq;  /* lost, duplicate and reordered packets */
 
-        crc = crc32(0x00, packet.data, packet.data_size);
-        if(packet.crc32 != crc) {
-            crc_errors++;
-            printf("Warning! wrong crc [0x%.8x] for packet: #%.8i crc32[0x%.8x]\n", crc, packet.number, packet.crc32);
-        } else {
-            printf("CRC32 [0x%.8x]: OK\n", packet.crc32);
-        }
+    struct uart_mark_t *mark;  /* NULL - no error markers */
 
-        free(packet.data);
-    }
+    /* frames out of the byte stream, packet_received() checks them */
+    struct packet_decoder_t decoder;
+    struct options_t *options;
+    struct timespec ts;        /* arrival of bytes being decoded */
+    struct uart_t *uart;       /* told of bad frames, NULL - I/O thread unpacks characters */
 
-    printf("Test completed:\n");
-    printf("\tPackets received: %i\n", packets_received);
-    printf("\tCRC errors:       %i\n", crc_errors);
-    printf("\tPackets lost:     %i\n", packets_lost);
-}
+    /* device lost and reopened, see reconnect_device() */
+    uint64_t outages;
+    uint64_t outage_ms;
+    uint64_t outage_longest_ms;
+    uint64_t outage_lost;      /* packets sent while the device was gone */
+    uint8_t  outage_open;      /* 1 - packets lost in last outage not known yet */
+    uint8_t  outage_started;   /* sequence had started before last outage */
+    uint32_t outage_highest;   /* highest number before last outage */
+    uint64_t outage_last_ms;
 
-int main(int argc, char *argv[]) {
-    options = parse_options(argc, argv);
+    struct soak_t *soak; /* NULL - not a soak run */
 
-    printf("UART test started\n");
+    struct rx_timing_t timing;
 
-    (void)print_options(&options);
+    struct queue_monitor_t queue;
+    int queue_monitoring;
 
-    register_signal_handler();
+    struct stats_shm_counters_t counters; /* exported to stats segment */
+    struct stats_shm_writer_t shm_writer;
+};
 
-    /* Initialization */
-    struct uart_t *uart = NULL;
+/* Report error markers of the frame, returns bytes marked; markers in bytes skipped before it count too */
+static uint32_t check_marks(struct recv_stats_t *stats, const struct packet_decoder_event_t *frame) {
+    struct uart_mark_event_t event;
+    uint32_t number = frame->packet.number;
+    uint32_t marked = 0;
 
-    uart = uart_init(options.uart_options.device, options.uart_options);
-    if(uart == NULL) {
-        printf("UART init failed - exit\n");
-        exit(-1);
+    while(uart_mark_next(stats->mark, frame->offset + frame->size, &event)) {
+        /* Offsets of packed characters are approximate */
+        uint64_t offset = (event.offset > frame->offset) ? event.offset - frame->offset : 0;
+
+        if(event.type == UART_MARK_BREAK) {
+            alog2(ALOG_ERROR, "Warning! break in packet #%.8" PRIu64 " at byte %" PRIu64 "\n", number, offset);
+        } else {
+            alog3(ALOG_ERROR, "Warning! parity/framing error in packet #%.8" PRIu64 " at byte %" PRIu64
+                  " [0x%.2" PRIx64 "]\n", number, offset, event.value);
+        }
+        marked++;
     }
 
-    /* Print UART icounters */
-    uart_print_icounter(uart);
+    return marked;
+}
 
-    /* Do work */
-    if(options.direction == DIRECTION_SEND)
-        send_packets(uart, &options);
-    else
-        read_packets(uart, &options);
+/* Verify one decoded packet completed at ts, returns packet number */
+static uint32_t check_packet(struct recv_stats_t *stats, struct options_t *options,
+                             const struct packet_decoder_event_t *frame, struct timespec ts) {
+    struct packet_t packet = frame->packet;
+    struct data_t data = { (uint8_t*)frame->frame, frame->size };
+    uint64_t lost = 0;
+    uint32_t marked = 0;
+    uint32_t crc = frame->crc;
+    int crc_ok = frame->crc_ok;
+
+    show_packet_info(&packet);
+    stats->packets_received++;
+
+    if(stats->mark != NULL) {
+        marked = check_marks(stats, frame);
+    }
 
-    /* Print UART icounters */
-    uart_print_icounter(uart);
+    if(options->verbose == 1) {
+        printf("Packet dump: %lu\n", data.size);
+        show_data_struct(&data);
+    }
 
-    /* Close devices */
-    uart_close(uart);
+    if(packet.crc_type != options->checksum && packet.crc_type != PACKET_CRC_TYPE_INVALID && !stats->checksum_warned) {
+        alog2(ALOG_WARN, "Warning! Sender uses checksum type %" PRIu64 ", expected %" PRIu64 "\n",
+              packet.crc_type, options->checksum);
+        stats->checksum_warned = 1;
+    }
 
-    return 0;
+    uint32_t highest = seq_tracker_highest(&stats->seq);
+    uint64_t missing = seq_tracker_missing(&stats->seq);
+
+    switch(seq_tracker_add(&stats->seq, packet.number, ts, (marked == 0 && crc_ok))) {
+        case SEQ_TRACKER_GAP:
+            alog2(ALOG_WARN, "Warning! Packet lost [%.8" PRIu64 " ... %.8" PRIu64 "]\n", highest, packet.number);
+            break;
+        case SEQ_TRACKER_JUMP:
+            alog2(ALOG_WARN, "Warning! Packet #%.8" PRIu64 " far ahead of #%.8" PRIu64 ", lost packets if next one follows\n",
+                  packet.number, highest);
+            break;
+        case SEQ_TRACKER_LATE:
+            alog2(ALOG_WARN, "Warning! Packet #%.8" PRIu64 " out of order after #%.8" PRIu64 "\n", packet.number, highest);
+            break;
+        case SEQ_TRACKER_DUPLICATE:
+            alog1(ALOG_WARN, "Warning! Duplicate packet #%.8" PRIu64 "\n", packet.number);
+            break;
+        case SEQ_TRACKER_STALE:
+            alog2(ALOG_WARN, "Warning! Packet #%.8" PRIu64 " too late after #%.8" PRIu64 "\n", packet.number, highest);
+            break;
+        case SEQ_TRACKER_RESTART:
+            alog1(ALOG_WARN, "Warning! Sender restarted after #%.8" PRIu64 "\n", highest);
+            break;
+    }
+
+    if(seq_tracker_missing(&stats->seq) > missing)
+        lost = seq_tracker_missing(&stats->seq) - missing;
+
+    if(stats->outage_open && marked == 0 && crc_ok) {
+        int32_t step = (int32_t)(packet.number - stats->outage_highest);
+        uint64_t outage_lost = (stats->outage_started && step > 1) ? (uint64_t)(step - 1) : 0;
+
+        alog3(ALOG_WARN, "Warning! Reconnected at packet #%.8" PRIu64 " after %" PRIu64 " ms, %" PRIu64 " packets lost\n",
+              packet.number, stats->outage_last_ms, outage_lost);
+        stats->outage_lost += outage_lost;
+        stats->outage_open = 0;
+    }
+
+    if(stats->soak != NULL) {
+        soak_add(stats->soak, data.size, (marked > 0 || !crc_ok), lost);
+    }
+
+    if(marked > 0) {
+        /* Receiver already knows the bytes are bad: neither CRC error nor good packet */
+        stats->packets_marked++;
+    } else if(!crc_ok) {
+        stats->crc_errors++;
+        alog3(ALOG_ERROR, "Warning! wrong crc [0x%.8" PRIx64 "] for packet: #%.8" PRIu64 " checksum[0x%.8" PRIx64 "]\n",
+              crc, packet.number, packet.crc32);
+    } else {
+        alog_every(ALOG_INFO, "CRC32 [0x%.8" PRIx64 "]: OK\n", packet.crc32, 0, 0, 0);
+    }
+
+    stats->counters.packets = stats->packets_received;
+    stats->counters.bytes += data.size;
+    stats->counters.crc_errors = stats->crc_errors;
+    stats->counters.lost = seq_tracker_missing(&stats->seq);
+    stats_shm_update(&stats->shm_writer, &stats->counters, &stats->timing.inter_arrival);
+
+    return packet.number;
+}
+
+/* Decoder callback: frame completed by bytes that arrived at stats->ts */
+static void packet_received(void *ctx, const struct packet_decoder_event_t *event) {
+    struct recv_stats_t *stats = (struct recv_stats_t*)ctx;
+
+    /* Header of a bad frame is not verified: 5-7 bit packing must not keep cutting at its size */
+    if(!event->crc_ok && stats->uart != NULL) {
+        uart_rx_lost(stats->uart);
+    }
+
+    uint32_t number = check_packet(stats, stats->options, event, stats->ts);
+    rx_timing_packet(&stats->timing, stats->ts, number);
+}
+
+/* Decode chunks read by I/O thread */
+static void read_packets_pipelined(struct uart_t *uart, struct options_t *options, struct recv_stats_t *stats) {
+    struct recv_pipeline_t pipeline;
+
+    if(recv_pipeline_start(&pipeline, uart, options->rx_queue, uart->bytes_limit) != 0) {
+        exit(1);
+    }
+
+    while(test_in_action != 0) {
+        if(stats->soak != NULL && soak_tick(stats->soak) != SOAK_RUNNING) {
+            break;
+        }
+
+        const struct recv_chunk_t *chunk = recv_pipeline_next(&pipeline);
+        if(chunk == NULL) {
+            if(recv_pipeline_done(&pipeline)) {
+                printf("Error: I/O thread stopped\n");
+                break;
+            }
+
+            recv_pipeline_wait(&pipeline);
+            continue;
+        }
+
+        rx_timing_chunk(&stats->timing, chunk->ts, chunk->size, packet_decoder_pending(&stats->decoder) != 0);
+
+        if(stats->queue_monitoring) {
+            (void)queue_monitor_sample(&stats->queue);
+        }
+
+        stats->ts = chunk->ts;
+        (void)packet_decoder_feed(&stats->decoder, chunk->data, chunk->size);
+
+        recv_pipeline_release(&pipeline);
+    }
+
+    recv_pipeline_stop(&pipeline);
+    recv_pipeline_print_stats(&pipeline);
+}
+
+/*
+ * Device is gone: wait for its node to come back and open it again,
+ * returns 0 - reopened, -1 - gave up or stopped. The partial packet
+ * read before is dropped and the stream restarts mid-packet, so the
+ * decoder hunts for the first packet that checks.
+ */
+static int reconnect_device(struct uart_t *uart, struct options_t *options, struct recv_stats_t *stats) {
+    struct timespec lost_ts, now;
+    int reopened = 0;
+
+    rx_timing_now(&lost_ts);
+
+    alog1(ALOG_ERROR, "Warning! Device lost after packet #%.8" PRIu64 ", waiting for it\n",
+          seq_tracker_highest(&stats->seq));
+
+    /* Closes the old fd first: a returning USB adapter gets the same name only when nothing holds it */
+    while(!(reopened = (uart_reopen(uart) == 0)) && test_in_action != 0) {
+        rx_timing_now(&now);
+        uint64_t waited_ms = timespec_to_ms(timespec_diff(lost_ts, now));
+        int slice_ms = 1000;
+
+        if(options->reconnect_s > 0) {
+            if(waited_ms >= options->reconnect_s * 1000ULL)
+                break;
+            if(options->reconnect_s * 1000ULL - waited_ms < (uint64_t)slice_ms)
+                slice_ms = options->reconnect_s * 1000ULL - waited_ms;
+        }
+
+        if(stats->soak != NULL && soak_tick(stats->soak) != SOAK_RUNNING)
+            break;
+
+        if(access(uart->dev, F_OK) == 0) {
+            /* Node is back but not ready yet: udev rules, or a stale node */
+            struct timespec retry = timespec_from_ms(UART_WATCH_RETRY_MSEC);
+            nanosleep(&retry, NULL);
+            continue;
+        }
+
+        (void)uart_watch_device(uart->dev, slice_ms);
+    }
+
+    if(!reopened) {
+        if(test_in_action != 0)
+            printf("Device %s did not come back\n", uart->dev);
+        return -1;
+    }
+
+    rx_timing_now(&now);
+    uint64_t outage_ms = timespec_to_ms(timespec_diff(lost_ts, now));
+
+    stats->outages++;
+    stats->outage_ms += outage_ms;
+    if(outage_ms > stats->outage_longest_ms)
+        stats->outage_longest_ms = outage_ms;
+
+    stats->outage_last_ms = outage_ms;
+    stats->outage_highest = seq_tracker_highest(&stats->seq);
+    stats->outage_started = (stats->packets_received > 0);
+    stats->outage_open = 1;
+
+    /* Stream offsets restart with the reopened device */
+    if(stats->mark != NULL) {
+        struct uart_mark_event_t event;
+        while(uart_mark_next(stats->mark, UINT64_MAX, &event))
+            ;
+    }
+    packet_decoder_restart(&stats->decoder);
+
+    alog1(ALOG_WARN, "Warning! Device back after %" PRIu64 " ms, resyncing\n", outage_ms);
+
+    return 0;
+}
+
+void read_packets(struct uart_t *uart, struct options_t *options) {
+    struct recv_stats_t stats;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    memset(&stats, 0x00, sizeof(stats));
+    seq_tracker_init(&stats.seq);
+    stats.mark = uart->mark;
+
+    struct soak_t soak;
+    if(options->soak) {
+        soak_init(&soak, options->soak_s, options->max_error_ppm, options->checkpoint);
+        stats.soak = &soak;
+    }
+
+    rx_timing_init(&stats.timing, uart_byte_time_ns(uart), options->stall_chars);
+    stats_shm_writer_init(&stats.shm_writer, stats_shm, uart, STATS_SHM_ROLE_RECV);
+
+    stats.queue_monitoring = (options->queue_target >= 0);
+    if(stats.queue_monitoring) {
+        queue_monitor_init(&stats.queue, uart, QUEUE_MONITOR_RX, 0);
+    }
+
+    /* All packets of the run are packet_length bytes */
+    uint8_t *frame_buf = (uint8_t*)malloc(options->packet_length);
+    if (frame_buf == NULL) {
+        printf("read_packets: malloc() failed\n");
+        exit(1);
+    }
+
+    if(packet_decoder_init(&stats.decoder, frame_buf, options->packet_length, options->packet_length,
+                           packet_received, &stats) != 0) {
+        exit(1);
+    }
+    stats.options = options;
+    stats.uart = (options->rx_queue == 0) ? uart : NULL;
+
+    assert(uart->fd > 0 || uart->transport == UART_TRANSPORT_SIM);
+
+    if(options->rx_queue > 0) {
+        read_packets_pipelined(uart, options, &stats);
+    }
+
+    /* Read chunk by chunk to timestamp every chunk */
+    while(test_in_action != 0 && options->rx_queue == 0 && !uart->peer_closed) {
+        if(options->soak) {
+            if(soak_tick(&soak) != SOAK_RUNNING)
+                break;
+
+            /* Windows keep rolling while the line is silent */
+            if(uart_poll(uart, 1000) <= 0)
+                continue;
+        }
+
+        size_t want;
+        uint8_t *space = packet_decoder_space(&stats.decoder, &want);
+
+        ssize_t bytes = uart_read_some(uart, space, want);
+
+        if(uart->device_lost) {
+            if(!options->reconnect) {
+                printf("Device %s lost\n", uart->dev);
+                break;
+            }
+
+            if(reconnect_device(uart, options, &stats) != 0)
+                break;
+
+            continue;
+        }
+
+        if(bytes < 0) {
+            if(errno == EINTR)
+                continue;
+            strerr("UART read() failed\n");
+            exit(1);
+        }
+
+        if(bytes == 0) {
+            /* No data yet */
+            continue;
+        }
+
+        rx_timing_now(&stats.ts);
+        rx_timing_chunk(&stats.timing, stats.ts, bytes, packet_decoder_pending(&stats.decoder) != 0);
+
+        if(stats.queue_monitoring) {
+            (void)queue_monitor_sample(&stats.queue);
+        }
+
+        (void)packet_decoder_commit(&stats.decoder, bytes);
+    }
+
+    free(frame_buf);
+
+    /* Numbers the window still waits for are lost now */
+    seq_tracker_finish(&stats.seq);
+    stats.counters.lost = seq_tracker_missing(&stats.seq);
+
+    stats_shm_publish(&stats.shm_writer, &stats.counters, &stats.timing.inter_arrival, 1);
+
+    alog_flush();
+
+    printf("Test completed:\n");
+    printf("\tPackets received: %" PRIu64 "\n", stats.packets_received);
+    printf("\tCRC errors:       %" PRIu64 "\n", stats.crc_errors);
+    printf("\tPackets lost:     %" PRIu64 "\n", seq_tracker_missing(&stats.seq));
+    if(stats.mark != NULL) {
+        printf("\tPackets marked:   %" PRIu64 "\n", stats.packets_marked);
+    }
+    printf("\tI/O syscalls:     %" PRIu64 "\n", uart->syscalls);
+    if(options->reconnect) {
+        printf("\tDevice outages:   %" PRIu64 ", %" PRIu64 " ms total, %" PRIu64 " ms longest, "
+               "%" PRIu64 " packets lost\n",
+               stats.outages, stats.outage_ms, stats.outage_longest_ms, stats.outage_lost);
+    }
+
+    if(options->soak) {
+        soak_finish(&soak);
+    }
+
+    seq_tracker_print_stats(&stats.seq);
+    packet_decoder_print_stats(&stats.decoder);
+    rx_timing_print_stats(&stats.timing);
+
+    if(stats.queue_monitoring) {
+        queue_monitor_print_stats(&stats.queue);
+    }
+}
+
+void send_channel_packets(struct uart_t *uart, struct options_t *options) {
+    struct channel_t *channels = options->channels;
+    int channels_num = options->channels_num;
+    struct timespec now, wait;
+    int done = 0;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    /*
+     * Bulk packets queued in the kernel delay a high priority one: on a
+     * line queue no more than a bulk packet. Sockets and pipes drain at
+     * memory speed, character times would only slow them down.
+     */
+    struct queue_monitor_t queue;
+    int line = (uart->transport == UART_TRANSPORT_TTY ||
+                (uart->transport == UART_TRANSPORT_SIM && !options->uart_options.sim.unlimited));
+    int pacing = (options->queue_target >= 0 || line);
+
+    if(pacing) {
+        uint32_t target = (options->queue_target >= 0) ? (uint32_t)options->queue_target :
+                          channel_bulk_length(channels, channels_num);
+
+        queue_monitor_init(&queue, uart, QUEUE_MONITOR_TX, target);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    channel_start(channels, channels_num, now);
+
+    while(test_in_action != 0) {
+        /* Schedule after the wait: a packet that got ready meanwhile goes at this frame boundary */
+        if(pacing) {
+            queue_monitor_wait(&queue);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        struct channel_t *channel = channel_schedule(channels, channels_num, now, &wait, &done);
+        if(channel == NULL) {
+            if(done)
+                break;
+
+            /* Nothing ready: idle until next periodic packet */
+            (void)uart_flush(uart);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wait, NULL);
+            continue;
+        }
+
+        /* Periodic packet is ready at its due time, bulk one when scheduled */
+        struct timespec ready_ts = (channel->period_ms != 0) ? channel->next_ts : now;
+
+        struct packet_t packet = channel_create_packet(channel, ready_ts);
+        struct data_t data = packet_to_data(packet);
+
+        size_t offset = 0;
+        while(offset < data.size) {
+            int bytes = uart_write(uart, (const void*)(data.ptr + offset), data.size - offset);
+            if (bytes == -1) {
+                strerr("UART write failed\n");
+                exit(1);
+            }
+            offset += bytes;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        channel_add_packet(channel, data.size, now);
+        channel_add_latency(channel, timespec_to_ns(now) - timespec_to_ns(ready_ts));
+
+        if(options->verbose == 1) {
+            show_packet_info(&packet);
+        }
+
+        free(packet.data);
+        free(data.ptr);
+    } /* while test_in_action */
+
+    (void)uart_flush(uart);
+
+    alog_flush();
+
+    printf("Transfer done:\n");
+    channel_print_stats(channels, channels_num, "ready to write() done");
+
+    if(pacing) {
+        queue_monitor_print_stats(&queue);
+    }
+}
+
+void read_channel_packets(struct uart_t *uart, struct options_t *options) {
+    struct channel_t *channels = options->channels;
+    int channels_num = options->channels_num;
+    struct timespec now;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    uint8_t *buffer = (uint8_t*)malloc(PACKET_HEADER_SIZE + CHANNEL_MAX_DATA_SIZE);
+    if (buffer == NULL) {
+        printf("read_channel_packets: malloc() failed\n");
+        exit(1);
+    }
+
+    while(test_in_action != 0 && !uart->peer_closed) {
+        /* Packets differ in size: read header first */
+        int bytes = uart_read(uart, buffer, PACKET_HEADER_SIZE);
+        if(bytes < 0) {
+            strerr("UART read() failed\n");
+            exit(1);
+        }
+
+        if(bytes == 0) {
+            /* No data yet */
+            continue;
+        }
+
+        if(bytes != PACKET_HEADER_SIZE) {
+            printf("Error: Bytes read: %i, header size: %i\n", bytes, (int)PACKET_HEADER_SIZE);
+            break;
+        }
+
+        size_t data_size = packet_data_size(buffer);
+        if(data_size > CHANNEL_MAX_DATA_SIZE) {
+            printf("Error: Wrong data size: %lu\n", data_size);
+            break;
+        }
+
+        bytes = uart_read(uart, buffer + PACKET_HEADER_SIZE, data_size);
+        if(bytes != data_size) {
+            printf("Error: Bytes read: %i, data size: %lu\n", bytes, data_size);
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        struct data_t data;
+        data.ptr  = buffer;
+        data.size = PACKET_HEADER_SIZE + data_size;
+
+        struct packet_t packet = packet_from_data(data);
+
+        if(options->verbose == 1) {
+            show_packet_info(&packet);
+        }
+
+        struct channel_t *channel = channel_find(channels, &channels_num, packet.channel);
+        if(channel == NULL) {
+            printf("Warning! Too many channels: packet from channel %u ignored\n", packet.channel);
+            free(packet.data);
+            continue;
+        }
+
+        if(channel->packet_length == 0) {
+            channel->packet_length = data.size;
+        }
+
+        if(channel->prev_number != 0 && packet.number - channel->prev_number != 1) {
+            alog3(ALOG_WARN, "Warning! Channel %" PRIu64 " packet lost [%.8" PRIu64 " ... %.8" PRIu64 "]\n",
+                  channel->id, channel->prev_number, packet.number);
+            if(packet.number > channel->prev_number)
+                channel->lost += packet.number - channel->prev_number - 1;
+        }
+        channel->prev_number = packet.number;
+
+        if(packet.crc32 != packet_checksum(&packet)) {
+            channel->crc_errors++;
+            alog2(ALOG_ERROR, "Warning! wrong crc for channel %" PRIu64 " packet: #%.8" PRIu64 "\n",
+                  channel->id, packet.number);
+        } else {
+            uint64_t stamp = channel_packet_stamp(&packet);
+            uint64_t now_ns = timespec_to_ns(now);
+
+            if(stamp != 0 && now_ns >= stamp) {
+                channel_add_latency(channel, now_ns - stamp);
+            }
+        }
+
+        channel_add_packet(channel, data.size, now);
+
+        free(packet.data);
+    } /* while test_in_action */
+
+    free(buffer);
+
+    alog_flush();
+
+    printf("Test completed:\n");
+    channel_print_stats(channels, channels_num, "one-way, valid if both ends share CLOCK_MONOTONIC");
+}
+
+/* Drop what is left of a damaged feedback: next byte after idle line starts a packet */
+static void skip_feedback(struct uart_t *uart) {
+    uint8_t buffer[PACKET_HEADER_SIZE + ADAPT_FEEDBACK_SIZE];
+
+    while(test_in_action != 0 && !uart->peer_closed && uart_poll(uart, ADAPT_RESYNC_IDLE_MS) > 0) {
+        if(uart_read_some(uart, buffer, sizeof(buffer)) <= 0)
+            break;
+    }
+}
+
+/* Read one feedback packet if receiver sent any, returns 1 - feedback read, 0 - none, -1 - damaged, dropped */
+static int read_feedback(struct uart_t *uart, struct adapt_feedback_t *feedback) {
+    uint8_t buffer[PACKET_HEADER_SIZE + ADAPT_FEEDBACK_SIZE];
+
+    if(uart->peer_closed || uart_poll(uart, 0) <= 0) {
+        return 0;
+    }
+
+    if(uart_read(uart, buffer, PACKET_HEADER_SIZE) != PACKET_HEADER_SIZE ||
+       packet_data_size(buffer) != ADAPT_FEEDBACK_SIZE ||
+       uart_read(uart, buffer + PACKET_HEADER_SIZE, ADAPT_FEEDBACK_SIZE) != ADAPT_FEEDBACK_SIZE) {
+        skip_feedback(uart);
+        return -1;
+    }
+
+    struct data_t data = { buffer, sizeof(buffer) };
+    struct packet_t packet = packet_from_data(data);
+
+    int ret = adapt_feedback_from_packet(&packet, feedback);
+    free(packet.data);
+
+    if(ret != 0) {
+        skip_feedback(uart);
+        return -1;
+    }
+
+    return 1;
+}
+
+void send_adaptive_packets(struct uart_t *uart, struct options_t *options) {
+    struct adapt_t *adapt = &options->adapt;
+    struct adapt_feedback_t feedback;
+    unsigned int packets_send = 0;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    struct timespec sleep_time = timespec_from_ms(options->send_delay_ms);
+
+    adapt_start(adapt, options->packet_length);
+
+    for(int i = 0; i < options->packets_num && test_in_action != 0; ++i) {
+        int ret;
+
+        while((ret = read_feedback(uart, &feedback)) != 0) {
+            uint32_t length = adapt->length;
+
+            /* Damaged on the way back: length stays until the next good one */
+            if(ret < 0) {
+                alog0(ALOG_WARN, "Warning! Bad feedback packet dropped\n");
+                adapt->bad_feedbacks++;
+                continue;
+            }
+
+            if(adapt_feedback(adapt, &feedback) != length) {
+                alog2(ALOG_INFO, "Packet length: %" PRIu64 " -> %" PRIu64 "\n", length, adapt->length);
+            }
+
+            /* Receiver drops data until line is idle: stop until TX queue is empty */
+            if(feedback.flags & ADAPT_FLAG_RESYNC) {
+                (void)uart_flush(uart);
+
+                int queued = uart_get_outq(uart);
+                uint64_t drain_ms = queued > 0 ? queued * uart_char_time_ns(uart) / 1000000 : 0;
+                struct timespec pause = timespec_from_ms(drain_ms + 2 * ADAPT_RESYNC_IDLE_MS);
+
+                nanosleep(&pause, NULL);
+            }
+        }
+
+        struct packet_t packet = create_packet(adapt->length);
+        struct data_t data = packet_to_data(packet);
+
+        show_packet_info(&packet);
+        free(packet.data);
+
+        (void)send_data(uart, options, NULL, data.ptr, data.size);
+        free(data.ptr);
+
+        packets_send++;
+
+        /* Queued writes (io_uring backend) must not wait while sleeping */
+        (void)uart_submit(uart);
+        nanosleep(&sleep_time, NULL);
+    }
+
+    (void)uart_flush(uart);
+
+    alog_flush();
+
+    printf("Transfer done:\n\tPackets send: %i\n", packets_send);
+    printf("\tI/O syscalls: %" PRIu64 "\n", uart->syscalls);
+
+    adapt_print_stats(adapt);
+}
+
+static void send_feedback(struct uart_t *uart, struct adapt_feedback_t *feedback, uint32_t number) {
+    struct packet_t packet = adapt_feedback_packet(feedback, number);
+    struct data_t data = packet_to_data(packet);
+
+    if(uart_write(uart, data.ptr, data.size) != data.size) {
+        errprintf("Feedback write failed\n");
+    }
+    (void)uart_flush(uart);
+
+    free(packet.data);
+    free(data.ptr);
+}
+
+void read_adaptive_packets(struct uart_t *uart, struct options_t *options) {
+    struct adapt_feedback_t window, total;
+    struct timespec window_ts, now;
+    uint32_t feedback_number = 1;
+    uint32_t prev_number = 0;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    uint32_t max_length = options->adapt.max_length;
+
+    uint8_t *buffer = (uint8_t*)malloc(max_length);
+    if (buffer == NULL) {
+        printf("read_adaptive_packets: malloc() failed\n");
+        exit(1);
+    }
+
+    memset(&window, 0x00, sizeof(window));
+    memset(&total, 0x00, sizeof(total));
+    clock_gettime(CLOCK_MONOTONIC, &window_ts);
+
+    while(test_in_action != 0 && !uart->peer_closed) {
+        int ret = uart_poll(uart, ADAPT_FEEDBACK_MS);
+        int framing_lost = 0;
+
+        if(ret > 0) {
+            size_t data_size = 0;
+
+            /* Interval starts with its first packet, not with idle line */
+            if(window.packets == 0 && window.lost == 0 && window.flags == 0) {
+                clock_gettime(CLOCK_MONOTONIC, &window_ts);
+            }
+
+            /* Packets differ in size: read header first */
+            if(uart_read(uart, buffer, PACKET_HEADER_SIZE) != PACKET_HEADER_SIZE) {
+                framing_lost = 1;
+            } else {
+                data_size = packet_data_size(buffer);
+                if(data_size > max_length - PACKET_HEADER_SIZE ||
+                   uart_read(uart, buffer + PACKET_HEADER_SIZE, data_size) != data_size) {
+                    framing_lost = 1;
+                }
+            }
+
+            if(!framing_lost) {
+                struct data_t data = { buffer, PACKET_HEADER_SIZE + data_size };
+                struct packet_t packet = packet_from_data(data);
+
+                show_packet_info(&packet);
+
+                if(prev_number != 0 && packet.number > prev_number + 1) {
+                    alog2(ALOG_WARN, "Warning! Packet lost [%.8" PRIu64 " ... %.8" PRIu64 "]\n", prev_number, packet.number);
+                    window.lost += packet.number - prev_number - 1;
+                }
+                prev_number = packet.number;
+
+                window.packets++;
+
+                if(packet.crc32 != packet_checksum(&packet)) {
+                    alog1(ALOG_ERROR, "Warning! wrong crc for packet: #%.8" PRIu64 "\n", packet.number);
+                    window.crc_errors++;
+                } else {
+                    window.good_bytes += packet.data_size;
+                }
+
+                free(packet.data);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t elapsed_ms = timespec_to_ms(timespec_diff(window_ts, now));
+
+        if(framing_lost) {
+            alog0(ALOG_WARN, "Warning! Packet framing lost - waiting for idle line\n");
+            window.flags |= ADAPT_FLAG_RESYNC;
+        }
+
+        /* Report to sender, nothing to report once sender is done */
+        if((elapsed_ms >= ADAPT_FEEDBACK_MS || framing_lost) &&
+           (window.packets != 0 || window.lost != 0 || window.flags != 0)) {
+            window.interval_ms = elapsed_ms ? elapsed_ms : 1;
+            send_feedback(uart, &window, feedback_number++);
+
+            total.good_bytes += window.good_bytes;
+            total.packets += window.packets;
+            total.crc_errors += window.crc_errors;
+            total.lost += window.lost;
+            total.flags += (window.flags & ADAPT_FLAG_RESYNC) ? 1 : 0;
+
+            memset(&window, 0x00, sizeof(window));
+            window_ts = now;
+        } else if(elapsed_ms >= ADAPT_FEEDBACK_MS) {
+            window_ts = now;
+        }
+
+        if(framing_lost) {
+            /* Sender pauses on resync feedback: next byte after idle line starts a packet */
+            while(test_in_action != 0 && uart_poll(uart, ADAPT_RESYNC_IDLE_MS) > 0) {
+                if(uart_read_some(uart, buffer, max_length) < 0)
+                    break;
+            }
+        }
+    }
+
+    free(buffer);
+
+    alog_flush();
+
+    printf("Test completed:\n");
+    printf("\tPackets received: %u\n", total.packets);
+    printf("\tCRC errors:       %u\n", total.crc_errors);
+    printf("\tPackets lost:     %u\n", total.lost);
+    printf("\tResyncs:          %u\n", total.flags);
+    printf("\tGood data:        %" PRIu64 " bytes\n", total.good_bytes);
+    printf("\tFeedbacks sent:   %u\n", feedback_number - 1);
+}
+
+static void send_file_record(struct uart_t *uart, struct options_t *options,
+                             struct file_transfer_t *transfer, uint32_t type) {
+    for(int i = 0; i < FILE_TRANSFER_RECORD_REPEAT; i++) {
+        struct file_transfer_record_t record = file_transfer_record(transfer, type);
+        uint8_t data[FILE_TRANSFER_RECORD_SIZE];
+        struct packet_t packet = file_transfer_record_packet(&record, data);
+
+        (void)send_packet_parts(uart, options, &packet);
+    }
+}
+
+void send_file(struct uart_t *uart, struct options_t *options) {
+    struct file_transfer_t transfer;
+    struct packet_t packet;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    if(file_transfer_open_input(&transfer, options->file, options->packet_length - PACKET_HEADER_SIZE) != 0) {
+        exit(1);
+    }
+
+    struct timespec sleep_time = timespec_from_ms(options->send_delay_ms);
+
+    send_file_record(uart, options, &transfer, FILE_TRANSFER_START);
+
+    /* Slices go out of the file mapping behind their header, no copy unless the link encodes writes */
+    while(test_in_action != 0 && file_transfer_next(&transfer, &packet)) {
+        (void)send_packet_parts(uart, options, &packet);
+
+        file_transfer_progress(&transfer);
+
+        if(options->send_delay_ms != 0) {
+            (void)uart_submit(uart);
+            nanosleep(&sleep_time, NULL);
+        }
+    }
+
+    if(test_in_action != 0) {
+        send_file_record(uart, options, &transfer, FILE_TRANSFER_END);
+    }
+
+    (void)uart_flush(uart);
+
+    alog_flush();
+
+    file_transfer_print_stats(&transfer, "Transfer done");
+    printf("\tFile CRC32:       0x%.8x\n", transfer.crc32);
+    printf("\tI/O syscalls:     %" PRIu64 "\n", uart->syscalls);
+
+    file_transfer_close(&transfer);
+}
+
+/* Returns 0 if the output file matches the END record of the sender */
+int read_file(struct uart_t *uart, struct options_t *options) {
+    struct file_transfer_t transfer;
+    struct file_transfer_record_t record;
+    uint64_t skipped = 0;
+    size_t have = 0;
+
+    assert(options != NULL);
+    assert(uart != NULL);
+
+    /* Grows to slice length once START tells it */
+    size_t capacity = PACKET_HEADER_SIZE + FILE_TRANSFER_RECORD_SIZE;
+    uint8_t *buffer = (uint8_t*)malloc(capacity);
+    if(buffer == NULL) {
+        printf("read_file: malloc() failed\n");
+        exit(1);
+    }
+
+    file_transfer_init_output(&transfer);
+
+    while(test_in_action != 0 && !uart->peer_closed && !transfer.ended) {
+        if(have >= PACKET_HEADER_SIZE) {
+            size_t size = file_transfer_packet_size(&transfer, buffer);
+
+            /* Line error broke framing: find next header of this transfer byte by byte */
+            if(size == 0) {
+                memmove(buffer, buffer + 1, --have);
+                skipped++;
+                continue;
+            }
+
+            if(have >= size) {
+                struct data_t data = { buffer, size };
+                struct packet_t packet = packet_view(data);
+
+                if(packet.channel == FILE_TRANSFER_CHANNEL) {
+                    if(file_transfer_record_from_packet(&packet, &record) != 0) {
+                        transfer.bad_packets++;
+                    } else if(record.type == FILE_TRANSFER_START && !transfer.started) {
+                        if(file_transfer_start_output(&transfer, options->output, &record) != 0) {
+                            exit(1);
+                        }
+
+                        uint8_t *grown = (uint8_t*)realloc(buffer, capacity + record.slice);
+                        if(grown == NULL) {
+                            printf("read_file: realloc() failed\n");
+                            exit(1);
+                        }
+                        buffer = grown;
+                        capacity += record.slice;
+                    } else if(record.type == FILE_TRANSFER_END) {
+                        transfer.crc32 = record.crc32;
+                        transfer.ended = 1;
+                    }
+                } else if(file_transfer_write(&transfer, &packet) != 0) {
+                    alog1(ALOG_ERROR, "Warning! wrong crc for slice: #%.8" PRIu64 "\n", packet.number);
+                }
+
+                have -= size;
+                memmove(buffer, buffer + size, have);
+
+                file_transfer_progress(&transfer);
+                continue;
+            }
+        }
+
+        ssize_t bytes = uart_read_some(uart, buffer + have, capacity - have);
+        if(bytes < 0) {
+            if(errno == EINTR)
+                continue;
+            strerr("UART read() failed\n");
+            exit(1);
+        }
+
+        have += bytes;
+    }
+
+    free(buffer);
+
+    alog_flush();
+
+    int ret = file_transfer_verify(&transfer);
+
+    file_transfer_print_stats(&transfer, "Test completed");
+    printf("\tBad packets:      %" PRIu64 "\n", transfer.bad_packets);
+    printf("\tDuplicates:       %" PRIu64 "\n", transfer.duplicates);
+    printf("\tMissing bytes:    %" PRIu64 "\n", transfer.size - transfer.file_bytes);
+    printf("\tSkipped bytes:    %" PRIu64 " (resync)\n", skipped);
+
+    if(!transfer.started) {
+        printf("\tFile CRC32:       no START record, nothing written\n");
+    } else if(!transfer.ended) {
+        printf("\tFile CRC32:       no END record, transfer incomplete\n");
+    } else {
+        printf("\tFile CRC32:       0x%.8x %s\n", transfer.crc32, ret == 0 ? "OK" : "FAIL");
+    }
+
+    file_transfer_close(&transfer);
+
+    return (ret == 0) ? 0 : 1;
+}
+
+/* One end of a scenario run, kept between steps */
+struct scenario_link_t {
+    struct uart_t *uart;
+    uint8_t *buffer;            /* received packet */
+    uint8_t *data;              /* data of sent packet */
+    uint8_t *wire;              /* serialized sent packet */
+    uint32_t max_length;
+    uint32_t control_number;
+    uint32_t retry_ms;          /* control resend interval at current line speed */
+    struct scenario_control_t last_result; /* resent when peer repeats DONE */
+    uint8_t  has_result;
+};
+
+static uint64_t scenario_elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_ms(timespec_diff(*start, now));
+}
+
+/* Control message must survive a slow line: resend interval covers two control packets */
+static uint32_t scenario_retry_ms(struct uart_t *uart) {
+    uint64_t packet_ns = (PACKET_HEADER_SIZE + SCENARIO_CONTROL_SIZE) * uart_byte_time_ns(uart);
+
+    return SCENARIO_RETRY_MS + 2 * packet_ns / 1000000;
+}
+
+static void scenario_send_control(struct scenario_link_t *link, const struct scenario_control_t *control) {
+    struct packet_t packet = scenario_control_packet(control, link->control_number++);
+    size_t size = packet_to_buffer(packet, link->wire, link->max_length);
+
+    free(packet.data);
+
+    if(uart_write(link->uart, link->wire, size) != size && test_in_action != 0) {
+        errprintf("Control write failed\n");
+    }
+    (void)uart_flush(link->uart);
+}
+
+/* Bytes of one packet follow each other, a gap of timeout_ms ends the read */
+static size_t scenario_read_bytes(struct uart_t *uart, uint8_t *buffer, size_t count, int timeout_ms) {
+    size_t bytes = 0;
+
+    while(bytes < count && !uart->peer_closed) {
+        if(uart_poll(uart, timeout_ms) <= 0)
+            break;
+
+        ssize_t ret = uart_read_some(uart, buffer + bytes, count - bytes);
+        if(ret < 0)
+            break;
+
+        bytes += ret;
+    }
+
+    return bytes;
+}
+
+/* Returns 1 - packet in link buffer, 0 - nothing within timeout_ms, -1 - garbage skipped */
+static int scenario_read_packet(struct scenario_link_t *link, int timeout_ms, struct packet_t *packet) {
+    struct uart_t *uart = link->uart;
+    size_t data_size = 0;
+
+    if(uart->peer_closed || uart_poll(uart, timeout_ms) <= 0) {
+        return 0;
+    }
+
+    if(scenario_read_bytes(uart, link->buffer, PACKET_HEADER_SIZE, link->retry_ms) == PACKET_HEADER_SIZE) {
+        data_size = packet_data_size(link->buffer);
+
+        if(data_size <= link->max_length - PACKET_HEADER_SIZE &&
+           scenario_read_bytes(uart, link->buffer + PACKET_HEADER_SIZE, data_size, link->retry_ms) == data_size) {
+            struct data_t data = { link->buffer, PACKET_HEADER_SIZE + data_size };
+
+            *packet = packet_view(data);
+            return 1;
+        }
+    }
+
+    /* Next byte after idle line starts a packet */
+    while(test_in_action != 0 && !uart->peer_closed && uart_poll(uart, SCENARIO_IDLE_MS) > 0) {
+        if(uart_read_some(uart, link->buffer, link->max_length) < 0)
+            break;
+    }
+
+    return -1;
+}
+
+/* Peer missed RESULT of the previous step and repeats DONE */
+static void scenario_answer_stale(struct scenario_link_t *link, const struct scenario_control_t *control) {
+    if(control->type == SCENARIO_DONE && link->has_result && control->step == link->last_result.step) {
+        scenario_send_control(link, &link->last_result);
+    }
+}
+
+/* Send request until peer answers with answer_type for the same step, returns 0 or -1 */
+static int scenario_request(struct scenario_link_t *link, const struct scenario_control_t *request,
+                            uint32_t answer_type, struct scenario_control_t *answer) {
+    struct packet_t packet;
+    struct timespec sent_ts;
+
+    for(int retry = 0; retry < SCENARIO_RETRIES && test_in_action != 0; retry++) {
+        scenario_send_control(link, request);
+        clock_gettime(CLOCK_MONOTONIC, &sent_ts);
+
+        uint64_t elapsed_ms;
+        while((elapsed_ms = scenario_elapsed_ms(&sent_ts)) < link->retry_ms && test_in_action != 0) {
+            if(scenario_read_packet(link, link->retry_ms - elapsed_ms, &packet) <= 0 ||
+               scenario_control_from_packet(&packet, answer) != 0) {
+                continue;
+            }
+
+            if(answer->type == answer_type && answer->step == request->step) {
+                return 0;
+            }
+
+            scenario_answer_stale(link, answer);
+        }
+
+        if(link->uart->peer_closed)
+            break;
+    }
+
+    return -1;
+}
+
+static void scenario_send_step(struct scenario_link_t *link, const struct scenario_step_t *step,
+                               uint32_t index, struct scenario_result_t *result) {
+    struct scenario_control_t control, answer;
+    struct timespec start_ts, sleep_time = timespec_from_ms(step->delay_ms);
+
+    memset(&control, 0x00, sizeof(control));
+    control.type = SCENARIO_READY;
+    control.step = index;
+
+    if(scenario_request(link, &control, SCENARIO_ACK, &answer) != 0) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+    while(test_in_action != 0) {
+        if(step->packets_num != 0 && result->sent >= step->packets_num)
+            break;
+        if(step->duration_ms != 0 && scenario_elapsed_ms(&start_ts) >= step->duration_ms)
+            break;
+
+        struct packet_t packet = packet_fill(link->data, step->packet_length);
+        size_t size = packet_to_buffer(packet, link->wire, link->max_length);
+
+        if(uart_write(link->uart, link->wire, size) != size) {
+            if(test_in_action != 0)
+                errprintf("Data write failed\n");
+            break;
+        }
+        result->sent++;
+
+        if(step->delay_ms != 0) {
+            (void)uart_submit(link->uart);
+            nanosleep(&sleep_time, NULL);
+        }
+    }
+
+    /* Data phase ends when the line is empty */
+    (void)uart_flush(link->uart);
+    (void)uart_wait_read(link->uart);
+
+    struct timespec end_ts;
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    result->elapsed_ns = timespec_to_ns(timespec_diff(start_ts, end_ts));
+
+    control.type = SCENARIO_DONE;
+    control.packets = result->sent;
+
+    if(scenario_request(link, &control, SCENARIO_RESULT, &answer) != 0) {
+        return;
+    }
+
+    result->completed = 1;
+    result->received = answer.packets;
+    result->crc_errors = answer.crc_errors;
+    result->framing = answer.framing;
+    result->bytes = answer.bytes;
+}
+
+static void scenario_recv_step(struct scenario_link_t *link, const struct scenario_step_t *step,
+                               uint32_t index, struct scenario_result_t *result) {
+    struct scenario_control_t control, answer;
+    struct packet_t packet;
+    struct timespec start_ts;
+    int ret, ready = 0;
+
+    memset(&answer, 0x00, sizeof(answer));
+    answer.step = index;
+
+    /* Sender may still reconfigure or finish the previous step */
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    while(!ready && test_in_action != 0 && !link->uart->peer_closed &&
+          scenario_elapsed_ms(&start_ts) < (SCENARIO_RETRIES + 5) * link->retry_ms) {
+        if(scenario_read_packet(link, link->retry_ms, &packet) <= 0 ||
+           scenario_control_from_packet(&packet, &control) != 0) {
+            continue;
+        }
+
+        if(control.type == SCENARIO_READY && control.step == index)
+            ready = 1;
+        else
+            scenario_answer_stale(link, &control);
+    }
+
+    if(!ready) {
+        return;
+    }
+
+    answer.type = SCENARIO_ACK;
+    scenario_send_control(link, &answer);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+    uint32_t idle = 0;
+    size_t data_size = step->packet_length - PACKET_HEADER_SIZE;
+
+    while(test_in_action != 0 && !link->uart->peer_closed && idle < SCENARIO_RETRIES) {
+        ret = scenario_read_packet(link, link->retry_ms + step->delay_ms, &packet);
+        if(ret == 0) {
+            idle++;
+            continue;
+        }
+        idle = 0;
+
+        if(ret < 0) {
+            result->framing++;
+            continue;
+        }
+
+        if(scenario_control_from_packet(&packet, &control) == 0) {
+            if(control.type == SCENARIO_READY && control.step == index) {
+                /* ACK lost */
+                scenario_send_control(link, &answer);
+            } else if(control.type == SCENARIO_DONE && control.step == index) {
+                result->completed = 1;
+                result->sent = control.packets;
+                break;
+            }
+            continue;
+        }
+
+        if(packet.data_size != data_size || packet.crc32 != packet_checksum(&packet)) {
+            result->crc_errors++;
+        } else {
+            result->received++;
+            result->bytes += packet.data_size;
+        }
+    }
+
+    struct timespec end_ts;
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    result->elapsed_ns = timespec_to_ns(timespec_diff(start_ts, end_ts));
+
+    if(!result->completed) {
+        return;
+    }
+
+    answer.type = SCENARIO_RESULT;
+    answer.packets = result->received;
+    answer.crc_errors = result->crc_errors;
+    answer.framing = result->framing;
+    answer.bytes = result->bytes;
+
+    link->last_result = answer;
+    link->has_result = 1;
+
+    scenario_send_control(link, &answer);
+}
+
+/* Before the line changes: answer DONE repeated by sender that missed RESULT */
+static void scenario_linger(struct scenario_link_t *link) {
+    struct scenario_control_t control;
+    struct packet_t packet;
+    struct timespec start_ts;
+    uint64_t elapsed_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+    while((elapsed_ms = scenario_elapsed_ms(&start_ts)) < link->retry_ms && test_in_action != 0) {
+        if(scenario_read_packet(link, link->retry_ms - elapsed_ms, &packet) <= 0 ||
+           scenario_control_from_packet(&packet, &control) != 0) {
+            continue;
+        }
+
+        if(control.type == SCENARIO_DONE && link->has_result && control.step == link->last_result.step) {
+            scenario_answer_stale(link, &control);
+            clock_gettime(CLOCK_MONOTONIC, &start_ts);
+        }
+    }
+}
+
+/* Steps of options->scenario on one open port, returns 0 - all steps passed */
+static int run_scenario(struct uart_t *uart, struct options_t *options) {
+    struct scenario_t scenario;
+    struct scenario_link_t link;
+    struct scenario_step_t defaults = {
+        .speed         = options->uart_options.speed,
+        .bits          = options->uart_options.bits,
+        .parity        = options->uart_options.parity,
+        .stop_bits     = options->uart_options.stop_bits,
+        .packet_length = options->packet_length,
+        .packets_num   = options->packets_num,
+        .delay_ms      = options->send_delay_ms,
+        .pattern       = PACKET_PATTERN_RANDOM,
+        .direction     = SCENARIO_FORWARD,
+    };
+
+    if(scenario_load(options->scenario, &defaults, &scenario) != 0) {
+        printf("Scenario load failed - exit\n");
+        exit(1);
+    }
+
+    memset(&link, 0x00, sizeof(link));
+    link.uart = uart;
+    link.control_number = 1;
+    link.retry_ms = scenario_retry_ms(uart);
+    link.max_length = PACKET_HEADER_SIZE + SCENARIO_CONTROL_SIZE;
+
+    for(uint32_t i = 0; i < scenario.steps_num; i++) {
+        if(scenario.steps[i].packet_length > link.max_length)
+            link.max_length = scenario.steps[i].packet_length;
+    }
+
+    link.buffer = (uint8_t*)malloc(link.max_length);
+    link.data = (uint8_t*)malloc(link.max_length);
+    link.wire = (uint8_t*)malloc(link.max_length);
+    if(link.buffer == NULL || link.data == NULL || link.wire == NULL) {
+        printf("run_scenario: malloc() failed\n");
+        exit(1);
+    }
+
+    struct scenario_step_t line = defaults;
+    uint8_t received_last = 0;
+
+    for(uint32_t i = 0; i < scenario.steps_num && test_in_action != 0; i++) {
+        const struct scenario_step_t *step = &scenario.steps[i];
+        struct scenario_result_t result;
+        struct timespec start_ts, end_ts;
+
+        memset(&result, 0x00, sizeof(result));
+        clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+        if(scenario_line_changed(&line, step)) {
+            if(received_last)
+                scenario_linger(&link);
+
+            /* Last characters leave the line at the old settings */
+            (void)uart_flush(uart);
+            (void)uart_wait_read(uart);
+
+            struct timespec pause = timespec_from_ms(2 * uart_char_time_ns(uart) / 1000000 + 1);
+            nanosleep(&pause, NULL);
+
+            if(uart_set_interface_attribs(uart, step->speed, step->bits, step->parity, step->stop_bits) != 0) {
+                errprintf("Step %u: line reconfiguration failed\n", i + 1);
+            }
+
+            line = *step;
+            link.retry_ms = scenario_retry_ms(uart);
+            scenario.reconfigs++;
+        }
+
+        uint8_t sending = (step->direction == SCENARIO_FORWARD) == (options->direction == DIRECTION_SEND);
+
+        if(sending) {
+            packet_set_pattern(step->pattern);
+            scenario_send_step(&link, step, i, &result);
+        } else {
+            scenario_recv_step(&link, step, i, &result);
+        }
+        received_last = !sending && result.completed;
+
+        clock_gettime(CLOCK_MONOTONIC, &end_ts);
+        uint64_t step_ns = timespec_to_ns(timespec_diff(start_ts, end_ts));
+
+        scenario.data_ns += result.elapsed_ns;
+        scenario.control_ns += step_ns > result.elapsed_ns ? step_ns - result.elapsed_ns : 0;
+
+        if(scenario_step_passed(&result))
+            scenario.passed++;
+        else
+            scenario.failed++;
+
+        scenario_print_result(&scenario, i, sending, &result);
+    }
+
+    if(received_last)
+        scenario_linger(&link);
+
+    scenario_print_summary(&scenario);
+
+    int ret = (scenario.failed != 0 || scenario.passed != scenario.steps_num) ? 1 : 0;
+
+    free(link.buffer);
+    free(link.data);
+    free(link.wire);
+    scenario_free(&scenario);
+
+    return ret;
+}
+
+/* Returns exit code of the test */
+static int run_test(struct uart_t *uart, struct options_t *options) {
+    if(options->scenario != NULL) {
+        return run_scenario(uart, options);
+    }
+
+    if(options->direction == DIRECTION_SEND && options->file != NULL) {
+        send_file(uart, options);
+        return 0;
+    }
+
+    if(options->direction == DIRECTION_RECV && options->output != NULL) {
+        return read_file(uart, options);
+    }
+
+    if(options->adaptive) {
+        if(options->direction == DIRECTION_SEND) {
+            send_adaptive_packets(uart, options);
+        } else {
+            read_adaptive_packets(uart, options);
+        }
+    } else if(options->channels_num > 0) {
+        if(options->direction == DIRECTION_SEND)
+            send_channel_packets(uart, options);
+        else
+            read_channel_packets(uart, options);
+    } else {
+        /* Every packet is packet_length bytes: a header telling another size is damaged */
+        uart_set_frame_fixed(uart, options->packet_length);
+
+        if(options->direction == DIRECTION_SEND)
+            send_packets(uart, options);
+        else
+            read_packets(uart, options);
+    }
+
+    return 0;
+}
+
+struct local_sender_t {
+    struct uart_t *uart;
+    struct options_t options;
+    int ret;
+};
+
+static void* local_sender_thread(void *arg) {
+    struct local_sender_t *sender = (struct local_sender_t*)arg;
+
+    sender->ret = run_test(sender->uart, &sender->options);
+
+    /* Receiver stops once it has read everything sent, EOF wakes blocked read() */
+    (void)uart_wait_read(sender->uart);
+    test_in_action = 0;
+    (void)uart_shutdown(sender->uart);
+
+    return NULL;
+}
+
+/* Sender in a thread on one end of in-process link, receiver on the other */
+static int run_in_process(struct options_t *options) {
+    struct local_sender_t sender;
+
+    sender.options = *options;
+    sender.options.direction = DIRECTION_SEND;
+    options->direction = DIRECTION_RECV;
+
+    struct uart_t *uart = uart_init(options->uart_options.device, options->uart_options);
+    sender.uart = uart_init(options->uart_options.device, options->uart_options);
+    if(uart == NULL || sender.uart == NULL) {
+        printf("UART init failed - exit\n");
+        exit(-1);
+    }
+
+    /* Packets are the frames of 5-7 bit packing */
+    uart_set_framing(uart, PACKET_FRAME_PREFIX, packet_frame_size);
+    uart_set_framing(sender.uart, PACKET_FRAME_PREFIX, packet_frame_size);
+
+    printf("Link '%s': sender thread and receiver in one process\n", uart->dev);
+
+    /* Signals go to receiver thread, sender follows test_in_action */
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, local_sender_thread, &sender) != 0) {
+        printf("Sender thread start failed - exit\n");
+        exit(1);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    int ret = run_test(uart, options);
+
+    /* Closed receiver end fails or discards writes, sender cannot block on full line */
+    uart_print_icounter(uart);
+    uart_close(uart);
+
+    pthread_join(thread, NULL);
+
+    uart_print_icounter(sender.uart);
+    uart_close(sender.uart);
+
+    return ret ? ret : sender.ret;
+}
+
+/* Relay between two ports until interrupted or a peer closes */
+static int run_bridge(struct options_t *options) {
+    struct uart_options_t line = options->uart_options;
+
+    if(options->bridge_line != NULL && uart_parse_line(options->bridge_line, &line) != 0) {
+        exit(1);
+    }
+
+    struct uart_t *a = uart_init(options->uart_options.device, options->uart_options);
+    struct uart_t *b = uart_init(options->bridge, line);
+    if(a == NULL || b == NULL) {
+        printf("UART init failed - exit\n");
+        exit(-1);
+    }
+
+    /* Large: two rings and latency histograms */
+    struct bridge_t *bridge = (struct bridge_t*)malloc(sizeof(struct bridge_t));
+    if(bridge == NULL) {
+        printf("run_bridge: malloc() failed\n");
+        exit(1);
+    }
+
+    if(bridge_init(bridge, a, b) != 0) {
+        exit(1);
+    }
+
+    bridge_run(bridge, &test_in_action);
+    bridge_print_stats(bridge);
+
+    uart_print_icounter(a);
+    uart_print_icounter(b);
+
+    uart_close(a);
+    uart_close(b);
+    free(bridge);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    options = parse_options(argc, argv);
+
+    packet_set_checksum(options.checksum);
+    packet_set_format(options.header_format);
+
+    if(!packet_length_valid(options.packet_length)) {
+        printf("Wrong packet length %u for %s header\n", options.packet_length,
+               packet_format_name(options.header_format));
+        exit(1);
+    }
+
+    printf("UART test started\n");
+
+    (void)print_options(&options);
+
+    register_signal_handler();
+
+    if(options.stats_shm != NULL) {
+        stats_shm = stats_shm_create(options.stats_shm);
+        if(stats_shm == NULL) {
+            printf("Stats segment create failed - exit\n");
+            exit(-1);
+        }
+    }
+
+    if(options.log_async) {
+        if(alog_start() != 0) {
+            printf("Async log start failed - exit\n");
+            exit(-1);
+        }
+    }
+
+    if(options.bridge != NULL) {
+        int ret = run_bridge(&options);
+
+        alog_stop();
+
+        return ret;
+    }
+
+    /* pipe, socketpair and simulated links: both ends in this process */
+    if(uart_transport_in_process(uart_transport_from_device(options.uart_options.device))) {
+        if((options.file == NULL) != (options.output == NULL)) {
+            printf("File transfer on in-process link needs both -f and -o\n");
+            exit(1);
+        }
+
+        int ret = run_in_process(&options);
+
+        alog_stop();
+        stats_shm_destroy(stats_shm);
+
+        return ret;
+    }
+
+    /* Initialization */
+    struct uart_t *uart = NULL;
+
+    uart = uart_init(options.uart_options.device, options.uart_options);
+    if(uart == NULL) {
+        printf("UART init failed - exit\n");
+        exit(-1);
+    }
+
+    /* Packets are the frames of 5-7 bit packing */
+    uart_set_framing(uart, PACKET_FRAME_PREFIX, packet_frame_size);
+
+    /* Print UART icounters */
+    uart_print_icounter(uart);
+
+    /* Do work */
+    int ret = run_test(uart, &options);
+
+    /* Print UART icounters */
+    uart_print_icounter(uart);
+
+    /* Close devices */
+    uart_close(uart);
+
+    alog_stop();
+    stats_shm_destroy(stats_shm);
+
+    return ret;
 }
 
 void register_signal_handler() {
@@ -371,6 +2496,7 @@ void register_signal_handler() {
 
     sigfillset(&sa.sa_mask);
     sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 }
 
 void signal_handler(int signal) {
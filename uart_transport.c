@@ -0,0 +1,323 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "uart.h"
+#include "uart_transport.h"
+#include "uart_sim.h"
+
+#define N_ "UART_TRANSPORT: "
+#define N_ERR "UART_TRANSPORT ERROR: "
+
+#ifdef UART_DEBUG
+#define dprintf(format, ...) \
+        printf(N_ format, ##__VA_ARGS__)
+#else
+#define dprintf
+#endif
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+/* First end of in-process pair waiting for the second open */
+struct transport_pair_t {
+    char name[64];
+    int  fd;
+    int  fd_tx;
+    struct transport_pair_t *next;
+};
+
+static struct transport_pair_t *transport_pairs = NULL;
+static pthread_mutex_t transport_pairs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* transport_prefixes[] = {
+    [UART_TRANSPORT_TTY]        = "",
+    [UART_TRANSPORT_PIPE]       = "pipe",
+    [UART_TRANSPORT_SOCKETPAIR] = "socketpair",
+    [UART_TRANSPORT_UNIX]       = "unix",
+    [UART_TRANSPORT_TCP]        = "tcp",
+    [UART_TRANSPORT_SIM]        = UART_SIM_DEVICE,
+};
+
+#define TRANSPORT_NUM (sizeof(transport_prefixes) / sizeof(transport_prefixes[0]))
+
+int uart_transport_from_device(const char *device) {
+    assert(device != NULL);
+
+    for(int transport = UART_TRANSPORT_PIPE; transport < TRANSPORT_NUM; transport++) {
+        size_t length = strlen(transport_prefixes[transport]);
+
+        if(strncmp(device, transport_prefixes[transport], length) == 0 &&
+           (device[length] == '\0' || device[length] == ':')) {
+            return transport;
+        }
+    }
+
+    return UART_TRANSPORT_TTY;
+}
+
+const char* uart_transport_name(int transport) {
+    if(transport == UART_TRANSPORT_TTY)
+        return "tty";
+
+    return (transport > 0 && transport < TRANSPORT_NUM) ? transport_prefixes[transport] : "unknown";
+}
+
+int uart_transport_in_process(int transport) {
+    return transport == UART_TRANSPORT_PIPE || transport == UART_TRANSPORT_SOCKETPAIR ||
+           transport == UART_TRANSPORT_SIM;
+}
+
+/* Second open of a name takes ends saved by the first one */
+static int transport_open_pair(struct uart_t *instance, const char *device, int transport) {
+    pthread_mutex_lock(&transport_pairs_lock);
+
+    struct transport_pair_t **next = &transport_pairs;
+    while(*next != NULL && strcmp((*next)->name, device) != 0) {
+        next = &(*next)->next;
+    }
+
+    if(*next != NULL) {
+        struct transport_pair_t *pair = *next;
+
+        instance->fd = pair->fd;
+        instance->fd_tx = pair->fd_tx;
+
+        *next = pair->next;
+        free(pair);
+
+        pthread_mutex_unlock(&transport_pairs_lock);
+        return 0;
+    }
+
+    struct transport_pair_t *pair = (struct transport_pair_t*)malloc(sizeof(struct transport_pair_t));
+    if(pair == NULL) {
+        pthread_mutex_unlock(&transport_pairs_lock);
+        errprintf("malloc() failed\n");
+        return -1;
+    }
+    memset(pair, 0x00, sizeof(struct transport_pair_t));
+    strncpy(pair->name, device, sizeof(pair->name) - 1);
+
+    if(transport == UART_TRANSPORT_PIPE) {
+        int forward[2], backward[2];
+
+        if(pipe(forward) != 0) {
+            strerr("pipe() failed");
+            goto error;
+        }
+        if(pipe(backward) != 0) {
+            strerr("pipe() failed");
+            close(forward[0]);
+            close(forward[1]);
+            goto error;
+        }
+
+        /* first end writes forward, reads backward */
+        instance->fd = backward[0];
+        instance->fd_tx = forward[1];
+        pair->fd = forward[0];
+        pair->fd_tx = backward[1];
+    } else {
+        int sv[2];
+
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            strerr("socketpair() failed");
+            goto error;
+        }
+
+        instance->fd = instance->fd_tx = sv[0];
+        pair->fd = pair->fd_tx = sv[1];
+    }
+
+    pair->next = transport_pairs;
+    transport_pairs = pair;
+
+    pthread_mutex_unlock(&transport_pairs_lock);
+    return 0;
+
+error:
+    pthread_mutex_unlock(&transport_pairs_lock);
+    free(pair);
+    return -1;
+}
+
+/* Connect, or become the listening end when nobody listens yet */
+static int transport_open_socket(struct uart_t *instance, const char *device, int transport) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len = 0;
+    const char *target = strchr(device, ':');
+
+    memset(&addr, 0x00, sizeof(addr));
+
+    if(target == NULL || target[1] == '\0') {
+        errprintf("Wrong device '%s': expected %s:<%s>\n", device, uart_transport_name(transport),
+                  transport == UART_TRANSPORT_UNIX ? "path" : "host>:<port");
+        return -1;
+    }
+    target++;
+
+    if(transport == UART_TRANSPORT_UNIX) {
+        struct sockaddr_un *un = (struct sockaddr_un*)&addr;
+
+        if(strlen(target) >= sizeof(un->sun_path)) {
+            errprintf("UNIX socket path too long: %s\n", target);
+            return -1;
+        }
+
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, target);
+        addr_len = sizeof(struct sockaddr_un);
+    } else {
+        char host[64];
+        const char *port = strrchr(target, ':');
+
+        if(port == NULL || port == target || port - target >= sizeof(host)) {
+            errprintf("Wrong device '%s': expected tcp:<host>:<port>\n", device);
+            return -1;
+        }
+
+        memcpy(host, target, port - target);
+        host[port - target] = '\0';
+
+        struct addrinfo hints, *result = NULL;
+        memset(&hints, 0x00, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        int ret = getaddrinfo(host, port + 1, &hints, &result);
+        if(ret != 0 || result == NULL) {
+            errprintf("Cannot resolve '%s': %s\n", target, gai_strerror(ret));
+            return -1;
+        }
+
+        memcpy(&addr, result->ai_addr, result->ai_addrlen);
+        addr_len = result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+
+    int domain = (transport == UART_TRANSPORT_UNIX) ? AF_UNIX : AF_INET;
+
+    for(int retry = 0; retry < UART_TRANSPORT_ACCEPT_RETRIES; retry++) {
+        int fd = socket(domain, SOCK_STREAM, 0);
+        if(fd < 0) {
+            strerr("socket() failed");
+            return -1;
+        }
+
+        if(connect(fd, (struct sockaddr*)&addr, addr_len) == 0) {
+            dprintf("Connected to %s\n", device);
+            instance->fd = instance->fd_tx = fd;
+            return 0;
+        }
+
+        if(errno != ECONNREFUSED && errno != ENOENT) {
+            strerr("connect(%s) failed", device);
+            close(fd);
+            return -1;
+        }
+
+        /* Nobody listens: stale socket file is left by a killed run */
+        if(transport == UART_TRANSPORT_UNIX && errno == ECONNREFUSED) {
+            (void)unlink(target);
+        } else {
+            int on = 1;
+            (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        }
+
+        if(bind(fd, (struct sockaddr*)&addr, addr_len) != 0) {
+            int err = errno;
+            close(fd);
+
+            /* Peer became the listening end at the same time */
+            if(err == EADDRINUSE) {
+                usleep(10000);
+                continue;
+            }
+
+            errno = err;
+            strerr("bind(%s) failed", device);
+            return -1;
+        }
+
+        if(listen(fd, 1) != 0) {
+            strerr("listen(%s) failed", device);
+            close(fd);
+            return -1;
+        }
+
+        printf("Waiting for peer on %s\n", device);
+
+        int conn = accept(fd, NULL, NULL);
+        close(fd);
+
+        if(transport == UART_TRANSPORT_UNIX) {
+            (void)unlink(target);
+        }
+
+        if(conn < 0) {
+            strerr("accept(%s) failed", device);
+            return -1;
+        }
+
+        instance->fd = instance->fd_tx = conn;
+        return 0;
+    }
+
+    errprintf("Cannot connect or listen on %s\n", device);
+    return -1;
+}
+
+int uart_transport_open(struct uart_t *instance, const char *device) {
+    assert(instance != NULL);
+    assert(device != NULL);
+
+    int transport = uart_transport_from_device(device);
+    int ret = -1;
+
+    switch(transport) {
+        case UART_TRANSPORT_PIPE:
+        case UART_TRANSPORT_SOCKETPAIR:
+            ret = transport_open_pair(instance, device, transport);
+            break;
+        case UART_TRANSPORT_UNIX:
+        case UART_TRANSPORT_TCP:
+            ret = transport_open_socket(instance, device, transport);
+            break;
+        default:
+            errprintf("Transport %s is not a pipe or socket\n", uart_transport_name(transport));
+            return -1;
+    }
+
+    if(ret != 0) {
+        return -1;
+    }
+
+    if(transport == UART_TRANSPORT_TCP) {
+        /* Serial line sends every byte as it comes */
+        int on = 1;
+        if(setsockopt(instance->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0) {
+            strerr("setsockopt(TCP_NODELAY) failed");
+        }
+    }
+
+    /* Closed peer must fail write() with EPIPE instead of killing the test */
+    signal(SIGPIPE, SIG_IGN);
+
+    instance->transport = transport;
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _UART_TRANSPORT_H_
+#define _UART_TRANSPORT_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+struct uart_t;
+
+#define UART_TRANSPORT_TTY        0 /* serial device, termios applies */
+#define UART_TRANSPORT_PIPE       1 /* "pipe[:name]", two pipes, both ends in this process */
+#define UART_TRANSPORT_SOCKETPAIR 2 /* "socketpair[:name]", both ends in this process */
+#define UART_TRANSPORT_UNIX       3 /* "unix:<path>", stream socket */
+#define UART_TRANSPORT_TCP        4 /* "tcp:<host>:<port>", TCP_NODELAY stream */
+#define UART_TRANSPORT_SIM        5 /* "sim[:name]", see uart_sim.h */
+
+#define UART_TRANSPORT_ACCEPT_RETRIES 50 /* connect retries when both ends start at once */
+
+/*
+ * Byte stream transports behind struct uart_t
+ *
+ * The transport is chosen by device name, everything not matching a
+ * prefix is a tty. Non-tty transports carry bytes only: termios,
+ * TIOCEXCL and TIOCGICOUNT are skipped, speed and frame format still
+ * set the nominal character time used by timing and pacing.
+ *
+ * Socket transports connect to a listening peer, or listen and accept
+ * one connection when nobody listens yet, so two uart_test processes
+ * find each other whatever the start order. pipe and socketpair pair
+ * the second open of the same name with the first one, like sim.
+ *
+ * Functions are called by uart.c only.
+ */
+int uart_transport_from_device(const char *device);
+const char* uart_transport_name(int transport);
+
+/* Both ends live in one process: test driver runs sender and receiver */
+int uart_transport_in_process(int transport);
+
+/* Open pipe and socket transports: sets fd and fd_tx, returns 0 or -1 */
+int uart_transport_open(struct uart_t *instance, const char *device);
+
+#endif /* _UART_TRANSPORT_H_ */
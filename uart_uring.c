@@ -0,0 +1,674 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uart.h"
+#include "uart_uring.h"
+
+#define N_ "UART_URING: "
+#define N_ERR "UART_URING ERROR: "
+
+#ifdef UART_DEBUG
+#define dprintf(format, ...) \
+        printf(N_ format, ##__VA_ARGS__)
+#else
+#define dprintf
+#endif
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+/* Linux 6.7+, may be missing in installed uapi headers */
+#define URING_OP_READ_MULTISHOT 49
+
+#define URING_ENTRIES      64
+
+#define URING_RX_BUFS      16 /* power of 2 */
+#define URING_RX_BUF_SIZE  4096
+#define URING_RX_BGID      0
+
+#define URING_TX_BUFS      16
+#define URING_TX_BUF_SIZE  4096
+#define URING_TX_BATCH     8 /* buffers queued behind a chain in flight that submit it */
+
+#define URING_FIXED_FD     0 /* index of device fd in registered files */
+
+#define URING_UD_READ      0x1000
+#define URING_UD_WRITE     0x2000 /* | tx slot */
+#define URING_UD_SLOT_MASK 0x0fff
+
+struct uring_t {
+    int fd;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned  sq_entries;
+    unsigned  sqe_tail; /* local tail, published on submit */
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void  *sq_ptr;
+    size_t sq_len;
+    void  *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+};
+
+struct rx_chunk_t {
+    uint16_t bid;
+    uint32_t len;
+    uint32_t offset;
+};
+
+struct uart_uring_t {
+    struct uring_t rx;
+    struct uring_t tx;
+
+    /* rx: provided buffer ring and completed chunks fifo */
+    struct io_uring_buf_ring *br;
+    size_t    br_len;
+    uint16_t  br_tail;
+    uint8_t  *rx_bufs;
+    uint8_t   rx_opcode;
+    int       rx_armed;
+    int       rx_error;
+    struct rx_chunk_t rx_done[URING_RX_BUFS];
+    unsigned  rx_done_head;
+    unsigned  rx_done_tail;
+
+    /* tx: registered buffers */
+    uint8_t  *tx_bufs;
+    uint32_t  tx_len[URING_TX_BUFS];
+    uint8_t   tx_busy[URING_TX_BUFS];
+    unsigned  tx_next;
+    unsigned  tx_queued;
+    unsigned  tx_inflight;
+    struct io_uring_sqe *tx_first; /* of queued chain, not submitted yet */
+    struct io_uring_sqe *tx_last;  /* its buffer takes small writes that follow */
+    int       tx_error;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int uring_setup(struct uring_t *ring, unsigned entries) {
+    struct io_uring_params p;
+
+    memset(ring, 0x00, sizeof(struct uring_t));
+    memset(&p, 0x00, sizeof(p));
+
+    ring->fd = sys_io_uring_setup(entries, &p);
+    if(ring->fd < 0) {
+        strerr("io_uring_setup() failed");
+        return -1;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_len > ring->sq_len)
+            ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ptr == MAP_FAILED) {
+        strerr("mmap(IORING_OFF_SQ_RING) failed");
+        close(ring->fd);
+        return -1;
+    }
+
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ptr == MAP_FAILED) {
+            strerr("mmap(IORING_OFF_CQ_RING) failed");
+            munmap(ring->sq_ptr, ring->sq_len);
+            close(ring->fd);
+            return -1;
+        }
+    }
+
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED) {
+        strerr("mmap(IORING_OFF_SQES) failed");
+        if(ring->cq_ptr != ring->sq_ptr)
+            munmap(ring->cq_ptr, ring->cq_len);
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_head    = (unsigned*)((uint8_t*)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail    = (unsigned*)((uint8_t*)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask    = (unsigned*)((uint8_t*)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array   = (unsigned*)((uint8_t*)ring->sq_ptr + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+    ring->sqe_tail   = *ring->sq_tail;
+
+    ring->cq_head = (unsigned*)((uint8_t*)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned*)((uint8_t*)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned*)((uint8_t*)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe*)((uint8_t*)ring->cq_ptr + p.cq_off.cqes);
+
+    return 0;
+}
+
+static void uring_free(struct uring_t *ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    if(ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+static struct io_uring_sqe* uring_get_sqe(struct uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if(ring->sqe_tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+
+    memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+
+    return sqe;
+}
+
+/* Publish prepared SQEs and optionally wait for min_complete CQEs */
+static int uring_submit(struct uart_t *instance, struct uring_t *ring, unsigned min_complete) {
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if(to_submit == 0 && min_complete == 0) {
+        return 0;
+    }
+
+    instance->syscalls++;
+
+    return sys_io_uring_enter(ring->fd, to_submit, min_complete,
+                              min_complete ? IORING_ENTER_GETEVENTS : 0);
+}
+
+static void uring_rx_return_buf(struct uart_uring_t *u, uint16_t bid) {
+    struct io_uring_buf *buf = &u->br->bufs[u->br_tail & (URING_RX_BUFS - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(u->rx_bufs + (size_t)bid * URING_RX_BUF_SIZE);
+    buf->len  = URING_RX_BUF_SIZE;
+    buf->bid  = bid;
+
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_rx_arm(struct uart_uring_t *u) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&u->rx);
+    if(sqe == NULL) {
+        return -1;
+    }
+
+    sqe->opcode    = u->rx_opcode;
+    sqe->fd        = URING_FIXED_FD;
+    sqe->flags     = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->off       = (uint64_t)-1;
+    sqe->len       = (u->rx_opcode == URING_OP_READ_MULTISHOT) ? 0 : URING_RX_BUF_SIZE;
+    sqe->buf_group = URING_RX_BGID;
+    sqe->user_data = URING_UD_READ;
+
+    u->rx_armed = 1;
+
+    return 0;
+}
+
+static void uring_rx_reap(struct uart_uring_t *u) {
+    unsigned head = *u->rx.cq_head;
+    unsigned tail = __atomic_load_n(u->rx.cq_tail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++) {
+        struct io_uring_cqe *cqe = &u->rx.cqes[head & *u->rx.cq_mask];
+
+        if(!(cqe->flags & IORING_CQE_F_MORE)) {
+            u->rx_armed = 0;
+        }
+
+        if(cqe->res > 0) {
+            struct rx_chunk_t *chunk = &u->rx_done[u->rx_done_tail++ & (URING_RX_BUFS - 1)];
+
+            chunk->bid    = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            chunk->len    = cqe->res;
+            chunk->offset = 0;
+        } else if(cqe->res == -EINVAL && u->rx_opcode == URING_OP_READ_MULTISHOT) {
+            /* Kernel without multishot read: re-arm single shot reads */
+            dprintf("multishot read not supported - use single shot reads\n");
+            u->rx_opcode = IORING_OP_READ;
+        } else if(cqe->res == -ENOBUFS) {
+            /* All buffers are waiting to be consumed: re-arm on next read */
+        } else if(cqe->res < 0) {
+            u->rx_error = -cqe->res;
+        }
+    }
+
+    __atomic_store_n(u->rx.cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void uring_tx_reap(struct uart_uring_t *u) {
+    unsigned head = *u->tx.cq_head;
+    unsigned tail = __atomic_load_n(u->tx.cq_tail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++) {
+        struct io_uring_cqe *cqe = &u->tx.cqes[head & *u->tx.cq_mask];
+        unsigned slot = cqe->user_data & URING_UD_SLOT_MASK;
+
+        assert(slot < URING_TX_BUFS);
+
+        if(cqe->res < 0) {
+            u->tx_error = -cqe->res;
+        } else if((uint32_t)cqe->res != u->tx_len[slot]) {
+            errprintf("partial write: %d of %u\n", cqe->res, u->tx_len[slot]);
+        }
+
+        u->tx_busy[slot] = 0;
+        u->tx_inflight--;
+    }
+
+    __atomic_store_n(u->tx.cq_head, head, __ATOMIC_RELEASE);
+}
+
+struct uart_uring_t* uart_uring_init(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    struct uart_uring_t *u = (struct uart_uring_t*)malloc(sizeof(struct uart_uring_t));
+    if(u == NULL) {
+        errprintf("malloc() failed\n");
+        return NULL;
+    }
+    memset(u, 0x00, sizeof(struct uart_uring_t));
+
+    if(uring_setup(&u->rx, URING_ENTRIES) != 0) {
+        free(u);
+        return NULL;
+    }
+
+    if(uring_setup(&u->tx, URING_ENTRIES) != 0) {
+        uring_free(&u->rx);
+        free(u);
+        return NULL;
+    }
+
+    /* Register device fd as fixed file on both rings */
+    int fds[1] = { instance->fd };
+
+    if(sys_io_uring_register(u->rx.fd, IORING_REGISTER_FILES, fds, 1) != 0 ||
+       sys_io_uring_register(u->tx.fd, IORING_REGISTER_FILES, fds, 1) != 0) {
+        strerr("io_uring_register(IORING_REGISTER_FILES) failed");
+        goto fail;
+    }
+
+    /* rx: provided buffer ring */
+    u->br_len = URING_RX_BUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->br_len, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(u->br == MAP_FAILED) {
+        strerr("mmap() buffer ring failed");
+        u->br = NULL;
+        goto fail;
+    }
+
+    u->rx_bufs = (uint8_t*)malloc(URING_RX_BUFS * URING_RX_BUF_SIZE);
+    u->tx_bufs = (uint8_t*)malloc(URING_TX_BUFS * URING_TX_BUF_SIZE);
+    if(u->rx_bufs == NULL || u->tx_bufs == NULL) {
+        errprintf("malloc() failed\n");
+        goto fail;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0x00, sizeof(reg));
+
+    reg.ring_addr    = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = URING_RX_BUFS;
+    reg.bgid         = URING_RX_BGID;
+
+    if(sys_io_uring_register(u->rx.fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        strerr("io_uring_register(IORING_REGISTER_PBUF_RING) failed");
+        goto fail;
+    }
+
+    for(uint16_t bid = 0; bid < URING_RX_BUFS; bid++) {
+        uring_rx_return_buf(u, bid);
+    }
+
+    u->rx_opcode = URING_OP_READ_MULTISHOT;
+
+    /* tx: registered buffers */
+    struct iovec iov[URING_TX_BUFS];
+
+    for(int i = 0; i < URING_TX_BUFS; i++) {
+        iov[i].iov_base = u->tx_bufs + (size_t)i * URING_TX_BUF_SIZE;
+        iov[i].iov_len  = URING_TX_BUF_SIZE;
+    }
+
+    if(sys_io_uring_register(u->tx.fd, IORING_REGISTER_BUFFERS, iov, URING_TX_BUFS) != 0) {
+        strerr("io_uring_register(IORING_REGISTER_BUFFERS) failed");
+        goto fail;
+    }
+
+    dprintf("io_uring backend enabled for %s\n", instance->dev);
+
+    return u;
+
+fail:
+    uring_free(&u->tx);
+    uring_free(&u->rx);
+    if(u->br != NULL)
+        munmap(u->br, u->br_len);
+    free(u->rx_bufs);
+    free(u->tx_bufs);
+    free(u);
+
+    return NULL;
+}
+
+void uart_uring_free(struct uart_t *instance) {
+    assert(instance != NULL);
+
+    struct uart_uring_t *u = instance->uring;
+    if(u == NULL)
+        return;
+
+    (void)uart_uring_drain(instance);
+
+    uring_free(&u->tx);
+    uring_free(&u->rx);
+    munmap(u->br, u->br_len);
+    free(u->rx_bufs);
+    free(u->tx_bufs);
+    free(u);
+
+    instance->uring = NULL;
+}
+
+/* Read up to count bytes, wait until at least min bytes are read */
+static ssize_t uring_read(struct uart_t *instance, void *buf, size_t count, size_t min) {
+    assert(instance != NULL);
+    assert(instance->uring != NULL);
+    assert(buf != NULL);
+
+    struct uart_uring_t *u = instance->uring;
+    size_t bytes_read = 0;
+
+    while(bytes_read < count) {
+        /* Consume completed chunks first */
+        if(u->rx_done_head != u->rx_done_tail) {
+            struct rx_chunk_t *chunk = &u->rx_done[u->rx_done_head & (URING_RX_BUFS - 1)];
+            size_t size = chunk->len - chunk->offset;
+
+            if(size > count - bytes_read)
+                size = count - bytes_read;
+
+            memcpy((uint8_t*)buf + bytes_read,
+                   u->rx_bufs + (size_t)chunk->bid * URING_RX_BUF_SIZE + chunk->offset, size);
+
+            bytes_read    += size;
+            chunk->offset += size;
+
+            if(chunk->offset == chunk->len) {
+                uring_rx_return_buf(u, chunk->bid);
+                u->rx_done_head++;
+            }
+            continue;
+        }
+
+        if(bytes_read >= min) {
+            break;
+        }
+
+        if(u->rx_error != 0) {
+            errno = u->rx_error;
+            u->rx_error = 0;
+            strerr("uart_read() : read() error");
+            return bytes_read;
+        }
+
+        if(!u->rx_armed && uring_rx_arm(u) != 0) {
+            errprintf("uart_read() : no free SQE\n");
+            return bytes_read;
+        }
+
+        /* Submit (re)armed read and wait for data */
+        if(uring_submit(instance, &u->rx, 1) < 0) {
+            strerr("uart_read() : io_uring_enter() error");
+            return bytes_read;
+        }
+
+        uring_rx_reap(u);
+    } /* while */
+
+    return bytes_read;
+}
+
+ssize_t uart_uring_read(struct uart_t *instance, void *buf, size_t count) {
+    return uring_read(instance, buf, count, count);
+}
+
+ssize_t uart_uring_read_some(struct uart_t *instance, void *buf, size_t count) {
+    return uring_read(instance, buf, count, 1);
+}
+
+int uart_uring_flush(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->uring != NULL);
+
+    struct uart_uring_t *u = instance->uring;
+
+    if(u->tx_queued == 0) {
+        return 0;
+    }
+
+    /* Queued writes are one linked chain, which starts after the chain in flight completes */
+    u->tx_last->flags &= ~IOSQE_IO_LINK;
+    if(u->tx_inflight > 0) {
+        u->tx_first->flags |= IOSQE_IO_DRAIN;
+    }
+
+    int ret = uring_submit(instance, &u->tx, 0);
+    if(ret < 0) {
+        strerr("write() : io_uring_enter() error");
+        return -1;
+    }
+
+    u->tx_inflight += u->tx_queued;
+    u->tx_queued = 0;
+
+    return 0;
+}
+
+int uart_uring_drain(struct uart_t *instance) {
+    assert(instance != NULL);
+    assert(instance->uring != NULL);
+
+    struct uart_uring_t *u = instance->uring;
+
+    if(uart_uring_flush(instance) != 0) {
+        return -1;
+    }
+
+    while(u->tx_inflight > 0) {
+        if(uring_submit(instance, &u->tx, 1) < 0) {
+            strerr("write() : io_uring_enter() error");
+            return -1;
+        }
+        uring_tx_reap(u);
+    }
+
+    return 0;
+}
+
+int uart_uring_write(struct uart_t *instance, const void *buf, size_t count) {
+    assert(instance != NULL);
+    assert(instance->uring != NULL);
+    assert(buf != NULL);
+
+    struct uart_uring_t *u = instance->uring;
+    size_t offset = 0;
+
+    uring_tx_reap(u);
+
+    while(offset < count) {
+        unsigned slot = u->tx_next;
+        size_t size = count - offset;
+
+        /* Small writes fill the buffer of the last queued one: one SQE for all of them */
+        if(u->tx_queued > 0 && u->tx_len[u->tx_last->buf_index] < URING_TX_BUF_SIZE) {
+            unsigned last = u->tx_last->buf_index;
+
+            if(size > URING_TX_BUF_SIZE - u->tx_len[last])
+                size = URING_TX_BUF_SIZE - u->tx_len[last];
+
+            memcpy(u->tx_bufs + (size_t)last * URING_TX_BUF_SIZE + u->tx_len[last],
+                   (const uint8_t*)buf + offset, size);
+            u->tx_len[last] += size;
+            u->tx_last->len = u->tx_len[last];
+
+            offset += size;
+            continue;
+        }
+
+        /* Wait for the oldest write to complete if all buffers are busy */
+        while(u->tx_busy[slot]) {
+            if(uart_uring_flush(instance) != 0) {
+                return -1;
+            }
+            if(uring_submit(instance, &u->tx, 1) < 0) {
+                strerr("write() : io_uring_enter() error");
+                return -1;
+            }
+            uring_tx_reap(u);
+        }
+
+        if(u->tx_error != 0) {
+            errno = u->tx_error;
+            u->tx_error = 0;
+            strerr("write() error");
+            return -1;
+        }
+
+        if(size > URING_TX_BUF_SIZE)
+            size = URING_TX_BUF_SIZE;
+
+        struct io_uring_sqe *sqe = uring_get_sqe(&u->tx);
+        if(sqe == NULL) {
+            errprintf("write() : no free SQE\n");
+            return -1;
+        }
+
+        uint8_t *ptr = u->tx_bufs + (size_t)slot * URING_TX_BUF_SIZE;
+        memcpy(ptr, (const uint8_t*)buf + offset, size);
+
+        /*
+         * Link keeps writes of the chain in order, async forces blocking
+         * write() semantics in io-wq so tty writes are never completed short
+         */
+        sqe->opcode    = IORING_OP_WRITE_FIXED;
+        sqe->fd        = URING_FIXED_FD;
+        sqe->flags     = IOSQE_FIXED_FILE | IOSQE_IO_LINK | IOSQE_ASYNC;
+        sqe->addr      = (uint64_t)(uintptr_t)ptr;
+        sqe->len       = size;
+        sqe->off       = (uint64_t)-1;
+        sqe->buf_index = slot;
+        sqe->user_data = URING_UD_WRITE | slot;
+
+        u->tx_len[slot]  = size;
+        u->tx_busy[slot] = 1;
+        u->tx_next = (slot + 1) % URING_TX_BUFS;
+        if(u->tx_queued++ == 0)
+            u->tx_first = sqe;
+        u->tx_last = sqe;
+
+        offset += size;
+    } /* while */
+
+    /* Submit now if the line would be idle, otherwise batch behind in-flight writes */
+    uring_tx_reap(u);
+    if(u->tx_inflight == 0 || u->tx_queued >= URING_TX_BATCH) {
+        if(uart_uring_flush(instance) != 0) {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+int uart_uring_poll(struct uart_t *instance, int timeout_msec) {
+    assert(instance != NULL);
+    assert(instance->uring != NULL);
+
+    struct uart_uring_t *u = instance->uring;
+
+    uring_rx_reap(u);
+
+    if(u->rx_done_head != u->rx_done_tail) {
+        return 1;
+    }
+
+    if(!u->rx_armed) {
+        if(uring_rx_arm(u) != 0 || uring_submit(instance, &u->rx, 0) < 0) {
+            strerr("uart_poll() : io_uring_enter() failed");
+            return -1;
+        }
+    }
+
+    /* io_uring fd is readable when completions are available */
+    struct pollfd fds;
+    memset(&fds, 0x00, sizeof(struct pollfd));
+
+    fds.fd = u->rx.fd;
+    fds.events = POLLIN;
+
+    instance->syscalls++;
+
+    int ret = poll(&fds, 1, timeout_msec);
+    if(ret == -1) {
+        strerr("uart_poll() : poll() failed");
+        return -1;
+    }
+
+    uring_rx_reap(u);
+
+    return (u->rx_done_head != u->rx_done_tail) ? 1 : 0;
+}
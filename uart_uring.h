@@ -0,0 +1,39 @@
+#ifndef _UART_URING_H_
+#define _UART_URING_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct uart_t;
+struct uart_uring_t;
+
+/*
+ * io_uring I/O backend for uart_read()/uart_write()
+ *
+ * Each UART gets two rings using the device fd as a fixed file:
+ * - rx ring: multishot read into a registered provided buffer ring,
+ *   so the kernel keeps filling buffers while data is consumed
+ * - tx ring: WRITE_FIXED from registered buffers; a write to an idle
+ *   line is submitted at once, writes that come while a chain is in
+ *   flight fill buffers and go as the next linked chain when it
+ *   completes, URING_TX_BATCH buffers are queued or uart_flush() is
+ *   called, so one io_uring_enter() carries many small writes
+ *
+ * Functions are called by uart.c only, use uart_set_backend() to enable
+ */
+struct uart_uring_t* uart_uring_init(struct uart_t *instance);
+void uart_uring_free(struct uart_t *instance);
+
+ssize_t uart_uring_read(struct uart_t *instance, void *buf, size_t count);
+ssize_t uart_uring_read_some(struct uart_t *instance, void *buf, size_t count);
+int uart_uring_write(struct uart_t *instance, const void *buf, size_t count);
+
+/* Submit queued writes without waiting for completion */
+int uart_uring_flush(struct uart_t *instance);
+/* Wait until all submitted writes are completed */
+int uart_uring_drain(struct uart_t *instance);
+
+int uart_uring_poll(struct uart_t *instance, int timeout_msec);
+
+#endif /* _UART_URING_H_ */
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <limits.h>
+#include <libgen.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/inotify.h>
+
+#include "uart_watch.h"
+#include "utils.h"
+
+#define N_ERR "UART_WATCH ERROR: "
+
+#define strerr(format, ...) \
+        printf(N_ERR format " %s : %i\n", ##__VA_ARGS__, strerror(errno), errno)
+
+/* Milliseconds left until deadline, -1 - no deadline */
+static int uart_watch_left(const struct timespec *start, int timeout_msec) {
+    struct timespec now;
+
+    if(timeout_msec < 0)
+        return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t spent = timespec_to_ms(timespec_diff(*start, now));
+    return (spent >= (uint64_t)timeout_msec) ? 0 : timeout_msec - (int)spent;
+}
+
+static int uart_watch_poll(const char *path, const struct timespec *start, int timeout_msec) {
+    while(access(path, F_OK) != 0) {
+        int left = uart_watch_left(start, timeout_msec);
+        if(left == 0)
+            return 0;
+
+        struct timespec retry = timespec_from_ms((left < 0 || left > UART_WATCH_RETRY_MSEC) ? UART_WATCH_RETRY_MSEC : left);
+        nanosleep(&retry, NULL);
+    }
+
+    return 1;
+}
+
+/* 1 - an event of name in buffer */
+static int uart_watch_match(const char *buf, ssize_t size, const char *name) {
+    const char *p = buf;
+
+    while(p < buf + size) {
+        const struct inotify_event *event = (const struct inotify_event*)p;
+
+        if(event->len > 0 && strcmp(event->name, name) == 0)
+            return 1;
+
+        p += sizeof(struct inotify_event) + event->len;
+    }
+
+    return 0;
+}
+
+int uart_watch_device(const char *path, int timeout_msec) {
+    assert(path != NULL);
+
+    char dir_path[PATH_MAX];
+    char name_path[PATH_MAX];
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    strncpy(dir_path, path, sizeof(dir_path) - 1);
+    dir_path[sizeof(dir_path) - 1] = '\0';
+    strncpy(name_path, path, sizeof(name_path) - 1);
+    name_path[sizeof(name_path) - 1] = '\0';
+
+    const char *dir = dirname(dir_path);
+    const char *name = basename(name_path);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd < 0) {
+        strerr("inotify_init1() failed - polling %s", path);
+        return uart_watch_poll(path, &start, timeout_msec);
+    }
+
+    if(inotify_add_watch(fd, dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB) < 0) {
+        strerr("inotify_add_watch(%s) failed - polling %s", dir, path);
+        close(fd);
+        return uart_watch_poll(path, &start, timeout_msec);
+    }
+
+    /* Node may be back before the watch was set */
+    int found = (access(path, F_OK) == 0);
+
+    while(!found) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        struct pollfd fds = { .fd = fd, .events = POLLIN };
+
+        int left = uart_watch_left(&start, timeout_msec);
+        if(left == 0)
+            break;
+
+        int ret = poll(&fds, 1, left);
+        if(ret < 0) {
+            /* Signal: caller decides whether to go on waiting */
+            if(errno != EINTR)
+                strerr("poll() failed");
+            found = -1;
+            break;
+        }
+
+        if(ret == 0)
+            break;
+
+        ssize_t size = read(fd, buf, sizeof(buf));
+        if(size > 0 && uart_watch_match(buf, size, name))
+            found = (access(path, F_OK) == 0);
+    }
+
+    close(fd);
+
+    return found;
+}
@@ -0,0 +1,23 @@
+#ifndef _UART_WATCH_H_
+#define _UART_WATCH_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define UART_WATCH_RETRY_MSEC 200 /* node is back but cannot be opened yet (udev, stale node) */
+
+/*
+ * Wait for a device node to appear
+ *
+ * USB serial adapters drop off the bus and come back under the same
+ * name. An inotify watch on the directory of the node wakes up on
+ * create, rename into place and attribute change of that name, so
+ * the node is noticed without polling; a symlink to a PTY works the
+ * same when the link is recreated. Without inotify it checks every
+ * UART_WATCH_RETRY_MSEC.
+ */
+
+/* Returns 1 - node exists, 0 - timeout (-1 - wait forever), -1 - error */
+int uart_watch_device(const char *path, int timeout_msec);
+
+#endif /* _UART_WATCH_H_ */
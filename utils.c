@@ -42,3 +42,11 @@ struct timespec timespec_from_ms(uint32_t ms) {
 
     return ts;
 }
+
+uint64_t timespec_to_ms(struct timespec ts) {
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000L;
+}
+
+uint64_t timespec_to_ns(struct timespec ts) {
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -9,5 +9,7 @@ void show_data(const uint8_t* data, size_t size);
 
 struct timespec timespec_diff(struct timespec start, struct timespec stop);
 struct timespec timespec_from_ms(uint32_t ms);
+uint64_t        timespec_to_ms(struct timespec ts);
+uint64_t        timespec_to_ns(struct timespec ts);
 
 #endif /* UTILS_H_ */
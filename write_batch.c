@@ -0,0 +1,137 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "write_batch.h"
+#include "utils.h"
+
+#define N_ERR "WRITE_BATCH ERROR: "
+
+#define errprintf(format, ...) \
+        printf(N_ERR format, ##__VA_ARGS__)
+
+int write_batch_init(struct write_batch_t *batch, struct uart_t *uart, size_t size, uint32_t timeout_ms) {
+    assert(batch != NULL);
+    assert(uart != NULL);
+    assert(size > 0);
+
+    memset(batch, 0x00, sizeof(struct write_batch_t));
+
+    batch->buf = (uint8_t*)malloc(size);
+    if (batch->buf == NULL) {
+        errprintf("malloc() failed\n");
+        return -1;
+    }
+
+    batch->uart = uart;
+    batch->size = size;
+    batch->timeout_ms = timeout_ms;
+
+    return 0;
+}
+
+void write_batch_free(struct write_batch_t *batch) {
+    assert(batch != NULL);
+
+    free(batch->buf);
+    batch->buf = NULL;
+}
+
+static int write_batch_write(struct write_batch_t *batch, const uint8_t *buf, size_t count) {
+    size_t offset = 0;
+
+    while(offset < count) {
+        int bytes = uart_write(batch->uart, buf + offset, count - offset);
+        if(bytes == -1) {
+            return -1;
+        }
+
+        batch->syscalls++;
+        offset += bytes;
+    }
+
+    return 0;
+}
+
+int write_batch_flush(struct write_batch_t *batch) {
+    assert(batch != NULL);
+
+    if(batch->used == 0) {
+        return 0;
+    }
+
+    if(write_batch_write(batch, batch->buf, batch->used) != 0) {
+        return -1;
+    }
+
+    batch->packets_written += batch->packets;
+    batch->bytes_written   += batch->used;
+
+    batch->used = 0;
+    batch->packets = 0;
+
+    return 0;
+}
+
+int write_batch_expired(struct write_batch_t *batch) {
+    assert(batch != NULL);
+
+    if(batch->used == 0) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return timespec_to_ms(timespec_diff(batch->first_ts, now)) >= batch->timeout_ms;
+}
+
+int write_batch_add(struct write_batch_t *batch, const void *buf, size_t count) {
+    assert(batch != NULL);
+    assert(buf != NULL);
+
+    /* Packet does not fit: flush buffered packets first */
+    if(batch->used + count > batch->size) {
+        if(write_batch_flush(batch) != 0) {
+            return -1;
+        }
+    }
+
+    /* Packet larger than the whole buffer: write it directly */
+    if(count > batch->size) {
+        if(write_batch_write(batch, (const uint8_t*)buf, count) != 0) {
+            return -1;
+        }
+
+        batch->packets_written++;
+        batch->bytes_written += count;
+
+        return 0;
+    }
+
+    if(batch->used == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &batch->first_ts);
+    }
+
+    memcpy(batch->buf + batch->used, buf, count);
+    batch->used += count;
+    batch->packets++;
+
+    if(batch->used == batch->size || write_batch_expired(batch)) {
+        return write_batch_flush(batch);
+    }
+
+    return 0;
+}
+
+void write_batch_print_stats(struct write_batch_t *batch) {
+    assert(batch != NULL);
+
+    printf("Write batching:\n");
+    printf("\tBatch size:       %lu bytes, timeout %u ms\n", batch->size, batch->timeout_ms);
+    printf("\twrite() calls:    %" PRIu64 "\n", batch->syscalls);
+    printf("\tPackets written:  %" PRIu64 "\n", batch->packets_written);
+    printf("\tPackets/syscall:  %.2f\n",
+           batch->syscalls ? (double)batch->packets_written / batch->syscalls : 0.0);
+}
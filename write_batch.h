@@ -0,0 +1,45 @@
+#ifndef _WRITE_BATCH_H_
+#define _WRITE_BATCH_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "uart.h"
+
+/*
+ * Write coalescing: serialized packets are gathered into one buffer
+ * and sent with a single write() when the byte threshold is reached,
+ * when the oldest buffered packet is older than timeout_ms
+ * or when write_batch_flush() is called explicitly
+ */
+struct write_batch_t {
+    struct uart_t *uart;
+
+    uint8_t *buf;
+    size_t   size;      /* byte threshold (buffer capacity) */
+    size_t   used;
+    uint32_t packets;   /* packets in buffer */
+
+    uint32_t timeout_ms;
+    struct timespec first_ts; /* time of first packet in buffer */
+
+    /* statistics */
+    uint64_t syscalls;
+    uint64_t packets_written;
+    uint64_t bytes_written;
+};
+
+int  write_batch_init(struct write_batch_t *batch, struct uart_t *uart, size_t size, uint32_t timeout_ms);
+void write_batch_free(struct write_batch_t *batch);
+
+/* Append data, flushing before (buffer full) or after (timeout) if needed */
+int write_batch_add(struct write_batch_t *batch, const void *buf, size_t count);
+int write_batch_flush(struct write_batch_t *batch);
+
+/* Check if the oldest buffered packet waits longer than timeout_ms */
+int write_batch_expired(struct write_batch_t *batch);
+
+void write_batch_print_stats(struct write_batch_t *batch);
+
+#endif /* _WRITE_BATCH_H_ */